@@ -11,9 +11,14 @@
 #include <iomanip>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "Eigen/Core"
 #include "common.h"
+#include "lqr_gain_schedule.h"
+#include "riccati_solver.h"
+#include "trajectory_matcher.h"
+#include "trajectory_snapshot.h"
 
 namespace shenlan {
 namespace control {
@@ -22,6 +27,21 @@ using Matrix = Eigen::MatrixXd;
 
 class LqrController {
  public:
+  // lateral error, lateral error rate, heading error, heading error rate
+  static constexpr int kStateSize = 4;
+  // front wheel steer angle
+  static constexpr int kControlSize = 1;
+
+  // fixed-size matrices of the lateral model: sized at compile time, no
+  // heap allocation and fully unrolled products in the control loop
+  typedef Eigen::Matrix<double, kStateSize, kStateSize> StateMatrix;
+  typedef Eigen::Matrix<double, kStateSize, kControlSize> ControlMatrix;
+  typedef Eigen::Matrix<double, kControlSize, kControlSize> ControlWeightMatrix;
+  typedef Eigen::Matrix<double, kControlSize, kStateSize> GainMatrix;
+  typedef Eigen::Matrix<double, kStateSize, 1> StateVector;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   LqrController();
   ~LqrController();
 
@@ -32,6 +52,78 @@ class LqrController {
       const VehicleState &localization,
       const TrajectoryData &planning_published_trajectory, ControlCmd &cmd);
 
+  /**
+   * @brief look K up in a velocity-scheduled gain table instead of solving
+   * the Riccati equation every cycle; call after Init
+   * @param v_step grid resolution [m/s]
+   * @param v_max upper end of the grid [m/s], the lower end is the minimum
+   * speed protection
+   * @param table_path table cache; loaded if it was built for the current
+   * model and weights, otherwise the table is solved and written there.
+   * Empty to always solve
+   * @return false if the table could not be built
+   */
+  bool EnableGainSchedule(const double v_step, const double v_max,
+                          const std::string &table_path);
+
+  /**
+   * @brief exact gain at speed v, as used to fill the gain table; solved
+   * to convergence with the doubling method whatever the online solver is
+   */
+  bool SolveGainAtSpeed(const double v, Matrix *K);
+
+  /**
+   * @brief interpolation error of the gain table against SolveGainAtSpeed
+   */
+  LqrGainSchedule::ErrorReport EvaluateGainSchedule(
+      const std::size_t samples_per_cell = 3);
+
+  const LqrGainSchedule &gain_schedule() const { return gain_schedule_; }
+  bool gain_schedule_loaded() const { return gain_schedule_loaded_; }
+
+  /**
+   * @brief pick the Riccati solver used every cycle
+   * @param method fixed-point iteration or structure-preserving doubling
+   * @param warm_start seed the fixed-point iteration with the previous
+   * cycle's P instead of Q
+   */
+  void SetRiccatiSolver(const RiccatiMethod method, const bool warm_start);
+
+  /**
+   * @brief preview (look-ahead) LQR: the error model is augmented with the
+   * desired heading rate v_ref * kappa of the reference at the next
+   * preview_steps cycles, held in a shift register, and their gain K_c is
+   * added to the feedback u = -K x - K_c c in place of the curvature
+   * feedforward. K_c comes from the 4x4 Riccati solution by a recursion
+   * over the shift register, O(preview_steps) 4x4 products, instead of an
+   * augmented (4 + preview_steps) Riccati solve. 0 turns it off; call after
+   * Init and before EnableGainSchedule, whose table then holds [K K_c].
+   * The reference is sampled from the snapshot's station line, so create
+   * the snapshots with build_station_line; without it the curvature
+   * feedforward is used
+   * @return false for a negative preview_steps
+   */
+  bool EnablePreview(const int preview_steps);
+
+  int preview_steps() const { return preview_steps_; }
+  // preview part K_c of the last cycle's gain
+  const Eigen::RowVectorXd &preview_gain() const { return matrix_k_preview_; }
+
+  // iterations, residual and time of the last cycle's Riccati solve
+  const RiccatiStats &riccati_stats() const { return riccati_stats_; }
+  // number of solves that did not converge
+  std::size_t riccati_failure_count() const { return riccati_failure_count_; }
+
+  // arc length of the last match point along the trajectory it was matched
+  // on, from its first point
+  double matched_s() const { return matched_s_; }
+  // the same measured on the route: plus the s_offset of the window it was
+  // matched on, which may be older than the latest published snapshot
+  double matched_route_s() const {
+    return trajectory_ != nullptr ? trajectory_->window().s_offset + matched_s_
+                                  : 0.0;
+  }
+
  protected:
   void UpdateState(const VehicleState &vehicle_state);
 
@@ -47,11 +139,39 @@ class LqrController {
 
   TrajectoryPoint QueryNearestPointByPosition(const double x, const double y);
 
-  void SolveLQRProblem(const Matrix &A, const Matrix &B, const Matrix &Q,
-                       const Matrix &R, const double tolerance,
-                       const uint max_num_iteration, Matrix *ptr_K);
+  void SolveLQRProblem(const StateMatrix &A, const ControlMatrix &B,
+                       const StateMatrix &Q, const ControlWeightMatrix &R,
+                       const double tolerance, const uint max_num_iteration,
+                       GainMatrix *ptr_K);
+
+  // parameters the lqr gain depends on, keys the gain table cache
+  std::vector<double> GainModelKey() const;
+
+  // discrete effect Dd of the desired heading rate on the error state at
+  // speed v: x_(k+1) = Ad x_k + Bd u_k + Dd c_k
+  StateVector PreviewDisturbance(const double v) const;
+
+  /**
+   * @brief preview gain of the shift register c_0 .. c_(N-1) (c_j moves to
+   * c_(j-1) each cycle) from the Riccati solution P and gain K of A, B:
+   * the off-diagonal block of the augmented solution is P_xc e_j =
+   * (A - B K)'^(j+1) P D, so K_c e_0 = G B' P D and K_c e_j = G B' P_xc
+   * e_(j-1), G = (R + B'PB)^-1
+   * @param preview_gain preview_steps_ values
+   */
+  void ComputePreviewGain(const StateMatrix &A, const ControlMatrix &B,
+                          const StateVector &D, const StateMatrix &P,
+                          const GainMatrix &K, double *preview_gain) const;
+
+  // desired heading rate at the points reached after j = 0 .. N-1 cycles
+  // at speed v from arc length s, into preview_heading_rate_
+  void SamplePreview(const double s, const double v);
+
+  // trajectory being tracked, shared with the publisher, never copied
+  TrajectorySnapshotPtr trajectory_;
 
-  std::vector<TrajectoryPoint> trajectory_points_;
+  // windowed match-point search, remembers the last matched index
+  TrajectoryMatcher trajectory_matcher_;
 
   // the following parameters are vehicle physics related.
   // control time interval
@@ -77,35 +197,60 @@ class LqrController {
 
   // number of states without previews, includes
   // lateral error, lateral error rate, heading error, heading error rate
-  const int basic_state_size_ = 4;
+  const int basic_state_size_ = kStateSize;
   // vehicle state matrix
-  Eigen::MatrixXd matrix_a_;
+  StateMatrix matrix_a_;
   // vehicle state matrix (discrete-time)
-  Eigen::MatrixXd matrix_ad_;
+  StateMatrix matrix_ad_;
   // control matrix
-  Eigen::MatrixXd matrix_b_;
+  ControlMatrix matrix_b_;
   // control matrix (discrete-time)
-  Eigen::MatrixXd matrix_bd_;
+  ControlMatrix matrix_bd_;
   // gain matrix
-  Eigen::MatrixXd matrix_k_;
+  GainMatrix matrix_k_;
   // control authority weighting matrix
-  Eigen::MatrixXd matrix_r_;
+  ControlWeightMatrix matrix_r_;
   // state weighting matrix
-  Eigen::MatrixXd matrix_q_;
+  StateMatrix matrix_q_;
   // updated state weighting matrix
-  Eigen::MatrixXd matrix_q_updated_;
+  StateMatrix matrix_q_updated_;
   // vehicle state matrix coefficients
-  Eigen::MatrixXd matrix_a_coeff_;
+  StateMatrix matrix_a_coeff_;
   // 4 by 1 matrix; state matrix
-  Eigen::MatrixXd matrix_state_;
+  StateVector matrix_state_;
 
   // parameters for lqr solver; number of iterations
   int lqr_max_iteration_ = 0;
   // parameters for lqr solver; threshold for computation
   double lqr_eps_ = 0.0;
+  // parameters for lqr solver; solver backend
+  RiccatiMethod lqr_solver_ = RiccatiMethod::kFixedPoint;
+  // parameters for lqr solver; start from the previous P
+  bool lqr_warm_start_ = false;
+  // Riccati solution of the previous cycle, warm start value
+  StateMatrix matrix_p_;
+  // set once Init has filled the model matrices
+  bool model_initialized_ = false;
+  RiccatiStats riccati_stats_;
+  std::size_t riccati_failure_count_ = 0;
+
+  // gain scheduling: interpolate K over speed instead of solving every cycle
+  bool enable_gain_schedule_ = false;
+  LqrGainSchedule gain_schedule_;
+  // true if the table came from the cache file
+  bool gain_schedule_loaded_ = false;
 
   // Look-ahead controller
   bool enable_look_ahead_back_control_ = false;
+  // preview length [cycles] and the preview part of the gain
+  int preview_steps_ = 0;
+  Eigen::RowVectorXd matrix_k_preview_;
+  // desired heading rate at the preview points, c_0 .. c_(N-1)
+  Eigen::VectorXd preview_heading_rate_;
+  // [K K_c] looked up in the gain table
+  std::vector<double> preview_gain_lookup_;
+  // arc length of the last match point
+  double matched_s_ = 0.0;
 
   // for compute the differential valute to estimate acceleration/lon_jerk
   double previous_lateral_acceleration_ = 0.0;
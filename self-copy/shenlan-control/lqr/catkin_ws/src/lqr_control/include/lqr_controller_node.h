@@ -9,10 +9,18 @@
 #ifndef __LQR_CONTROLLER_NODE_H__
 #define __LQR_CONTROLLER_NODE_H__
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <thread>
 
+#include "compiled_roadmap.h"
 #include "lqr_controller.h"
 #include "pid_controller.h"
+#include "streaming_reference_line.h"
 #include "ros_viz_tools/ros_viz_tools.h"
 using namespace shenlan::control;
 using namespace ros_viz_tools;
@@ -32,6 +40,22 @@ class LQRControllerNode {
   void visTimerLoop(const ros::TimerEvent &);
   //加载路网地图，并设置轨迹的速度信息
   bool loadRoadmap(const std::string &roadmap_path, const double target_speed);
+  //加载roadmap_compiler生成的二进制路网, 无需解析文本与重算路径曲线
+  bool loadCompiledRoadmap(const std::string &roadmap_path,
+                           const double target_speed);
+  //流式模式: 打开路网文件, 读入第一个窗口
+  bool openRoadmapStream(const std::string &roadmap_path,
+                         const double target_speed);
+  //流式模式: 前方剩余不到一半时把车辆在路线上的弧长交给读取线程
+  void requestRoadmapWindow();
+  //流式模式的读取线程: 等待控制线程的请求并更新窗口
+  void roadmapStreamLoop();
+  //流式模式: 随车辆前进丢弃后方的点、读入前方的点, 窗口变化时重新发布
+  void updateRoadmapWindow(const double s_vehicle);
+  //从路网文件(文本或编译好的)读一个点, 文件结束时返回false
+  bool readRoadmapPoint(double *x, double *y);
+  //将当前窗口作为轨迹快照发布
+  void publishRoadmapWindow();
   //将路网转换成可视化的marker数据
   void addRoadmapMarker(const std::vector<TrajectoryPoint> &path,
                         const std::string &frame_id);
@@ -57,6 +81,7 @@ class LQRControllerNode {
   ros::Subscriber VehiclePoseSub_;                 //订阅车辆的定位信息
   ros::Publisher controlPub_;                      //发布控制指令
   std::shared_ptr<RosVizTools> roadmapMarkerPtr_;  //发布可视化路网
+  std::mutex roadmapMarkerMutex_;  //读取线程更新marker时, 可视化线程跳过发布
   VehicleState vehicleState_;
 
   double targetSpeed_ = 5;
@@ -64,9 +89,36 @@ class LQRControllerNode {
   std::shared_ptr<LqrController> lqrController_;
   double controlFrequency_ = 100;               //控制频率
   TrajectoryData planningPublishedTrajectory_;  //跟踪的轨迹
+  TrajectoryChannel trajectoryChannel_;  //轨迹快照的发布通道, 发布时只交换指针
   TrajectoryPoint goalPoint_;                   //终点
+  bool goalKnown_ = false;  //终点已确定(流式模式下读到文件末尾后)
   double goalTolerance_ = 0.5;                  //到终点的容忍距离
   bool isReachGoal_ = false;
   bool firstRecord_ = true;
+  bool roadmapStationLine_ = false;  //快照是否构建等弧长参考线(预瞄时需要)
+  double maxRiccatiTimeUs_ = 0.0;  // Riccati求解的最坏耗时
+
+  //流式读取路网: 只保留车辆附近的一段, 内存与路线长度无关.
+  //读文件、重建快照和marker都在读取线程中进行, 不占用控制周期
+  bool roadmapStreaming_ = false;
+  std::thread roadmapThread_;
+  std::mutex roadmapMutex_;  //保护下面两个请求字段
+  std::condition_variable roadmapWake_;
+  bool roadmapRunning_ = false;
+  bool roadmapRequested_ = false;
+  double roadmapVehicleS_ = 0.0;  //请求时车辆在路线上的弧长
+  //含路线终点的窗口的快照版本, 0表示尚未读到文件末尾
+  std::atomic<std::uint64_t> roadmapLastVersion_{0};
+  std::ifstream roadmapFile_;
+  CompiledRoadmap roadmapCompiled_;  //编译好的路网, 按需映射读入
+  std::size_t roadmapCursor_ = 0;    //下一个要读的点
+  bool roadmapEnd_ = false;  //已读到文件末尾, 只由读取线程访问
+  std::unique_ptr<StreamingReferenceLine> streamingLine_;
+  std::uint64_t routeId_ = 0;
+  double roadmapSpeed_ = 0.0;           //窗口中轨迹点的速度
+  double roadmapWindowBehind_ = 30.0;   //车辆后方保留的路线长度[m]
+  double roadmapWindowAhead_ = 300.0;   //车辆前方读入的路线长度[m]
+  int roadmapWindowPoints_ = 4096;      //窗口最多容纳的点数
+  std::string frameId_;
 };
 #endif /* __LQR_CONTROLLER_NODE_H__ */
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Eigen/Core"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Table of LQR feedback gains over a uniform velocity grid.
+ *
+ * The lateral model only depends on speed, so the discrete Riccati equation
+ * can be solved once per grid speed at startup (or offline) and K looked up
+ * at runtime by linear interpolation between the two neighbouring grid
+ * points, in constant time and without allocation. Speeds outside the grid
+ * are clamped to its ends.
+ */
+class LqrGainSchedule {
+ public:
+  struct Config {
+    // grid range and spacing [m/s]
+    double v_min = 0.1;
+    double v_max = 30.0;
+    double v_step = 0.25;
+  };
+
+  // interpolation error against the exact solve, sampled between grid points
+  struct ErrorReport {
+    std::size_t num_samples = 0;
+    // max |K_table - K_exact| over all gain entries
+    double max_abs_error = 0.0;
+    // max ||K_table - K_exact|| / ||K_exact||
+    double max_rel_error = 0.0;
+    double mean_rel_error = 0.0;
+    // speed at which max_rel_error occurs
+    double worst_v = 0.0;
+  };
+
+  // exact gain at speed v, false if the solve failed
+  typedef std::function<bool(const double v, Eigen::MatrixXd *K)> GainSolver;
+
+  /**
+   * @brief solve the gain at every grid speed
+   * @param config grid range and resolution
+   * @param solver exact gain solve for one speed
+   * @param model_key parameters the gains depend on (vehicle model, weights,
+   * sample time); stored with the table so a stale file is rejected by Load
+   * @return false on an invalid grid or a failed solve
+   */
+  bool Build(const Config &config, const GainSolver &solver,
+             const std::vector<double> &model_key);
+
+  /**
+   * @brief interpolate the gain at speed v
+   * @param K resized to the gain shape on first use, filled in place
+   * @return false if the table is empty
+   */
+  bool Lookup(const double v, Eigen::MatrixXd *K) const;
+
+  /**
+   * @brief interpolate the gain at speed v into caller storage, e.g. the
+   * data of a fixed-size gain matrix
+   * @param K rows() * cols() values, written column-major
+   * @return false if the table is empty
+   */
+  bool Lookup(const double v, double *K) const;
+
+  /**
+   * @brief compare interpolated gains against the exact solve
+   * @param solver exact gain solve for one speed
+   * @param samples_per_cell speeds sampled strictly inside each grid cell
+   */
+  ErrorReport Evaluate(const GainSolver &solver,
+                       const std::size_t samples_per_cell = 3) const;
+
+  /**
+   * @brief write the table to a binary file
+   */
+  bool Save(const std::string &path) const;
+
+  /**
+   * @brief read a table written by Save
+   * @param model_key must equal the key the table was built with
+   * @return false if the file is missing, malformed or was built for a
+   * different model; the table is left unchanged then
+   */
+  bool Load(const std::string &path, const std::vector<double> &model_key);
+
+  bool empty() const { return gains_.empty(); }
+  std::size_t num_points() const { return num_points_; }
+  const Config &config() const { return config_; }
+  // shape of each gain
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  // time spent in Build, 0 after Load [ms]
+  double build_time_ms() const { return build_time_ms_; }
+
+ private:
+  Config config_;
+  std::vector<double> model_key_;
+  std::size_t num_points_ = 0;
+  int rows_ = 0;
+  int cols_ = 0;
+  double inv_step_ = 0.0;
+  // gain of grid point i stored column-major at [i * rows * cols, ...)
+  std::vector<double> gains_;
+  double build_time_ms_ = 0.0;
+};
+
+}  // namespace control
+}  // namespace shenlan
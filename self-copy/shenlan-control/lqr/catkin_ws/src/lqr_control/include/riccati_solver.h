@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Eigen/Core"
+
+namespace shenlan {
+namespace control {
+
+enum class RiccatiMethod {
+  // P <- Q + A'PA - A'PB(R + B'PB)^-1 B'PA until the update is small,
+  // linear convergence, can be warm started
+  kFixedPoint = 0,
+  // structure-preserving doubling, quadratic convergence, always starts
+  // from Q
+  kDoubling = 1,
+};
+
+struct RiccatiOptions {
+  RiccatiMethod method = RiccatiMethod::kFixedPoint;
+  // stop once the max abs change of P between two iterations is below this
+  double tolerance = 0.01;
+  int max_iterations = 1500;
+};
+
+struct RiccatiStats {
+  int iterations = 0;
+  // max abs entry of the DARE residual at the returned P
+  double residual = 0.0;
+  double solve_time_us = 0.0;
+  bool converged = false;
+  bool warm_started = false;
+};
+
+/**
+ * @brief solve the discrete algebraic Riccati equation
+ *   P = Q + A'PA - A'PB(R + B'PB)^-1 B'PA
+ * and the gain K = (R + B'PB)^-1 B'PA
+ *
+ * N states and M controls are template parameters so the controllers' small
+ * problems run on fixed-size Eigen matrices, unrolled and without heap
+ * allocation. Instantiated for the lateral model (4 states, 1 control) and
+ * for Eigen::Dynamic, the runtime-sized variant used with MatrixXd.
+ * @param P_init start value for the fixed-point iteration, null or empty to
+ * start from Q; ignored by the doubling method
+ * @param P solution, the last iterate if not converged
+ * @param K gain computed from P
+ * @param stats iterations, residual, time and convergence, may be null
+ * @return true if converged within max_iterations
+ */
+template <int N, int M>
+bool SolveDiscreteRiccati(const Eigen::Matrix<double, N, N> &A,
+                          const Eigen::Matrix<double, N, M> &B,
+                          const Eigen::Matrix<double, N, N> &Q,
+                          const Eigen::Matrix<double, M, M> &R,
+                          const RiccatiOptions &options,
+                          const Eigen::Matrix<double, N, N> *P_init,
+                          Eigen::Matrix<double, N, N> *P,
+                          Eigen::Matrix<double, M, N> *K,
+                          RiccatiStats *stats = nullptr);
+
+extern template bool SolveDiscreteRiccati<4, 1>(
+    const Eigen::Matrix<double, 4, 4> &, const Eigen::Matrix<double, 4, 1> &,
+    const Eigen::Matrix<double, 4, 4> &, const Eigen::Matrix<double, 1, 1> &,
+    const RiccatiOptions &, const Eigen::Matrix<double, 4, 4> *,
+    Eigen::Matrix<double, 4, 4> *, Eigen::Matrix<double, 1, 4> *,
+    RiccatiStats *);
+extern template bool SolveDiscreteRiccati<Eigen::Dynamic, Eigen::Dynamic>(
+    const Eigen::MatrixXd &, const Eigen::MatrixXd &, const Eigen::MatrixXd &,
+    const Eigen::MatrixXd &, const RiccatiOptions &, const Eigen::MatrixXd *,
+    Eigen::MatrixXd *, Eigen::MatrixXd *, RiccatiStats *);
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Rolling window over a reference line that is read as the vehicle
+ * drives, for routes too long to load and profile at once.
+ *
+ * Points are appended at the back and retired from the front; at most
+ * capacity points are held, in storage allocated once, so memory does not
+ * depend on the route length. The profile (heading, accumulated s, kappa,
+ * dkappa) is that of ReferenceLine::ComputePathProfile over the whole route:
+ * a point's values depend on the points up to three before and after it, so
+ * an append recomputes only the last four points, from the last seven. The
+ * last three are provisional (end-of-route differences) until more points
+ * arrive; retired points never change the values of the ones kept. s is the
+ * arc length from the first point of the route.
+ */
+class StreamingReferenceLine {
+ public:
+  // points on either side a point's profile depends on
+  static constexpr std::size_t kContext = 3;
+
+  /**
+   * @param capacity most points held at once, at least 2 * kContext + 1
+   */
+  explicit StreamingReferenceLine(const std::size_t capacity);
+
+  /**
+   * @brief append a point at the back; a point closer than 1e-6 m to the
+   * last one is skipped (true), a full window refuses it (false)
+   */
+  bool Append(const double x, const double y);
+
+  /**
+   * @brief drop up to count points from the front, always keeping
+   * 2 * kContext + 1 so later appends have their context
+   * @return points dropped
+   */
+  std::size_t Retire(const std::size_t count);
+
+  std::size_t size() const { return end_ - begin_; }
+  std::size_t capacity() const { return capacity_; }
+  bool full() const { return size() == capacity_; }
+  // route index of the first point held, and points appended so far
+  std::size_t first_index() const { return first_index_; }
+  std::size_t appended() const { return first_index_ + size(); }
+
+  // attributes of point i of the window, 0 <= i < size()
+  double x(const std::size_t i) const { return points_[begin_ + i].first; }
+  double y(const std::size_t i) const { return points_[begin_ + i].second; }
+  double heading(const std::size_t i) const { return headings_[begin_ + i]; }
+  double s(const std::size_t i) const { return accumulated_s_[begin_ + i]; }
+  double kappa(const std::size_t i) const { return kappas_[begin_ + i]; }
+  double dkappa(const std::size_t i) const { return dkappas_[begin_ + i]; }
+
+  /**
+   * @brief the window as trajectory points with speed v and zero
+   * acceleration, e.g. for a TrajectorySnapshot
+   */
+  void Window(const double v, std::vector<TrajectoryPoint> *points) const;
+
+  // bytes of the window storage, fixed at construction
+  std::size_t MemoryBytes() const;
+
+ private:
+  std::size_t capacity_;
+  // window [begin_, end_) of storage for 2 * capacity_ points, moved back
+  // to the start when end_ reaches the end
+  std::size_t begin_ = 0;
+  std::size_t end_ = 0;
+  std::size_t first_index_ = 0;
+  std::vector<std::pair<double, double>> points_;
+  std::vector<double> headings_;
+  std::vector<double> accumulated_s_;
+  std::vector<double> kappas_;
+  std::vector<double> dkappas_;
+};
+
+}  // namespace control
+}  // namespace shenlan
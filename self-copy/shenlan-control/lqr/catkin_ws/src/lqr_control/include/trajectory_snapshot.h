@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "arc_length_reference_line.h"
+#include "common.h"
+#include "trajectory_soa.h"
+#include "trajectory_spatial_index.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Where a snapshot lies on a route streamed in windows
+ * (StreamingReferenceLine); all zero for a trajectory held whole.
+ */
+struct TrajectoryWindow {
+  // windows of the same route share a nonzero id
+  std::uint64_t route_id = 0;
+  // route index and arc length of the first point
+  std::size_t first_index = 0;
+  double s_offset = 0.0;
+};
+
+/**
+ * @brief Immutable, versioned trajectory shared by reference.
+ *
+ * Holds the trajectory points together with everything derived from them
+ * (structure-of-arrays columns, accumulated arc length, spatial index and,
+ * on request, station lookup). All of it is built once in Create(), off the
+ * control loop; afterwards the snapshot never changes, so controllers share
+ * it through a shared_ptr instead of copying the points every cycle. Every
+ * snapshot gets a new, process-wide unique version number.
+ */
+class TrajectorySnapshot {
+ public:
+  /**
+   * @brief build a snapshot and all derived data
+   * @param points trajectory points, moved into the snapshot
+   * @param build_spatial_index also build the 2d-tree for global matching
+   * @param build_station_line also build station_line(), for controllers
+   * that look ahead by arc length (LQR preview, LTV and RTI MPC)
+   * @param window position of the points on a streamed route
+   * @return shared immutable snapshot
+   */
+  static std::shared_ptr<const TrajectorySnapshot> Create(
+      std::vector<TrajectoryPoint> points,
+      const bool build_spatial_index = true,
+      const bool build_station_line = false,
+      const TrajectoryWindow &window = TrajectoryWindow());
+
+  /**
+   * @brief the same with a spatial index built beforehand over the points
+   * (e.g. loaded from a compiled roadmap), null for none
+   */
+  static std::shared_ptr<const TrajectorySnapshot> Create(
+      std::vector<TrajectoryPoint> points,
+      std::shared_ptr<const TrajectorySpatialIndex> spatial_index,
+      const bool build_station_line = false,
+      const TrajectoryWindow &window = TrajectoryWindow());
+
+  /**
+   * @brief the same with the path profile computed beforehand as well
+   * (e.g. the columns of a compiled roadmap): accumulated_s and dkappa,
+   * points.size() values each, are taken instead of recomputed
+   */
+  static std::shared_ptr<const TrajectorySnapshot> Create(
+      std::vector<TrajectoryPoint> points, const double *accumulated_s,
+      const double *dkappa,
+      std::shared_ptr<const TrajectorySpatialIndex> spatial_index,
+      const bool build_station_line = false,
+      const TrajectoryWindow &window = TrajectoryWindow());
+
+  // a new id for the windows of one streamed route
+  static std::uint64_t NewRouteId();
+
+  std::uint64_t version() const { return version_; }
+  const TrajectoryWindow &window() const { return window_; }
+
+  /**
+   * @brief points dropped from the front since an earlier window of the
+   * same route, so match indices into it can be carried over
+   * @return false if earlier is not an earlier window of this route
+   */
+  bool FollowsWindow(const TrajectorySnapshot &earlier,
+                     std::size_t *dropped) const;
+  std::size_t size() const { return points_.size(); }
+  bool empty() const { return points_.empty(); }
+
+  const std::vector<TrajectoryPoint> &points() const { return points_; }
+  const TrajectorySoA &soa() const { return soa_; }
+  // null when built without a spatial index
+  const std::shared_ptr<const TrajectorySpatialIndex> &spatial_index() const {
+    return spatial_index_;
+  }
+  // the points resampled by arc length at half their mean spacing, for
+  // lookups by station s; empty unless requested in Create() and for fewer
+  // than two distinct points
+  const ArcLengthReferenceLine &station_line() const { return station_line_; }
+
+ private:
+  TrajectorySnapshot() = default;
+  // resample the columns into station_line_; dkappa per point, null
+  // differences it from kappa
+  void BuildStationLine(const double *dkappa);
+
+  std::uint64_t version_ = 0;
+  TrajectoryWindow window_;
+  std::vector<TrajectoryPoint> points_;
+  TrajectorySoA soa_;
+  std::shared_ptr<const TrajectorySpatialIndex> spatial_index_;
+  ArcLengthReferenceLine station_line_;
+};
+
+typedef std::shared_ptr<const TrajectorySnapshot> TrajectorySnapshotPtr;
+
+/**
+ * @brief Single-slot mailbox handing the latest snapshot to the control loop.
+ *
+ * The producer builds a snapshot on its own thread and calls Publish(), which
+ * only swaps a pointer. The control loop calls Latest() each cycle; it never
+ * waits for a snapshot to be built, and a snapshot it still holds stays
+ * alive until it lets go, whatever is published in the meantime.
+ */
+class TrajectoryChannel {
+ public:
+  void Publish(TrajectorySnapshotPtr snapshot);
+  TrajectorySnapshotPtr Latest() const;
+
+  /**
+   * @brief version of the latest snapshot, 0 before the first publish
+   *
+   * Lets the control loop skip Latest() when nothing new was published.
+   */
+  std::uint64_t version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
+ private:
+  TrajectorySnapshotPtr snapshot_;
+  std::atomic<std::uint64_t> version_{0};
+};
+
+}  // namespace control
+}  // namespace shenlan
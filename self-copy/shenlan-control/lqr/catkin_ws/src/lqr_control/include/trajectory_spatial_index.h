@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Static 2d-tree over the x/y of reference-line points.
+ *
+ * Built once after the path profile is computed and shared read-only by the
+ * controllers. Nearest and k-nearest queries cost O(log N) on average. All
+ * queries are const and keep their state on the stack, so any number of
+ * threads may query one index concurrently.
+ */
+class TrajectorySpatialIndex {
+ public:
+  struct BuildStats {
+    std::size_t num_points = 0;
+    double build_time_ms = 0.0;
+    std::size_t memory_bytes = 0;
+    double bytes_per_point = 0.0;
+  };
+
+  /**
+   * @brief build an index over the given points
+   * @param points reference-line points, indices returned by queries refer
+   * to this vector
+   * @return shared immutable index
+   */
+  static std::shared_ptr<const TrajectorySpatialIndex> Build(
+      const std::vector<TrajectoryPoint> &points);
+
+  /**
+   * @brief restore an index from the tree of an earlier Build() over the
+   * same points, e.g. one stored in a compiled roadmap
+   * @param x point x, size values
+   * @param y point y, size values
+   * @param tree_indices tree_indices() of the earlier index
+   * @param tree_split_dims tree_split_dims() of the earlier index
+   * @return null if the tree does not fit size points
+   */
+  static std::shared_ptr<const TrajectorySpatialIndex> Load(
+      const double *x, const double *y, const std::size_t size,
+      const std::uint32_t *tree_indices, const std::uint8_t *tree_split_dims);
+
+  /**
+   * @brief find the point nearest to (x, y)
+   * @param x query position x
+   * @param y query position y
+   * @param d2_min squared distance to the nearest point, may be null
+   * @return index of the nearest point, 0 for an empty index
+   */
+  std::size_t Nearest(const double x, const double y,
+                      double *d2_min = nullptr) const;
+
+  /**
+   * @brief find the k points nearest to (x, y)
+   * @param x query position x
+   * @param y query position y
+   * @param k number of points wanted
+   * @return point indices sorted by increasing distance, at most k
+   */
+  std::vector<std::size_t> KNearest(const double x, const double y,
+                                    const std::size_t k) const;
+
+  std::size_t size() const { return xs_.size(); }
+  const BuildStats &stats() const { return stats_; }
+  // point index and split dimension of each tree slot, for Load()
+  const std::vector<std::uint32_t> &tree_indices() const { return indices_; }
+  const std::vector<std::uint8_t> &tree_split_dims() const {
+    return split_dims_;
+  }
+
+ private:
+  TrajectorySpatialIndex() = default;
+
+  // fill stats_ for an index of num_points points made since start
+  void FinishStats(const std::size_t num_points,
+                   const std::chrono::steady_clock::time_point &start);
+
+  void BuildRange(const std::size_t begin, const std::size_t end,
+                  std::vector<std::uint32_t> *order,
+                  const std::vector<TrajectoryPoint> &points);
+  void NearestRange(const std::size_t begin, const std::size_t end,
+                    const double x, const double y, double *d2_min,
+                    std::size_t *slot_min) const;
+  void KNearestRange(const std::size_t begin, const std::size_t end,
+                     const double x, const double y, const std::size_t k,
+                     std::vector<std::pair<double, std::size_t>> *heap) const;
+
+  // points stored in tree order: node of range [begin, end) sits at
+  // (begin + end) / 2 and splits on split_dims_ of that slot
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<std::uint32_t> indices_;
+  std::vector<std::uint8_t> split_dims_;
+
+  BuildStats stats_;
+};
+
+}  // namespace control
+}  // namespace shenlan
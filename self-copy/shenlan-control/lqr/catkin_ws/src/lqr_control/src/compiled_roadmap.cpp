@@ -0,0 +1,333 @@
+#include "compiled_roadmap.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "reference_line.h"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'L', 'R', 'O', 'A', 'D', 'M', 'P'};
+// 按本机字节序写入, 读入时不一致说明文件来自字节序不同的机器
+constexpr std::uint32_t kByteOrder = 0x01020304;
+// 每一列按缓存行对齐
+constexpr std::size_t kAlignment = 64;
+constexpr std::uint64_t kHasSpatialIndex = 1;
+
+// 文件中各段的顺序
+enum Section {
+  kX = 0,
+  kY,
+  kHeading,
+  kS,
+  kKappa,
+  kDkappa,
+  kTreeIndices,
+  kTreeSplitDims,
+  kNumSections
+};
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t header_bytes;
+  std::uint64_t file_bytes;
+  std::uint64_t num_points;
+  std::uint64_t flags;
+  // 编译时文本文件的大小与修改时间, 用于判断是否过期
+  std::int64_t source_bytes;
+  std::int64_t source_mtime_ns;
+  // 各段相对文件头的字节偏移, 没有的段为0
+  std::uint64_t offsets[kNumSections];
+};
+
+std::size_t Align(const std::size_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+std::size_t SectionBytes(const int section, const std::size_t num_points) {
+  switch (section) {
+    case kTreeIndices:
+      return num_points * sizeof(std::uint32_t);
+    case kTreeSplitDims:
+      return num_points * sizeof(std::uint8_t);
+    default:
+      return num_points * sizeof(double);
+  }
+}
+
+// 文本文件的大小与修改时间[ns], 无法读取时返回false
+bool FileStamp(const std::string &path, std::int64_t *bytes,
+               std::int64_t *mtime_ns) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  *bytes = static_cast<std::int64_t>(info.st_size);
+  *mtime_ns = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+              info.st_mtim.tv_nsec;
+  return true;
+}
+
+void SetError(std::string *error, const std::string &reason) {
+  if (error != nullptr) {
+    *error = reason;
+  }
+}
+
+}  // namespace
+
+CompiledRoadmap::~CompiledRoadmap() { Close(); }
+
+bool CompiledRoadmap::Compile(const std::string &text_path,
+                              const std::string &compiled_path,
+                              const bool with_spatial_index,
+                              std::string *error) {
+  std::ifstream infile(text_path);
+  if (!infile.is_open()) {
+    SetError(error, "cannot open " + text_path);
+    return false;
+  }
+  std::vector<std::pair<double, double>> xy_points;
+  std::string line;
+  std::string word_x;
+  std::string word_y;
+  while (std::getline(infile, line)) {
+    std::stringstream word(line);
+    if (word >> word_x >> word_y) {
+      xy_points.emplace_back(std::atof(word_x.c_str()),
+                             std::atof(word_y.c_str()));
+    }
+  }
+  infile.close();
+
+  const std::size_t num_points = xy_points.size();
+  std::vector<double> columns[kTreeIndices];
+  for (int section = 0; section < kTreeIndices; ++section) {
+    columns[section].resize(num_points);
+  }
+  if (!ReferenceLine::ComputePathProfile(
+          xy_points.data(), num_points, columns[kHeading].data(),
+          columns[kS].data(), columns[kKappa].data(),
+          columns[kDkappa].data())) {
+    SetError(error, text_path + " has fewer than two points");
+    return false;
+  }
+  for (std::size_t i = 0; i < num_points; ++i) {
+    columns[kX][i] = xy_points[i].first;
+    columns[kY][i] = xy_points[i].second;
+  }
+  std::shared_ptr<const TrajectorySpatialIndex> index;
+  if (with_spatial_index) {
+    std::vector<TrajectoryPoint> points(num_points);
+    for (std::size_t i = 0; i < num_points; ++i) {
+      points[i].x = xy_points[i].first;
+      points[i].y = xy_points[i].second;
+    }
+    index = TrajectorySpatialIndex::Build(points);
+  }
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrder;
+  header.header_bytes = sizeof(FileHeader);
+  header.num_points = num_points;
+  header.flags = index != nullptr ? kHasSpatialIndex : 0;
+  header.source_bytes = -1;
+  FileStamp(text_path, &header.source_bytes, &header.source_mtime_ns);
+  const int num_sections = index != nullptr ? kNumSections : kTreeIndices;
+  std::size_t offset = sizeof(FileHeader);
+  for (int section = 0; section < num_sections; ++section) {
+    offset = Align(offset);
+    header.offsets[section] = offset;
+    offset += SectionBytes(section, num_points);
+  }
+  header.file_bytes = offset;
+
+  // 先写临时文件再改名, 正在映射旧文件的进程不受影响
+  const std::string temporary_path = compiled_path + ".tmp";
+  std::ofstream outfile(temporary_path, std::ios::binary | std::ios::trunc);
+  if (!outfile.is_open()) {
+    SetError(error, "cannot write " + temporary_path);
+    return false;
+  }
+  outfile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  std::size_t written = sizeof(header);
+  const char padding[kAlignment] = {};
+  for (int section = 0; section < num_sections; ++section) {
+    outfile.write(padding, header.offsets[section] - written);
+    const char *bytes =
+        section == kTreeIndices
+            ? reinterpret_cast<const char *>(index->tree_indices().data())
+            : section == kTreeSplitDims
+                  ? reinterpret_cast<const char *>(
+                        index->tree_split_dims().data())
+                  : reinterpret_cast<const char *>(columns[section].data());
+    outfile.write(bytes, SectionBytes(section, num_points));
+    written = header.offsets[section] + SectionBytes(section, num_points);
+  }
+  outfile.close();
+  if (!outfile || std::rename(temporary_path.c_str(),
+                              compiled_path.c_str()) != 0) {
+    std::remove(temporary_path.c_str());
+    SetError(error, "cannot write " + compiled_path);
+    return false;
+  }
+  return true;
+}
+
+bool CompiledRoadmap::IsCompiled(const std::string &path) {
+  char magic[sizeof(kMagic)];
+  std::ifstream infile(path, std::ios::binary);
+  return infile.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool CompiledRoadmap::Open(const std::string &path) {
+  Close();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Fail("cannot open " + path);
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0 ||
+      static_cast<std::size_t>(info.st_size) < sizeof(FileHeader)) {
+    ::close(fd);
+    return Fail(path + " is too short for a compiled roadmap");
+  }
+  file_bytes_ = static_cast<std::size_t>(info.st_size);
+  void *mapping = ::mmap(nullptr, file_bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // 映射建立后即可关闭文件描述符
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    file_bytes_ = 0;
+    return Fail("cannot map " + path);
+  }
+  data_ = static_cast<const unsigned char *>(mapping);
+
+  const FileHeader &header = *reinterpret_cast<const FileHeader *>(data_);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return Fail(path + " is not a compiled roadmap");
+  }
+  if (header.version != kVersion || header.byte_order != kByteOrder ||
+      header.header_bytes != sizeof(FileHeader)) {
+    return Fail(path + " was compiled by another version or byte order, "
+                       "compile it again");
+  }
+  if (header.file_bytes != file_bytes_ || header.num_points < 2 ||
+      header.num_points > file_bytes_ / sizeof(double)) {
+    return Fail(path + " is truncated or corrupt");
+  }
+  size_ = header.num_points;
+  const int num_sections =
+      (header.flags & kHasSpatialIndex) != 0 ? kNumSections : kTreeIndices;
+  for (int section = 0; section < num_sections; ++section) {
+    const std::uint64_t offset = header.offsets[section];
+    if (offset < sizeof(FileHeader) || offset % kAlignment != 0 ||
+        offset > file_bytes_ ||
+        SectionBytes(section, size_) > file_bytes_ - offset) {
+      return Fail(path + " is truncated or corrupt");
+    }
+  }
+  source_bytes_ = header.source_bytes;
+  source_mtime_ns_ = header.source_mtime_ns;
+  const auto column = [this, &header](const int section) {
+    return reinterpret_cast<const double *>(data_ + header.offsets[section]);
+  };
+  x_ = column(kX);
+  y_ = column(kY);
+  heading_ = column(kHeading);
+  s_ = column(kS);
+  kappa_ = column(kKappa);
+  dkappa_ = column(kDkappa);
+  if (num_sections == kNumSections) {
+    tree_indices_ = reinterpret_cast<const std::uint32_t *>(
+        data_ + header.offsets[kTreeIndices]);
+    tree_split_dims_ = data_ + header.offsets[kTreeSplitDims];
+  }
+  return true;
+}
+
+bool CompiledRoadmap::Fail(const std::string &reason) {
+  Close();
+  error_ = reason;
+  return false;
+}
+
+void CompiledRoadmap::Close() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<unsigned char *>(data_), file_bytes_);
+  }
+  data_ = nullptr;
+  file_bytes_ = 0;
+  size_ = 0;
+  source_bytes_ = -1;
+  source_mtime_ns_ = 0;
+  x_ = y_ = heading_ = s_ = kappa_ = dkappa_ = nullptr;
+  tree_indices_ = nullptr;
+  tree_split_dims_ = nullptr;
+  error_.clear();
+}
+
+bool CompiledRoadmap::Stale(const std::string &text_path) const {
+  std::int64_t bytes = 0;
+  std::int64_t mtime_ns = 0;
+  if (!is_open() || !FileStamp(text_path, &bytes, &mtime_ns)) {
+    return false;
+  }
+  return bytes != source_bytes_ || mtime_ns != source_mtime_ns_;
+}
+
+void CompiledRoadmap::Points(const double v,
+                             std::vector<TrajectoryPoint> *points) const {
+  points->resize(size_);
+  for (std::size_t i = 0; i < size_; ++i) {
+    TrajectoryPoint &point = (*points)[i];
+    point.x = x_[i];
+    point.y = y_[i];
+    point.heading = heading_[i];
+    point.kappa = kappa_[i];
+    point.v = v;
+    point.a = 0.0;
+  }
+}
+
+std::shared_ptr<const TrajectorySpatialIndex> CompiledRoadmap::SpatialIndex()
+    const {
+  if (!has_spatial_index()) {
+    return nullptr;
+  }
+  return TrajectorySpatialIndex::Load(x_, y_, size_, tree_indices_,
+                                      tree_split_dims_);
+}
+
+TrajectorySnapshotPtr CompiledRoadmap::Snapshot(
+    const double v, const bool build_station_line) const {
+  std::vector<TrajectoryPoint> points;
+  Points(v, &points);
+  std::shared_ptr<const TrajectorySpatialIndex> spatial_index = SpatialIndex();
+  if (spatial_index == nullptr) {
+    spatial_index = TrajectorySpatialIndex::Build(points);
+  }
+  return TrajectorySnapshot::Create(std::move(points), s_, dkappa_,
+                                    std::move(spatial_index),
+                                    build_station_line);
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -61,9 +61,9 @@ namespace shenlan
         void LqrController::Init()
         {
             // Matrix init operations.
-            const int matrix_size = basic_state_size_;
-            matrix_a_ = Matrix::Zero(basic_state_size_, basic_state_size_);
-            matrix_ad_ = Matrix::Zero(basic_state_size_, basic_state_size_);
+            // 维数在编译期确定(kStateSize x kStateSize), 这里只需置零
+            matrix_a_ = StateMatrix::Zero();
+            matrix_ad_ = StateMatrix::Zero();
             /*
             A matrix (Gear Drive)
             [0.0,        1.0,                                     0.0,                              0.0;
@@ -78,7 +78,7 @@ namespace shenlan
             matrix_a_(3, 2) = (lf_ * cf_ - lr_ * cr_) / iz_;
 
             // 初始化A矩阵的非常数项
-            matrix_a_coeff_ = Matrix::Zero(matrix_size, matrix_size);
+            matrix_a_coeff_ = StateMatrix::Zero();
             matrix_a_coeff_(1, 1) = -(cf_ + cr_) / mass_;
             matrix_a_coeff_(1, 3) = (lr_ * cr_ - lf_ * cf_) / mass_;
             matrix_a_coeff_(3, 1) = (lr_ * cr_ - lf_ * cf_) / iz_;
@@ -88,21 +88,21 @@ namespace shenlan
           b = [0.0, c_f / m, 0.0, l_f * c_f / i_z]^T
           */
             // 初始化B矩阵
-            matrix_b_ = Matrix::Zero(basic_state_size_, 1);
-            matrix_bd_ = Matrix::Zero(basic_state_size_, 1);
+            matrix_b_ = ControlMatrix::Zero();
+            matrix_bd_ = ControlMatrix::Zero();
             matrix_b_(1, 0) = cf_ / mass_;
             matrix_b_(3, 0) = lf_ * cf_ / iz_;
             matrix_bd_ = matrix_b_ * ts_; // 离散化 B_d = B * dt 向前欧拉
 
             // 状态向量
-            matrix_state_ = Matrix::Zero(matrix_size, 1);
+            matrix_state_ = StateVector::Zero();
             // 反馈矩阵
-            matrix_k_ = Matrix::Zero(1, matrix_size);
+            matrix_k_ = GainMatrix::Zero();
             // lqr cost function中 输入值u的权重
-            matrix_r_ = Matrix::Identity(1, 1);
+            matrix_r_ = ControlWeightMatrix::Identity();
             matrix_r_(0, 0) = 10;
             // lqr cost function中 状态向量x的权重
-            matrix_q_ = Matrix::Zero(matrix_size, matrix_size);
+            matrix_q_ = StateMatrix::Zero();
 
             // int q_param_size = 4;
             matrix_q_(0, 0) = 1; // lateral_error
@@ -111,19 +111,12 @@ namespace shenlan
             matrix_q_(3, 3) = 1; // heading__error_rate
 
             matrix_q_updated_ = matrix_q_;
+            matrix_p_ = matrix_q_;
+            model_initialized_ = true;
 
             return;
         }
 
-        // 两点之间的距离
-        double PointDistanceSquare(const TrajectoryPoint &point, const double x,
-                                   const double y)
-        {
-            double dx = point.x - x;
-            double dy = point.y - y;
-            return dx * dx + dy * dy;
-        }
-
         // 将角度(弧度制)归化到[-M_PI, M_PI]之间
         double NormalizeAngle(const double angle)
         {
@@ -140,8 +133,30 @@ namespace shenlan
             const VehicleState &localization,
             const TrajectoryData &planning_published_trajectory, ControlCmd &cmd)
         {
-            // 规划轨迹
-            trajectory_points_ = planning_published_trajectory.trajectory_points;
+            // 规划轨迹: 只持有快照的引用, 版本号变化时才切换并重置匹配状态
+            const TrajectorySnapshotPtr &snapshot =
+                planning_published_trajectory.snapshot;
+            if (snapshot == nullptr || snapshot->empty())
+            {
+                std::cout << "trajectory snapshot is empty" << std::endl;
+                return false;
+            }
+            if (trajectory_ == nullptr ||
+                trajectory_->version() != snapshot->version())
+            {
+                // 同一路线的后续窗口: 按前端丢弃的点数平移上一次的匹配点
+                std::size_t dropped = 0;
+                if (trajectory_ != nullptr &&
+                    snapshot->FollowsWindow(*trajectory_, &dropped))
+                {
+                    trajectory_matcher_.Rebase(snapshot->soa(), dropped);
+                }
+                else
+                {
+                    trajectory_matcher_.Reset();
+                }
+                trajectory_ = snapshot;
+            }
             /*
             A matrix (Gear Drive)
             [0.0,        1.0,                                     0.0,                              0.0;
@@ -168,15 +183,39 @@ namespace shenlan
             // to-do 03 计算横向误差并且更新状态向量x
             UpdateState(localization);
 
-            /// to-do 04 更新状态矩阵A并将状态矩阵A离散化
-            UpdateMatrix(localization);
+            if (enable_gain_schedule_ && enable_look_ahead_back_control_)
+            {
+                // 预瞄时表中每个车速存[K K_c]
+                gain_schedule_.Lookup(v_, preview_gain_lookup_.data());
+                std::copy(preview_gain_lookup_.begin(),
+                          preview_gain_lookup_.begin() + kStateSize,
+                          matrix_k_.data());
+                std::copy(preview_gain_lookup_.begin() + kStateSize,
+                          preview_gain_lookup_.end(), matrix_k_preview_.data());
+            }
+            else if (enable_gain_schedule_)
+            {
+                // 按车速在增益表中插值, 不再每个周期迭代求解Riccati方程
+                gain_schedule_.Lookup(v_, matrix_k_.data());
+            }
+            else
+            {
+                /// to-do 04 更新状态矩阵A并将状态矩阵A离散化
+                UpdateMatrix(localization);
 
-            // cout << "matrix_bd_.row(): " << matrix_bd_.rows() << endl;
-            // cout << "matrix_bd_.col(): " << matrix_bd_.cols() << endl;
+                // cout << "matrix_bd_.row(): " << matrix_bd_.rows() << endl;
+                // cout << "matrix_bd_.col(): " << matrix_bd_.cols() << endl;
 
-            // to-do 05 Solve Lqr Problem
-            SolveLQRProblem(matrix_ad_, matrix_bd_, matrix_q_, matrix_r_, lqr_eps_,
-                            lqr_max_iteration_, &matrix_k_);
+                // to-do 05 Solve Lqr Problem
+                SolveLQRProblem(matrix_ad_, matrix_bd_, matrix_q_, matrix_r_, lqr_eps_,
+                                lqr_max_iteration_, &matrix_k_);
+                if (enable_look_ahead_back_control_)
+                {
+                    ComputePreviewGain(matrix_ad_, matrix_bd_,
+                                       PreviewDisturbance(v_), matrix_p_,
+                                       matrix_k_, matrix_k_preview_.data());
+                }
+            }
             // 求出最优控制率k, 算出反馈控制量 u = -k * x
 
             // to-do 06 计算feedback
@@ -189,8 +228,20 @@ namespace shenlan
             // to-do 07 计算前馈控制，计算横向转角的反馈量
             double steer_angle_feedforward = 0.0;
             double feedforward_coef = 1.3;
-            steer_angle_feedforward = ComputeFeedForward(localization, ref_curv_);
-            double steer_angle = steer_angle_feedback + feedforward_coef * steer_angle_feedforward;
+            double steer_angle = steer_angle_feedback;
+            // 快照没有等弧长参考线时预瞄无从采样, 退回曲率前馈
+            if (enable_look_ahead_back_control_ &&
+                !trajectory_->station_line().empty())
+            {
+                // 预瞄反馈 -K_c * c 已经包含了曲率的作用, 不再叠加前馈
+                SamplePreview(matched_s_, v_);
+                steer_angle -= matrix_k_preview_.dot(preview_heading_rate_);
+            }
+            else
+            {
+                steer_angle_feedforward = ComputeFeedForward(localization, ref_curv_);
+                steer_angle += feedforward_coef * steer_angle_feedforward;
+            }
             // Set the steer commands
             // 限制前轮最大转角，这里定义前轮最大转角位于 [-20度～20度]
             double max_steer_angle = (double)20 * M_PI / 180;
@@ -231,7 +282,7 @@ namespace shenlan
         // to-do 04 更新状态矩阵A并将状态矩阵A离散化
         void LqrController::UpdateMatrix(const VehicleState &vehicle_state)
         {
-            Matrix matrix_I = Matrix::Identity(matrix_a_.cols(), matrix_a_.rows());
+            const StateMatrix matrix_I = StateMatrix::Identity();
             // 离散化Ad，中点欧拉
             matrix_ad_ = (matrix_I - 0.5 * ts_ * matrix_a_).inverse() * (matrix_I + 0.5 * ts_ * matrix_a_);
         }
@@ -254,7 +305,7 @@ namespace shenlan
                                                  const double linear_a,
                                                  LateralControlErrorPtr &lat_con_err)
         {
-            // 寻找match_point
+            // 寻找match_point, 即车辆在轨迹上的投影点
             TrajectoryPoint match_point = QueryNearestPointByPosition(x, y);
 
             // 计算横向误差
@@ -279,61 +330,247 @@ namespace shenlan
             lat_con_err->heading_error_rate = match_point.v * match_point.kappa - angular_v;
         }
 
-        // 查询距离当前位置最近的轨迹点
+        // 查询当前位置在轨迹上的投影点(垂足), heading/kappa/v在线段上插值
         TrajectoryPoint LqrController::QueryNearestPointByPosition(const double x,
                                                                    const double y)
         {
-            double d_min = PointDistanceSquare(trajectory_points_.front(), x, y);
-            size_t index_min = 0;
-
-            for (size_t i = 1; i < trajectory_points_.size(); ++i)
-            {
-                double d_temp = PointDistanceSquare(trajectory_points_[i], x, y);
-                if (d_temp < d_min)
-                {
-                    d_min = d_temp;
-                    index_min = i;
-                }
-            }
-            // cout << "x: " << trajectory_points_[index_min].x << " " << "y: " <<
-            // trajectory_points_[index_min].y; cout << " index_min: " << index_min <<
+            // 在上一次匹配点附近的窗口内搜索, 必要时退化为全局搜索
+            const ProjectedPoint match_point = trajectory_matcher_.Project(
+                trajectory_->soa(), x, y, trajectory_->spatial_index().get());
+            // cout << "x: " << match_point.point.x << " " << "y: " <<
+            // match_point.point.y; cout << " s: " << match_point.s <<
             // endl; cout << "tarjectory.heading: " <<
-            // trajectory_points_[index_min].heading << endl;
+            // match_point.point.heading << endl;
 
-            ref_curv_ =
-                trajectory_points_[index_min].kappa; // 对应的最近的轨迹点上的曲率
+            ref_curv_ = match_point.point.kappa; // 投影点处插值得到的曲率
+            matched_s_ = match_point.s;
 
-            return trajectory_points_[index_min];
+            return match_point.point;
         }
 
         // to-do 05:求解LQR方程
-        void LqrController::SolveLQRProblem(const Matrix &A, const Matrix &B,
-                                            const Matrix &Q, const Matrix &R,
+        void LqrController::SolveLQRProblem(const StateMatrix &A,
+                                            const ControlMatrix &B,
+                                            const StateMatrix &Q,
+                                            const ControlWeightMatrix &R,
                                             const double tolerance,
                                             const uint max_num_iteration,
-                                            Matrix *ptr_K)
+                                            GainMatrix *ptr_K)
         {
-            // 防止矩阵的维数出错导致后续的运算失败
-            if (A.rows() != A.cols() || B.rows() != A.rows() || Q.rows() != Q.cols() ||
-                Q.rows() != A.rows() || R.rows() != R.cols() || R.rows() != B.cols())
+            // 矩阵维数由类型在编译期保证, 不再需要运行时检查
+            RiccatiOptions options;
+            options.method = lqr_solver_;
+            options.tolerance = tolerance;
+            options.max_iterations = static_cast<int>(max_num_iteration);
+            // 车速在相邻周期间变化很小, 上一周期的P是很好的初值
+            const StateMatrix *P_init =
+                lqr_warm_start_ && riccati_stats_.converged ? &matrix_p_ : nullptr;
+            StateMatrix P;
+            GainMatrix K;
+            if (SolveDiscreteRiccati(A, B, Q, R, options, P_init, &P, &K,
+                                     &riccati_stats_))
             {
-                std::cout
-                    << "LQR solver: one or more matrices have incompatible dimensions."
-                    << std::endl;
+                matrix_p_ = P;
+                *ptr_K = K;
                 return;
             }
-            Matrix A_trans = A.transpose();
-            Matrix B_trans = B.transpose();
-            double P_error = std::numeric_limits<double>::max();
-            Matrix P = Q;
-            uint num_iteration = 0;
-            while (num_iteration++ <= max_num_iteration && P_error > tolerance)
+
+            // 未收敛: 报告出来, 结果有限时仍使用最后一次迭代, 否则保留上一周期的K
+            ++riccati_failure_count_;
+            std::cout << "LQR solver: not converged after "
+                      << riccati_stats_.iterations << " iterations, residual "
+                      << riccati_stats_.residual << std::endl;
+            if (K.allFinite() && P.allFinite())
+            {
+                // 预瞄增益由同一次迭代的P算出
+                matrix_p_ = P;
+                *ptr_K = K;
+            }
+        }
+
+        void LqrController::SetRiccatiSolver(const RiccatiMethod method,
+                                             const bool warm_start)
+        {
+            lqr_solver_ = method;
+            lqr_warm_start_ = warm_start;
+            riccati_stats_ = RiccatiStats();
+        }
+
+        // 车速v下的精确增益: 与ComputeControlCommand相同的A矩阵和离散化
+        bool LqrController::SolveGainAtSpeed(const double v, Matrix *K)
+        {
+            if (!model_initialized_)
+            {
+                return false;
+            }
+            const double speed = std::max(v, minimum_speed_protection_);
+            StateMatrix matrix_a = matrix_a_;
+            matrix_a(1, 1) = matrix_a_coeff_(1, 1) / speed;
+            matrix_a(1, 3) = matrix_a_coeff_(1, 3) / speed;
+            matrix_a(3, 1) = matrix_a_coeff_(3, 1) / speed;
+            matrix_a(3, 3) = matrix_a_coeff_(3, 3) / speed;
+            const StateMatrix matrix_I = StateMatrix::Identity();
+            const StateMatrix matrix_ad =
+                (matrix_I - 0.5 * ts_ * matrix_a).inverse() *
+                (matrix_I + 0.5 * ts_ * matrix_a);
+            // 用doubling求到收敛, 结果与在线求解器的设置和上一周期无关
+            RiccatiOptions options;
+            options.method = RiccatiMethod::kDoubling;
+            options.tolerance = 1e-9;
+            options.max_iterations = 100;
+            StateMatrix P;
+            GainMatrix gain;
+            if (!SolveDiscreteRiccati<kStateSize, kControlSize>(
+                    matrix_ad, matrix_bd_, matrix_q_, matrix_r_, options, nullptr,
+                    &P, &gain) ||
+                !gain.allFinite())
             {
-                Matrix P_next = Q + A_trans * P * A - A_trans * P * B * (R + B_trans * P * B).inverse() * B_trans * P * A;
-                P_error = fabs((P_next - P).maxCoeff());
-                P = P_next;
+                return false;
             }
-            *ptr_K = ((R + B_trans * P * B).inverse()) * B_trans * P * A;
+            if (!enable_look_ahead_back_control_)
+            {
+                *K = gain;
+                return true;
+            }
+            // 预瞄: K后面接上K_c, 整行一起进增益表
+            K->resize(kControlSize, kStateSize + preview_steps_);
+            K->leftCols(kStateSize) = gain;
+            Eigen::RowVectorXd preview_gain(preview_steps_);
+            ComputePreviewGain(matrix_ad, matrix_bd_, PreviewDisturbance(speed),
+                               P, gain, preview_gain.data());
+            K->rightCols(preview_steps_) = preview_gain;
+            return K->allFinite();
+        }
+
+        bool LqrController::EnablePreview(const int preview_steps)
+        {
+            if (preview_steps < 0)
+            {
+                return false;
+            }
+            preview_steps_ = preview_steps;
+            enable_look_ahead_back_control_ = preview_steps > 0;
+            matrix_k_preview_ = Eigen::RowVectorXd::Zero(preview_steps);
+            preview_heading_rate_ = Eigen::VectorXd::Zero(preview_steps);
+            preview_gain_lookup_.assign(kStateSize + preview_steps, 0.0);
+            // 增益表的列数随之改变, 需要重新EnableGainSchedule
+            enable_gain_schedule_ = false;
+            return true;
+        }
+
+        /*
+        期望横摆角速度c = v_ref * kappa对误差的作用(与A矩阵同一误差定义):
+        D = [0.0, v - (l_r * c_r - l_f * c_f) / m / v, 0.0, (l_f^2 * c_f + l_r^2 * c_r) / i_z / v]^T
+        与B相同, 离散化 D_d = D * dt
+        */
+        LqrController::StateVector LqrController::PreviewDisturbance(
+            const double v) const
+        {
+            StateVector matrix_d = StateVector::Zero();
+            matrix_d(1) = v - matrix_a_coeff_(1, 3) / v;
+            matrix_d(3) = -matrix_a_coeff_(3, 3) / v;
+            return matrix_d * ts_;
+        }
+
+        void LqrController::ComputePreviewGain(const StateMatrix &A,
+                                               const ControlMatrix &B,
+                                               const StateVector &D,
+                                               const StateMatrix &P,
+                                               const GainMatrix &K,
+                                               double *preview_gain) const
+        {
+            // 单输入: G = (R + B'PB)^-1 是标量
+            const double gain =
+                1.0 / (matrix_r_(0, 0) + (B.transpose() * P * B)(0, 0));
+            const StateMatrix closed_loop_t = (A - B * K).transpose();
+            const StateVector b_gain = gain * B;
+            // m_0 = P D, m_j = (A - BK)' m_(j-1) = P_xc e_(j-1)
+            StateVector m = P * D;
+            for (int j = 0; j < preview_steps_; ++j)
+            {
+                preview_gain[j] = b_gain.dot(m);
+                m = closed_loop_t * m;
+            }
+        }
+
+        // 从弧长s起按当前车速前推, 第j个点在s + j * v * dt处
+        void LqrController::SamplePreview(const double s, const double v)
+        {
+            // 等弧长采样的参考线, 每个预瞄点O(1)查找; 轨迹末端之后保持最后一个点
+            const ArcLengthReferenceLine &station_line = trajectory_->station_line();
+            for (int j = 0; j < preview_steps_; ++j)
+            {
+                const StationPoint point = station_line.at(s + j * v * ts_);
+                preview_heading_rate_(j) = point.v * point.kappa;
+            }
+        }
+
+        std::vector<double> LqrController::GainModelKey() const
+        {
+            std::vector<double> key = {ts_, cf_, cr_, mass_, lf_, lr_, iz_};
+            key.insert(key.end(), matrix_q_.data(),
+                       matrix_q_.data() + matrix_q_.size());
+            key.insert(key.end(), matrix_r_.data(),
+                       matrix_r_.data() + matrix_r_.size());
+            if (enable_look_ahead_back_control_)
+            {
+                key.push_back(preview_steps_);
+            }
+            return key;
+        }
+
+        // 在车速网格上预先求解增益表, 运行时按车速插值
+        bool LqrController::EnableGainSchedule(const double v_step,
+                                               const double v_max,
+                                               const std::string &table_path)
+        {
+            const std::vector<double> key = GainModelKey();
+            LqrGainSchedule::Config config;
+            config.v_min = minimum_speed_protection_;
+            config.v_max = v_max;
+            config.v_step = v_step;
+
+            // 缓存表与当前模型、权重和网格一致时直接加载, 跳过求解
+            LqrGainSchedule cached;
+            gain_schedule_loaded_ =
+                !table_path.empty() && cached.Load(table_path, key) &&
+                cached.config().v_min == config.v_min &&
+                cached.config().v_step == config.v_step &&
+                cached.config().v_max >= config.v_max &&
+                cached.rows() == kControlSize && cached.cols() == kStateSize + preview_steps_;
+            if (gain_schedule_loaded_)
+            {
+                gain_schedule_ = cached;
+            }
+            else
+            {
+                const LqrGainSchedule::GainSolver solver =
+                    [this](const double v, Matrix *K)
+                { return SolveGainAtSpeed(v, K); };
+                if (!gain_schedule_.Build(config, solver, key))
+                {
+                    std::cout << "LQR gain schedule: failed to build the table"
+                              << std::endl;
+                    enable_gain_schedule_ = false;
+                    return false;
+                }
+                if (!table_path.empty() && !gain_schedule_.Save(table_path))
+                {
+                    std::cout << "LQR gain schedule: failed to write " << table_path
+                              << std::endl;
+                }
+            }
+            enable_gain_schedule_ = true;
+            return true;
+        }
+
+        LqrGainSchedule::ErrorReport LqrController::EvaluateGainSchedule(
+            const std::size_t samples_per_cell)
+        {
+            const LqrGainSchedule::GainSolver solver =
+                [this](const double v, Matrix *K)
+            { return SolveGainAtSpeed(v, K); };
+            return gain_schedule_.Evaluate(solver, samples_per_cell);
         }
 
     } // namespace control
@@ -7,7 +7,16 @@
 
 #include "lqr_controller_node.h"
 LQRControllerNode::LQRControllerNode() : pnh_("~") {}
-LQRControllerNode::~LQRControllerNode() {}
+LQRControllerNode::~LQRControllerNode() {
+  if (roadmapThread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(roadmapMutex_);
+      roadmapRunning_ = false;
+    }
+    roadmapWake_.notify_one();
+    roadmapThread_.join();
+  }
+}
 bool LQRControllerNode::init() {
   std::string vehicle_odom_topic;
   std::string vehicle_cmd_topic;
@@ -15,6 +24,13 @@ bool LQRControllerNode::init() {
   std::string path_vis_topic;
   std::string frame_id;
   double speed_P, speed_I, speed_D, target_speed, vis_frequency;
+  bool use_gain_schedule = false;
+  double gain_schedule_resolution = 0.25;
+  double gain_schedule_v_max = 30.0;
+  std::string gain_schedule_path;
+  std::string lqr_solver = "fixed_point";
+  bool lqr_warm_start = false;
+  int lqr_preview_steps = 0;
   pnh_.getParam("vehicle_odom_topic",
                 vehicle_odom_topic);  //读取车辆定位的topic名
   pnh_.getParam("vehicle_cmd_topic",
@@ -29,6 +45,25 @@ bool LQRControllerNode::init() {
   pnh_.getParam("control_frequency", controlFrequency_);  //读取控制的频率
   pnh_.getParam("vis_frequency", vis_frequency);  //读取路网显示的频率
   pnh_.getParam("frame_id", frame_id);            //读取全局坐标系名
+  pnh_.getParam("use_gain_schedule", use_gain_schedule);  //是否使用增益表
+  pnh_.getParam("gain_schedule_resolution",
+                gain_schedule_resolution);  //增益表的车速分辨率
+  pnh_.getParam("gain_schedule_v_max", gain_schedule_v_max);  //增益表最高车速
+  pnh_.getParam("gain_schedule_path", gain_schedule_path);  //增益表缓存文件
+  pnh_.getParam("lqr_solver", lqr_solver);  // Riccati求解器: fixed_point/doubling
+  pnh_.getParam("lqr_warm_start", lqr_warm_start);  //用上一周期的P作为初值
+  pnh_.getParam("lqr_preview_steps",
+                lqr_preview_steps);  //预瞄的控制周期数, 0为曲率前馈
+  pnh_.getParam("roadmap_streaming", roadmapStreaming_);  //流式读取路网
+  pnh_.getParam("roadmap_window_behind",
+                roadmapWindowBehind_);  //车辆后方保留的路线长度
+  pnh_.getParam("roadmap_window_ahead",
+                roadmapWindowAhead_);  //车辆前方读入的路线长度
+  pnh_.getParam("roadmap_window_points",
+                roadmapWindowPoints_);  //窗口最多容纳的点数
+  frameId_ = frame_id;
+  //预瞄按弧长采样参考线, 只有此时快照才需要等弧长参考线
+  roadmapStationLine_ = lqr_preview_steps > 0;
 
   //加载路网文件
   if (!loadRoadmap(roadmap_path, target_speed)) return false;
@@ -39,6 +74,34 @@ bool LQRControllerNode::init() {
   lqrController_ = std::shared_ptr<LqrController>(new LqrController());
   lqrController_->LoadControlConf();
   lqrController_->Init();
+  lqrController_->SetRiccatiSolver(lqr_solver == "doubling"
+                                       ? RiccatiMethod::kDoubling
+                                       : RiccatiMethod::kFixedPoint,
+                                   lqr_warm_start);
+  //预瞄需在增益表之前设置, 增益表中同时存K和K_c
+  if (!lqrController_->EnablePreview(lqr_preview_steps)) {
+    return false;
+  }
+  if (lqr_preview_steps > 0) {
+    ROS_INFO("lqr preview: %d steps (%.2f s)", lqr_preview_steps,
+             lqr_preview_steps / controlFrequency_);
+  }
+  if (use_gain_schedule) {
+    //预先在车速网格上求解LQR增益, 缓存文件有效时直接加载
+    if (!lqrController_->EnableGainSchedule(gain_schedule_resolution,
+                                            gain_schedule_v_max,
+                                            gain_schedule_path)) {
+      return false;
+    }
+    const LqrGainSchedule &schedule = lqrController_->gain_schedule();
+    if (lqrController_->gain_schedule_loaded()) {
+      ROS_INFO("lqr gain schedule: %zu points loaded from %s",
+               schedule.num_points(), gain_schedule_path.c_str());
+    } else {
+      ROS_INFO("lqr gain schedule: %zu points solved in %.1f ms",
+               schedule.num_points(), schedule.build_time_ms());
+    }
+  }
   roadmapMarkerPtr_ =
       std::shared_ptr<RosVizTools>(new RosVizTools(nh_, path_vis_topic));
 
@@ -59,9 +122,16 @@ bool LQRControllerNode::init() {
   controlTimer_ = nh_.createTimer(ros::Duration(1 / controlFrequency_),
                                   &LQRControllerNode::controlTimerLoop,
                                   this);  //这侧控制线程
-  addRoadmapMarker(planningPublishedTrajectory_.trajectory_points, frame_id);
-  goalPoint_ =
-      planningPublishedTrajectory_.trajectory_points.back();  //确定目标点
+  const TrajectorySnapshotPtr roadmap = trajectoryChannel_.Latest();
+  addRoadmapMarker(roadmap->points(), frame_id);
+  if (!roadmapStreaming_ || roadmapEnd_) {
+    goalPoint_ = roadmap->points().back();  //确定目标点
+    goalKnown_ = true;
+  } else {
+    //之后的窗口由读取线程更新
+    roadmapRunning_ = true;
+    roadmapThread_ = std::thread(&LQRControllerNode::roadmapStreamLoop, this);
+  }
   ROS_INFO("lqr_control_node init finish!");
   return true;
 }
@@ -109,6 +179,12 @@ void LQRControllerNode::odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
 
 bool LQRControllerNode::loadRoadmap(const std::string& roadmap_path,
                                     const double target_speed) {
+  if (roadmapStreaming_) {
+    return openRoadmapStream(roadmap_path, target_speed);
+  }
+  if (CompiledRoadmap::IsCompiled(roadmap_path)) {
+    return loadCompiledRoadmap(roadmap_path, target_speed);
+  }
   // 读取参考线路径
   std::ifstream infile;
   infile.open(roadmap_path);  //将文件流对象与文件连接起来
@@ -145,8 +221,204 @@ bool LQRControllerNode::loadRoadmap(const std::string& roadmap_path,
     trajectory_pt.kappa = kappas[i];
     planningPublishedTrajectory_.trajectory_points.push_back(trajectory_pt);
   }
+
+  //构建不可变的轨迹快照(含空间索引)并发布, 控制线程按版本号取用;
+  //轨迹点移入快照, 之后只经由快照访问
+  trajectoryChannel_.Publish(TrajectorySnapshot::Create(
+      std::move(planningPublishedTrajectory_.trajectory_points), true,
+      roadmapStationLine_));
+  const TrajectorySpatialIndex::BuildStats &index_stats =
+      trajectoryChannel_.Latest()->spatial_index()->stats();
+  ROS_INFO("spatial index: %zu points, build %.3f ms, %.1f bytes/point",
+           index_stats.num_points, index_stats.build_time_ms,
+           index_stats.bytes_per_point);
   return true;
 }
+bool LQRControllerNode::loadCompiledRoadmap(const std::string& roadmap_path,
+                                            const double target_speed) {
+  const auto start = std::chrono::steady_clock::now();
+  CompiledRoadmap roadmap;
+  if (!roadmap.Open(roadmap_path)) {
+    ROS_ERROR("%s", roadmap.error().c_str());
+    return false;
+  }
+  //点直接读入快照, s与dkappa取文件中的列; 文件中没有空间索引时在此构建
+  trajectoryChannel_.Publish(
+      roadmap.Snapshot(target_speed, roadmapStationLine_));
+  ROS_INFO("compiled roadmap: %zu points, %zu bytes, %s spatial index, "
+           "loaded in %.3f ms",
+           roadmap.size(), roadmap.file_bytes(),
+           roadmap.has_spatial_index() ? "stored" : "built",
+           std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count());
+  return true;
+}
+
+bool LQRControllerNode::openRoadmapStream(const std::string& roadmap_path,
+                                          const double target_speed) {
+  //编译好的路网只映射文件, 读到哪一段才载入哪一段
+  roadmapCursor_ = 0;
+  if (CompiledRoadmap::IsCompiled(roadmap_path)) {
+    if (!roadmapCompiled_.Open(roadmap_path)) {
+      ROS_ERROR("%s", roadmapCompiled_.error().c_str());
+      return false;
+    }
+  } else {
+    roadmapFile_.open(roadmap_path);
+    if (!roadmapFile_.is_open()) {
+      return false;
+    }
+  }
+  streamingLine_ = std::unique_ptr<StreamingReferenceLine>(
+      new StreamingReferenceLine(roadmapWindowPoints_));
+  routeId_ = TrajectorySnapshot::NewRouteId();
+  roadmapSpeed_ = target_speed;
+  roadmapEnd_ = false;
+  //读入起点前方的第一个窗口
+  double x = 0.0;
+  double y = 0.0;
+  while (!streamingLine_->full() &&
+         (streamingLine_->size() < 2 ||
+          streamingLine_->s(streamingLine_->size() - 1) <
+              roadmapWindowAhead_) &&
+         readRoadmapPoint(&x, &y)) {
+    streamingLine_->Append(x, y);
+  }
+  if (streamingLine_->size() < 2) {
+    return false;
+  }
+  publishRoadmapWindow();
+  ROS_INFO("roadmap streaming: window of %zu points, %zu bytes",
+           streamingLine_->capacity(), streamingLine_->MemoryBytes());
+  return true;
+}
+
+bool LQRControllerNode::readRoadmapPoint(double* x, double* y) {
+  if (roadmapCompiled_.is_open()) {
+    if (roadmapCursor_ < roadmapCompiled_.size()) {
+      *x = roadmapCompiled_.x()[roadmapCursor_];
+      *y = roadmapCompiled_.y()[roadmapCursor_];
+      ++roadmapCursor_;
+      return true;
+    }
+    roadmapEnd_ = true;
+    return false;
+  }
+  std::string s, word_x, word_y;
+  while (getline(roadmapFile_, s)) {
+    std::stringstream word(s);
+    if (word >> word_x >> word_y) {
+      *x = std::atof(word_x.c_str());
+      *y = std::atof(word_y.c_str());
+      return true;
+    }
+  }
+  roadmapEnd_ = true;
+  return false;
+}
+
+void LQRControllerNode::requestRoadmapWindow() {
+  const TrajectorySnapshotPtr& snapshot = planningPublishedTrajectory_.snapshot;
+  if (snapshot == nullptr || snapshot->empty()) {
+    return;
+  }
+  const std::uint64_t last_version = roadmapLastVersion_.load();
+  if (last_version != 0) {
+    //已取用含终点的窗口后确定目标点
+    if (!goalKnown_ && snapshot->version() == last_version) {
+      goalPoint_ = snapshot->points().back();
+      goalKnown_ = true;
+    }
+    return;
+  }
+  //车辆在路线上的弧长: 取控制器上一周期匹配所用的窗口, 此时快照可能已换成新窗口
+  const double s_vehicle = lqrController_->matched_route_s();
+  //前方剩余不到一半时才请求, 避免每个周期重建快照
+  const double s_back =
+      snapshot->window().s_offset + snapshot->soa().accumulated_s().back();
+  if (s_back - s_vehicle >= 0.5 * roadmapWindowAhead_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(roadmapMutex_);
+    roadmapRequested_ = true;
+    roadmapVehicleS_ = s_vehicle;
+  }
+  roadmapWake_.notify_one();
+}
+
+void LQRControllerNode::roadmapStreamLoop() {
+  std::unique_lock<std::mutex> lock(roadmapMutex_);
+  while (roadmapRunning_ && !roadmapEnd_) {
+    roadmapWake_.wait(lock,
+                      [this] { return !roadmapRunning_ || roadmapRequested_; });
+    if (!roadmapRunning_) {
+      break;
+    }
+    //只处理最新的请求, 更新时不持锁
+    const double s_vehicle = roadmapVehicleS_;
+    roadmapRequested_ = false;
+    lock.unlock();
+    updateRoadmapWindow(s_vehicle);
+    lock.lock();
+  }
+}
+
+void LQRControllerNode::updateRoadmapWindow(const double s_vehicle) {
+  StreamingReferenceLine& line = *streamingLine_;
+  const double s_back = line.s(line.size() - 1);
+  if (roadmapEnd_ || s_back - s_vehicle >= 0.5 * roadmapWindowAhead_) {
+    return;
+  }
+
+  std::size_t retire = 0;
+  while (retire < line.size() &&
+         line.s(retire) < s_vehicle - roadmapWindowBehind_) {
+    ++retire;
+  }
+  bool changed = line.Retire(retire) > 0;
+  double x = 0.0;
+  double y = 0.0;
+  while (line.s(line.size() - 1) < s_vehicle + roadmapWindowAhead_) {
+    if (line.full()) {
+      ROS_WARN_THROTTLE(1.0,
+                        "roadmap streaming: window of %zu points is full, "
+                        "increase roadmap_window_points",
+                        line.capacity());
+      break;
+    }
+    if (!readRoadmapPoint(&x, &y)) {
+      break;
+    }
+    changed = line.Append(x, y) || changed;
+  }
+  if (changed || roadmapEnd_) {
+    publishRoadmapWindow();
+  }
+}
+
+void LQRControllerNode::publishRoadmapWindow() {
+  const StreamingReferenceLine& line = *streamingLine_;
+  //窗口的点直接移入快照, 控制线程持有的轨迹数据不被改动
+  std::vector<TrajectoryPoint> points;
+  line.Window(roadmapSpeed_, &points);
+  TrajectoryWindow window;
+  window.route_id = routeId_;
+  window.first_index = line.first_index();
+  window.s_offset = line.s(0);
+  const TrajectorySnapshotPtr snapshot = TrajectorySnapshot::Create(
+      std::move(points), true, roadmapStationLine_, window);
+  trajectoryChannel_.Publish(snapshot);
+  if (roadmapEnd_) {
+    roadmapLastVersion_.store(snapshot->version());
+  }
+  if (roadmapMarkerPtr_ != nullptr) {
+    std::lock_guard<std::mutex> lock(roadmapMarkerMutex_);
+    addRoadmapMarker(snapshot->points(), frameId_);
+  }
+}
+
 void LQRControllerNode::addRoadmapMarker(
     const std::vector<TrajectoryPoint>& path, const std::string& frame_id) {
   roadmapMarkerPtr_->clear();
@@ -160,28 +432,53 @@ void LQRControllerNode::addRoadmapMarker(
     p.z = 0;
     marker_linestrip.points.push_back(p);
   }
-  std::cout << "path size is " << marker_linestrip.points.size() << std::endl;
   roadmapMarkerPtr_->append(marker_linestrip);
   return;
 }
 void LQRControllerNode::visTimerLoop(const ros::TimerEvent&) {
   // std::cout << "publish path vis " << std::endl;
-  roadmapMarkerPtr_->publish();
+  //读取线程正在重建marker时跳过本次发布, 不阻塞定时器回调
+  std::unique_lock<std::mutex> lock(roadmapMarkerMutex_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    roadmapMarkerPtr_->publish();
+  }
 }
 void LQRControllerNode::controlTimerLoop(const ros::TimerEvent&) {
   ControlCmd cmd;
   if (!firstRecord_) {  //有定位数据开始控制
 
     //小于容忍距离，车辆速度设置为0
-    if (pointDistance(goalPoint_, vehicleState_.x, vehicleState_.y) <
-        goalTolerance_) {
+    if (goalKnown_ &&
+        pointDistance(goalPoint_, vehicleState_.x, vehicleState_.y) <
+            goalTolerance_) {
       targetSpeed_ = 0;
       isReachGoal_ = true;
     }
 
+    //有新轨迹发布时才取用新快照, 旧快照由引用计数释放
+    const TrajectorySnapshotPtr &snapshot = planningPublishedTrajectory_.snapshot;
+    if (snapshot == nullptr ||
+        snapshot->version() != trajectoryChannel_.version()) {
+      planningPublishedTrajectory_.snapshot = trajectoryChannel_.Latest();
+    }
+
+    //流式模式只把车辆弧长交给读取线程, 窗口在那里更新
+    if (roadmapStreaming_) {
+      requestRoadmapWindow();
+    }
+
     if (!isReachGoal_) {
       lqrController_->ComputeControlCommand(vehicleState_,
                                             planningPublishedTrajectory_, cmd);
+      //统计Riccati求解的最坏耗时, 用于核对控制周期的时间预算
+      const RiccatiStats &stats = lqrController_->riccati_stats();
+      maxRiccatiTimeUs_ = std::max(maxRiccatiTimeUs_, stats.solve_time_us);
+      ROS_INFO_THROTTLE(1.0,
+                        "riccati: %d iterations, residual %.2e, %.1f us "
+                        "(max %.1f us, %zu not converged)",
+                        stats.iterations, stats.residual, stats.solve_time_us,
+                        maxRiccatiTimeUs_,
+                        lqrController_->riccati_failure_count());
     }
 
     carla_msgs::CarlaEgoVehicleControl control_cmd;
@@ -0,0 +1,224 @@
+#include "lqr_gain_schedule.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+const char kMagic[8] = {'L', 'Q', 'R', 'G', 'A', 'I', 'N', 'S'};
+const std::uint32_t kFormatVersion = 1;
+
+template <typename T>
+void WritePod(std::ofstream *out, const T &value) {
+  out->write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool ReadPod(std::ifstream *in, T *value) {
+  return static_cast<bool>(
+      in->read(reinterpret_cast<char *>(value), sizeof(T)));
+}
+
+}  // namespace
+
+bool LqrGainSchedule::Build(const Config &config, const GainSolver &solver,
+                            const std::vector<double> &model_key) {
+  if (!(config.v_step > 0.0) || !(config.v_max >= config.v_min)) {
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const std::size_t num_points =
+      static_cast<std::size_t>(
+          std::ceil((config.v_max - config.v_min) / config.v_step - 1e-9)) +
+      1;
+
+  std::vector<double> gains;
+  Eigen::MatrixXd K;
+  int rows = 0;
+  int cols = 0;
+  for (std::size_t i = 0; i < num_points; ++i) {
+    const double v = config.v_min + static_cast<double>(i) * config.v_step;
+    if (!solver(v, &K) || K.size() == 0) {
+      return false;
+    }
+    if (i == 0) {
+      rows = static_cast<int>(K.rows());
+      cols = static_cast<int>(K.cols());
+      gains.reserve(num_points * K.size());
+    } else if (K.rows() != rows || K.cols() != cols) {
+      return false;
+    }
+    gains.insert(gains.end(), K.data(), K.data() + K.size());
+  }
+
+  config_ = config;
+  // 最后一个格点可能略超出 v_max, 以实际格点为准
+  config_.v_max =
+      config.v_min + static_cast<double>(num_points - 1) * config.v_step;
+  model_key_ = model_key;
+  num_points_ = num_points;
+  rows_ = rows;
+  cols_ = cols;
+  inv_step_ = 1.0 / config.v_step;
+  gains_.swap(gains);
+  build_time_ms_ = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return true;
+}
+
+bool LqrGainSchedule::Lookup(const double v, Eigen::MatrixXd *K) const {
+  if (gains_.empty()) {
+    return false;
+  }
+  if (K->rows() != rows_ || K->cols() != cols_) {
+    K->resize(rows_, cols_);
+  }
+  return Lookup(v, K->data());
+}
+
+bool LqrGainSchedule::Lookup(const double v, double *K) const {
+  if (gains_.empty()) {
+    return false;
+  }
+  const std::size_t size = static_cast<std::size_t>(rows_) * cols_;
+  const double position =
+      (std::min(std::max(v, config_.v_min), config_.v_max) - config_.v_min) *
+      inv_step_;
+  const std::size_t i =
+      std::min(static_cast<std::size_t>(position), num_points_ - 1);
+  const double *k0 = gains_.data() + i * size;
+  if (i + 1 == num_points_) {
+    std::copy(k0, k0 + size, K);
+    return true;
+  }
+  const double *k1 = k0 + size;
+  const double ratio = position - static_cast<double>(i);
+  for (std::size_t j = 0; j < size; ++j) {
+    K[j] = k0[j] + ratio * (k1[j] - k0[j]);
+  }
+  return true;
+}
+
+LqrGainSchedule::ErrorReport LqrGainSchedule::Evaluate(
+    const GainSolver &solver, const std::size_t samples_per_cell) const {
+  ErrorReport report;
+  if (gains_.empty() || num_points_ < 2) {
+    return report;
+  }
+  Eigen::MatrixXd K_exact;
+  Eigen::MatrixXd K_table;
+  double rel_error_sum = 0.0;
+  for (std::size_t i = 0; i + 1 < num_points_; ++i) {
+    for (std::size_t k = 1; k <= samples_per_cell; ++k) {
+      const double v =
+          config_.v_min + (static_cast<double>(i) +
+                           static_cast<double>(k) / (samples_per_cell + 1)) /
+                              inv_step_;
+      if (!solver(v, &K_exact) || !Lookup(v, &K_table)) {
+        continue;
+      }
+      const double abs_error = (K_table - K_exact).cwiseAbs().maxCoeff();
+      const double norm = K_exact.norm();
+      const double rel_error =
+          norm > 0.0 ? (K_table - K_exact).norm() / norm : 0.0;
+      report.max_abs_error = std::max(report.max_abs_error, abs_error);
+      if (rel_error > report.max_rel_error) {
+        report.max_rel_error = rel_error;
+        report.worst_v = v;
+      }
+      rel_error_sum += rel_error;
+      ++report.num_samples;
+    }
+  }
+  if (report.num_samples > 0) {
+    report.mean_rel_error = rel_error_sum / report.num_samples;
+  }
+  return report;
+}
+
+// layout: magic, format version, v_min, v_step, num_points, rows, cols,
+// key size, key, gains. Native byte order, the file is a local cache.
+bool LqrGainSchedule::Save(const std::string &path) const {
+  if (gains_.empty()) {
+    return false;
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  out.write(kMagic, sizeof(kMagic));
+  WritePod(&out, kFormatVersion);
+  WritePod(&out, config_.v_min);
+  WritePod(&out, config_.v_step);
+  WritePod(&out, static_cast<std::uint64_t>(num_points_));
+  WritePod(&out, static_cast<std::int32_t>(rows_));
+  WritePod(&out, static_cast<std::int32_t>(cols_));
+  WritePod(&out, static_cast<std::uint64_t>(model_key_.size()));
+  out.write(reinterpret_cast<const char *>(model_key_.data()),
+            model_key_.size() * sizeof(double));
+  out.write(reinterpret_cast<const char *>(gains_.data()),
+            gains_.size() * sizeof(double));
+  return static_cast<bool>(out);
+}
+
+bool LqrGainSchedule::Load(const std::string &path,
+                           const std::vector<double> &model_key) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    return false;
+  }
+  char magic[sizeof(kMagic)];
+  std::uint32_t format_version = 0;
+  Config config;
+  std::uint64_t num_points = 0;
+  std::int32_t rows = 0;
+  std::int32_t cols = 0;
+  std::uint64_t key_size = 0;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !ReadPod(&in, &format_version) || format_version != kFormatVersion ||
+      !ReadPod(&in, &config.v_min) || !ReadPod(&in, &config.v_step) ||
+      !ReadPod(&in, &num_points) || !ReadPod(&in, &rows) ||
+      !ReadPod(&in, &cols) || !ReadPod(&in, &key_size)) {
+    return false;
+  }
+  if (num_points == 0 || rows <= 0 || cols <= 0 || !(config.v_step > 0.0) ||
+      key_size != model_key.size()) {
+    return false;
+  }
+  std::vector<double> key(key_size);
+  std::vector<double> gains(num_points * rows * cols);
+  if (!in.read(reinterpret_cast<char *>(key.data()),
+               key.size() * sizeof(double)) ||
+      !in.read(reinterpret_cast<char *>(gains.data()),
+               gains.size() * sizeof(double))) {
+    return false;
+  }
+  // 模型参数或权重变化后旧表作废
+  if (key != model_key) {
+    return false;
+  }
+
+  config.v_max =
+      config.v_min + static_cast<double>(num_points - 1) * config.v_step;
+  config_ = config;
+  model_key_.swap(key);
+  num_points_ = num_points;
+  rows_ = rows;
+  cols_ = cols;
+  inv_step_ = 1.0 / config.v_step;
+  gains_.swap(gains);
+  build_time_ms_ = 0.0;
+  return true;
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,113 @@
+/**
+ * Builds the velocity-scheduled LQR gain table for the controller's vehicle
+ * model and weights, and reports for several grid resolutions: build time,
+ * table size, interpolation error against the exact Riccati solve, and the
+ * per-cycle cost of an exact solve versus a table lookup. With an output
+ * path the table at the chosen resolution is written there, ready to be
+ * loaded by the node through the gain_schedule_path parameter.
+ *
+ * usage: lqr_gain_table [v_step] [v_max] [output.bin]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "lqr_controller.h"
+
+using shenlan::control::LqrController;
+using shenlan::control::LqrGainSchedule;
+using shenlan::control::Matrix;
+
+namespace {
+
+class GainTableTool : public LqrController {
+ public:
+  GainTableTool() {
+    LoadControlConf();
+    Init();
+  }
+
+  void Report(const double v_step, const double v_max) {
+    if (!EnableGainSchedule(v_step, v_max, "")) {
+      std::cout << "failed to build table with step " << v_step << std::endl;
+      return;
+    }
+    const LqrGainSchedule::ErrorReport report = EvaluateGainSchedule();
+
+    // exact solve versus lookup, sweeping the speed range like a drive would
+    const int cycles = 200;
+    Matrix K = Matrix::Zero(1, basic_state_size_);
+    double checksum = 0.0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < cycles; ++k) {
+      SolveGainAtSpeed(v_max * k / cycles, &K);
+      checksum += K(0, 0);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    const int lookups = 1000000;
+    GainMatrix gain = GainMatrix::Zero();
+    for (int k = 0; k < lookups; ++k) {
+      gain_schedule().Lookup(v_max * (k % 1000) / 1000.0, gain.data());
+      checksum += gain(0, 0);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    const double solve_us =
+        std::chrono::duration<double, std::micro>(t1 - t0).count() / cycles;
+    const double lookup_ns =
+        std::chrono::duration<double, std::nano>(t2 - t1).count() / lookups;
+
+    std::cout << std::setw(8) << std::fixed << std::setprecision(2) << v_step
+              << std::setw(8) << gain_schedule().num_points() << std::setw(12)
+              << std::setprecision(1) << gain_schedule().build_time_ms()
+              << std::setw(10)
+              << gain_schedule().num_points() * basic_state_size_ *
+                     sizeof(double)
+              << std::setw(12) << std::scientific << std::setprecision(2)
+              << report.max_abs_error << std::setw(12) << report.max_rel_error
+              << std::setw(12) << report.mean_rel_error << std::setw(8)
+              << std::fixed << std::setprecision(2) << report.worst_v
+              << std::setw(12) << std::setprecision(1) << solve_us
+              << std::setw(10) << lookup_ns << "  ("
+              << (checksum != 0.0) << ")" << std::endl;
+  }
+
+  bool Write(const double v_step, const double v_max,
+             const std::string &path) {
+    return EnableGainSchedule(v_step, v_max, "") &&
+           gain_schedule().Save(path);
+  }
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const double v_step = argc > 1 ? std::atof(argv[1]) : 0.25;
+  const double v_max = argc > 2 ? std::atof(argv[2]) : 30.0;
+  GainTableTool tool;
+
+  std::cout << "gain table over [0.1, " << v_max << "] m/s" << std::endl;
+  std::cout << std::setw(8) << "step" << std::setw(8) << "points"
+            << std::setw(12) << "build ms" << std::setw(10) << "bytes"
+            << std::setw(12) << "max abs" << std::setw(12) << "max rel"
+            << std::setw(12) << "mean rel" << std::setw(8) << "worst v"
+            << std::setw(12) << "solve us" << std::setw(10) << "lookup ns"
+            << std::endl;
+  const double steps[] = {2.0, 1.0, 0.5, 0.25, 0.1};
+  for (const double step : steps) {
+    tool.Report(step, v_max);
+  }
+  if (argc > 1) {
+    tool.Report(v_step, v_max);
+  }
+
+  if (argc > 3) {
+    if (!tool.Write(v_step, v_max, argv[3])) {
+      std::cout << "fail to write " << argv[3] << std::endl;
+      return -1;
+    }
+    std::cout << "table written to " << argv[3] << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,391 @@
+/**
+ * Per-cycle cost of the LQR Riccati solve over a simulated drive (100 Hz,
+ * speed ramping up to 15 m/s, cruising with small oscillations, braking to
+ * a stop). Compares the cold-started fixed-point iteration, the
+ * warm-started fixed-point iteration and the doubling solver: iterations,
+ * solve time percentiles, worst residual, solves that did not converge and
+ * the largest gain deviation from a converged reference solve. A second
+ * table runs the whole per-cycle computation (A update, discretization,
+ * Riccati solve, feedback) on the compile-time 4x1 matrices the controller
+ * uses and on runtime-sized MatrixXd.
+ *
+ * A third table covers the preview LQR for a range of preview lengths: the
+ * per-cycle time of the controller's gain computation (4x4 Riccati solve
+ * plus the shift-register recursion for K_c), the recursion alone, the time
+ * of the augmented (4 + N)-state Riccati solve it replaces, the largest
+ * difference of K and K_c from that solve, and the largest lateral error
+ * entering a 30 m radius curve at 10 m/s on the discrete error model (N = 0
+ * is the curvature feedforward the controller uses without preview).
+ *
+ * usage: lqr_riccati_benchmark
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Eigen/LU"
+#include "lqr_controller.h"
+
+using shenlan::control::LqrController;
+using shenlan::control::Matrix;
+using shenlan::control::RiccatiMethod;
+using shenlan::control::RiccatiOptions;
+using shenlan::control::RiccatiStats;
+
+namespace {
+
+std::vector<double> SpeedProfile() {
+  std::vector<double> speeds;
+  const double dt = 0.01;
+  for (double t = 0.0; t < 60.0; t += dt) {
+    double v = 0.0;
+    if (t < 20.0) {
+      v = 15.0 * t / 20.0;
+    } else if (t < 50.0) {
+      v = 15.0 + 0.5 * std::sin(t);
+    } else {
+      v = 15.0 * (60.0 - t) / 10.0;
+    }
+    speeds.push_back(v);
+  }
+  return speeds;
+}
+
+// lateral model with N states and M controls, fixed size or Eigen::Dynamic
+template <int N, int M>
+struct LateralModel {
+  Eigen::Matrix<double, N, N> a;
+  Eigen::Matrix<double, N, N> a_coeff;
+  Eigen::Matrix<double, N, M> bd;
+  Eigen::Matrix<double, N, N> q;
+  Eigen::Matrix<double, M, M> r;
+  Eigen::Matrix<double, N, 1> state;
+};
+
+struct CycleReport {
+  double mean_us = 0.0;
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double checksum = 0.0;
+};
+
+// 每个周期: 更新A, Tustin离散化, 求解Riccati, 计算反馈 u = -K x
+template <int N, int M>
+CycleReport RunCycles(LateralModel<N, M> model, const double ts,
+                      const RiccatiOptions &options, const bool warm_start,
+                      const double min_speed,
+                      const std::vector<double> &speeds) {
+  typedef Eigen::Matrix<double, N, N> MatrixNN;
+  const int n = static_cast<int>(model.a.rows());
+  const MatrixNN I = MatrixNN::Identity(n, n);
+  MatrixNN ad(n, n);
+  MatrixNN P = model.q;
+  Eigen::Matrix<double, M, N> K(model.r.rows(), n);
+  RiccatiStats stats;
+  CycleReport report;
+  std::vector<double> times;
+  times.reserve(speeds.size());
+  for (std::size_t k = 0; k < speeds.size(); ++k) {
+    const auto start = std::chrono::steady_clock::now();
+    const double v = std::max(speeds[k], min_speed);
+    model.a(1, 1) = model.a_coeff(1, 1) / v;
+    model.a(1, 3) = model.a_coeff(1, 3) / v;
+    model.a(3, 1) = model.a_coeff(3, 1) / v;
+    model.a(3, 3) = model.a_coeff(3, 3) / v;
+    ad.noalias() =
+        (I - 0.5 * ts * model.a).inverse() * (I + 0.5 * ts * model.a);
+    const MatrixNN *P_init = warm_start && stats.converged ? &P : nullptr;
+    shenlan::control::SolveDiscreteRiccati(ad, model.bd, model.q, model.r,
+                                           options, P_init, &P, &K, &stats);
+    model.state(0) = 0.1 * std::sin(0.01 * k);
+    report.checksum += -(K * model.state)(0, 0);
+    times.push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+  }
+  std::vector<double> sorted = times;
+  std::sort(sorted.begin(), sorted.end());
+  for (const double t : times) {
+    report.mean_us += t;
+  }
+  report.mean_us /= times.size();
+  report.p50_us = sorted[sorted.size() / 2];
+  report.p99_us = sorted[sorted.size() * 99 / 100];
+  return report;
+}
+
+class RiccatiBenchmark : public LqrController {
+ public:
+  RiccatiBenchmark() {
+    LoadControlConf();
+    Init();
+  }
+
+  void Run(const std::string &name, const RiccatiMethod method,
+           const bool warm_start, const std::vector<double> &speeds) {
+    SetRiccatiSolver(method, warm_start);
+    riccati_failure_count_ = 0;
+    matrix_k_ = GainMatrix::Zero();
+    Matrix K_ref;
+    VehicleState state{};
+    std::vector<double> times;
+    times.reserve(speeds.size());
+    long total_iterations = 0;
+    int max_iterations = 0;
+    double max_residual = 0.0;
+    double max_gain_error = 0.0;
+    for (const double speed : speeds) {
+      // 与ComputeControlCommand相同的A矩阵更新、离散化和求解
+      const double v = std::max(speed, minimum_speed_protection_);
+      matrix_a_(1, 1) = matrix_a_coeff_(1, 1) / v;
+      matrix_a_(1, 3) = matrix_a_coeff_(1, 3) / v;
+      matrix_a_(3, 1) = matrix_a_coeff_(3, 1) / v;
+      matrix_a_(3, 3) = matrix_a_coeff_(3, 3) / v;
+      UpdateMatrix(state);
+      SolveLQRProblem(matrix_ad_, matrix_bd_, matrix_q_, matrix_r_, lqr_eps_,
+                      lqr_max_iteration_, &matrix_k_);
+
+      const RiccatiStats &stats = riccati_stats();
+      times.push_back(stats.solve_time_us);
+      total_iterations += stats.iterations;
+      max_iterations = std::max(max_iterations, stats.iterations);
+      max_residual = std::max(max_residual, stats.residual);
+      SolveGainAtSpeed(v, &K_ref);
+      max_gain_error =
+          std::max(max_gain_error, (matrix_k_ - K_ref).cwiseAbs().maxCoeff());
+    }
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (const double t : times) {
+      mean += t;
+    }
+    mean /= times.size();
+    std::cout << std::setw(14) << name << std::setw(10) << std::fixed
+              << std::setprecision(1)
+              << static_cast<double>(total_iterations) / speeds.size()
+              << std::setw(8) << max_iterations << std::setw(10) << mean
+              << std::setw(10) << sorted[sorted.size() / 2] << std::setw(10)
+              << sorted[sorted.size() * 99 / 100] << std::setw(10)
+              << sorted.back() << std::setw(12) << std::scientific
+              << std::setprecision(2) << max_residual << std::setw(8)
+              << riccati_failure_count() << std::setw(12) << max_gain_error
+              << std::endl;
+  }
+
+  // gain computation of the preview LQR against the augmented solve
+  void RunPreview(const int preview_steps, const std::vector<double> &speeds) {
+    SetRiccatiSolver(RiccatiMethod::kDoubling, false);
+    EnablePreview(preview_steps);
+    const int n = kStateSize + preview_steps;
+    VehicleState state{};
+    std::vector<double> times;
+    times.reserve(speeds.size());
+    double recursion_us = 0.0;
+    for (const double speed : speeds) {
+      const auto start = std::chrono::steady_clock::now();
+      const double v = std::max(speed, minimum_speed_protection_);
+      matrix_a_(1, 1) = matrix_a_coeff_(1, 1) / v;
+      matrix_a_(1, 3) = matrix_a_coeff_(1, 3) / v;
+      matrix_a_(3, 1) = matrix_a_coeff_(3, 1) / v;
+      matrix_a_(3, 3) = matrix_a_coeff_(3, 3) / v;
+      UpdateMatrix(state);
+      SolveLQRProblem(matrix_ad_, matrix_bd_, matrix_q_, matrix_r_, lqr_eps_,
+                      lqr_max_iteration_, &matrix_k_);
+      const auto recursion_start = std::chrono::steady_clock::now();
+      ComputePreviewGain(matrix_ad_, matrix_bd_, PreviewDisturbance(v),
+                         matrix_p_, matrix_k_, matrix_k_preview_.data());
+      const auto end = std::chrono::steady_clock::now();
+      recursion_us +=
+          std::chrono::duration<double, std::micro>(end - recursion_start)
+              .count();
+      times.push_back(
+          std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    // 增广系统 z = [x; c_0 .. c_(N-1)], c按移位寄存器前移, 只在部分车速上求解
+    double augmented_us = 0.0;
+    double max_gain_error = 0.0;
+    int augmented_solves = 0;
+    for (std::size_t k = 0; k < speeds.size(); k += speeds.size() / 50) {
+      const double v = std::max(speeds[k], minimum_speed_protection_);
+      Matrix K;
+      if (!SolveGainAtSpeed(v, &K)) {
+        continue;
+      }
+      matrix_a_(1, 1) = matrix_a_coeff_(1, 1) / v;
+      matrix_a_(1, 3) = matrix_a_coeff_(1, 3) / v;
+      matrix_a_(3, 1) = matrix_a_coeff_(3, 1) / v;
+      matrix_a_(3, 3) = matrix_a_coeff_(3, 3) / v;
+      UpdateMatrix(state);
+      Matrix A = Matrix::Zero(n, n);
+      A.topLeftCorner(kStateSize, kStateSize) = matrix_ad_;
+      if (preview_steps > 0) {
+        A.block(0, kStateSize, kStateSize, 1) = PreviewDisturbance(v);
+        for (int j = 0; j + 1 < preview_steps; ++j) {
+          A(kStateSize + j, kStateSize + j + 1) = 1.0;
+        }
+      }
+      Matrix B = Matrix::Zero(n, kControlSize);
+      B.topRows(kStateSize) = matrix_bd_;
+      Matrix Q = Matrix::Zero(n, n);
+      Q.topLeftCorner(kStateSize, kStateSize) = matrix_q_;
+      const Matrix R = matrix_r_;
+      RiccatiOptions options;
+      options.method = RiccatiMethod::kDoubling;
+      options.tolerance = 1e-9;
+      options.max_iterations = 100;
+      Matrix P;
+      Matrix K_augmented;
+      RiccatiStats stats;
+      shenlan::control::SolveDiscreteRiccati<Eigen::Dynamic, Eigen::Dynamic>(
+          A, B, Q, R, options, nullptr, &P, &K_augmented, &stats);
+      augmented_us += stats.solve_time_us;
+      ++augmented_solves;
+      max_gain_error = std::max(
+          max_gain_error, (K - K_augmented).cwiseAbs().maxCoeff());
+    }
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (const double t : times) {
+      mean += t;
+    }
+    mean /= times.size();
+    std::cout << std::setw(6) << preview_steps << std::setw(10) << std::fixed
+              << std::setprecision(2) << mean << std::setw(10)
+              << sorted[sorted.size() * 99 / 100] << std::setw(12)
+              << recursion_us / speeds.size() << std::setw(14)
+              << std::setprecision(1) << augmented_us / augmented_solves
+              << std::setw(12) << std::scientific << std::setprecision(2)
+              << max_gain_error << std::setw(12) << std::fixed
+              << std::setprecision(4) << CurveEntryError(10.0, 30.0)
+              << std::endl;
+    EnablePreview(0);
+  }
+
+  // the same cycle on compile-time and runtime-sized matrices
+  void RunSizes(const std::string &name, const RiccatiMethod method,
+                const bool warm_start, const std::vector<double> &speeds) {
+    RiccatiOptions options;
+    options.method = method;
+    options.tolerance = lqr_eps_;
+    options.max_iterations = lqr_max_iteration_;
+    const CycleReport fixed =
+        RunCycles(Model<kStateSize, kControlSize>(), ts_, options, warm_start,
+                  minimum_speed_protection_, speeds);
+    const CycleReport dynamic =
+        RunCycles(Model<Eigen::Dynamic, Eigen::Dynamic>(), ts_, options,
+                  warm_start, minimum_speed_protection_, speeds);
+    for (int k = 0; k < 2; ++k) {
+      const CycleReport &report = k == 0 ? fixed : dynamic;
+      std::cout << std::setw(14) << name << std::setw(10)
+                << (k == 0 ? "4x1" : "dynamic") << std::setw(10) << std::fixed
+                << std::setprecision(2) << report.mean_us << std::setw(10)
+                << report.p50_us << std::setw(10) << report.p99_us
+                << std::setw(10)
+                << dynamic.mean_us / report.mean_us << std::setw(14)
+                << std::scientific << std::setprecision(3)
+                << std::abs(report.checksum - fixed.checksum) << std::endl;
+    }
+  }
+
+ private:
+  // 直道以速度v进入半径radius的圆弧: 离散误差模型上的最大横向误差
+  double CurveEntryError(const double v, const double radius) {
+    matrix_a_(1, 1) = matrix_a_coeff_(1, 1) / v;
+    matrix_a_(1, 3) = matrix_a_coeff_(1, 3) / v;
+    matrix_a_(3, 1) = matrix_a_coeff_(3, 1) / v;
+    matrix_a_(3, 3) = matrix_a_coeff_(3, 3) / v;
+    VehicleState vehicle{};
+    vehicle.velocity = v;
+    UpdateMatrix(vehicle);
+    Matrix K;
+    SolveGainAtSpeed(v, &K);
+    matrix_k_ = K.leftCols(kStateSize);
+    matrix_k_preview_ = K.rightCols(preview_steps_);
+    const StateVector matrix_d = PreviewDisturbance(v);
+    const int entry = 100;
+    const auto heading_rate = [&](const int k) {
+      return k >= entry ? v / radius : 0.0;
+    };
+    const double max_steer_angle = 20.0 * M_PI / 180.0;
+    StateVector x = StateVector::Zero();
+    double max_error = 0.0;
+    for (int k = 0; k < 1000; ++k) {
+      double steer_angle = -(matrix_k_ * x)(0, 0);
+      if (enable_look_ahead_back_control_) {
+        for (int j = 0; j < preview_steps_; ++j) {
+          steer_angle -= matrix_k_preview_(j) * heading_rate(k + j);
+        }
+      } else {
+        steer_angle +=
+            1.3 * ComputeFeedForward(vehicle, heading_rate(k) / v);
+      }
+      steer_angle =
+          std::min(std::max(steer_angle, -max_steer_angle), max_steer_angle);
+      x = matrix_ad_ * x + matrix_bd_ * steer_angle +
+          matrix_d * heading_rate(k);
+      max_error = std::max(max_error, std::abs(x(0)));
+    }
+    return max_error;
+  }
+
+  template <int N, int M>
+  LateralModel<N, M> Model() const {
+    LateralModel<N, M> model;
+    model.a = matrix_a_;
+    model.a_coeff = matrix_a_coeff_;
+    model.bd = matrix_bd_;
+    model.q = matrix_q_;
+    model.r = matrix_r_;
+    model.state = StateVector::Zero();
+    return model;
+  }
+};
+
+}  // namespace
+
+int main() {
+  const std::vector<double> speeds = SpeedProfile();
+  RiccatiBenchmark benchmark;
+  std::cout << speeds.size() << " cycles" << std::endl;
+  std::cout << std::setw(14) << "solver" << std::setw(10) << "mean it"
+            << std::setw(8) << "max it" << std::setw(10) << "mean us"
+            << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "max us" << std::setw(12) << "residual"
+            << std::setw(8) << "failed" << std::setw(12) << "|K-K*|"
+            << std::endl;
+  benchmark.Run("fixed cold", RiccatiMethod::kFixedPoint, false, speeds);
+  benchmark.Run("fixed warm", RiccatiMethod::kFixedPoint, true, speeds);
+  benchmark.Run("doubling", RiccatiMethod::kDoubling, false, speeds);
+
+  std::cout << std::endl
+            << "per cycle: A update, discretization, Riccati, feedback"
+            << std::endl;
+  std::cout << std::setw(14) << "solver" << std::setw(10) << "matrices"
+            << std::setw(10) << "mean us" << std::setw(10) << "p50 us"
+            << std::setw(10) << "p99 us" << std::setw(10) << "speedup" << std::setw(14) << "|u-u_4x1|"
+            << std::endl;
+  benchmark.RunSizes("fixed warm", RiccatiMethod::kFixedPoint, true, speeds);
+  benchmark.RunSizes("doubling", RiccatiMethod::kDoubling, false, speeds);
+
+  std::cout << std::endl
+            << "preview: 4x4 Riccati and K_c recursion per cycle against the "
+               "augmented solve"
+            << std::endl;
+  std::cout << std::setw(6) << "N" << std::setw(10) << "mean us"
+            << std::setw(10) << "p99 us" << std::setw(12) << "K_c rec us"
+            << std::setw(14) << "augmented us" << std::setw(12) << "|K-K_aug|"
+            << std::setw(12) << "curve e [m]" << std::endl;
+  for (const int preview_steps : {0, 10, 20, 50, 100}) {
+    benchmark.RunPreview(preview_steps, speeds);
+  }
+  return 0;
+}
@@ -0,0 +1,237 @@
+/**
+ * Per-cycle cost of the match-point search: full O(N) scan versus the
+ * windowed TrajectoryMatcher, on synthetic routes of 1k to 1M points and
+ * optionally on a reference line file given on the command line. Also
+ * reports the spatial index build time, memory per point and the cost of a
+ * global (relocalization) query through the index. A second table compares
+ * full-scan kernels: array-of-structs scalar against the structure-of-arrays
+ * scalar, SSE2, AVX2 and float32 AVX2 kernels.
+ *
+ * usage: match_point_benchmark [reference_line.txt]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nearest_point_kernels.h"
+#include "trajectory_matcher.h"
+#include "trajectory_soa.h"
+#include "trajectory_spatial_index.h"
+
+using shenlan::control::SimdLevel;
+using shenlan::control::TrajectoryMatcher;
+using shenlan::control::TrajectorySoA;
+using shenlan::control::TrajectorySpatialIndex;
+
+namespace {
+
+// 1 m spaced gently winding route
+std::vector<TrajectoryPoint> SyntheticRoute(const std::size_t num_points) {
+  std::vector<TrajectoryPoint> points(num_points);
+  for (std::size_t i = 0; i < num_points; ++i) {
+    const double s = static_cast<double>(i);
+    points[i].x = s;
+    points[i].y = 20.0 * std::sin(s / 50.0);
+    points[i].heading = std::atan(0.4 * std::cos(s / 50.0));
+    points[i].kappa = 0.0;
+    points[i].v = 5.0;
+    points[i].a = 0.0;
+  }
+  return points;
+}
+
+std::vector<TrajectoryPoint> LoadRoute(const std::string &path) {
+  std::vector<TrajectoryPoint> points;
+  std::ifstream infile(path);
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::stringstream word(line);
+    TrajectoryPoint point{};
+    if (word >> point.x >> point.y) {
+      points.push_back(point);
+    }
+  }
+  return points;
+}
+
+std::size_t FullScan(const std::vector<TrajectoryPoint> &points,
+                     const double x, const double y) {
+  double d_min = std::numeric_limits<double>::max();
+  std::size_t index_min = 0;
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    const double dx = points[i].x - x;
+    const double dy = points[i].y - y;
+    const double d = dx * dx + dy * dy;
+    if (d < d_min) {
+      d_min = d;
+      index_min = i;
+    }
+  }
+  return index_min;
+}
+
+// Drive along the route one point per cycle with a small lateral offset and
+// return the average cost per cycle in nanoseconds.
+template <typename Search>
+double NanosPerCycle(const std::vector<TrajectoryPoint> &points,
+                     const std::size_t cycles, Search search,
+                     std::size_t *checksum) {
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t k = 0; k < cycles; ++k) {
+    const TrajectoryPoint &p = points[k % points.size()];
+    *checksum += search(p.x + 0.3, p.y - 0.2);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() /
+         static_cast<double>(cycles);
+}
+
+void Run(const std::string &name, const std::vector<TrajectoryPoint> &points) {
+  const std::size_t cycles = points.size() > 100000 ? 200 : 2000;
+  std::size_t checksum = 0;
+  const double full_ns = NanosPerCycle(
+      points, cycles,
+      [&](double x, double y) { return FullScan(points, x, y); }, &checksum);
+
+  // 与控制器一样在快照的SoA上匹配
+  const TrajectorySoA soa(points);
+  TrajectoryMatcher matcher;
+  matcher.Match(soa, points.front().x, points.front().y);
+  const double windowed_ns = NanosPerCycle(
+      points, cycles,
+      [&](double x, double y) { return matcher.Match(soa, x, y); },
+      &checksum);
+
+  // relocalization: random query positions around the route
+  const auto index = TrajectorySpatialIndex::Build(points);
+  std::size_t mismatches = 0;
+  std::size_t seed = 12345;
+  const std::size_t queries = 200;
+  double scan_ns = 0.0;
+  double index_ns = 0.0;
+  for (std::size_t k = 0; k < queries; ++k) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    const TrajectoryPoint &p = points[(seed >> 33) % points.size()];
+    const double x = p.x + static_cast<double>((seed >> 20) % 200) / 10.0;
+    const double y = p.y - static_cast<double>((seed >> 8) % 200) / 10.0;
+    auto t0 = std::chrono::steady_clock::now();
+    const std::size_t expected = FullScan(points, x, y);
+    auto t1 = std::chrono::steady_clock::now();
+    const std::size_t got = index->Nearest(x, y);
+    auto t2 = std::chrono::steady_clock::now();
+    scan_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    index_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+    mismatches += expected != got;
+    mismatches += index->KNearest(x, y, 5).front() != expected;
+  }
+
+  std::cout << std::setw(16) << name.substr(name.size() > 16 ? name.size() - 16 : 0)
+            << std::setw(10) << points.size() << std::setw(16) << std::fixed
+            << std::setprecision(1) << full_ns << std::setw(16) << windowed_ns
+            << std::setw(10) << matcher.global_search_count() << std::setw(16)
+            << index->stats().build_time_ms << std::setw(10)
+            << index->stats().bytes_per_point << std::setw(16)
+            << scan_ns / queries << std::setw(16) << index_ns / queries
+            << std::setw(6) << mismatches << "  (" << checksum % 7 << ")"
+            << std::endl;
+}
+
+// Full-scan cost per query of each kernel, and the number of queries whose
+// result differs from the array-of-structs scan.
+void RunKernels(const std::string &name,
+                const std::vector<TrajectoryPoint> &points) {
+  const TrajectorySoA soa(points);
+  const TrajectorySoA local(points, true);
+  const std::size_t n = points.size();
+  const std::size_t cycles = n > 100000 ? 200 : 2000;
+  std::size_t checksum = 0;
+  std::size_t mismatches = 0;
+
+  const double aos_ns = NanosPerCycle(
+      points, cycles,
+      [&](double x, double y) { return FullScan(points, x, y); }, &checksum);
+  const SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSse2,
+                              SimdLevel::kAvx2};
+  double soa_ns[3];
+  for (int l = 0; l < 3; ++l) {
+    soa_ns[l] = NanosPerCycle(
+        points, cycles,
+        [&](double x, double y) {
+          return shenlan::control::ArgMinDistanceSquare(
+              soa.x().data(), soa.y().data(), n, x, y, nullptr, levels[l]);
+        },
+        &checksum);
+  }
+  const double float_ns = NanosPerCycle(
+      points, cycles,
+      [&](double x, double y) { return local.NearestIndex(0, n, x, y); },
+      &checksum);
+
+  // 各个 kernel 与 AoS 扫描结果逐一比对
+  for (std::size_t k = 0; k < std::min<std::size_t>(cycles, n); ++k) {
+    const TrajectoryPoint &p = points[k * (n / std::min(cycles, n))];
+    const double x = p.x + 0.3;
+    const double y = p.y - 0.2;
+    const std::size_t expected = FullScan(points, x, y);
+    for (int l = 0; l < 3; ++l) {
+      mismatches += shenlan::control::ArgMinDistanceSquare(
+                        soa.x().data(), soa.y().data(), n, x, y, nullptr,
+                        levels[l]) != expected;
+    }
+    mismatches += soa.NearestIndex(0, n, x, y) != expected;
+  }
+
+  std::cout << std::setw(16) << name.substr(name.size() > 16 ? name.size() - 16 : 0)
+            << std::setw(10) << n << std::setw(12) << std::fixed
+            << std::setprecision(1) << aos_ns << std::setw(12) << soa_ns[0]
+            << std::setw(12) << soa_ns[1] << std::setw(12) << soa_ns[2]
+            << std::setw(12) << float_ns << std::setw(10)
+            << std::setprecision(2) << aos_ns / soa_ns[2] << std::setw(6)
+            << mismatches << "  (" << checksum % 7 << ")" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::cout << std::setw(16) << "route" << std::setw(10) << "points"
+            << std::setw(16) << "full ns/cycle" << std::setw(16)
+            << "window ns/cycle" << std::setw(10) << "global" << std::setw(16)
+            << "index build ms" << std::setw(10) << "B/point" << std::setw(16)
+            << "scan ns/query" << std::setw(16) << "index ns/query"
+            << std::setw(6) << "diff" << std::endl;
+  if (argc > 1) {
+    const std::vector<TrajectoryPoint> points = LoadRoute(argv[1]);
+    if (points.empty()) {
+      std::cout << "fail to load " << argv[1] << std::endl;
+      return -1;
+    }
+    Run(argv[1], points);
+  }
+  for (std::size_t n = 1000; n <= 1000000; n *= 10) {
+    Run("synthetic", SyntheticRoute(n));
+  }
+
+  std::cout << std::endl
+            << "full scan ns/query, cpu level "
+            << static_cast<int>(shenlan::control::DetectSimdLevel())
+            << " (0 scalar, 1 sse2, 2 avx2)" << std::endl;
+  std::cout << std::setw(16) << "route" << std::setw(10) << "points"
+            << std::setw(12) << "aos" << std::setw(12) << "soa" << std::setw(12)
+            << "soa sse2" << std::setw(12) << "soa avx2" << std::setw(12)
+            << "f32 local" << std::setw(10) << "speedup" << std::setw(6)
+            << "diff" << std::endl;
+  if (argc > 1) {
+    RunKernels(argv[1], LoadRoute(argv[1]));
+  }
+  for (std::size_t n = 1000; n <= 1000000; n *= 10) {
+    RunKernels("synthetic", SyntheticRoute(n));
+  }
+  return 0;
+}
@@ -6,159 +6,171 @@
  */
 #include "reference_line.h"
 
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace shenlan {
 namespace control {
 
-ReferenceLine::ReferenceLine(
-    const std::vector<std::pair<double, double>>& xy_points) {
-  xy_points_ = xy_points;
-}
+namespace {
+
+static_assert(sizeof(std::pair<double, double>) == 2 * sizeof(double),
+              "x and y of a point must be adjacent");
+
+#ifdef __SSE2__
+// x and y of a point or derivative in the two lanes of one SSE2 register,
+// loaded straight from the std::pair; both components cost one instruction
+class Xy {
+ public:
+  explicit Xy(const std::pair<double, double>& point)
+      : value_(_mm_loadu_pd(&point.first)) {}
+
+  Xy operator-(const Xy& other) const {
+    return Xy(_mm_sub_pd(value_, other.value_));
+  }
+  Xy operator*(const double factor) const {
+    return Xy(_mm_mul_pd(value_, _mm_set1_pd(factor)));
+  }
+  Xy operator/(const double divisor) const {
+    return Xy(_mm_div_pd(value_, _mm_set1_pd(divisor)));
+  }
+  double x() const { return _mm_cvtsd_f64(value_); }
+  double y() const { return _mm_cvtsd_f64(_mm_unpackhi_pd(value_, value_)); }
+  double SquaredNorm() const {
+    const __m128d square = _mm_mul_pd(value_, value_);
+    return _mm_cvtsd_f64(square) +
+           _mm_cvtsd_f64(_mm_unpackhi_pd(square, square));
+  }
+
+ private:
+  explicit Xy(const __m128d value) : value_(value) {}
+
+  __m128d value_;
+};
+#else
+class Xy {
+ public:
+  explicit Xy(const std::pair<double, double>& point)
+      : x_(point.first), y_(point.second) {}
+
+  Xy operator-(const Xy& other) const { return Xy(x_ - other.x_, y_ - other.y_); }
+  Xy operator*(const double factor) const {
+    return Xy(x_ * factor, y_ * factor);
+  }
+  Xy operator/(const double divisor) const {
+    return Xy(x_ / divisor, y_ / divisor);
+  }
+  double x() const { return x_; }
+  double y() const { return y_; }
+  double SquaredNorm() const { return x_ * x_ + y_ * y_; }
+
+ private:
+  Xy(const double x, const double y) : x_(x), y_(y) {}
+
+  double x_;
+  double y_;
+};
+#endif
+
+}  // namespace
+
+ReferenceLine::ReferenceLine(std::vector<std::pair<double, double>> xy_points)
+    : xy_points_(std::move(xy_points)) {}
 
 bool ReferenceLine::ComputePathProfile(std::vector<double>* headings,
                                        std::vector<double>* accumulated_s,
                                        std::vector<double>* kappas,
                                        std::vector<double>* dkappas) {
-  headings->clear();
-  kappas->clear();
-  dkappas->clear();
-
   if (xy_points_.size() < 2) {
+    headings->clear();
+    accumulated_s->clear();
+    kappas->clear();
+    dkappas->clear();
     return false;
   }
-  std::vector<double> dxs;
-  std::vector<double> dys;
-  std::vector<double> y_over_s_first_derivatives;
-  std::vector<double> x_over_s_first_derivatives;
-  std::vector<double> y_over_s_second_derivatives;
-  std::vector<double> x_over_s_second_derivatives;
-
-  // Get finite difference approximated dx and dy for heading and kappa
-  // calculation
-  std::size_t points_size = xy_points_.size();
-  for (std::size_t i = 0; i < points_size; ++i) {
-    double x_delta = 0.0;
-    double y_delta = 0.0;
-    if (i == 0) {
-      x_delta = (xy_points_[i + 1].first - xy_points_[i].first);
-      y_delta = (xy_points_[i + 1].second - xy_points_[i].second);
-    } else if (i == points_size - 1) {
-      x_delta = (xy_points_[i].first - xy_points_[i - 1].first);
-      y_delta = (xy_points_[i].second - xy_points_[i - 1].second);
-    } else {
-      x_delta = 0.5 * (xy_points_[i + 1].first - xy_points_[i - 1].first);
-      y_delta = 0.5 * (xy_points_[i + 1].second - xy_points_[i - 1].second);
-    }
-    dxs.push_back(x_delta);
-    dys.push_back(y_delta);
-  }
+  const std::size_t points_size = xy_points_.size();
+  headings->resize(points_size);
+  accumulated_s->resize(points_size);
+  kappas->resize(points_size);
+  dkappas->resize(points_size);
+  return ComputePathProfile(xy_points_.data(), points_size, headings->data(),
+                            accumulated_s->data(), kappas->data(),
+                            dkappas->data());
+}
 
-  // Heading calculation
-  for (std::size_t i = 0; i < points_size; ++i) {
-    headings->push_back(std::atan2(dys[i], dxs[i]));
+// Finite differences as before: one-sided at the two ends, central inside,
+// derivatives with respect to the linearly interpolated s. The operations
+// and their order are those of the separate passes, so the results are the
+// same to the bit.
+bool ReferenceLine::ComputePathProfile(
+    const std::pair<double, double>* xy_points, const std::size_t size,
+    double* headings, double* accumulated_s, double* kappas,
+    double* dkappas) {
+  if (size < 2) {
+    return false;
   }
+  const std::pair<double, double>* points = xy_points;
+  double* s = accumulated_s;
+  const std::size_t last = size - 1;
 
-  // Get linear interpolated s for dkappa calculation
-  double distance = 0.0;
-  accumulated_s->push_back(distance);
-  double fx = xy_points_[0].first;
-  double fy = xy_points_[0].second;
-  double nx = 0.0;
-  double ny = 0.0;
-  for (std::size_t i = 1; i < points_size; ++i) {
-    nx = xy_points_[i].first;
-    ny = xy_points_[i].second;
-    double end_segment_s =
-        std::sqrt((fx - nx) * (fx - nx) + (fy - ny) * (fy - ny));
-    accumulated_s->push_back(end_segment_s + distance);
-    distance += end_segment_s;
-    fx = nx;
-    fy = ny;
-  }
+  // Get linear interpolated s, the loop below keeps it two points ahead
+  s[0] = 0.0;
+  s[1] = std::sqrt((Xy(points[0]) - Xy(points[1])).SquaredNorm());
 
-  // Get finite difference approximated first derivative of y and x respective
-  // to s for kappa calculation
-  for (std::size_t i = 0; i < points_size; ++i) {
-    double xds = 0.0;
-    double yds = 0.0;
-    if (i == 0) {
-      xds = (xy_points_[i + 1].first - xy_points_[i].first) /
-            (accumulated_s->at(i + 1) - accumulated_s->at(i));
-      yds = (xy_points_[i + 1].second - xy_points_[i].second) /
-            (accumulated_s->at(i + 1) - accumulated_s->at(i));
-    } else if (i == points_size - 1) {
-      xds = (xy_points_[i].first - xy_points_[i - 1].first) /
-            (accumulated_s->at(i) - accumulated_s->at(i - 1));
-      yds = (xy_points_[i].second - xy_points_[i - 1].second) /
-            (accumulated_s->at(i) - accumulated_s->at(i - 1));
-    } else {
-      xds = (xy_points_[i + 1].first - xy_points_[i - 1].first) /
-            (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
-      yds = (xy_points_[i + 1].second - xy_points_[i - 1].second) /
-            (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+  // First derivative of x and y respective to s at point 0; at point i the
+  // loop computes the one of point i + 1
+  Xy ds_first = (Xy(points[1]) - Xy(points[0])) / (s[1] - s[0]);
+  Xy ds_first_prev = ds_first;
+  for (std::size_t i = 0; i <= last; ++i) {
+    if (i + 2 <= last) {
+      s[i + 2] =
+          std::sqrt((Xy(points[i + 1]) - Xy(points[i + 2])).SquaredNorm()) +
+          s[i + 1];
     }
-    x_over_s_first_derivatives.push_back(xds);
-    y_over_s_first_derivatives.push_back(yds);
-  }
+    const std::size_t lower = i == 0 ? 0 : i - 1;
+    const std::size_t upper = i == last ? last : i + 1;
+    const double ds = s[upper] - s[lower];
 
-  // Get finite difference approximated second derivative of y and x
-  // respective to s for kappa calculation
-  for (std::size_t i = 0; i < points_size; ++i) {
-    double xdds = 0.0;
-    double ydds = 0.0;
-    if (i == 0) {
-      xdds =
-          (x_over_s_first_derivatives[i + 1] - x_over_s_first_derivatives[i]) /
-          (accumulated_s->at(i + 1) - accumulated_s->at(i));
-      ydds =
-          (y_over_s_first_derivatives[i + 1] - y_over_s_first_derivatives[i]) /
-          (accumulated_s->at(i + 1) - accumulated_s->at(i));
-    } else if (i == points_size - 1) {
-      xdds =
-          (x_over_s_first_derivatives[i] - x_over_s_first_derivatives[i - 1]) /
-          (accumulated_s->at(i) - accumulated_s->at(i - 1));
-      ydds =
-          (y_over_s_first_derivatives[i] - y_over_s_first_derivatives[i - 1]) /
-          (accumulated_s->at(i) - accumulated_s->at(i - 1));
-    } else {
-      xdds = (x_over_s_first_derivatives[i + 1] -
-              x_over_s_first_derivatives[i - 1]) /
-             (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
-      ydds = (y_over_s_first_derivatives[i + 1] -
-              y_over_s_first_derivatives[i - 1]) /
-             (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+    // Heading calculation
+    Xy delta = Xy(points[upper]) - Xy(points[lower]);
+    if (i != 0 && i != last) {
+      delta = delta * 0.5;
     }
-    x_over_s_second_derivatives.push_back(xdds);
-    y_over_s_second_derivatives.push_back(ydds);
-  }
+    headings[i] = std::atan2(delta.y(), delta.x());
 
-  for (std::size_t i = 0; i < points_size; ++i) {
-    double xds = x_over_s_first_derivatives[i];
-    double yds = y_over_s_first_derivatives[i];
-    double xdds = x_over_s_second_derivatives[i];
-    double ydds = y_over_s_second_derivatives[i];
-    double kappa =
-        (xds * ydds - yds * xdds) /
-        (std::sqrt(xds * xds + yds * yds) * (xds * xds + yds * yds) + 1e-6);
-    kappas->push_back(kappa);
-  }
+    // First derivative of point i + 1
+    Xy ds_first_next = ds_first;
+    if (i < last) {
+      const std::size_t next_upper = i + 1 == last ? last : i + 2;
+      ds_first_next = (Xy(points[next_upper]) - Xy(points[i])) /
+                      (s[next_upper] - s[i]);
+    }
+
+    // Second derivative and kappa of point i
+    const Xy ds_second = ((i == last ? ds_first : ds_first_next) -
+                          (i == 0 ? ds_first : ds_first_prev)) /
+                         ds;
+    const double xds = ds_first.x();
+    const double yds = ds_first.y();
+    const double square = ds_first.SquaredNorm();
+    kappas[i] = (xds * ds_second.y() - yds * ds_second.x()) /
+                (std::sqrt(square) * square + 1e-6);
 
-  // Dkappa calculation
-  for (std::size_t i = 0; i < points_size; ++i) {
-    double dkappa = 0.0;
-    if (i == 0) {
-      dkappa = (kappas->at(i + 1) - kappas->at(i)) /
-               (accumulated_s->at(i + 1) - accumulated_s->at(i));
-    } else if (i == points_size - 1) {
-      dkappa = (kappas->at(i) - kappas->at(i - 1)) /
-               (accumulated_s->at(i) - accumulated_s->at(i - 1));
-    } else {
-      dkappa = (kappas->at(i + 1) - kappas->at(i - 1)) /
-               (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+    // Dkappa of point i - 1, whose neighbours are known now
+    if (i > 0) {
+      const std::size_t prev_lower = i == 1 ? 0 : i - 2;
+      dkappas[i - 1] =
+          (kappas[i] - kappas[prev_lower]) / (s[i] - s[prev_lower]);
     }
-    dkappas->push_back(dkappa);
+    ds_first_prev = ds_first;
+    ds_first = ds_first_next;
   }
+  dkappas[last] = (kappas[last] - kappas[last - 1]) / (s[last] - s[last - 1]);
   return true;
 }
 
 }  // namespace control
-}  // namespace shenlan
\ No newline at end of file
+}  // namespace shenlan
@@ -0,0 +1,519 @@
+/**
+ * Throughput of ReferenceLine::ComputePathProfile on synthetic routes of 1k
+ * to 1M unevenly spaced points and optionally on a reference line file
+ * given on the command line. Compares the previous implementation (seven
+ * passes, six temporary vectors filled with push_back, bounds-checked
+ * accumulated_s, kept here as the reference) with the single-pass one
+ * through the vector interface (output vectors reused across calls, sized
+ * by a first untimed call) and through caller-provided columns. Reports
+ * the best time of a few runs, points per second, heap allocations per call
+ * and the largest difference of each output from the reference.
+ *
+ * Then streams a synthetic route of 500k points (about 500 km) through a
+ * StreamingReferenceLine, retiring points as a vehicle would, for a few
+ * window capacities: append time per point, window bytes, heap allocations
+ * while streaming, and the largest difference of every point's profile,
+ * taken just before it is retired or at the end, from ComputePathProfile
+ * over the whole route.
+ *
+ * Last, lookups by station s on the 100k point route: an
+ * ArcLengthReferenceLine resampled at a few spacings (constant-time
+ * lookup) and one keeping the unevenly spaced knots (binary search), with
+ * build time, bytes, time per at() for random and for increasing s, and
+ * the largest heading and kappa difference from interpolating the knots.
+ *
+ * usage: reference_line_benchmark [reference_line.txt]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arc_length_reference_line.h"
+#include "reference_line.h"
+#include "streaming_reference_line.h"
+
+using shenlan::control::ArcLengthReferenceLine;
+using shenlan::control::ReferenceLine;
+using shenlan::control::StationPoint;
+using shenlan::control::StreamingReferenceLine;
+
+namespace {
+
+// operator new below counts every heap allocation of the process
+std::size_t g_allocations = 0;
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+  ++g_allocations;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+typedef std::vector<std::pair<double, double>> XyPoints;
+
+// gently winding route, spacing between 0.5 and 1.5 m
+XyPoints SyntheticRoute(const std::size_t num_points) {
+  XyPoints points(num_points);
+  for (std::size_t i = 0; i < num_points; ++i) {
+    const double s = static_cast<double>(i) + 0.5 * std::sin(0.7 * i);
+    points[i] = std::make_pair(s, 20.0 * std::sin(s / 50.0));
+  }
+  return points;
+}
+
+XyPoints LoadRoute(const std::string &path) {
+  XyPoints points;
+  std::ifstream infile(path);
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::stringstream word(line);
+    double x = 0.0;
+    double y = 0.0;
+    if (word >> x >> y) {
+      points.emplace_back(x, y);
+    }
+  }
+  return points;
+}
+
+// the previous ReferenceLine::ComputePathProfile, unchanged
+bool LegacyPathProfile(const XyPoints &xy_points_,
+                       std::vector<double> *headings,
+                       std::vector<double> *accumulated_s,
+                       std::vector<double> *kappas,
+                       std::vector<double> *dkappas) {
+  headings->clear();
+  kappas->clear();
+  dkappas->clear();
+
+  if (xy_points_.size() < 2) {
+    return false;
+  }
+  std::vector<double> dxs;
+  std::vector<double> dys;
+  std::vector<double> y_over_s_first_derivatives;
+  std::vector<double> x_over_s_first_derivatives;
+  std::vector<double> y_over_s_second_derivatives;
+  std::vector<double> x_over_s_second_derivatives;
+
+  std::size_t points_size = xy_points_.size();
+  for (std::size_t i = 0; i < points_size; ++i) {
+    double x_delta = 0.0;
+    double y_delta = 0.0;
+    if (i == 0) {
+      x_delta = (xy_points_[i + 1].first - xy_points_[i].first);
+      y_delta = (xy_points_[i + 1].second - xy_points_[i].second);
+    } else if (i == points_size - 1) {
+      x_delta = (xy_points_[i].first - xy_points_[i - 1].first);
+      y_delta = (xy_points_[i].second - xy_points_[i - 1].second);
+    } else {
+      x_delta = 0.5 * (xy_points_[i + 1].first - xy_points_[i - 1].first);
+      y_delta = 0.5 * (xy_points_[i + 1].second - xy_points_[i - 1].second);
+    }
+    dxs.push_back(x_delta);
+    dys.push_back(y_delta);
+  }
+
+  for (std::size_t i = 0; i < points_size; ++i) {
+    headings->push_back(std::atan2(dys[i], dxs[i]));
+  }
+
+  double distance = 0.0;
+  accumulated_s->push_back(distance);
+  double fx = xy_points_[0].first;
+  double fy = xy_points_[0].second;
+  double nx = 0.0;
+  double ny = 0.0;
+  for (std::size_t i = 1; i < points_size; ++i) {
+    nx = xy_points_[i].first;
+    ny = xy_points_[i].second;
+    double end_segment_s =
+        std::sqrt((fx - nx) * (fx - nx) + (fy - ny) * (fy - ny));
+    accumulated_s->push_back(end_segment_s + distance);
+    distance += end_segment_s;
+    fx = nx;
+    fy = ny;
+  }
+
+  for (std::size_t i = 0; i < points_size; ++i) {
+    double xds = 0.0;
+    double yds = 0.0;
+    if (i == 0) {
+      xds = (xy_points_[i + 1].first - xy_points_[i].first) /
+            (accumulated_s->at(i + 1) - accumulated_s->at(i));
+      yds = (xy_points_[i + 1].second - xy_points_[i].second) /
+            (accumulated_s->at(i + 1) - accumulated_s->at(i));
+    } else if (i == points_size - 1) {
+      xds = (xy_points_[i].first - xy_points_[i - 1].first) /
+            (accumulated_s->at(i) - accumulated_s->at(i - 1));
+      yds = (xy_points_[i].second - xy_points_[i - 1].second) /
+            (accumulated_s->at(i) - accumulated_s->at(i - 1));
+    } else {
+      xds = (xy_points_[i + 1].first - xy_points_[i - 1].first) /
+            (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+      yds = (xy_points_[i + 1].second - xy_points_[i - 1].second) /
+            (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+    }
+    x_over_s_first_derivatives.push_back(xds);
+    y_over_s_first_derivatives.push_back(yds);
+  }
+
+  for (std::size_t i = 0; i < points_size; ++i) {
+    double xdds = 0.0;
+    double ydds = 0.0;
+    if (i == 0) {
+      xdds =
+          (x_over_s_first_derivatives[i + 1] - x_over_s_first_derivatives[i]) /
+          (accumulated_s->at(i + 1) - accumulated_s->at(i));
+      ydds =
+          (y_over_s_first_derivatives[i + 1] - y_over_s_first_derivatives[i]) /
+          (accumulated_s->at(i + 1) - accumulated_s->at(i));
+    } else if (i == points_size - 1) {
+      xdds =
+          (x_over_s_first_derivatives[i] - x_over_s_first_derivatives[i - 1]) /
+          (accumulated_s->at(i) - accumulated_s->at(i - 1));
+      ydds =
+          (y_over_s_first_derivatives[i] - y_over_s_first_derivatives[i - 1]) /
+          (accumulated_s->at(i) - accumulated_s->at(i - 1));
+    } else {
+      xdds = (x_over_s_first_derivatives[i + 1] -
+              x_over_s_first_derivatives[i - 1]) /
+             (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+      ydds = (y_over_s_first_derivatives[i + 1] -
+              y_over_s_first_derivatives[i - 1]) /
+             (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+    }
+    x_over_s_second_derivatives.push_back(xdds);
+    y_over_s_second_derivatives.push_back(ydds);
+  }
+
+  for (std::size_t i = 0; i < points_size; ++i) {
+    double xds = x_over_s_first_derivatives[i];
+    double yds = y_over_s_first_derivatives[i];
+    double xdds = x_over_s_second_derivatives[i];
+    double ydds = y_over_s_second_derivatives[i];
+    double kappa =
+        (xds * ydds - yds * xdds) /
+        (std::sqrt(xds * xds + yds * yds) * (xds * xds + yds * yds) + 1e-6);
+    kappas->push_back(kappa);
+  }
+
+  for (std::size_t i = 0; i < points_size; ++i) {
+    double dkappa = 0.0;
+    if (i == 0) {
+      dkappa = (kappas->at(i + 1) - kappas->at(i)) /
+               (accumulated_s->at(i + 1) - accumulated_s->at(i));
+    } else if (i == points_size - 1) {
+      dkappa = (kappas->at(i) - kappas->at(i - 1)) /
+               (accumulated_s->at(i) - accumulated_s->at(i - 1));
+    } else {
+      dkappa = (kappas->at(i + 1) - kappas->at(i - 1)) /
+               (accumulated_s->at(i + 1) - accumulated_s->at(i - 1));
+    }
+    dkappas->push_back(dkappa);
+  }
+  return true;
+}
+
+struct Profile {
+  std::vector<double> headings;
+  std::vector<double> accumulated_s;
+  std::vector<double> kappas;
+  std::vector<double> dkappas;
+};
+
+struct RunReport {
+  double best_ms = std::numeric_limits<double>::max();
+  double allocations = 0.0;
+};
+
+// best of runs calls of compute, allocations counted per call
+template <typename Compute>
+RunReport Measure(const int runs, Compute compute) {
+  RunReport report;
+  for (int run = 0; run < runs; ++run) {
+    const std::size_t allocations = g_allocations;
+    const auto start = std::chrono::steady_clock::now();
+    compute();
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    report.best_ms = std::min(report.best_ms, ms);
+    report.allocations += g_allocations - allocations;
+  }
+  report.allocations /= runs;
+  return report;
+}
+
+double MaxDifference(const std::vector<double> &a,
+                     const std::vector<double> &b) {
+  double max_difference = 0.0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    max_difference = std::max(max_difference, std::fabs(a[i] - b[i]));
+  }
+  return max_difference;
+}
+
+void RunRoute(const std::string &name, const XyPoints &points) {
+  const std::size_t n = points.size();
+  const int runs = n >= 1000000 ? 5 : n >= 100000 ? 20 : 200;
+
+  // 旧实现: 调用方每次传入空的vector
+  Profile legacy;
+  const RunReport legacy_report = Measure(runs, [&]() {
+    legacy = Profile();
+    LegacyPathProfile(points, &legacy.headings, &legacy.accumulated_s,
+                      &legacy.kappas, &legacy.dkappas);
+  });
+
+  // 新实现, vector接口: 输出vector跨调用复用, 第一次调用(不计时)分配
+  ReferenceLine reference_line(points);
+  Profile fused;
+  reference_line.ComputePathProfile(&fused.headings, &fused.accumulated_s,
+                                    &fused.kappas, &fused.dkappas);
+  const RunReport vector_report = Measure(runs, [&]() {
+    reference_line.ComputePathProfile(&fused.headings, &fused.accumulated_s,
+                                      &fused.kappas, &fused.dkappas);
+  });
+
+  // 新实现, 调用方预先分配的四列
+  std::vector<double> columns(4 * n);
+  const RunReport column_report = Measure(runs, [&]() {
+    ReferenceLine::ComputePathProfile(points.data(), n, columns.data(),
+                                      columns.data() + n,
+                                      columns.data() + 2 * n,
+                                      columns.data() + 3 * n);
+  });
+  const std::vector<double> column_kappas(columns.begin() + 2 * n,
+                                          columns.begin() + 3 * n);
+
+  const double max_difference =
+      std::max({MaxDifference(legacy.headings, fused.headings),
+                MaxDifference(legacy.accumulated_s, fused.accumulated_s),
+                MaxDifference(legacy.kappas, fused.kappas),
+                MaxDifference(legacy.dkappas, fused.dkappas),
+                MaxDifference(legacy.kappas, column_kappas)});
+
+  std::cout << std::setw(10) << name << std::setw(10) << n;
+  for (const RunReport *report :
+       {&legacy_report, &vector_report, &column_report}) {
+    std::cout << std::fixed << std::setprecision(3) << std::setw(11)
+              << report->best_ms << std::setprecision(1) << std::setw(8)
+              << n / report->best_ms / 1e3 << std::setprecision(0)
+              << std::setw(7) << report->allocations;
+  }
+  std::cout << std::setprecision(2) << std::setw(9)
+            << legacy_report.best_ms / column_report.best_ms
+            << std::scientific << std::setw(11) << max_difference
+            << std::defaultfloat << std::endl;
+}
+
+// largest difference of points [0, count) of the window from the whole-route
+// profile
+double WindowDifference(const StreamingReferenceLine &line,
+                        const std::size_t count, const Profile &route) {
+  double max_difference = 0.0;
+  for (std::size_t i = 0; i < count; ++i) {
+    const std::size_t k = line.first_index() + i;
+    max_difference = std::max(
+        {max_difference, std::fabs(line.heading(i) - route.headings[k]),
+         std::fabs(line.s(i) - route.accumulated_s[k]),
+         std::fabs(line.kappa(i) - route.kappas[k]),
+         std::fabs(line.dkappa(i) - route.dkappas[k])});
+  }
+  return max_difference;
+}
+
+// 模拟车辆: 窗口占满3/4后, 丢弃前一半, 与节点按弧长成批丢弃的方式相同
+void StreamRoute(const XyPoints &points, const Profile &route,
+                 const std::size_t capacity) {
+  StreamingReferenceLine line(capacity);
+  const std::size_t batch = capacity / 2;
+  const std::size_t allocations = g_allocations;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &point : points) {
+    if (line.size() >= capacity * 3 / 4) {
+      line.Retire(batch);
+    }
+    line.Append(point.first, point.second);
+  }
+  const double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  const std::size_t streaming_allocations = g_allocations - allocations;
+
+  // 同样的流程再走一遍, 每个点在丢弃前与整条路线的结果比较
+  StreamingReferenceLine checked(capacity);
+  double max_difference = 0.0;
+  for (const auto &point : points) {
+    if (checked.size() >= capacity * 3 / 4) {
+      max_difference = std::max(max_difference,
+                                WindowDifference(checked, batch, route));
+      checked.Retire(batch);
+    }
+    checked.Append(point.first, point.second);
+  }
+  max_difference = std::max(max_difference,
+                            WindowDifference(checked, checked.size(), route));
+
+  std::cout << std::setw(10) << capacity << std::setw(10) << points.size()
+            << std::fixed << std::setprecision(3) << std::setw(11) << ms
+            << std::setprecision(1) << std::setw(11)
+            << ms * 1e6 / points.size() << std::setw(11)
+            << line.MemoryBytes() << std::setw(8) << streaming_allocations
+            << std::scientific << std::setprecision(2) << std::setw(11)
+            << max_difference << std::defaultfloat << std::endl;
+}
+
+// 查找时间[ns]: 逐个调用, 结果累加防止被优化掉
+double LookupNs(const ArcLengthReferenceLine &line,
+                const std::vector<double> &stations) {
+  double sum = 0.0;
+  double best_ns = std::numeric_limits<double>::max();
+  for (int run = 0; run < 5; ++run) {
+    const auto start = std::chrono::steady_clock::now();
+    for (const double s : stations) {
+      sum += line.at(s).kappa;
+    }
+    best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(
+                                    std::chrono::steady_clock::now() - start)
+                                        .count() /
+                                    stations.size());
+  }
+  if (sum == 42.0) {
+    std::cout << std::endl;
+  }
+  return best_ns;
+}
+
+void RunStationLookup(const XyPoints &points) {
+  Profile profile;
+  ReferenceLine(points).ComputePathProfile(
+      &profile.headings, &profile.accumulated_s, &profile.kappas,
+      &profile.dkappas);
+  const double length = profile.accumulated_s.back();
+  const double mean_spacing = length / (points.size() - 1);
+
+  ArcLengthReferenceLine knots;
+  knots.Build(points, profile.headings, profile.accumulated_s,
+              profile.kappas, profile.dkappas, 5.0, 0.0);
+
+  const std::size_t lookups = 1000000;
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<double> station(0.0, length);
+  std::vector<double> random_s(lookups);
+  std::vector<double> increasing_s(lookups);
+  for (std::size_t i = 0; i < lookups; ++i) {
+    random_s[i] = station(generator);
+    increasing_s[i] = length * i / lookups;
+  }
+
+  std::cout << std::endl
+            << "station lookup over " << points.size() << " knots, mean "
+            << "spacing " << std::setprecision(3) << mean_spacing << " m"
+            << std::endl;
+  std::cout << std::setw(12) << "spacing" << std::setw(10) << "samples"
+            << std::setw(10) << "build ms" << std::setw(11) << "bytes"
+            << std::setw(11) << "random ns" << std::setw(11) << "seq ns"
+            << std::setw(12) << "heading" << std::setw(12) << "kappa"
+            << std::endl;
+  for (const double factor : {0.0, 1.0, 0.5, 0.25}) {
+    ArcLengthReferenceLine line;
+    const auto start = std::chrono::steady_clock::now();
+    line.Build(points, profile.headings, profile.accumulated_s,
+               profile.kappas, profile.dkappas, 5.0, factor * mean_spacing);
+    const double build_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    double heading_difference = 0.0;
+    double kappa_difference = 0.0;
+    for (const double s : random_s) {
+      const StationPoint exact = knots.at(s);
+      const StationPoint point = line.at(s);
+      heading_difference =
+          std::max(heading_difference,
+                   std::fabs(std::remainder(point.heading - exact.heading,
+                                            2.0 * M_PI)));
+      kappa_difference =
+          std::max(kappa_difference, std::fabs(point.kappa - exact.kappa));
+    }
+    std::ostringstream name;
+    if (factor > 0.0) {
+      name << std::setprecision(2) << factor << " x mean";
+    } else {
+      name << (line.uniform() ? "knots" : "knots bsearch");
+    }
+    std::cout << std::setw(12) << name.str() << std::setw(10) << line.size()
+              << std::fixed << std::setprecision(2) << std::setw(10)
+              << build_ms << std::setw(11) << line.MemoryBytes()
+              << std::setprecision(1) << std::setw(11)
+              << LookupNs(line, random_s) << std::setw(11)
+              << LookupNs(line, increasing_s) << std::scientific
+              << std::setprecision(2) << std::setw(12) << heading_difference
+              << std::setw(12) << kappa_difference << std::defaultfloat
+              << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::cout << "per implementation: best ms, M points/s, allocations per "
+               "call"
+            << std::endl;
+  std::cout << std::setw(10) << "route" << std::setw(10) << "points"
+            << std::setw(26) << "previous" << std::setw(26) << "vectors"
+            << std::setw(26) << "columns" << std::setw(9) << "speedup"
+            << std::setw(11) << "max diff" << std::endl;
+  for (const std::size_t n : {1000, 10000, 100000, 1000000}) {
+    RunRoute("synthetic", SyntheticRoute(n));
+  }
+  if (argc > 1) {
+    const XyPoints points = LoadRoute(argv[1]);
+    if (points.size() < 2) {
+      std::cerr << "could not read " << argv[1] << std::endl;
+      return 1;
+    }
+    RunRoute("file", points);
+  }
+
+  const XyPoints route_points = SyntheticRoute(500000);
+  Profile route;
+  ReferenceLine(route_points)
+      .ComputePathProfile(&route.headings, &route.accumulated_s,
+                          &route.kappas, &route.dkappas);
+  std::cout << std::endl
+            << "streaming window over " << std::fixed << std::setprecision(1)
+            << route.accumulated_s.back() / 1e3 << std::defaultfloat
+            << " km" << std::endl;
+  std::cout << std::setw(10) << "capacity" << std::setw(10) << "points"
+            << std::setw(11) << "total ms" << std::setw(11) << "ns/point"
+            << std::setw(11) << "bytes" << std::setw(8) << "allocs"
+            << std::setw(11) << "max diff" << std::endl;
+  for (const std::size_t capacity : {64, 1024, 4096}) {
+    StreamRoute(route_points, route, capacity);
+  }
+
+  RunStationLookup(SyntheticRoute(100000));
+  return 0;
+}
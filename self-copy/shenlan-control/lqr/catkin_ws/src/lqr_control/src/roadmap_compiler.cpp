@@ -0,0 +1,206 @@
+/**
+ * Compiles an "x y" text roadmap into the binary format of CompiledRoadmap
+ * (path profile and, unless --no-index, the spatial index precomputed), so
+ * the nodes map it at startup instead of parsing the text. The output
+ * defaults to the input path with its extension replaced by ".roadmap";
+ * give it to the node through the roadmap_path parameter, or place it next
+ * to the text file the mpc and stanley nodes read.
+ *
+ * Then compares the startup work both ways, as the nodes do it: reading the
+ * text (getline, stringstream, atof), ComputePathProfile and a
+ * TrajectorySnapshot with a freshly built spatial index, against mapping
+ * the compiled file and a snapshot over its columns and stored index. Both
+ * are run several times with the files in the page cache; the table gives
+ * the first and the fastest run and checks that the two snapshots match.
+ *
+ * usage: roadmap_compiler input.txt [output.roadmap] [--no-index]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "compiled_roadmap.h"
+#include "reference_line.h"
+#include "trajectory_snapshot.h"
+
+using shenlan::control::CompiledRoadmap;
+using shenlan::control::ReferenceLine;
+using shenlan::control::TrajectorySnapshot;
+using shenlan::control::TrajectorySnapshotPtr;
+
+namespace {
+
+constexpr double kSpeed = 5.0;
+constexpr int kRuns = 7;
+
+// 与节点相同的文本读取与路径曲线计算
+TrajectorySnapshotPtr LoadText(const std::string &path) {
+  std::ifstream infile(path);
+  std::vector<std::pair<double, double>> xy_points;
+  std::string s, x, y;
+  while (getline(infile, s)) {
+    std::stringstream word(s);
+    word >> x;
+    word >> y;
+    xy_points.push_back(
+        std::make_pair(std::atof(x.c_str()), std::atof(y.c_str())));
+  }
+  std::vector<double> headings, accumulated_s, kappas, dkappas;
+  ReferenceLine(xy_points).ComputePathProfile(&headings, &accumulated_s,
+                                              &kappas, &dkappas);
+  std::vector<TrajectoryPoint> points(headings.size());
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    points[i].x = xy_points[i].first;
+    points[i].y = xy_points[i].second;
+    points[i].v = kSpeed;
+    points[i].a = 0.0;
+    points[i].heading = headings[i];
+    points[i].kappa = kappas[i];
+  }
+  return TrajectorySnapshot::Create(std::move(points));
+}
+
+TrajectorySnapshotPtr LoadCompiled(const std::string &path) {
+  CompiledRoadmap roadmap;
+  if (!roadmap.Open(path)) {
+    return nullptr;
+  }
+  return roadmap.Snapshot(kSpeed, false);
+}
+
+struct Timing {
+  double first_ms = 0.0;
+  double best_ms = 0.0;
+  TrajectorySnapshotPtr snapshot;
+};
+
+template <typename Load>
+Timing Measure(const std::string &path, Load load) {
+  Timing timing;
+  for (int run = 0; run < kRuns; ++run) {
+    const auto start = std::chrono::steady_clock::now();
+    timing.snapshot = load(path);
+    const double ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    timing.first_ms = run == 0 ? ms : timing.first_ms;
+    timing.best_ms = run == 0 ? ms : std::min(timing.best_ms, ms);
+  }
+  return timing;
+}
+
+// 两个快照的点属性与累计弧长之差, 以及空间索引在各点附近查询结果不同的次数
+double Difference(const TrajectorySnapshot &a, const TrajectorySnapshot &b,
+                  std::size_t *nearest_mismatches) {
+  *nearest_mismatches = 0;
+  if (a.size() != b.size()) {
+    return INFINITY;
+  }
+  double max_diff = 0.0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    const TrajectoryPoint &p = a.points()[i];
+    const TrajectoryPoint &q = b.points()[i];
+    const double ds = a.soa().accumulated_s()[i] - b.soa().accumulated_s()[i];
+    for (const double diff : {p.x - q.x, p.y - q.y, p.heading - q.heading,
+                              p.kappa - q.kappa, ds}) {
+      // 重复点处两边都可能是nan
+      if (!std::isnan(diff) || std::isnan(p.kappa) != std::isnan(q.kappa)) {
+        max_diff = std::max(max_diff, std::fabs(diff));
+      }
+    }
+    if (a.spatial_index() != nullptr && b.spatial_index() != nullptr &&
+        a.spatial_index()->Nearest(p.x + 0.3, p.y - 0.2) !=
+            b.spatial_index()->Nearest(p.x + 0.3, p.y - 0.2)) {
+      ++*nearest_mismatches;
+    }
+  }
+  return max_diff;
+}
+
+std::size_t FileBytes(const std::string &path) {
+  std::ifstream infile(path, std::ios::binary | std::ios::ate);
+  return infile.is_open() ? static_cast<std::size_t>(infile.tellg()) : 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths;
+  bool with_index = true;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--no-index") {
+      with_index = false;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty() || paths.size() > 2) {
+    std::cerr << "usage: roadmap_compiler input.txt [output.roadmap] "
+                 "[--no-index]"
+              << std::endl;
+    return 1;
+  }
+  const std::string input = paths[0];
+  std::string output = paths.size() > 1 ? paths[1] : "";
+  if (output.empty()) {
+    const std::size_t slash = input.find_last_of('/');
+    const std::size_t dot = input.find_last_of('.');
+    output = (dot != std::string::npos &&
+                      (slash == std::string::npos || dot > slash)
+                  ? input.substr(0, dot)
+                  : input) +
+             ".roadmap";
+  }
+
+  std::string error;
+  if (!CompiledRoadmap::Compile(input, output, with_index, &error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  CompiledRoadmap roadmap;
+  if (!roadmap.Open(output)) {
+    std::cerr << roadmap.error() << std::endl;
+    return 1;
+  }
+  std::cout << "wrote " << output << ": " << roadmap.size() << " points, "
+            << roadmap.file_bytes() << " bytes (text " << FileBytes(input)
+            << " bytes), spatial index "
+            << (roadmap.has_spatial_index() ? "stored" : "not stored")
+            << std::endl
+            << std::endl;
+  roadmap.Close();
+
+  const Timing text = Measure(input, LoadText);
+  const Timing compiled = Measure(output, LoadCompiled);
+  if (compiled.snapshot == nullptr) {
+    std::cerr << "could not load " << output << std::endl;
+    return 1;
+  }
+  std::size_t nearest_mismatches = 0;
+  const double max_diff =
+      Difference(*text.snapshot, *compiled.snapshot, &nearest_mismatches);
+
+  std::cout << "startup to a ready snapshot, " << kRuns << " runs [ms]"
+            << std::endl;
+  std::cout << std::setw(10) << "format" << std::setw(10) << "first"
+            << std::setw(10) << "best" << std::endl;
+  std::cout << std::fixed << std::setprecision(3) << std::setw(10) << "text"
+            << std::setw(10) << text.first_ms << std::setw(10) << text.best_ms
+            << std::endl;
+  std::cout << std::setw(10) << "compiled" << std::setw(10)
+            << compiled.first_ms << std::setw(10) << compiled.best_ms
+            << std::endl;
+  std::cout << std::setprecision(1) << "speedup " << text.best_ms /
+            compiled.best_ms << "x" << std::defaultfloat << ", max point "
+            << "difference " << max_diff << ", nearest-point mismatches "
+            << nearest_mismatches << std::endl;
+  return max_diff == 0.0 && nearest_mismatches == 0 ? 0 : 1;
+}
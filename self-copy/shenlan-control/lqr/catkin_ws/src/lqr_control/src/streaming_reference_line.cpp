@@ -0,0 +1,118 @@
+#include "streaming_reference_line.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "reference_line.h"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// the points an append recomputes, and the slice they are computed from
+constexpr std::size_t kRecomputed = StreamingReferenceLine::kContext + 1;
+constexpr std::size_t kSlice = kRecomputed + StreamingReferenceLine::kContext;
+
+}  // namespace
+
+StreamingReferenceLine::StreamingReferenceLine(const std::size_t capacity)
+    : capacity_(std::max(capacity, 2 * kContext + 1)),
+      points_(2 * capacity_),
+      headings_(2 * capacity_),
+      accumulated_s_(2 * capacity_),
+      kappas_(2 * capacity_),
+      dkappas_(2 * capacity_) {}
+
+bool StreamingReferenceLine::Append(const double x, const double y) {
+  if (size() > 0 && std::hypot(x - points_[end_ - 1].first,
+                               y - points_[end_ - 1].second) <= 1e-6) {
+    // 重复点会使差分的分母为0
+    return true;
+  }
+  if (full()) {
+    return false;
+  }
+  if (end_ == points_.size()) {
+    // 窗口移回存储的开头; begin_ >= capacity_, 源和目标不重叠
+    const std::size_t n = size();
+    std::copy(points_.begin() + begin_, points_.begin() + end_,
+              points_.begin());
+    std::copy(headings_.begin() + begin_, headings_.begin() + end_,
+              headings_.begin());
+    std::copy(accumulated_s_.begin() + begin_, accumulated_s_.begin() + end_,
+              accumulated_s_.begin());
+    std::copy(kappas_.begin() + begin_, kappas_.begin() + end_,
+              kappas_.begin());
+    std::copy(dkappas_.begin() + begin_, dkappas_.begin() + end_,
+              dkappas_.begin());
+    begin_ = 0;
+    end_ = n;
+  }
+
+  const std::size_t i = end_++;
+  points_[i] = std::make_pair(x, y);
+  headings_[i] = 0.0;
+  kappas_[i] = 0.0;
+  dkappas_[i] = 0.0;
+  if (i == begin_) {
+    accumulated_s_[i] = 0.0;
+    return true;
+  }
+  // 与ReferenceLine相同的累积方式, s从路线的第一个点算起
+  const double dx = points_[i - 1].first - x;
+  const double dy = points_[i - 1].second - y;
+  accumulated_s_[i] = std::sqrt(dx * dx + dy * dy) + accumulated_s_[i - 1];
+
+  // 新点只影响最后kRecomputed个点, 从它们前面kContext个点起算一小段
+  const std::size_t first = end_ - begin_ > kSlice ? end_ - kSlice : begin_;
+  const std::size_t slice = end_ - first;
+  double headings[kSlice];
+  double accumulated_s[kSlice];
+  double kappas[kSlice];
+  double dkappas[kSlice];
+  ReferenceLine::ComputePathProfile(&points_[first], slice, headings,
+                                    accumulated_s, kappas, dkappas);
+  // 一小段开头的差分是单侧的, 只有路线的开头才取用
+  const std::size_t keep =
+      first == begin_ && first_index_ == 0 ? 0 : slice - kRecomputed;
+  for (std::size_t j = keep; j < slice; ++j) {
+    headings_[first + j] = headings[j];
+    kappas_[first + j] = kappas[j];
+    dkappas_[first + j] = dkappas[j];
+  }
+  return true;
+}
+
+std::size_t StreamingReferenceLine::Retire(const std::size_t count) {
+  const std::size_t keep = 2 * kContext + 1;
+  const std::size_t retired =
+      size() > keep ? std::min(count, size() - keep) : 0;
+  begin_ += retired;
+  first_index_ += retired;
+  return retired;
+}
+
+void StreamingReferenceLine::Window(const double v,
+                                    std::vector<TrajectoryPoint> *points) const {
+  points->resize(size());
+  for (std::size_t i = 0; i < size(); ++i) {
+    TrajectoryPoint &point = (*points)[i];
+    point.x = x(i);
+    point.y = y(i);
+    point.heading = heading(i);
+    point.kappa = kappa(i);
+    point.v = v;
+    point.a = 0.0;
+  }
+}
+
+std::size_t StreamingReferenceLine::MemoryBytes() const {
+  return points_.capacity() * sizeof(points_[0]) +
+         (headings_.capacity() + accumulated_s_.capacity() +
+          kappas_.capacity() + dkappas_.capacity()) *
+             sizeof(double);
+}
+
+}  // namespace control
+}  // namespace shenlan
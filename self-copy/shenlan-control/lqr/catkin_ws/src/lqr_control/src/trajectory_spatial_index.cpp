@@ -0,0 +1,194 @@
+#include "trajectory_spatial_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+
+namespace shenlan {
+namespace control {
+
+std::shared_ptr<const TrajectorySpatialIndex> TrajectorySpatialIndex::Build(
+    const std::vector<TrajectoryPoint> &points) {
+  const auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<TrajectorySpatialIndex> index(new TrajectorySpatialIndex());
+
+  const std::size_t num_points = points.size();
+  std::vector<std::uint32_t> order(num_points);
+  std::iota(order.begin(), order.end(), 0);
+  index->split_dims_.resize(num_points);
+  index->BuildRange(0, num_points, &order, points);
+
+  // 按树的顺序存放坐标, 查询时访问连续内存
+  index->xs_.resize(num_points);
+  index->ys_.resize(num_points);
+  for (std::size_t slot = 0; slot < num_points; ++slot) {
+    index->xs_[slot] = points[order[slot]].x;
+    index->ys_[slot] = points[order[slot]].y;
+  }
+  index->indices_ = std::move(order);
+
+  index->FinishStats(num_points, start);
+  return index;
+}
+
+std::shared_ptr<const TrajectorySpatialIndex> TrajectorySpatialIndex::Load(
+    const double *x, const double *y, const std::size_t size,
+    const std::uint32_t *tree_indices, const std::uint8_t *tree_split_dims) {
+  const auto start = std::chrono::steady_clock::now();
+  std::shared_ptr<TrajectorySpatialIndex> index(new TrajectorySpatialIndex());
+  index->xs_.resize(size);
+  index->ys_.resize(size);
+  index->indices_.assign(tree_indices, tree_indices + size);
+  index->split_dims_.assign(tree_split_dims, tree_split_dims + size);
+  for (std::size_t slot = 0; slot < size; ++slot) {
+    const std::uint32_t i = tree_indices[slot];
+    if (i >= size || tree_split_dims[slot] > 1) {
+      return nullptr;
+    }
+    index->xs_[slot] = x[i];
+    index->ys_[slot] = y[i];
+  }
+  index->FinishStats(size, start);
+  return index;
+}
+
+void TrajectorySpatialIndex::FinishStats(
+    const std::size_t num_points,
+    const std::chrono::steady_clock::time_point &start) {
+  stats_.num_points = num_points;
+  stats_.build_time_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  stats_.memory_bytes = sizeof(TrajectorySpatialIndex) +
+                        xs_.capacity() * sizeof(double) +
+                        ys_.capacity() * sizeof(double) +
+                        indices_.capacity() * sizeof(std::uint32_t) +
+                        split_dims_.capacity() * sizeof(std::uint8_t);
+  stats_.bytes_per_point =
+      num_points > 0 ? static_cast<double>(stats_.memory_bytes) / num_points
+                     : 0.0;
+}
+
+// Split [begin, end) at its median along the wider side of its bounding box.
+void TrajectorySpatialIndex::BuildRange(
+    const std::size_t begin, const std::size_t end,
+    std::vector<std::uint32_t> *order,
+    const std::vector<TrajectoryPoint> &points) {
+  if (begin >= end) {
+    return;
+  }
+  double min_x = std::numeric_limits<double>::max();
+  double max_x = std::numeric_limits<double>::lowest();
+  double min_y = min_x;
+  double max_y = max_x;
+  for (std::size_t i = begin; i < end; ++i) {
+    const TrajectoryPoint &point = points[(*order)[i]];
+    min_x = std::min(min_x, point.x);
+    max_x = std::max(max_x, point.x);
+    min_y = std::min(min_y, point.y);
+    max_y = std::max(max_y, point.y);
+  }
+  const std::uint8_t dim = (max_x - min_x) >= (max_y - min_y) ? 0 : 1;
+  const std::size_t mid = begin + (end - begin) / 2;
+  std::nth_element(order->begin() + begin, order->begin() + mid,
+                   order->begin() + end,
+                   [&points, dim](const std::uint32_t a, const std::uint32_t b) {
+                     return dim == 0 ? points[a].x < points[b].x
+                                     : points[a].y < points[b].y;
+                   });
+  split_dims_[mid] = dim;
+  BuildRange(begin, mid, order, points);
+  BuildRange(mid + 1, end, order, points);
+}
+
+std::size_t TrajectorySpatialIndex::Nearest(const double x, const double y,
+                                            double *d2_min) const {
+  double best_d2 = std::numeric_limits<double>::max();
+  std::size_t best_slot = 0;
+  NearestRange(0, xs_.size(), x, y, &best_d2, &best_slot);
+  if (d2_min != nullptr) {
+    *d2_min = best_d2;
+  }
+  return indices_.empty() ? 0 : indices_[best_slot];
+}
+
+void TrajectorySpatialIndex::NearestRange(const std::size_t begin,
+                                          const std::size_t end,
+                                          const double x, const double y,
+                                          double *d2_min,
+                                          std::size_t *slot_min) const {
+  if (begin >= end) {
+    return;
+  }
+  const std::size_t mid = begin + (end - begin) / 2;
+  const double dx = xs_[mid] - x;
+  const double dy = ys_[mid] - y;
+  const double d2 = dx * dx + dy * dy;
+  // 距离相同时取原始下标较小的点, 与线性扫描的结果一致
+  if (d2 < *d2_min || (d2 == *d2_min && indices_[mid] < indices_[*slot_min])) {
+    *d2_min = d2;
+    *slot_min = mid;
+  }
+  const double diff = split_dims_[mid] == 0 ? x - xs_[mid] : y - ys_[mid];
+  if (diff < 0.0) {
+    NearestRange(begin, mid, x, y, d2_min, slot_min);
+    if (diff * diff <= *d2_min) {
+      NearestRange(mid + 1, end, x, y, d2_min, slot_min);
+    }
+  } else {
+    NearestRange(mid + 1, end, x, y, d2_min, slot_min);
+    if (diff * diff <= *d2_min) {
+      NearestRange(begin, mid, x, y, d2_min, slot_min);
+    }
+  }
+}
+
+std::vector<std::size_t> TrajectorySpatialIndex::KNearest(
+    const double x, const double y, const std::size_t k) const {
+  // max-heap of (squared distance, slot), holds the k best so far
+  std::vector<std::pair<double, std::size_t>> heap;
+  heap.reserve(k + 1);
+  if (k > 0) {
+    KNearestRange(0, xs_.size(), x, y, k, &heap);
+  }
+  std::sort_heap(heap.begin(), heap.end());
+  std::vector<std::size_t> result(heap.size());
+  for (std::size_t i = 0; i < heap.size(); ++i) {
+    result[i] = indices_[heap[i].second];
+  }
+  return result;
+}
+
+void TrajectorySpatialIndex::KNearestRange(
+    const std::size_t begin, const std::size_t end, const double x,
+    const double y, const std::size_t k,
+    std::vector<std::pair<double, std::size_t>> *heap) const {
+  if (begin >= end) {
+    return;
+  }
+  const std::size_t mid = begin + (end - begin) / 2;
+  const double dx = xs_[mid] - x;
+  const double dy = ys_[mid] - y;
+  const double d2 = dx * dx + dy * dy;
+  if (heap->size() < k) {
+    heap->emplace_back(d2, mid);
+    std::push_heap(heap->begin(), heap->end());
+  } else if (d2 < heap->front().first) {
+    std::pop_heap(heap->begin(), heap->end());
+    heap->back() = std::make_pair(d2, mid);
+    std::push_heap(heap->begin(), heap->end());
+  }
+  const double diff = split_dims_[mid] == 0 ? x - xs_[mid] : y - ys_[mid];
+  const std::size_t near_begin = diff < 0.0 ? begin : mid + 1;
+  const std::size_t near_end = diff < 0.0 ? mid : end;
+  const std::size_t far_begin = diff < 0.0 ? mid + 1 : begin;
+  const std::size_t far_end = diff < 0.0 ? end : mid;
+  KNearestRange(near_begin, near_end, x, y, k, heap);
+  if (heap->size() < k || diff * diff < heap->front().first) {
+    KNearestRange(far_begin, far_end, x, y, k, heap);
+  }
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mpc_controller.h"
+#include "triple_buffer.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief MPCController with the QP solved on a worker thread.
+ *
+ * Every control cycle hands the error state and the discrete model to the
+ * worker, which solves the MPC problem for the newest one it finds and
+ * publishes a plan: the whole control sequence, the states it predicts and
+ * the LQR gain of the same linearization. The control thread applies the
+ * element of the latest plan for the current time, u_k - K (x - x_k), so
+ * the drift of the measured state from the predicted one since the solve is
+ * corrected by the LQR gain. Without a plan, or once the latest one has run
+ * out of steps, the command is the plain LQR fallback. The solve time
+ * therefore only limits how old the plans are, not the command rate, and
+ * horizons far beyond one control period can run at 100 Hz.
+ *
+ * States and plans cross the threads through TripleBuffer, without locks;
+ * the control thread only notifies a condition variable the worker sleeps
+ * on between requests. The formulation, horizon, weights and the
+ * time-varying switch must be set before Start and stay fixed while the
+ * worker runs.
+ */
+class AsyncMpcController : public MPCController {
+ public:
+  // error state and discrete model of a control cycle, for the worker
+  struct Request {
+    std::chrono::steady_clock::time_point stamp;
+    StateMatrix matrix_ad;
+    ControlMatrix matrix_bd;
+    // stage-wise model when time-varying, presized at Start
+    bool time_varying = false;
+    StageModel stages;
+    StateVector state;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // solution of the worker for the request with the same stamp
+  struct Plan {
+    bool valid = false;
+    std::chrono::steady_clock::time_point stamp;
+    // u_0 .. u_(N-1), stacked
+    Eigen::VectorXd controls;
+    // x_0 .. x_N predicted with the model(s) of the request
+    std::vector<StateVector, Eigen::aligned_allocator<StateVector>> states;
+    // LQR gain of the same model, for the drift correction
+    GainMatrix gain;
+    MpcOsqpStats stats;
+    // QP, sequence extraction, prediction and gain [us]
+    double solve_time_us = 0.0;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  AsyncMpcController();
+  ~AsyncMpcController() override;
+
+  /**
+   * @brief size the plans for the current horizon and start the worker
+   */
+  void Start();
+
+  /**
+   * @brief stop and join the worker; the next Start resets the plans
+   */
+  void Stop();
+
+  bool ComputeControlCommand(const VehicleState &localization,
+                             const TrajectoryData &planning_published_trajectory,
+                             ControlCmd &cmd) override;
+
+  // steps between the plan's state and the last cycle, -1 without a plan
+  int plan_age() const { return plan_age_; }
+  // plans published and solves without a plan since Start
+  std::size_t plans() const { return plans_published_.load(); }
+  std::size_t failed_solves() const { return failed_solves_.load(); }
+
+ protected:
+  /**
+   * @brief control-thread part of a cycle after UpdateModel: hand
+   * matrix_state_ and the model to the worker, then take the command from
+   * the latest plan, or from the LQR fallback
+   * @return kPlan, kLqr or kNone
+   */
+  MpcCommandSource ApplyLatestPlan(
+      const std::chrono::steady_clock::time_point &now,
+      ControlVector *control);
+
+ private:
+  void WorkerLoop();
+
+  std::unique_ptr<TripleBuffer<Request>> requests_;
+  std::unique_ptr<TripleBuffer<Plan>> plans_;
+  std::thread worker_;
+  std::atomic<bool> running_{false};
+  // the worker sleeps here between requests
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  // time limit of a worker solve: half the time a plan stays usable [us]
+  double worker_time_limit_us_ = 0.0;
+
+  std::atomic<std::size_t> plans_published_{0};
+  std::atomic<std::size_t> failed_solves_{0};
+  int plan_age_ = -1;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+
+#include "Eigen/Eigen"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Dual active-set solver (Goldfarb-Idnani) for small, dense, strictly
+ * convex QPs
+ *
+ *   min 0.5 * x^T H x + g^T x   s.t.  lb <= x <= ub,  lb_a <= C x <= ub_a
+ *
+ * Starts from the unconstrained minimum and adds the most violated
+ * constraint at a time. J = L^-T (H = L L^T) and the triangular factor R of
+ * the active normals are kept up to date with Givens rotations, so one step
+ * costs O(n^2), and a problem with few active constraints finishes in few
+ * steps. Bounds beyond kInfinity are ignored. Storage is sized by Resize;
+ * Solve does not allocate.
+ */
+class DenseQpSolver {
+ public:
+  static constexpr double kInfinity = 1e20;
+
+  // same values as the OSQP status codes
+  enum Status {
+    kSolved = 1,
+    kMaxIterations = -2,
+    kInfeasible = -3,
+    kTimeLimit = -6,
+    kNotConvex = -7,
+  };
+
+  /**
+   * @brief size the workspace for n variables and m rows of C
+   */
+  void Resize(const int num_variables, const int num_rows);
+
+  /**
+   * @brief factorize H; false if it is not positive definite
+   */
+  bool SetHessian(const Eigen::MatrixXd &H);
+
+  /**
+   * @brief solve with the Hessian of the last SetHessian
+   * @param max_iterations limit on the add/drop steps
+   * @param time_limit_us limit on the solve time, checked every add/drop
+   * step, 0 for none
+   * @param x solution, or the last iterate if not kSolved; the iterates of
+   * the dual method are not primal feasible
+   * @return Status
+   */
+  int Solve(const Eigen::VectorXd &g, const Eigen::VectorXd &lb,
+            const Eigen::VectorXd &ub, const Eigen::MatrixXd &C,
+            const Eigen::VectorXd &lb_a, const Eigen::VectorXd &ub_a,
+            const int max_iterations, const double time_limit_us,
+            Eigen::VectorXd *x);
+
+  // add/drop steps of the last Solve
+  int iterations() const { return iterations_; }
+  // active constraints at the solution of the last Solve
+  int num_active() const { return num_active_; }
+
+  // heap held by the factorization and the active-set workspace [bytes]
+  size_t MemoryBytes() const;
+
+ private:
+  // constraint i reads normal_i^T x >= bound_i:
+  //   [0, n)          x_j >= lb_j
+  //   [n, 2n)        -x_j >= -ub_j
+  //   [2n, 2n + m)    C_r x >= lb_a_r
+  //   [2n + m, 2n + 2m)  -C_r x >= -ub_a_r
+  double Bound(const int i) const;
+  double Slack(const int i, const Eigen::VectorXd &x) const;
+  // d_ = J^T normal_i
+  void TransformNormal(const int i);
+  // append constraint i with d_ = J^T normal_i, false if it is linearly
+  // dependent on the active set
+  bool AddConstraint(const int i);
+  // remove the constraint at active position k
+  void DropConstraint(const int k);
+
+  int num_variables_ = 0;
+  int num_rows_ = 0;
+  bool factorized_ = false;
+  Eigen::LLT<Eigen::MatrixXd> llt_;
+  // L^-T of the current Hessian
+  Eigen::MatrixXd J0_;
+  // J0_ rotated by the active set of the current Solve
+  Eigen::MatrixXd J_;
+  Eigen::MatrixXd R_;
+  Eigen::VectorXd d_;
+  Eigen::VectorXd z_;
+  Eigen::VectorXd r_;
+  // multipliers of the active constraints
+  Eigen::VectorXd u_;
+  std::vector<int> active_;
+  std::vector<char> is_active_;
+  int num_active_ = 0;
+  int iterations_ = 0;
+
+  // problem of the running Solve
+  const Eigen::VectorXd *lb_ = nullptr;
+  const Eigen::VectorXd *ub_ = nullptr;
+  const Eigen::MatrixXd *C_ = nullptr;
+  const Eigen::VectorXd *lb_a_ = nullptr;
+  const Eigen::VectorXd *ub_a_ = nullptr;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "Eigen/Eigen"
+
+namespace shenlan {
+namespace control {
+
+// one linear MPC problem of ExplicitMpcLaw: x_(k+1) = A x_k + B u_k, cost
+// sum of x_k^T Q x_k (k = 1 .. N) and u_k^T R u_k (k = 0 .. N-1), box limits
+// on u_k; the law is computed for x_0 in [x_lower, x_upper]
+struct ExplicitMpcProblem {
+  Eigen::MatrixXd matrix_a;
+  Eigen::MatrixXd matrix_b;
+  Eigen::MatrixXd matrix_q;
+  Eigen::MatrixXd matrix_r;
+  Eigen::VectorXd u_lower;
+  Eigen::VectorXd u_upper;
+  Eigen::VectorXd x_lower;
+  Eigen::VectorXd x_upper;
+  int horizon = 10;
+};
+
+// offline exploration and region tree of ExplicitMpcLaw::Build
+struct ExplicitMpcBuildOptions {
+  // random initial states solved to find the active sets
+  int samples = 20000;
+  // regions a leaf of the tree may list, unless max_depth stops the split
+  int leaf_size = 8;
+  int max_depth = 16;
+  unsigned int seed = 1;
+};
+
+/**
+ * @brief Piecewise-affine explicit solution of one ExplicitMpcProblem.
+ *
+ * The condensed QP min 0.5 U^T H U + (F x_0)^T U, lb <= U <= ub is a
+ * multiparametric QP in x_0: for a fixed set of controls at their limits,
+ * the free ones are affine in x_0, and the set of x_0 where that active set
+ * is optimal is a polyhedron (free controls within their limits, multipliers
+ * of the active ones nonnegative). Build solves the QP (DenseQpSolver) at
+ * random x_0 of the box, and keeps every new active set as a region: its
+ * halfspaces, rows that cannot bind inside the box dropped, and the affine
+ * law of the first control u_0 = K x_0 + k. A binary tree of axis-aligned
+ * splits of the box, each leaf listing the regions that intersect its cell,
+ * locates x_0 online. Active sets no sample reached are not in the table,
+ * so Evaluate can fail inside the box too; the caller then solves the QP.
+ *
+ * Stored in float32, halfspaces normalized: the law is continuous across
+ * region boundaries, so a state classified into the neighbouring region
+ * by rounding gets the same control up to rounding. Evaluate does not
+ * allocate.
+ */
+class ExplicitMpcLaw {
+ public:
+  /**
+   * @return false if the problem is malformed or H is not positive definite
+   */
+  bool Build(const ExplicitMpcProblem &problem,
+             const ExplicitMpcBuildOptions &options);
+
+  /**
+   * @brief u_0 of the MPC at x_0 (state_dim values) -> control (control_dim
+   * values); false if x_0 is outside the box or in no stored region
+   */
+  bool Evaluate(const double *state, double *control) const;
+
+  std::size_t state_dim() const { return state_dim_; }
+  std::size_t control_dim() const { return control_dim_; }
+  std::size_t num_regions() const {
+    return row_offset_.empty() ? 0 : row_offset_.size() - 1;
+  }
+  std::size_t num_nodes() const { return nodes_.size(); }
+  std::size_t depth() const { return depth_; }
+
+  // bytes of the stored table
+  std::size_t MemoryBytes() const;
+
+  void Write(std::ostream *out) const;
+  bool Read(std::istream *in);
+
+ private:
+  // inner node: split of axis at value, left child follows the node, right
+  // child at index second; leaf (axis < 0): regions leaf_regions_[first ..
+  // first + second)
+  struct Node {
+    std::int32_t axis;
+    float value;
+    std::uint32_t first;
+    std::uint32_t second;
+  };
+
+  // x_0 satisfies the halfspaces of region r
+  bool Contains(const std::size_t r, const double *state) const;
+  // some x_0 of the cell [lower, upper] satisfies the halfspaces of region r
+  bool Intersects(const std::size_t r, const Eigen::VectorXd &lower,
+                  const Eigen::VectorXd &upper) const;
+  void BuildTree(const std::vector<std::uint32_t> &regions,
+                 const Eigen::VectorXd &lower, const Eigen::VectorXd &upper,
+                 const std::size_t depth,
+                 const ExplicitMpcBuildOptions &options);
+
+  std::uint32_t state_dim_ = 0;
+  std::uint32_t control_dim_ = 0;
+  std::uint32_t depth_ = 0;
+  std::vector<float> lower_;
+  std::vector<float> upper_;
+  // halfspaces a^T x <= b of region r: rows_[row_offset_[r] ..
+  // row_offset_[r+1]), state_dim_ + 1 floats each (a, b)
+  std::vector<std::uint32_t> row_offset_;
+  std::vector<float> rows_;
+  // u_0 = K x_0 + k of region r: control_dim_ rows of (K, k)
+  std::vector<float> laws_;
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> leaf_regions_;
+};
+
+// region and sampling of ExplicitMpc::Build
+struct ExplicitMpcConfig {
+  int horizon = 10;
+  // speed grid of the lateral laws [m/s], evenly spaced in 1 / v
+  double min_speed = 1.0;
+  double max_speed = 15.0;
+  int num_speeds = 15;
+  // box of the error state covered by the table
+  double max_lateral_error = 1.0;
+  double max_lateral_error_rate = 2.0;
+  double max_heading_error = 0.5;
+  double max_heading_error_rate = 1.0;
+  double max_speed_error = 5.0;
+  ExplicitMpcBuildOptions options;
+};
+
+/**
+ * @brief Explicit MPC of the error model of MPCController.
+ *
+ * With the controller's diagonal Q and R the 6x2 problem falls apart into a
+ * lateral one (lateral error and heading error and their rates, front wheel
+ * angle) whose model depends on the speed, and a longitudinal one (speed
+ * error, acceleration; the station error has no weight and no effect) that
+ * does not. The lateral model depends on the speed through 1 / v, so the
+ * lateral law is stored for a grid of speeds evenly spaced in 1 / v and
+ * interpolated linearly in 1 / v between the two neighbouring ones; the
+ * longitudinal law is stored once.
+ * The table covers the box of ExplicitMpcConfig (the heading limit of the
+ * QP, +-pi, cannot bind inside it); Evaluate fails outside the box or the
+ * speed range, or where no sampled region covers the state.
+ *
+ * Built offline (explicit_mpc_tool) by MPCController::BuildExplicitMpc
+ * from the same model, weights and limits the controller uses, and stored
+ * as one binary file.
+ */
+class ExplicitMpc {
+ public:
+  // the error state and the controls of MPCController
+  typedef Eigen::Matrix<double, 6, 1> StateVector;
+  typedef Eigen::Matrix<double, 2, 1> ControlVector;
+
+  // speed i = 0 .. num_speeds - 1 of the grid of config [m/s]
+  static double GridSpeed(const ExplicitMpcConfig &config, const int i);
+
+  /**
+   * @param lateral problem of every grid speed, GridSpeed(config, i)
+   * @param longitudinal the speed-independent speed-error problem
+   * @param model_key parameters the problems were derived from (vehicle
+   * model, weights, limits, horizon); stored with the table so a stale file
+   * is rejected by Load
+   */
+  bool Build(const ExplicitMpcConfig &config,
+             const std::vector<ExplicitMpcProblem> &lateral,
+             const ExplicitMpcProblem &longitudinal,
+             const std::vector<double> &model_key);
+
+  /**
+   * @brief front wheel angle and acceleration of the MPC at the error state
+   * and speed v; false where the table does not cover them
+   */
+  bool Evaluate(const StateVector &state, const double v,
+                ControlVector *control) const;
+
+  int horizon() const { return horizon_; }
+  const std::vector<double> &model_key() const { return model_key_; }
+  const std::vector<ExplicitMpcLaw> &lateral_laws() const {
+    return lateral_;
+  }
+  const ExplicitMpcLaw &longitudinal_law() const { return longitudinal_; }
+
+  // bytes of the stored tables
+  std::size_t MemoryBytes() const;
+
+  bool Save(const std::string &path) const;
+
+  /**
+   * @brief read a table written by Save
+   * @param model_key must equal the key the table was built with
+   * @return false if the file is missing, malformed or was built for a
+   * different model
+   */
+  bool Load(const std::string &path, const std::vector<double> &model_key);
+
+ private:
+  int horizon_ = 0;
+  std::vector<double> model_key_;
+  // 1 / v of the first grid speed and the step of 1 / v between two
+  double inverse_min_speed_ = 0.0;
+  double inverse_speed_step_ = 0.0;
+  std::vector<ExplicitMpcLaw> lateral_;
+  ExplicitMpcLaw longitudinal_;
+};
+
+}  // namespace control
+}  // namespace shenlan
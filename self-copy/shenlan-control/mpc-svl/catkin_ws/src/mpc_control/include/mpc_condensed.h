@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+
+#include "Eigen/Eigen"
+#include "dense_qp.h"
+#include "mpc_osqp.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Condensed solver of the same linear MPC problem as MpcOsqp.
+ *
+ * The states are eliminated through the prediction x_k = A^k x_0 +
+ * sum_j A^(k-1-j) B u_j, leaving a dense QP in the N*m controls only:
+ * H = Gamma^T Q Gamma + R, with the control limits as variable bounds and
+ * the finite state limits of stages 1..N as inequality rows. Infinite state
+ * limits (beyond DenseQpSolver::kInfinity, e.g. numeric_limits::max) add no
+ * rows. Cost and constraints equal MpcOsqp's (diagonal of Q and R in the
+ * quadratic term, full Q in the reference term), so both return the same
+ * controls up to solver tolerance.
+ *
+ * H and the state rows are built from the blocks A^(i-1) B in O(N^2) and
+ * only when A or B changed; x_0 and the reference only move the gradient
+ * and the row bounds. The QP is solved by DenseQpSolver, which pays a
+ * Cholesky factorization of H whenever the model changed, so the condensed
+ * form pays off for short horizons and small state counts.
+ *
+ * SetMoveBlocking holds the input constant over blocks of stages as in
+ * MpcOsqp. Here the QP then has one variable per block and control: H, the
+ * gradient and the state rows are summed over the stages of each block
+ * after condensing, so a long horizon with few moves pays O(N^2) for the
+ * condensing but factorizes and solves only the blocked QP.
+ *
+ * Same interface as MpcOsqp: the first Solve sets up, Update stages the
+ * next model, initial state and reference. stats() reports the condensing
+ * as assembly (setup) or update time and the active-set steps as
+ * iterations.
+ */
+template <int kStates = Eigen::Dynamic, int kControls = Eigen::Dynamic>
+class MpcCondensed {
+ public:
+  typedef Eigen::Matrix<double, kStates, kStates> StateMatrix;
+  typedef Eigen::Matrix<double, kStates, kControls> ControlMatrix;
+  typedef Eigen::Matrix<double, kControls, kControls> ControlWeightMatrix;
+  typedef Eigen::Matrix<double, kStates, 1> StateVector;
+  typedef Eigen::Matrix<double, kControls, 1> ControlVector;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * @brief same parameters as MpcOsqp; eps_abs is unused, the active-set
+   * solution is exact up to rounding
+   */
+  MpcCondensed(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+               const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,
+               const StateVector &matrix_initial_x,
+               const ControlVector &matrix_u_lower,
+               const ControlVector &matrix_u_upper,
+               const StateVector &matrix_x_lower,
+               const StateVector &matrix_x_upper,
+               const StateVector &matrix_x_ref, const int max_iter,
+               const int horizon, const double eps_abs);
+
+  /**
+   * @brief set the model, initial state and reference of the next Solve
+   */
+  void Update(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+              const StateVector &matrix_initial_x,
+              const StateVector &matrix_x_ref);
+
+  /**
+   * @brief hold the input constant over blocks of stages, same lengths as
+   * MpcOsqp::SetMoveBlocking; empty (the default) for a move at every stage.
+   * The next Solve sizes the QP again if the blocks changed
+   */
+  void SetMoveBlocking(const std::vector<int> &block_lengths);
+
+  // independent control moves of the horizon
+  size_t num_blocks() const { return num_blocks_; }
+
+  /**
+   * @brief time limit of the following active-set solves [us], 0 for none
+   */
+  void SetTimeLimit(const double time_limit_us) {
+    time_limit_us_ = time_limit_us;
+  }
+
+  // control vector
+  bool Solve(std::vector<double> *control_cmd);
+
+  /**
+   * @brief always false: the dual active-set iterates are not primal
+   * feasible, a stopped solve leaves nothing to use
+   */
+  bool LastIterate(std::vector<double> *) const { return false; }
+
+  /**
+   * @brief controls u_0 .. u_(N-1) of the last successful Solve, stacked
+   * into controls (resized to N * m on first use), blocks expanded to their
+   * stages; false if it failed
+   */
+  bool ControlSequence(Eigen::VectorXd *controls) const;
+
+  const MpcOsqpStats &stats() const { return stats_; }
+
+  // heap held by the condensed QP [bytes]
+  size_t MemoryBytes() const;
+
+ private:
+  // A^(i-1) B, H and the state rows from the current A, B
+  void Condense();
+  // gradient and row bounds from the current x_0 and reference
+  void CalculateGradient();
+  // stages of the blocks of block_lengths -> block_start_, block_of_stage_,
+  // num_blocks_
+  void AssignBlocks(const std::vector<int> &block_lengths);
+  // sum of the m-column blocks of stage_matrix over the stages of every
+  // block -> blocked (rows x num_blocks_ * m)
+  void SumBlockColumns(const Eigen::MatrixXd &stage_matrix,
+                       Eigen::MatrixXd *blocked) const;
+  bool blocked() const { return num_blocks_ < horizon_; }
+
+ private:
+  StateMatrix matrix_a_;
+  ControlMatrix matrix_b_;
+  StateMatrix matrix_q_;
+  StateVector q_diagonal_;
+  ControlVector r_diagonal_;
+  // Q x_ref
+  StateVector q_x_ref_;
+  StateVector matrix_initial_x_;
+  const ControlVector matrix_u_lower_;
+  const ControlVector matrix_u_upper_;
+  const StateVector matrix_x_lower_;
+  const StateVector matrix_x_upper_;
+  StateVector matrix_x_ref_;
+  int max_iteration_;
+  double time_limit_us_ = 0.0;
+  size_t horizon_;
+  size_t state_dim_;
+  size_t control_dim_;
+  // state components with a finite lower or upper limit, one row per stage
+  std::vector<int> bounded_states_;
+  // control block j holds u over stages block_start_[j] .. block_start_[j+1]-1
+  size_t num_blocks_ = 0;
+  std::vector<size_t> block_start_;
+  std::vector<size_t> block_of_stage_;
+
+  // A^(i-1) B, i = 1..N
+  std::vector<ControlMatrix, Eigen::aligned_allocator<ControlMatrix>>
+      impulse_;
+  // A^k x_0 and the costate of the gradient recursion, k = 0..N
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector>>
+      free_response_;
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector>> costate_;
+
+  Eigen::MatrixXd hessian_;
+  Eigen::VectorXd gradient_;
+  Eigen::VectorXd lower_bound_;
+  Eigen::VectorXd upper_bound_;
+  Eigen::MatrixXd constraint_;
+  Eigen::VectorXd constraint_lower_;
+  Eigen::VectorXd constraint_upper_;
+  // the QP in the block moves, only with blocks: H summed over the blocks
+  // on both sides, its column sums, gradient and state rows
+  Eigen::MatrixXd blocked_hessian_;
+  Eigen::MatrixXd blocked_columns_;
+  Eigen::VectorXd blocked_gradient_;
+  Eigen::MatrixXd blocked_constraint_;
+  Eigen::VectorXd solution_;
+  DenseQpSolver qp_;
+
+  bool initialized_ = false;
+  bool dynamics_changed_ = false;
+  MpcOsqpStats stats_;
+};
+
+extern template class MpcCondensed<6, 2>;
+extern template class MpcCondensed<Eigen::Dynamic, Eigen::Dynamic>;
+
+}  // namespace control
+}  // namespace shenlan
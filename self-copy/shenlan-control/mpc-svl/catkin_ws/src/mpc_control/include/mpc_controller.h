@@ -5,10 +5,21 @@
 #include <iomanip>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "Eigen/Core"
 #include "common.h"
+#include "explicit_mpc.h"
+#include "mpc_condensed.h"
+#include "mpc_deadline_monitor.h"
+#include "mpc_horizon_scheduler.h"
 #include "mpc_osqp.h"
+#include "mpc_riccati.h"
+#include "mpc_rti.h"
+#include "riccati_solver.h"
+#include "trajectory_matcher.h"
+#include "trajectory_snapshot.h"
 
 
 
@@ -18,18 +29,176 @@ namespace control {
 
 using Matrix = Eigen::MatrixXd;
 
+// QP formulation of the MPC problem
+enum class MpcFormulation {
+  // states and controls as variables, dynamics as equality rows (OSQP)
+  kSparse,
+  // states eliminated, dense QP in the controls (DenseQpSolver)
+  kCondensed,
+  // interior point with Riccati recursion over the stages (MpcRiccati)
+  kRiccati,
+};
+
 class MPCController {
  public:
+  // lateral error, lateral error rate, heading error, heading error rate,
+  // station error, velocity error
+  static constexpr int kStateSize = 6;
+  // front wheel steer angle, acceleration
+  static constexpr int kControlSize = 2;
+  // prediction horizon [steps]
+  static constexpr int kHorizon = 10;
+
+  // fixed-size matrices of the model: sized at compile time, no heap
+  // allocation and unrolled products in the control loop
+  typedef Eigen::Matrix<double, kStateSize, kStateSize> StateMatrix;
+  typedef Eigen::Matrix<double, kStateSize, kControlSize> ControlMatrix;
+  typedef Eigen::Matrix<double, kControlSize, kControlSize> ControlWeightMatrix;
+  typedef Eigen::Matrix<double, kStateSize, 1> StateVector;
+  typedef Eigen::Matrix<double, kControlSize, 1> ControlVector;
+  typedef Eigen::Matrix<double, kControlSize, kStateSize> GainMatrix;
+  typedef std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>>
+      StateMatrixSequence;
+  typedef std::vector<ControlMatrix, Eigen::aligned_allocator<ControlMatrix>>
+      ControlMatrixSequence;
+  typedef std::vector<StateVector, Eigen::aligned_allocator<StateVector>>
+      StateVectorSequence;
+  typedef MpcOsqp<kStateSize, kControlSize> Solver;
+  typedef MpcCondensed<kStateSize, kControlSize> CondensedSolver;
+  typedef MpcRiccati<kStateSize, kControlSize> RiccatiSolver;
+
+  // discrete model of every stage of the horizon:
+  // x_(k+1) = A_k x_k + B_k u_k + c_k
+  struct StageModel {
+    StateMatrixSequence matrix_ad;
+    ControlMatrixSequence matrix_bd;
+    // effect of the reference curvature over one step
+    StateVectorSequence matrix_cd;
+  };
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   MPCController();
-  ~MPCController();
+  virtual ~MPCController();
 
   void LoadControlConf();
   void Init();
 
-  bool ComputeControlCommand(
+  virtual bool ComputeControlCommand(
       const VehicleState &localization,
       const TrajectoryData &planning_published_trajectory, ControlCmd &cmd);
 
+  /**
+   * @brief choose the QP formulation; the solver is set up again on the next
+   * cycle
+   */
+  void SetMpcFormulation(const MpcFormulation formulation);
+
+  /**
+   * @brief prediction horizon [steps], kHorizon by default; the solver is
+   * set up again on the next cycle if the horizon changed
+   */
+  void SetHorizon(const int horizon);
+
+  /**
+   * @brief hold the input constant over blocks of stages, see
+   * MpcOsqp::SetMoveBlocking; empty (the default) for a move at every
+   * stage. Sparse and condensed formulations, the Riccati one keeps a move
+   * per stage
+   */
+  void SetMoveBlocking(const std::vector<int> &block_lengths);
+
+  /**
+   * @brief choose the horizon of every cycle by MpcHorizonScheduler from the
+   * speed and the QP time against the time budget, within the limits of
+   * config, instead of the fixed SetHorizon; the QP is set up again only
+   * when the horizon changes. Synchronous controller only, the horizon of
+   * AsyncMpcController is fixed at Start
+   */
+  void SetAdaptiveHorizon(const MpcHorizonConfig &config);
+
+  // horizon of the last cycle [steps]
+  int horizon() const { return horizon_; }
+
+  // speed- and load-dependent horizon, if SetAdaptiveHorizon was called
+  const MpcHorizonScheduler &horizon_scheduler() const {
+    return horizon_scheduler_;
+  }
+
+  /**
+   * @brief linear time-varying MPC: every stage is linearized at the speed
+   * of the reference point the vehicle reaches there, with the affine term
+   * of the reference curvature, instead of one model at the current speed
+   * for the whole horizon. Sparse and Riccati formulations only, the
+   * condensed one keeps the model of the current speed. The reference is
+   * sampled from the snapshot's station line, so the snapshots have to be
+   * created with build_station_line
+   */
+  void SetTimeVarying(const bool time_varying) {
+    mpc_time_varying_ = time_varying;
+  }
+
+  /**
+   * @brief nonlinear MPC of the kinematic bicycle by real-time iteration
+   * (MpcRti, one SQP step per cycle on a persistent OSQP workspace) instead
+   * of the linear error model; it holds at large heading errors and at low
+   * speed, where the error model divides by minimum_speed_protection_.
+   * Lateral, heading and speed error with the weights of the linear model;
+   * the formulation, move blocking and time-varying settings do not apply.
+   * Synchronous controller only, AsyncMpcController solves the linear model.
+   * Like the time-varying model it needs snapshots with a station line
+   */
+  void SetNonlinear(const bool nonlinear);
+
+  // the real-time iteration solver, null before the first nonlinear cycle
+  const MpcRti *mpc_rti() const { return mpc_rti_.get(); }
+
+  /**
+   * @brief explicit MPC table built by BuildExplicitMpc, null (the default)
+   * for none. Inside the table the command is looked up without a solver
+   * call; outside it, or with another horizon, with the time-varying or
+   * nonlinear model or with move blocking, the QP is solved as before.
+   * Synchronous controller only
+   */
+  void SetExplicitMpc(std::shared_ptr<const ExplicitMpc> explicit_mpc) {
+    explicit_mpc_ = std::move(explicit_mpc);
+  }
+
+  /**
+   * @brief precompute the explicit MPC of the horizon config.horizon with
+   * the model, weights and limits of Init; false if they do not decouple
+   * into the lateral and the speed error problem ExplicitMpc expects
+   */
+  bool BuildExplicitMpc(const ExplicitMpcConfig &config,
+                        ExplicitMpc *explicit_mpc) const;
+
+  // parameters the explicit MPC of the given horizon depends on (vehicle
+  // model, weights, limits), keys the table file
+  std::vector<double> ExplicitMpcModelKey(const int horizon) const;
+
+  /**
+   * @brief time budget of a whole control cycle [us], 0 for none. The QP
+   * solve is stopped where the remaining budget, less a reserve for the LQR
+   * fallback, runs out; the command then comes from the solver's last
+   * iterate if it is close enough to feasible, else from the LQR gain of the
+   * same linearization
+   */
+  void SetTimeBudget(const double time_budget_us) {
+    mpc_time_budget_us_ = time_budget_us;
+  }
+
+  // setup, update and solve time of the last cycle's QP
+  const MpcOsqpStats &mpc_stats() const { return mpc_stats_; }
+
+  // where the last command came from
+  MpcCommandSource command_source() const { return command_source_; }
+
+  // deadline misses, fallbacks and cycle time percentiles
+  MpcDeadlineMonitor &deadline_monitor() { return deadline_monitor_; }
+
+  // the Riccati solve of the last LQR fallback
+  const RiccatiStats &lqr_stats() const { return lqr_stats_; }
+
  protected:
   double Wheel2SteerPct(const double wheel_angle);
   void UpdateState(const VehicleState &vehicle_state);
@@ -59,7 +228,97 @@ class MPCController {
 
   TrajectoryPoint QueryNearestPointByPosition(const double x, const double y);
 
-  std::vector<TrajectoryPoint> trajectory_points_;
+  /**
+   * @brief switch to a new trajectory snapshot, then update the error state
+   * matrix_state_ and the discrete model matrix_ad_, and stage_model_ for the
+   * time-varying MPC; false without a trajectory
+   */
+  bool UpdateModel(const VehicleState &localization,
+                   const TrajectoryData &planning_published_trajectory);
+
+  /**
+   * @brief horizon of the next solve from the scheduler, with the QP time of
+   * the last one; nothing without SetAdaptiveHorizon
+   */
+  void UpdateHorizon(const double speed);
+
+  /**
+   * @brief discrete model of the speed v, Tustin transform of matrix_a_
+   */
+  void DiscretizeAtSpeed(const double v, StateMatrix *matrix_ad) const;
+
+  /**
+   * @brief stage_model_ along the reference from arc length s at the current
+   * speed v, whose model matrix_ad_ is stage 0: stage k at the point reached
+   * after k steps at the reference speed
+   */
+  void UpdateStageModel(const double s, const double v);
+
+  /**
+   * @brief curvature and reference speed of the trajectory at the points
+   * reached from arc length s after k = 0 .. count - 1 steps: the first step
+   * at speed v, the following ones at the reference speed (at least
+   * minimum_speed_protection_); kappa and speed are resized to count
+   */
+  void SampleReference(const double s, const double v, const int count,
+                       std::vector<double> *kappa,
+                       std::vector<double> *speed) const;
+
+  /**
+   * @brief one real-time iteration of the nonlinear MPC at speed v from the
+   * errors of matrix_state_, within time_limit_us (0 for none)
+   * @return kSolution, kIterate or kNone, as SolveQp
+   */
+  MpcCommandSource SolveRti(const double v, const double time_limit_us,
+                            std::vector<double> *control_cmd,
+                            MpcOsqpStats *stats);
+
+  /**
+   * @brief set up or update the QP solver of mpc_formulation_ and solve it
+   * within time_limit_us (0 for none)
+   * @param stages time-varying model of the sparse and Riccati
+   * formulations, null for matrix_ad, matrix_bd at every stage
+   * @param control_cmd first control of the solution or usable iterate
+   * @return kSolution, kIterate or kNone
+   */
+  MpcCommandSource SolveQp(const StateMatrix &matrix_ad,
+                           const ControlMatrix &matrix_bd,
+                           const StageModel *stages,
+                           const StateVector &initial_state,
+                           const StateVector &reference_state,
+                           const double time_limit_us,
+                           std::vector<double> *control_cmd,
+                           MpcOsqpStats *stats);
+
+  /**
+   * @brief first control of the explicit MPC at speed v from the errors of
+   * matrix_state_; false without a table that applies or covers the state
+   */
+  bool EvaluateExplicitMpc(const double v, std::vector<double> *control_cmd);
+
+  // controls u_0 .. u_(N-1) of the last successful SolveQp or SolveRti
+  bool QpControlSequence(Eigen::VectorXd *controls) const;
+
+  /**
+   * @brief LQR gain of the given model and the MPC weights; false if the
+   * Riccati solve gives no finite gain
+   */
+  bool ComputeLqrGain(const StateMatrix &matrix_ad,
+                      const ControlMatrix &matrix_bd, GainMatrix *gain,
+                      RiccatiStats *stats) const;
+
+  /**
+   * @brief u = -K (x - x_ref) with the LQR gain of matrix_ad_, matrix_bd_,
+   * clamped to the control limits; false without a finite gain
+   */
+  bool ComputeLqrFallback(const StateVector &reference_state,
+                          ControlVector *control);
+
+  // trajectory being tracked, shared with the publisher, never copied
+  TrajectorySnapshotPtr trajectory_;
+
+  // windowed match-point search, remembers the last matched index
+  TrajectoryMatcher trajectory_matcher_;
 
   // the following parameters are vehicle physics related.
   // control time interval
@@ -91,33 +350,81 @@ class MPCController {
   // number of states, includes
   // lateral error, lateral error rate, heading error, heading error rate,
   // station error, velocity error,
-  const int basic_state_size_ = 6;  // 状态空间的大小
-  const int controls_ = 2;        // 控制量分别为车辆的转角/汽车前进的加速度(正负皆可)
-  const int horizon_ = 10;  
+  const int basic_state_size_ = kStateSize;  // 状态空间的大小
+  const int controls_ = kControlSize;        // 控制量分别为车辆的转角/汽车前进的加速度(正负皆可)
+  int horizon_ = kHorizon;
 
   // vehicle state matrix
-  Eigen::MatrixXd matrix_a_;
+  StateMatrix matrix_a_;
   // vehicle state matrix (discrete-time)
-  Eigen::MatrixXd matrix_ad_;
+  StateMatrix matrix_ad_;
   // control matrix
-  Eigen::MatrixXd matrix_b_;
+  ControlMatrix matrix_b_;
   // control matrix (discrete-time)
-  Eigen::MatrixXd matrix_bd_;
+  ControlMatrix matrix_bd_;
   // control authority weighting matrix
-  Eigen::MatrixXd matrix_r_;
+  ControlWeightMatrix matrix_r_;
   // state weighting matrix
-  Eigen::MatrixXd matrix_q_;
+  StateMatrix matrix_q_;
   // updated state weighting matrix
-  Eigen::MatrixXd matrix_q_updated_;
+  StateMatrix matrix_q_updated_;
   // vehicle state matrix coefficients
-  Eigen::MatrixXd matrix_a_coeff_;
-  // 4 by 1 matrix; state matrix
-  Eigen::MatrixXd matrix_state_;
+  StateMatrix matrix_a_coeff_;
+  // 6 by 1 matrix; state matrix
+  StateVector matrix_state_;
+  // time-varying model of the horizon, sized on first use
+  StageModel stage_model_;
+  // reference curvature and speed of the stages, sized on first use
+  std::vector<double> stage_kappa_;
+  std::vector<double> stage_speed_;
+  // arc length of the last matched point on the trajectory
+  double matched_s_ = 0.0;
+  // limits of the controls and the states
+  ControlVector lower_bound_;
+  ControlVector upper_bound_;
+  StateVector lower_state_bound_;
+  StateVector upper_state_bound_;
+
+  // QP solver kept across cycles, created on the first cycle
+  std::unique_ptr<Solver> mpc_osqp_;
+  std::unique_ptr<CondensedSolver> mpc_condensed_;
+  std::unique_ptr<RiccatiSolver> mpc_riccati_;
+  std::unique_ptr<MpcRti> mpc_rti_;
+  // precomputed law, shared read-only, null for none
+  std::shared_ptr<const ExplicitMpc> explicit_mpc_;
+  // first control of the solved sequence
+  std::vector<double> control_cmd_;
+  MpcOsqpStats mpc_stats_;
 
   // parameters for mpc solver; number of iterations
   int mpc_max_iteration_ = 0;
   // parameters for mpc solver; threshold for computation
   double mpc_eps_ = 0.0;
+  // parameters for mpc solver; starting point of each solve
+  WarmStartMode mpc_warm_start_ = WarmStartMode::kShifted;
+  // parameters for mpc solver; sparse (OSQP), condensed or Riccati QP
+  MpcFormulation mpc_formulation_ = MpcFormulation::kSparse;
+  // parameters for mpc solver; time budget of a cycle [us], 0 for none
+  double mpc_time_budget_us_ = 0.0;
+  // parameters for mpc solver; stage-wise model along the reference
+  bool mpc_time_varying_ = false;
+  // parameters for mpc solver; nonlinear bicycle model by real-time iteration
+  bool mpc_nonlinear_ = false;
+  // parameters for mpc solver; lengths of the blocks of constant input,
+  // empty for a move per stage
+  std::vector<int> mpc_move_blocking_;
+  // parameters for mpc solver; horizon from speed and load
+  bool mpc_adaptive_horizon_ = false;
+  MpcHorizonScheduler horizon_scheduler_;
+  // parameters for mpc solver; largest constraint violation of a stopped
+  // solver's iterate that is still used as the command
+  double mpc_iterate_tolerance_ = 0.0;
+
+  MpcCommandSource command_source_ = MpcCommandSource::kSolution;
+  MpcDeadlineMonitor deadline_monitor_;
+  // gain of the last LQR fallback
+  GainMatrix lqr_k_;
+  RiccatiStats lqr_stats_;
 
   double max_acceleration_ = 0.0;
   double max_deceleration_ = 0.0;
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace shenlan {
+namespace control {
+
+// where the command of a control cycle came from
+enum class MpcCommandSource {
+  // the QP was solved within the budget
+  kSolution,
+  // the solver stopped at the time or iteration limit, its last iterate
+  // was close enough to feasible
+  kIterate,
+  // LQR gain of the same linearization
+  kLqr,
+  // element of the latest asynchronous plan for the current time, with an
+  // LQR correction of the drift from its predicted state
+  kPlan,
+  // precomputed explicit MPC law, no solver call
+  kExplicit,
+  // nothing usable, zero command
+  kNone,
+};
+
+// deadline statistics since the last Reset
+struct MpcDeadlineSummary {
+  std::size_t cycles = 0;
+  // solver stopped at its time limit, or not started for lack of time
+  std::size_t deadline_misses = 0;
+  // whole cycle, fallback included, longer than the budget
+  std::size_t overruns = 0;
+  std::size_t iterate_fallbacks = 0;
+  std::size_t lqr_fallbacks = 0;
+  // commands from the explicit MPC table
+  std::size_t explicit_commands = 0;
+  // zero command
+  std::size_t failures = 0;
+  // cycle time percentiles over the last kWindow cycles [us]
+  double p50_us = 0.0;
+  double p90_us = 0.0;
+  double p99_us = 0.0;
+  // longest cycle since the last Reset [us]
+  double max_us = 0.0;
+};
+
+/**
+ * @brief per-cycle record of the MPC time budget: deadline misses, budget
+ * overruns, fallbacks by source and the cycle time distribution.
+ *
+ * Counters cover everything since Reset; percentiles cover a ring buffer
+ * of the last kWindow cycles, sized at construction. Record and Summarize
+ * do not allocate, so both can run in the control loop.
+ */
+class MpcDeadlineMonitor {
+ public:
+  // 10 s at 100 Hz
+  static constexpr std::size_t kWindow = 1000;
+
+  MpcDeadlineMonitor();
+
+  void Reset();
+
+  /**
+   * @param cycle_time_us time of the whole cycle
+   * @param budget_us time budget of the cycle, 0 for none
+   * @param deadline_reached the solver stopped at the budget
+   * @param source where the command came from
+   */
+  void Record(const double cycle_time_us, const double budget_us,
+              const bool deadline_reached, const MpcCommandSource source);
+
+  // counters and percentiles of the window, recomputed on each call
+  const MpcDeadlineSummary &Summarize();
+
+ private:
+  MpcDeadlineSummary summary_;
+  // cycle times of the window, next_ is the slot of the next Record
+  std::vector<double> window_;
+  std::vector<double> sorted_;
+  std::size_t next_ = 0;
+  std::size_t filled_ = 0;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+
+namespace shenlan {
+namespace control {
+
+// parameters of MpcHorizonScheduler
+struct MpcHorizonConfig {
+  // horizon at standstill and the longest one allowed [steps]
+  int min_horizon = 10;
+  int max_horizon = 100;
+  // steps added per m/s of speed
+  double steps_per_speed = 4.0;
+  // the horizon moves in multiples of step, so the QP is set up again only
+  // when the speed or the load crosses one
+  int step = 10;
+  // share of the time budget the QP may take before the horizon shrinks,
+  // and below which the next longer horizon is estimated to stay before a
+  // shorter one may grow back
+  double shrink_load = 0.7;
+  double grow_load = 0.4;
+  // weight of the newest cycle in the smoothed solve time per step
+  double smoothing = 0.1;
+};
+
+/**
+ * @brief prediction horizon of the next MPC cycle from the speed and the
+ * solve time of the last ones.
+ *
+ * The horizon grows with the speed, min_horizon + steps_per_speed * v
+ * rounded up to a multiple of step, and goes down once the speed asks for
+ * half a step less. The solve time per step is smoothed over the cycles and
+ * caps the horizon: the cap drops by one step when the estimate at the
+ * current horizon passes shrink_load of the budget or the solver hit the
+ * time limit, and rises by one step when the estimate one step further is
+ * below grow_load. The estimate assumes time linear in the horizon, as for
+ * the sparse and Riccati formulations. No allocation.
+ */
+class MpcHorizonScheduler {
+ public:
+  MpcHorizonScheduler();
+
+  // new parameters, back to the standstill horizon without load history
+  void Configure(const MpcHorizonConfig &config);
+
+  /**
+   * @param speed vehicle speed [m/s]
+   * @param qp_time_us update and solve time of the last QP, setup excluded;
+   * 0 if no QP was solved
+   * @param budget_us time budget of a cycle, 0 for none (no load cap)
+   * @param deadline_reached the last solve stopped at its time limit
+   * @return horizon of the next cycle
+   */
+  int Update(const double speed, const double qp_time_us,
+             const double budget_us, const bool deadline_reached);
+
+  int horizon() const { return horizon_; }
+  // longest horizon the load allows at the moment
+  int load_cap() const { return load_cap_; }
+  // cycles on which the horizon changed since Configure
+  std::size_t changes() const { return changes_; }
+
+ private:
+  int Clamp(const int horizon) const;
+
+  MpcHorizonConfig config_;
+  int horizon_ = 0;
+  int speed_horizon_ = 0;
+  int load_cap_ = 0;
+  // smoothed QP time per step, negative before the first sample [us]
+  double step_time_us_ = -1.0;
+  std::size_t changes_ = 0;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -12,62 +12,242 @@
 namespace shenlan {
 namespace control {
 
+// timings and outcome of the last MpcOsqp::Solve
+struct MpcOsqpStats {
+  // QP assembly and osqp_setup (scaling, KKT factorization), only on the
+  // solve that creates the workspace [us]
+  double setup_time_us = 0.0;
+  // the QP assembly part of setup_time_us: CSC arrays, gradient and
+  // bounds [us]
+  double assembly_time_us = 0.0;
+  // in-place update of A, bounds and q, including the KKT refactorization
+  // when A changed [us]
+  double update_time_us = 0.0;
+  // osqp_solve [us]
+  double solve_time_us = 0.0;
+  int iterations = 0;
+  int status = 0;
+  // false on the solve that ran osqp_setup
+  bool workspace_reused = false;
+  // the solve started from the previous solution
+  bool warm_started = false;
+  // the solver stopped at the time limit of SetTimeLimit
+  bool deadline_reached = false;
+  // constraint violation of the returned solution or last iterate, as the
+  // solver measures it; infinity when there is no iterate to use
+  double primal_residual = 0.0;
+};
+
+// starting point of each MpcOsqp::Solve
+enum class WarmStartMode {
+  // from zero
+  kCold,
+  // previous solution shifted forward by one stage, last stage duplicated
+  kShifted,
+  // previous solution as it is
+  kPrevious,
+};
+
+/**
+ * @brief OSQP based solver of the linear MPC problem.
+ *
+ * kStates and kControls fix the model dimensions at compile time so the
+ * per-stage blocks (A, B, Q, R, bounds) are fixed-size Eigen matrices;
+ * Eigen::Dynamic keeps the runtime-sized variant. The horizon stays a
+ * runtime parameter, the stacked QP is sparse and sized at setup. Explicitly
+ * instantiated in mpc_osqp.cpp for the controller's model (6 states, 2
+ * controls), the bicycle model of MpcRti (3 states, 2 controls) and for
+ * Eigen::Dynamic.
+ *
+ * The OSQP workspace lives as long as the object: the first Solve assembles
+ * the QP and runs osqp_setup, later Solves after Update only rewrite the
+ * dynamics entries of the constraint matrix that changed, the equality
+ * bounds and the linear cost through osqp_update_A, osqp_update_bounds and
+ * osqp_update_lin_cost. The sparsity pattern, the weights and the bounds on
+ * u and x are fixed at construction (the pattern also by SetMoveBlocking),
+ * and the update path does not allocate.
+ * UpdateStages gives every stage its own A_k, B_k and affine term c_k
+ * (linear time-varying MPC): the A_k, B_k blocks have their own entries in
+ * the pattern anyway, and c_k goes into the bounds of the dynamics rows.
+ * P and A are written straight into CSC arrays from the block structure,
+ * time and memory linear in the horizon, no dense intermediate.
+ *
+ * SetMoveBlocking holds the input constant over blocks of stages: one
+ * control variable per block, whose B_k columns appear in the dynamics rows
+ * of every stage of the block and whose weight is the block length times R.
+ * The states stay variables of every stage, so a blocked horizon still has
+ * N + 1 state blocks but only as many control blocks as moves.
+ *
+ * Consecutive problems are one control step apart, so by default the primal
+ * and dual solution of a successful solve are shifted forward by one stage,
+ * the last stage duplicated, and handed to the next solve as its starting
+ * point (osqp_warm_start), see WarmStartMode. A failed solve discards the
+ * guess and the next one starts from zero.
+ */
+template <int kStates = Eigen::Dynamic, int kControls = Eigen::Dynamic>
 class MpcOsqp {
  public:
+  typedef Eigen::Matrix<double, kStates, kStates> StateMatrix;
+  typedef Eigen::Matrix<double, kStates, kControls> ControlMatrix;
+  typedef Eigen::Matrix<double, kControls, kControls> ControlWeightMatrix;
+  typedef Eigen::Matrix<double, kStates, 1> StateVector;
+  typedef Eigen::Matrix<double, kControls, 1> ControlVector;
+  typedef std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>>
+      StateMatrixSequence;
+  typedef std::vector<ControlMatrix, Eigen::aligned_allocator<ControlMatrix>>
+      ControlMatrixSequence;
+  typedef std::vector<StateVector, Eigen::aligned_allocator<StateVector>>
+      StateVectorSequence;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   /**
    * @brief Solver for discrete-time model predictive control problem.
    * @param matrix_a The system dynamic matrix  状态矩阵A
    * @param matrix_b The control matrix     控制矩阵B
-   * @param matrix_q The cost matrix for control state  costfunction中的gain矩阵Q 
+   * @param matrix_q The cost matrix for control state  costfunction中的gain矩阵Q
    * @param matrix_lower The lower bound control constrain matrix   约束矩阵的上下界
-   * @param matrix_upper The upper bound control constrain matrix   
+   * @param matrix_upper The upper bound control constrain matrix
    * @param matrix_initial_state The initial state matrix   初始状态矩阵
    * @param max_iter The maximum iterations 最大迭代次数
    */
-  MpcOsqp(const Eigen::MatrixXd &matrix_a, const Eigen::MatrixXd &matrix_b,   // A, B
-          const Eigen::MatrixXd &matrix_q, const Eigen::MatrixXd &matrix_r,   // Q, R
-          const Eigen::MatrixXd &matrix_initial_x,  // 初始状态空间
-          const Eigen::MatrixXd &matrix_u_lower,    // 控制变量下界
-          const Eigen::MatrixXd &matrix_u_upper,    // 控制变量上界
-          const Eigen::MatrixXd &matrix_x_lower,    // 状态变量下界
-          const Eigen::MatrixXd &matrix_x_upper,    // 状态变量上界
-          const Eigen::MatrixXd &matrix_x_ref, const int max_iter,
+  MpcOsqp(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,   // A, B
+          const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,   // Q, R
+          const StateVector &matrix_initial_x,  // 初始状态空间
+          const ControlVector &matrix_u_lower,    // 控制变量下界
+          const ControlVector &matrix_u_upper,    // 控制变量上界
+          const StateVector &matrix_x_lower,    // 状态变量下界
+          const StateVector &matrix_x_upper,    // 状态变量上界
+          const StateVector &matrix_x_ref, const int max_iter,
           const int horizon, const double eps_abs);
+  ~MpcOsqp();
+
+  MpcOsqp(const MpcOsqp &) = delete;
+  MpcOsqp &operator=(const MpcOsqp &) = delete;
+
+  /**
+   * @brief set the model, initial state and reference of the next Solve,
+   * keeping the OSQP workspace
+   */
+  void Update(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+              const StateVector &matrix_initial_x,
+              const StateVector &matrix_x_ref);
+
+  /**
+   * @brief set a time-varying model of the next Solve, keeping the OSQP
+   * workspace: stage k is x_(k+1) = A_k x_k + B_k u_k + c_k; the first
+   * horizon entries of each sequence are used. Update goes back to one
+   * model for all stages
+   */
+  void UpdateStages(const StateMatrixSequence &matrix_a,
+                    const ControlMatrixSequence &matrix_b,
+                    const StateVectorSequence &matrix_c,
+                    const StateVector &matrix_initial_x,
+                    const StateVector &matrix_x_ref);
+
+  /**
+   * @brief polish the ADMM solution on the active set; more accurate, but
+   * OSQP allocates the reduced KKT system on every polished solve. Takes
+   * effect on the solve that creates the workspace, off by default
+   */
+  void SetPolish(const bool polish) { polish_ = polish; }
+
+  /**
+   * @brief relative tolerance of the OSQP termination, the OSQP default
+   * 1e-3 unless set. Takes effect on the solve that creates the workspace
+   */
+  void SetRelativeTolerance(const double eps_rel) { eps_rel_ = eps_rel; }
+
+  /**
+   * @brief hold the input constant over blocks of stages. block_lengths are
+   * the block lengths from stage 0 on, the last one repeated until the
+   * horizon is covered and the final block cut at the horizon; empty (the
+   * default) for a move at every stage. The next Solve sets the workspace up
+   * again if the blocks changed, otherwise nothing happens
+   */
+  void SetMoveBlocking(const std::vector<int> &block_lengths);
+
+  // independent control moves of the horizon
+  size_t num_blocks() const { return num_blocks_; }
+
+  /**
+   * @brief starting point of the following solves, kShifted by default
+   */
+  void SetWarmStart(const WarmStartMode mode);
+
+  /**
+   * @brief stop the following solves after time_limit_us (OSQP time_limit,
+   * which also counts the setup on the first solve); 0 for no limit
+   */
+  void SetTimeLimit(const double time_limit_us);
 
   // control vector
   bool Solve(std::vector<double> *control_cmd);
 
+  /**
+   * @brief first control of the last ADMM iterate after a Solve that stopped
+   * at the time or iteration limit; false if there is none. Its constraint
+   * violation is stats().primal_residual
+   */
+  bool LastIterate(std::vector<double> *control_cmd) const;
+
+  /**
+   * @brief controls u_0 .. u_(N-1) of the last successful Solve, stacked
+   * into controls (resized to N * m on first use), blocks expanded to their
+   * stages; false if it failed
+   */
+  bool ControlSequence(Eigen::VectorXd *controls) const;
+
+  /**
+   * @brief predicted states x_0 .. x_N of the last successful Solve, the
+   * first N + 1 entries of states (resized on first use); false if it failed
+   */
+  bool StateSequence(StateVectorSequence *states) const;
+
+  const MpcOsqpStats &stats() const { return stats_; }
+
+  // heap held by the assembled QP (CSC arrays of P and A, dynamics update
+  // buffers, gradient and bounds) [bytes]
+  size_t MemoryBytes() const;
+
  private:
-  void CalculateKernel(std::vector<c_float> *P_data,
-                       std::vector<c_int> *P_indices,
-                       std::vector<c_int> *P_indptr);
-  void CalculateEqualityConstraint(std::vector<c_float> *A_data,
-                                   std::vector<c_int> *A_indices,
-                                   std::vector<c_int> *A_indptr);
+  // row indices and column pointers of P and A, sized and filled directly
+  // from the block structure in O(horizon), and the position of the
+  // dynamics entries in A_data_
+  void CalculateSparsityPattern();
+  // values of P and A in the cached pattern
+  void CalculateKernel();
+  void CalculateEqualityConstraint();
   void CalculateGradient();
   void CalculateConstraintVectors();
+  // dynamics entries of the stage models that differ from dynamics_values_
+  // -> changed_index_, changed_values_; returns their number
+  c_int CollectDynamicsChanges();
+  // solution of the last solve -> primal_guess_, dual_guess_, shifted by
+  // one stage for kShifted
+  void StoreSolution();
+  // stages of the blocks of block_lengths (see SetMoveBlocking) ->
+  // block_start_, block_of_stage_, num_blocks_, num_param_
+  void AssignBlocks(const std::vector<int> &block_lengths);
   OSQPSettings *Settings();
   OSQPData *Data();
   void FreeData(OSQPData *data);
-
-  template <typename T>
-  T *CopyData(const std::vector<T> &vec) {
-    T *data = new T[vec.size()];
-    memcpy(data, vec.data(), sizeof(T) * vec.size());
-    return data;
-  }
+  bool Setup();
+  void UpdateWorkspace();
 
  private:
-  Eigen::MatrixXd matrix_a_;
-  Eigen::MatrixXd matrix_b_;
-  Eigen::MatrixXd matrix_q_;
-  Eigen::MatrixXd matrix_r_;
-  Eigen::MatrixXd matrix_initial_x_;
-  const Eigen::MatrixXd matrix_u_lower_;
-  const Eigen::MatrixXd matrix_u_upper_;
-  const Eigen::MatrixXd matrix_x_lower_;
-  const Eigen::MatrixXd matrix_x_upper_;
-  const Eigen::MatrixXd matrix_x_ref_;
+  // model of every stage, the same A, B and c = 0 unless set by UpdateStages
+  StateMatrixSequence stage_a_;
+  ControlMatrixSequence stage_b_;
+  StateVectorSequence stage_c_;
+  StateMatrix matrix_q_;
+  ControlWeightMatrix matrix_r_;
+  StateVector matrix_initial_x_;
+  const ControlVector matrix_u_lower_;
+  const ControlVector matrix_u_upper_;
+  const StateVector matrix_x_lower_;
+  const StateVector matrix_x_upper_;
+  StateVector matrix_x_ref_;
   int max_iteration_;
   size_t horizon_;
   double eps_abs_;
@@ -75,10 +255,48 @@ class MpcOsqp {
   size_t control_dim_;
   size_t num_param_;
   int num_constraint_;
+  // control block j holds u over stages block_start_[j] .. block_start_[j+1]-1
+  size_t num_blocks_ = 0;
+  std::vector<size_t> block_start_;
+  std::vector<size_t> block_of_stage_;
+  bool polish_ = false;
+  double eps_rel_ = 1e-3;
+  // OSQP time_limit [s], 0 for none
+  double time_limit_ = 0.0;
+  WarmStartMode warm_start_ = WarmStartMode::kShifted;
   Eigen::VectorXd gradient_;
   Eigen::VectorXd lowerBound_;
   Eigen::VectorXd upperBound_;
+
+  // P and A in CSC form, referenced by OSQPData during setup
+  std::vector<c_float> P_data_;
+  std::vector<c_int> P_indices_;
+  std::vector<c_int> P_indptr_;
+  std::vector<c_float> A_data_;
+  std::vector<c_int> A_indices_;
+  std::vector<c_int> A_indptr_;
+  // entries of A_data_ holding the A and B blocks, and their values in the
+  // workspace
+  std::vector<c_int> dynamics_index_;
+  std::vector<c_float> dynamics_values_;
+  // entries changed since the last update, the first count are valid
+  std::vector<c_int> changed_index_;
+  std::vector<c_float> changed_values_;
+
+  // starting point of the next solve, zero until a solve succeeded
+  std::vector<c_float> primal_guess_;
+  std::vector<c_float> dual_guess_;
+  bool guess_valid_ = false;
+
+  OSQPWorkspace *workspace_ = nullptr;
+  // pending change of the reference for the next UpdateWorkspace
+  bool reference_changed_ = false;
+  MpcOsqpStats stats_;
 };
 
+extern template class MpcOsqp<6, 2>;
+extern template class MpcOsqp<3, 2>;
+extern template class MpcOsqp<Eigen::Dynamic, Eigen::Dynamic>;
+
 }  // namespace control
-}  // namespace shenlan
\ No newline at end of file
+}  // namespace shenlan
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <vector>
+
+#include "Eigen/Eigen"
+#include "mpc_osqp.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Structure-exploiting interior-point solver of the linear MPC
+ * problem of MpcOsqp.
+ *
+ * Same QP as MpcOsqp (diagonal of Q and R in the quadratic term, full Q in
+ * the reference term, box limits on u_k and on x_1..x_N, x_0 fixed), solved
+ * by a primal-dual interior-point method with Mehrotra's predictor-corrector.
+ * All inequalities of this problem are simple bounds, so the barrier adds a
+ * diagonal term to the stage weights and every Newton step is an
+ * unconstrained LQ problem along the horizon. It is solved by a Riccati
+ * recursion: one backward pass factorizes the m x m stage matrices
+ * R_k + B^T P_(k+1) B, a second backward pass and a forward pass give the
+ * step, and the corrector reuses the factorization. An iteration costs
+ * O(N (n^3 + m^3)) instead of a factorization of the stacked KKT system.
+ * Limits beyond 1e20 (e.g. numeric_limits::max) are ignored.
+ *
+ * Iterations stop when the dynamics, bound and stationarity residuals,
+ * relative to the magnitude of the iterate, and the mean complementarity
+ * are all below eps_abs. The interior-point iteration count does not grow
+ * with the horizon, so max_iter is capped at kMaxIterations; an infeasible
+ * problem ends there with kMaxIterationsReached.
+ * SetTimeLimit stops the iterations once the next one would end past the
+ * limit (kTimeLimitReached); LastIterate then gives the first control of
+ * the iterate reached, stats().primal_residual its largest dynamics or
+ * bound violation.
+ * Every solve starts from the zero-input trajectory of x_0, clamped into
+ * the control limits, improved by one affine Newton step (Mehrotra's
+ * starting point). Storage is sized on the first Solve; later solves do
+ * not allocate.
+ *
+ * Same interface as MpcOsqp: the first Solve sets up, Update stages the next
+ * model, initial state and reference. UpdateStages gives every stage its
+ * own A_k, B_k and affine term c_k instead (x_(k+1) = A_k x_k + B_k u_k +
+ * c_k); the recursion is stage-wise anyway, so a time-varying model costs
+ * the same per iteration.
+ */
+template <int kStates = Eigen::Dynamic, int kControls = Eigen::Dynamic>
+class MpcRiccati {
+ public:
+  typedef Eigen::Matrix<double, kStates, kStates> StateMatrix;
+  typedef Eigen::Matrix<double, kStates, kControls> ControlMatrix;
+  typedef Eigen::Matrix<double, kControls, kControls> ControlWeightMatrix;
+  typedef Eigen::Matrix<double, kStates, 1> StateVector;
+  typedef Eigen::Matrix<double, kControls, 1> ControlVector;
+  typedef Eigen::Matrix<double, kControls, kStates> GainMatrix;
+  typedef std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>>
+      StateMatrixSequence;
+  typedef std::vector<ControlMatrix, Eigen::aligned_allocator<ControlMatrix>>
+      ControlMatrixSequence;
+  typedef std::vector<StateVector, Eigen::aligned_allocator<StateVector>>
+      StateVectorSequence;
+
+  // interior-point iterations per solve at most
+  static constexpr int kMaxIterations = 50;
+
+  // same values as the OSQP status codes
+  enum Status {
+    kSolved = 1,
+    kMaxIterationsReached = -2,
+    kTimeLimitReached = -6,
+    // a stage matrix R_k + B^T P B lost positive definiteness
+    kUnsolved = -10,
+  };
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * @brief same parameters as MpcOsqp; eps_abs is the tolerance of the KKT
+   * residuals and of the mean complementarity
+   */
+  MpcRiccati(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+             const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,
+             const StateVector &matrix_initial_x,
+             const ControlVector &matrix_u_lower,
+             const ControlVector &matrix_u_upper,
+             const StateVector &matrix_x_lower,
+             const StateVector &matrix_x_upper,
+             const StateVector &matrix_x_ref, const int max_iter,
+             const int horizon, const double eps_abs);
+
+  /**
+   * @brief set the model, initial state and reference of the next Solve
+   */
+  void Update(const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+              const StateVector &matrix_initial_x,
+              const StateVector &matrix_x_ref);
+
+  /**
+   * @brief set a time-varying model of the next Solve: stage k is
+   * x_(k+1) = A_k x_k + B_k u_k + c_k; the first horizon entries of each
+   * sequence are used. Update goes back to one model for all stages
+   */
+  void UpdateStages(const StateMatrixSequence &matrix_a,
+                    const ControlMatrixSequence &matrix_b,
+                    const StateVectorSequence &matrix_c,
+                    const StateVector &matrix_initial_x,
+                    const StateVector &matrix_x_ref);
+
+  /**
+   * @brief time limit of the following solves [us], 0 for none
+   */
+  void SetTimeLimit(const double time_limit_us) {
+    time_limit_us_ = time_limit_us;
+  }
+
+  // control vector
+  bool Solve(std::vector<double> *control_cmd);
+
+  /**
+   * @brief first control of the last iterate after a Solve that stopped at
+   * the time or iteration limit; false if there is none
+   */
+  bool LastIterate(std::vector<double> *control_cmd) const;
+
+  /**
+   * @brief controls u_0 .. u_(N-1) of the last successful Solve, stacked
+   * into controls (resized to N * m on first use); false if it failed
+   */
+  bool ControlSequence(Eigen::VectorXd *controls) const;
+
+  const MpcOsqpStats &stats() const { return stats_; }
+
+  // heap held by the stage models, the iterates and the Riccati factors
+  // [bytes]
+  size_t MemoryBytes() const;
+
+ private:
+  // stacked vectors below use the variable layout of MpcOsqp:
+  // [x_0 .. x_N, u_0 .. u_(N-1)]
+  void Allocate();
+  // zero-input trajectory, slacks and multipliers of the first iterate
+  void InitializeIterate();
+  // Mehrotra's starting point: one affine Newton step from the first
+  // iterate, slacks and multipliers moved back to at least 1
+  bool CenterStartingPoint();
+  // dynamics, bound and stationarity residuals; returns the largest one,
+  // relative to the magnitude of the iterate
+  double CalculateResiduals();
+  // Riccati factors of the Newton system with the current barrier weights,
+  // false if a stage matrix is not positive definite
+  bool FactorizeNewtonSystem();
+  // step of z and the new dynamics multipliers for the complementarity
+  // target in complementarity_lower_/upper_
+  void SolveNewtonSystem();
+  // largest step keeping slacks and multipliers nonnegative, not capped at 1
+  double MaxStep() const;
+
+ private:
+  // model of every stage, the same A, B and c = 0 unless set by UpdateStages
+  StateMatrixSequence stage_a_;
+  ControlMatrixSequence stage_b_;
+  StateVectorSequence stage_c_;
+  StateMatrix matrix_q_;
+  StateVector matrix_initial_x_;
+  StateVector matrix_x_ref_;
+  int max_iteration_;
+  size_t horizon_;
+  double eps_abs_;
+  double time_limit_us_ = 0.0;
+  size_t state_dim_;
+  size_t control_dim_;
+  size_t num_param_;
+  size_t first_control_;
+  // number of finite bounds, lower and upper counted separately
+  int num_bounds_ = 0;
+
+  // diagonal of the cost, linear cost, bounds and their masks (1 finite,
+  // 0 ignored; x_0 is never bounded)
+  Eigen::VectorXd hessian_diagonal_;
+  Eigen::VectorXd gradient_;
+  Eigen::VectorXd lower_bound_;
+  Eigen::VectorXd upper_bound_;
+  Eigen::VectorXd has_lower_;
+  Eigen::VectorXd has_upper_;
+
+  // iterate: variables, slacks z - lb, ub - z and their multipliers,
+  // multipliers of x_(k+1) = A x_k + B u_k
+  Eigen::VectorXd z_;
+  Eigen::VectorXd slack_lower_;
+  Eigen::VectorXd slack_upper_;
+  Eigen::VectorXd dual_lower_;
+  Eigen::VectorXd dual_upper_;
+  Eigen::VectorXd dual_dynamics_;
+
+  // residuals
+  Eigen::VectorXd residual_dynamics_;
+  Eigen::VectorXd residual_stationarity_;
+  Eigen::VectorXd residual_lower_;
+  Eigen::VectorXd residual_upper_;
+  // s .* lambda - sigma * mu (+ corrector) of the current Newton system
+  Eigen::VectorXd complementarity_lower_;
+  Eigen::VectorXd complementarity_upper_;
+  // barrier weights lambda / s and the linear term of the Newton LQ problem
+  Eigen::VectorXd barrier_;
+  Eigen::VectorXd newton_gradient_;
+
+  // step
+  Eigen::VectorXd step_z_;
+  Eigen::VectorXd step_slack_lower_;
+  Eigen::VectorXd step_slack_upper_;
+  Eigen::VectorXd step_dual_lower_;
+  Eigen::VectorXd step_dual_upper_;
+  Eigen::VectorXd next_dual_dynamics_;
+
+  // Riccati factors per stage
+  std::vector<StateMatrix, Eigen::aligned_allocator<StateMatrix>> cost_to_go_;
+  std::vector<StateVector, Eigen::aligned_allocator<StateVector>>
+      cost_to_go_linear_;
+  std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix>> cross_;
+  std::vector<GainMatrix, Eigen::aligned_allocator<GainMatrix>> gain_;
+  std::vector<ControlVector, Eigen::aligned_allocator<ControlVector>>
+      feedforward_;
+  std::vector<Eigen::LLT<ControlWeightMatrix>,
+              Eigen::aligned_allocator<Eigen::LLT<ControlWeightMatrix>>>
+      control_factor_;
+  // intermediates of the recursions: P A, P B, R + B^T P B, P c + p and the
+  // control right-hand side
+  StateMatrix state_scratch_;
+  ControlMatrix control_scratch_;
+  ControlWeightMatrix weight_scratch_;
+  StateVector vector_scratch_;
+  ControlVector control_vector_scratch_;
+
+  bool initialized_ = false;
+  MpcOsqpStats stats_;
+};
+
+extern template class MpcRiccati<6, 2>;
+extern template class MpcRiccati<Eigen::Dynamic, Eigen::Dynamic>;
+
+}  // namespace control
+}  // namespace shenlan
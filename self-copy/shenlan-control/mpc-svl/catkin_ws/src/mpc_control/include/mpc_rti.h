@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+
+#include "Eigen/Eigen"
+#include "mpc_osqp.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Nonlinear MPC of the kinematic bicycle in path coordinates by the
+ * real-time iteration scheme: one SQP step per control cycle.
+ *
+ * State x = (lateral error e_y, heading error e_psi, speed error e_v =
+ * v - v_ref), control u = (front wheel angle delta, acceleration a). With
+ * the reference curvature kappa and speed v_ref of the stage:
+ *   s'     = v cos(e_psi) / (1 - kappa e_y)
+ *   e_y'   = v sin(e_psi)
+ *   e_psi' = v tan(delta) / L - kappa s'
+ *   e_v'   = a
+ * discretized by explicit Euler over ts (10 ms, short against the vehicle
+ * motion), plus the change of v_ref from one stage to the next. Unlike the
+ * error model of MPCController there is no 1/v, so the model holds at any
+ * speed down to standstill and at any heading error.
+ *
+ * Every Solve linearizes the model along the predicted trajectory of the
+ * previous cycle, shifted forward by one stage with the last stage
+ * duplicated: stage k becomes x_(k+1) = A_k x_k + B_k u_k + c_k with the
+ * Jacobians at that trajectory and c_k = f(x_k, u_k) - A_k x_k - B_k u_k.
+ * The QP goes through MpcOsqp::UpdateStages, so after the first solve only
+ * the numeric values of the persistent OSQP workspace change, and it is
+ * warm started from the shifted previous solution. The solution (states
+ * and controls) is the trajectory of the next linearization. The first
+ * solve, and the one after a failed solve, linearizes along the zero-input
+ * rollout of the nonlinear model from the current state.
+ *
+ * Cost and limits as in MpcOsqp: diagonal Q and R, x_ref = 0, box limits
+ * on u_k and x_1 .. x_N. No allocation after the first Solve.
+ */
+class MpcRti {
+ public:
+  // lateral error, heading error, speed error
+  static constexpr int kStates = 3;
+  // front wheel angle, acceleration
+  static constexpr int kControls = 2;
+
+  typedef MpcOsqp<kStates, kControls> QpSolver;
+  typedef QpSolver::StateMatrix StateMatrix;
+  typedef QpSolver::ControlMatrix ControlMatrix;
+  typedef QpSolver::ControlWeightMatrix ControlWeightMatrix;
+  typedef QpSolver::StateVector StateVector;
+  typedef QpSolver::ControlVector ControlVector;
+  typedef QpSolver::StateMatrixSequence StateMatrixSequence;
+  typedef QpSolver::ControlMatrixSequence ControlMatrixSequence;
+  typedef QpSolver::StateVectorSequence StateVectorSequence;
+  typedef std::vector<ControlVector, Eigen::aligned_allocator<ControlVector>>
+      ControlVectorSequence;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * @param wheelbase distance of the axles L [m]
+   * @param ts step of the prediction [s]
+   * other parameters as MpcOsqp
+   */
+  MpcRti(const double wheelbase, const double ts, const StateMatrix &matrix_q,
+         const ControlWeightMatrix &matrix_r,
+         const ControlVector &matrix_u_lower,
+         const ControlVector &matrix_u_upper,
+         const StateVector &matrix_x_lower, const StateVector &matrix_x_upper,
+         const int max_iter, const int horizon, const double eps_abs);
+
+  MpcRti(const MpcRti &) = delete;
+  MpcRti &operator=(const MpcRti &) = delete;
+
+  /**
+   * @brief state and reference of the next Solve
+   * @param kappa curvature of the reference point of stage k, k = 0 .. N
+   * @param speed speed of the reference point of stage k, k = 0 .. N; the
+   * first horizon + 1 entries of both are used
+   */
+  void Update(const StateVector &matrix_initial_x,
+              const std::vector<double> &kappa,
+              const std::vector<double> &speed);
+
+  /**
+   * @brief time limit of the following QP solves [us], 0 for none; the
+   * linearization is not limited
+   */
+  void SetTimeLimit(const double time_limit_us) {
+    qp_.SetTimeLimit(time_limit_us);
+  }
+
+  // one SQP step: linearize and solve the QP; first control of the solution
+  bool Solve(std::vector<double> *control_cmd);
+
+  /**
+   * @brief first control of the last ADMM iterate after a Solve that stopped
+   * at the time or iteration limit, see MpcOsqp::LastIterate
+   */
+  bool LastIterate(std::vector<double> *control_cmd) const {
+    return qp_.LastIterate(control_cmd);
+  }
+
+  // controls u_0 .. u_(N-1) of the last successful Solve
+  bool ControlSequence(Eigen::VectorXd *controls) const {
+    return qp_.ControlSequence(controls);
+  }
+
+  // predicted states x_0 .. x_N of the last successful Solve, as the QP
+  // (the linearized model) predicts them
+  const StateVectorSequence &predicted_states() const { return states_; }
+
+  /**
+   * @brief QP timings of the last Solve; update_time_us includes the
+   * linearization
+   */
+  const MpcOsqpStats &stats() const { return stats_; }
+
+  // linearization of the last Solve [us]
+  double linearization_time_us() const { return linearization_time_us_; }
+
+  /**
+   * @brief largest difference between the predicted states of the last
+   * successful Solve and the nonlinear model driven by its controls from
+   * the same x_0, i.e. the error of the single SQP step
+   */
+  double PredictionError() const;
+
+  /**
+   * @brief one Euler step of the nonlinear model
+   */
+  StateVector Step(const StateVector &x, const ControlVector &u,
+                   const double kappa, const double speed,
+                   const double next_speed) const;
+
+  // heap held by the trajectory, the stage models and the QP [bytes]
+  size_t MemoryBytes() const;
+
+ private:
+  // A_k, B_k, c_k of stage k at (x, u)
+  void Linearize(const size_t k, const StateVector &x,
+                 const ControlVector &u);
+  // zero-input rollout of the nonlinear model from matrix_initial_x_
+  void Rollout();
+
+  const double wheelbase_;
+  const double ts_;
+  const size_t horizon_;
+  QpSolver qp_;
+  StateVector matrix_initial_x_;
+  std::vector<double> kappa_;
+  std::vector<double> speed_;
+  // trajectory of the linearization: the last solution, shifted on Solve
+  StateVectorSequence states_;
+  ControlVectorSequence controls_;
+  bool trajectory_valid_ = false;
+  // stage models handed to the QP
+  StateMatrixSequence stage_a_;
+  ControlMatrixSequence stage_b_;
+  StateVectorSequence stage_c_;
+  Eigen::VectorXd control_sequence_;
+  double linearization_time_us_ = 0.0;
+  MpcOsqpStats stats_;
+};
+
+}  // namespace control
+}  // namespace shenlan
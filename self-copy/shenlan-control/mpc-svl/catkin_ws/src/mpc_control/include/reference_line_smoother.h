@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace shenlan {
+namespace control {
+
+struct ReferenceLineSmootherConfig {
+  // spacing the raw points are resampled to before smoothing; the
+  // discrete-point cost assumes near-uniform spacing [m]
+  double resample_spacing = 0.5;
+  // half width of the box each smoothed point stays in around its
+  // resampled raw point [m]; the end points are kept
+  double max_deviation = 0.15;
+  // cost weights: second differences (curvature), first differences
+  // (length), distance to the raw point
+  double weight_smooth = 1000.0;
+  double weight_length = 1.0;
+  double weight_deviation = 1.0;
+  int max_iteration = 10000;
+  double eps_abs = 1e-7;
+  double eps_rel = 1e-7;
+
+  // decimation: largest difference between the curvature of the dense
+  // smoothed line and the one a consumer recomputes from the kept points
+  // (ReferenceLine::ComputePathProfile, linearly interpolated) [1/m]
+  double curvature_tolerance = 0.002;
+  // largest distance of a dropped point from the chord that replaces it [m]
+  double chord_tolerance = 0.02;
+  // longest chord kept, so nearest-point matching stays local [m]
+  double max_spacing = 10.0;
+};
+
+// sizes, timings and accuracy of the last ReferenceLineSmoother::Smooth
+struct ReferenceLineSmootherStats {
+  std::size_t raw_points = 0;
+  // after dropping repeated points and resampling
+  std::size_t resampled_points = 0;
+  std::size_t output_points = 0;
+  double resample_time_ms = 0.0;
+  // QP assembly and osqp_setup / osqp_solve
+  double setup_time_ms = 0.0;
+  double solve_time_ms = 0.0;
+  double decimate_time_ms = 0.0;
+  int iterations = 0;
+  int status = 0;
+  // largest distance of a smoothed point from its resampled raw point [m]
+  double max_deviation = 0.0;
+  // largest curvature difference left by the decimation [1/m], and the
+  // refinement passes it took
+  double max_curvature_error = 0.0;
+  int refinements = 0;
+};
+
+/**
+ * @brief Offline smoothing and decimation of a recorded reference line.
+ *
+ * Raw waypoint dumps repeat points and jitter by centimetres, which the
+ * finite differences of ReferenceLine::ComputePathProfile turn into noisy
+ * curvature. Smooth() drops repeated points, resamples the polyline to a
+ * uniform spacing and solves the discrete-point QP
+ *
+ *   min  w_s sum |p_(i-1) - 2 p_i + p_(i+1)|^2 + w_l sum |p_(i+1) - p_i|^2
+ *        + w_r sum |p_i - r_i|^2
+ *   s.t. |x_i - x_ri| <= d, |y_i - y_ri| <= d, end points fixed
+ *
+ * with OSQP; x and y decouple, so P is two pentadiagonal blocks and A the
+ * identity. The smoothed line is then decimated: greedily, each kept point
+ * reaches as far as the chord stays within chord_tolerance of the dropped
+ * points and their curvature stays linear within curvature_tolerance; the
+ * result is checked against the curvature ComputePathProfile gives on the
+ * kept points, and segments that miss the tolerance are split until none
+ * does.
+ */
+class ReferenceLineSmoother {
+ public:
+  typedef std::vector<std::pair<double, double>> Points;
+
+  explicit ReferenceLineSmoother(
+      const ReferenceLineSmootherConfig &config =
+          ReferenceLineSmootherConfig());
+
+  /**
+   * @brief resample, smooth and decimate raw
+   * @return false for fewer than three distinct points or if the QP is
+   * not solved; output is then left empty
+   */
+  bool Smooth(const Points &raw, Points *output);
+
+  /**
+   * @brief raw without repeated points, resampled along the polyline at
+   * the largest spacing <= spacing that ends on its last point
+   */
+  static void Resample(const Points &raw, const double spacing,
+                       Points *resampled);
+
+  /**
+   * @brief the QP above around the anchor points
+   */
+  bool SolveQp(const Points &anchors, Points *smoothed);
+
+  /**
+   * @brief fewest points of dense (as found greedily) meeting the
+   * curvature and chord tolerances
+   */
+  void Decimate(const Points &dense, Points *decimated);
+
+  const ReferenceLineSmootherConfig &config() const { return config_; }
+  const ReferenceLineSmootherStats &stats() const { return stats_; }
+
+ private:
+  ReferenceLineSmootherConfig config_;
+  ReferenceLineSmootherStats stats_;
+};
+
+}  // namespace control
+}  // namespace shenlan
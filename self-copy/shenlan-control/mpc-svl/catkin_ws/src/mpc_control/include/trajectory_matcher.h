@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common.h"
+#include "trajectory_soa.h"
+#include "trajectory_spatial_index.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Foot point of a position on the trajectory polyline.
+ */
+struct ProjectedPoint {
+  // x, y, heading, kappa, v and a interpolated at the foot point
+  TrajectoryPoint point{};
+  // arc length of the foot point from the first trajectory point
+  double s = 0.0;
+  // the foot point lies on segment [index, index + 1]
+  std::size_t index = 0;
+  // position of the foot point along the segment, in [0, 1]
+  double ratio = 0.0;
+};
+
+/**
+ * @brief Stateful match-point tracker over a reference trajectory.
+ *
+ * Instead of scanning every trajectory point each control cycle, the matcher
+ * remembers the last matched index and only searches an arc-length window
+ * [s_last - lookback, s_last + lookahead] around it. A global search is run
+ * on the first query, whenever the trajectory changes, when the windowed
+ * match is farther than the relocalization distance, or when the windowed
+ * match lands on the window boundary (the window no longer brackets the
+ * vehicle). The global search uses the trajectory's spatial index when one
+ * is given and falls back to a linear scan otherwise.
+ *
+ * Scans run over a TrajectorySoA with the SIMD kernels of
+ * nearest_point_kernels.h, normally those of a TrajectorySnapshot. The
+ * matcher cannot tell a replanned trajectory from the old one by its points
+ * without reading all of them, so callers compare snapshot versions and call
+ * Reset() or Rebase() on a new one; the matcher itself only resets when the
+ * size or the endpoints change.
+ */
+class TrajectoryMatcher {
+ public:
+  TrajectoryMatcher() = default;
+  ~TrajectoryMatcher() = default;
+
+  /**
+   * @brief set the arc-length window searched around the last match
+   * @param lookback_s window length behind the last match [m]
+   * @param lookahead_s window length ahead of the last match [m]
+   */
+  void SetWindow(const double lookback_s, const double lookahead_s);
+
+  /**
+   * @brief set the match distance above which a global search is forced
+   * @param distance relocalization distance [m]
+   */
+  void SetRelocalizationDistance(const double distance);
+
+  /**
+   * @brief drop the remembered match, the next query searches globally
+   */
+  void Reset();
+
+  /**
+   * @brief carry the remembered match over to a later window of the same
+   * route that starts dropped points further on; resets if the match is
+   * no longer inside it
+   * @param trajectory the new window
+   * @param dropped points dropped from the front since the last window
+   */
+  void Rebase(const TrajectorySoA &trajectory, const std::size_t dropped);
+
+  /**
+   * @brief find the index of the trajectory point nearest to (x, y)
+   * @param trajectory reference trajectory
+   * @param x query position x
+   * @param y query position y
+   * @param index spatial index built over the trajectory, may be null
+   * @return index of the matched point, 0 for an empty trajectory
+   */
+  std::size_t Match(const TrajectorySoA &trajectory, const double x,
+                    const double y,
+                    const TrajectorySpatialIndex *index = nullptr);
+
+  /**
+   * @brief project (x, y) onto the trajectory polyline
+   *
+   * Matches the nearest point first, then projects onto the segments on
+   * either side of it and keeps the closer foot point.
+   * @param trajectory reference trajectory, must not be empty
+   * @param x query position x
+   * @param y query position y
+   * @param index spatial index built over the trajectory, may be null
+   * @return the foot point with interpolated attributes
+   */
+  ProjectedPoint Project(const TrajectorySoA &trajectory, const double x,
+                         const double y,
+                         const TrajectorySpatialIndex *index = nullptr);
+
+  std::size_t last_index() const { return last_index_; }
+  bool last_match_was_global() const { return last_match_was_global_; }
+  std::size_t global_search_count() const { return global_search_count_; }
+
+ private:
+  bool IsSameShape(const std::size_t size, const double front_x,
+                   const double front_y, const double back_x,
+                   const double back_y) const;
+
+  double lookback_s_ = 5.0;
+  double lookahead_s_ = 20.0;
+  double relocalization_distance_ = 5.0;
+
+  // cached shape of the trajectory the hint refers to
+  std::size_t trajectory_size_ = 0;
+  double front_x_ = 0.0;
+  double front_y_ = 0.0;
+  double back_x_ = 0.0;
+  double back_y_ = 0.0;
+
+  bool has_hint_ = false;
+  std::size_t last_index_ = 0;
+  bool last_match_was_global_ = false;
+  std::size_t global_search_count_ = 0;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "common.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Structure-of-arrays copy of a trajectory.
+ *
+ * Each attribute of TrajectoryPoint lives in its own contiguous column, so a
+ * nearest-point scan only streams the x and y columns through the cache and
+ * can be vectorized. The accumulated arc length is stored alongside. x/y may
+ * additionally be kept as float32 relative to the first point, which halves
+ * the bytes scanned again.
+ */
+class TrajectorySoA {
+ public:
+  TrajectorySoA() = default;
+  /**
+   * @param points trajectory in array-of-structs form
+   * @param local_float_xy also keep float32 x/y relative to the first point
+   * and scan those in NearestIndex
+   */
+  explicit TrajectorySoA(const std::vector<TrajectoryPoint> &points,
+                         const bool local_float_xy = false);
+  ~TrajectorySoA() = default;
+
+  void Assign(const std::vector<TrajectoryPoint> &points,
+              const bool local_float_xy = false);
+
+  /**
+   * @brief the same with the accumulated arc length of the points given,
+   * points.size() values (e.g. the s column of a compiled roadmap), instead
+   * of summed from the points; null sums it
+   */
+  void Assign(const std::vector<TrajectoryPoint> &points,
+              const double *accumulated_s, const bool local_float_xy = false);
+
+  std::size_t size() const { return x_.size(); }
+  bool empty() const { return x_.empty(); }
+
+  const std::vector<double> &x() const { return x_; }
+  const std::vector<double> &y() const { return y_; }
+  const std::vector<double> &heading() const { return heading_; }
+  const std::vector<double> &kappa() const { return kappa_; }
+  const std::vector<double> &v() const { return v_; }
+  const std::vector<double> &a() const { return a_; }
+  const std::vector<double> &accumulated_s() const { return s_; }
+
+  bool has_local_float_xy() const { return !local_x_.empty(); }
+  double origin_x() const { return origin_x_; }
+  double origin_y() const { return origin_y_; }
+
+  /**
+   * @brief gather point i back into array-of-structs form
+   */
+  TrajectoryPoint point(const std::size_t i) const;
+
+  /**
+   * @brief index of the point in [begin, end) nearest to (x, y)
+   * @param d2_min squared distance to that point, may be null
+   */
+  std::size_t NearestIndex(const std::size_t begin, const std::size_t end,
+                           const double x, const double y,
+                           double *d2_min = nullptr) const;
+
+  /**
+   * @brief approximate heap bytes held by the columns
+   */
+  std::size_t MemoryBytes() const;
+
+ private:
+  std::vector<double> x_;
+  std::vector<double> y_;
+  std::vector<double> heading_;
+  std::vector<double> kappa_;
+  std::vector<double> v_;
+  std::vector<double> a_;
+  std::vector<double> s_;
+
+  double origin_x_ = 0.0;
+  double origin_y_ = 0.0;
+  std::vector<float> local_x_;
+  std::vector<float> local_y_;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Lock-free single-producer single-consumer handoff of the latest
+ * value.
+ *
+ * Three slots: the writer fills its back slot and Publish swaps it with the
+ * middle one; the reader's Update swaps its front slot with the middle one
+ * when something new was published. Neither side waits for the other or
+ * copies a value through a shared slot, and a reader that falls behind
+ * only sees the newest value. The slots are copies of the value given to
+ * the constructor, so presized vectors inside T are never reallocated by
+ * the handoff.
+ */
+template <class T>
+class TripleBuffer {
+ public:
+  explicit TripleBuffer(const T &initial = T())
+      : slots_{initial, initial, initial} {}
+
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  // writer side: slot to fill before Publish
+  T &write_buffer() { return slots_[back_]; }
+
+  // writer side: make write_buffer() the newest value
+  void Publish() {
+    back_ = middle_.exchange(back_ | kNew, std::memory_order_acq_rel) &
+            kIndexMask;
+  }
+
+  // reader side: a value was published since the last Update
+  bool HasNew() const {
+    return (middle_.load(std::memory_order_acquire) & kNew) != 0;
+  }
+
+  // reader side: move to the newest value, false if there is none
+  bool Update() {
+    if (!HasNew()) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  // reader side: value of the last successful Update
+  const T &read_buffer() const { return slots_[front_]; }
+
+ private:
+  static constexpr unsigned kIndexMask = 3;
+  static constexpr unsigned kNew = 4;
+
+  T slots_[3];
+  // index of the middle slot, kNew set while it holds an unread value
+  std::atomic<unsigned> middle_{1};
+  unsigned back_ = 0;
+  unsigned front_ = 2;
+};
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,210 @@
+#include "arc_length_reference_line.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// 相对长度的容差, 用于判断节点是否等间距
+constexpr double kUniformTolerance = 1e-9;
+
+bool StationLess(const StationPoint &point, const double s) {
+  return point.s < s;
+}
+
+bool StationGreater(const double s, const StationPoint &point) {
+  return s < point.s;
+}
+
+// a和b之间按比例线性插值, heading跨越+-pi时取较短的一侧
+StationPoint Interpolate(const StationPoint &a, const StationPoint &b,
+                         const double ratio) {
+  StationPoint point;
+  point.s = a.s + ratio * (b.s - a.s);
+  point.x = a.x + ratio * (b.x - a.x);
+  point.y = a.y + ratio * (b.y - a.y);
+  point.heading = std::remainder(
+      a.heading + ratio * std::remainder(b.heading - a.heading, 2.0 * M_PI),
+      2.0 * M_PI);
+  point.kappa = a.kappa + ratio * (b.kappa - a.kappa);
+  point.dkappa = a.dkappa + ratio * (b.dkappa - a.dkappa);
+  point.v = a.v + ratio * (b.v - a.v);
+  return point;
+}
+
+}  // namespace
+
+bool ArcLengthReferenceLine::Build(const std::vector<StationPoint> &knots,
+                                   const double spacing) {
+  samples_.clear();
+  uniform_ = false;
+  if (knots.size() < 2) {
+    return false;
+  }
+  for (std::size_t i = 1; i < knots.size(); ++i) {
+    if (!(knots[i].s >= knots[i - 1].s)) {
+      return false;
+    }
+  }
+  const double length = knots.back().s - knots.front().s;
+  if (!(length > 0.0) || !std::isfinite(length)) {
+    return false;
+  }
+  if (spacing <= 0.0) {
+    samples_ = knots;
+    return Finish();
+  }
+
+  // 步长取不大于spacing且使最后一个采样点落在终点上的值
+  const std::size_t size =
+      static_cast<std::size_t>(std::ceil(length / spacing)) + 1;
+  const double step = length / (size - 1);
+  samples_.resize(size);
+  std::size_t j = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    const double s =
+        i + 1 < size ? knots.front().s + i * step : knots.back().s;
+    // s单调增加, 节点游标只向前移动
+    while (j + 2 < knots.size() && knots[j + 1].s <= s) {
+      ++j;
+    }
+    const double length_j = knots[j + 1].s - knots[j].s;
+    const double ratio =
+        length_j > 0.0
+            ? std::min(std::max((s - knots[j].s) / length_j, 0.0), 1.0)
+            : 0.0;
+    samples_[i] = Interpolate(knots[j], knots[j + 1], ratio);
+    samples_[i].s = s;
+  }
+  return Finish();
+}
+
+bool ArcLengthReferenceLine::Build(
+    const std::vector<std::pair<double, double>> &xy_points,
+    const std::vector<double> &headings,
+    const std::vector<double> &accumulated_s,
+    const std::vector<double> &kappas, const std::vector<double> &dkappas,
+    const double v, const double spacing) {
+  const std::size_t size = xy_points.size();
+  if (headings.size() != size || accumulated_s.size() != size ||
+      kappas.size() != size || dkappas.size() != size) {
+    samples_.clear();
+    uniform_ = false;
+    return false;
+  }
+  std::vector<StationPoint> knots(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    knots[i].s = accumulated_s[i];
+    knots[i].x = xy_points[i].first;
+    knots[i].y = xy_points[i].second;
+    knots[i].heading = headings[i];
+    knots[i].kappa = kappas[i];
+    knots[i].dkappa = dkappas[i];
+    knots[i].v = v;
+  }
+  return Build(knots, spacing);
+}
+
+bool ArcLengthReferenceLine::Finish() {
+  const std::size_t size = samples_.size();
+  const double front = samples_.front().s;
+  const double length = samples_.back().s - front;
+  spacing_ = length / (size - 1);
+  inverse_spacing_ = 1.0 / spacing_;
+  uniform_ = true;
+  for (std::size_t i = 1; i + 1 < size && uniform_; ++i) {
+    uniform_ = std::fabs(samples_[i].s - (front + i * spacing_)) <=
+               kUniformTolerance * length;
+  }
+  return true;
+}
+
+std::size_t ArcLengthReferenceLine::Segment(const double s) const {
+  const std::size_t last = samples_.size() - 2;
+  if (uniform_) {
+    const double offset = (s - samples_.front().s) * inverse_spacing_;
+    return offset > 0.0 ? std::min(static_cast<std::size_t>(offset), last)
+                        : 0;
+  }
+  const auto it = std::upper_bound(samples_.begin(), samples_.end(), s,
+                                   StationGreater);
+  return it == samples_.begin()
+             ? 0
+             : std::min(static_cast<std::size_t>(it - samples_.begin()) - 1,
+                        last);
+}
+
+StationPoint ArcLengthReferenceLine::at(const double s) const {
+  if (samples_.empty()) {
+    StationPoint point;
+    point.s = s;
+    return point;
+  }
+  const double clamped = std::min(std::max(s, front_s()), back_s());
+  const std::size_t i = Segment(clamped);
+  const StationPoint &a = samples_[i];
+  const StationPoint &b = samples_[i + 1];
+  const double length = b.s - a.s;
+  const double ratio =
+      length > 0.0 ? std::min(std::max((clamped - a.s) / length, 0.0), 1.0)
+                   : 0.0;
+  StationPoint point = Interpolate(a, b, ratio);
+  point.s = clamped;
+  return point;
+}
+
+ArcLengthReferenceLine::Range ArcLengthReferenceLine::range(
+    const double s0, const double s1) const {
+  Range range;
+  if (samples_.empty() || !(s0 <= s1)) {
+    return range;
+  }
+  const StationPoint *data = samples_.data();
+  const std::size_t size = samples_.size();
+  std::size_t first = 0;
+  std::size_t end = 0;
+  if (uniform_) {
+    // 估计的下标与真实位置至多差一个采样点, 向两侧修正
+    const double front = samples_.front().s;
+    first = static_cast<std::size_t>(std::min(
+        std::max(std::ceil((s0 - front) * inverse_spacing_), 0.0),
+        static_cast<double>(size)));
+    while (first > 0 && data[first - 1].s >= s0) {
+      --first;
+    }
+    while (first < size && data[first].s < s0) {
+      ++first;
+    }
+    end = static_cast<std::size_t>(std::min(
+        std::max(std::floor((s1 - front) * inverse_spacing_) + 1.0, 0.0),
+        static_cast<double>(size)));
+    while (end < size && data[end].s <= s1) {
+      ++end;
+    }
+    while (end > 0 && data[end - 1].s > s1) {
+      --end;
+    }
+  } else {
+    first = std::lower_bound(samples_.begin(), samples_.end(), s0,
+                             StationLess) -
+            samples_.begin();
+    end = std::upper_bound(samples_.begin(), samples_.end(), s1,
+                           StationGreater) -
+          samples_.begin();
+  }
+  if (first < end) {
+    range.begin = data + first;
+    range.end = data + end;
+  }
+  return range;
+}
+
+std::size_t ArcLengthReferenceLine::MemoryBytes() const {
+  return samples_.capacity() * sizeof(StationPoint);
+}
+
+}  // namespace control
+}  // namespace shenlan
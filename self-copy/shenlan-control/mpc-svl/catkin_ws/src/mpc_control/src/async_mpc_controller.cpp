@@ -0,0 +1,163 @@
+#include "async_mpc_controller.h"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+double ElapsedUs(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+AsyncMpcController::AsyncMpcController() {}
+
+AsyncMpcController::~AsyncMpcController() { Stop(); }
+
+void AsyncMpcController::Start() {
+  Stop();
+  // 槽位按预测步长预先分配, 之后的交接和求解不再分配
+  Plan plan;
+  plan.controls = Eigen::VectorXd::Zero(controls_ * horizon_);
+  plan.states.assign(horizon_ + 1, StateVector::Zero());
+  plan.gain = GainMatrix::Zero();
+  Request request;
+  request.matrix_ad = StateMatrix::Zero();
+  request.matrix_bd = ControlMatrix::Zero();
+  request.state = StateVector::Zero();
+  request.time_varying = mpc_time_varying_;
+  if (mpc_time_varying_) {
+    request.stages.matrix_ad.assign(horizon_, StateMatrix::Zero());
+    request.stages.matrix_bd.assign(horizon_, ControlMatrix::Zero());
+    request.stages.matrix_cd.assign(horizon_, StateVector::Zero());
+  }
+  requests_.reset(new TripleBuffer<Request>(request));
+  plans_.reset(new TripleBuffer<Plan>(plan));
+  worker_time_limit_us_ = 0.5 * horizon_ * ts_ * 1e6;
+  plans_published_ = 0;
+  failed_solves_ = 0;
+  plan_age_ = -1;
+  running_ = true;
+  worker_ = std::thread(&AsyncMpcController::WorkerLoop, this);
+}
+
+void AsyncMpcController::Stop() {
+  if (!worker_.joinable()) {
+    return;
+  }
+  running_ = false;
+  wake_.notify_one();
+  worker_.join();
+}
+
+void AsyncMpcController::WorkerLoop() {
+  const StateVector reference_state = StateVector::Zero();
+  std::vector<double> control_cmd(controls_, 0.0);
+  while (running_) {
+    if (!requests_->Update()) {
+      // 控制线程通知时不加锁, 可能错过一次通知, 最多多等1ms
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(1));
+      continue;
+    }
+    const Request &request = requests_->read_buffer();
+    const auto start = std::chrono::steady_clock::now();
+    Plan &plan = plans_->write_buffer();
+    // 只发布完整求解的结果; 超时的迭代值不作为整条控制序列使用
+    if (SolveQp(request.matrix_ad, request.matrix_bd,
+                request.time_varying ? &request.stages : nullptr,
+                request.state, reference_state, worker_time_limit_us_, &control_cmd,
+                &plan.stats) != MpcCommandSource::kSolution ||
+        !QpControlSequence(&plan.controls) ||
+        !ComputeLqrGain(request.matrix_ad, request.matrix_bd, &plan.gain,
+                        nullptr)) {
+      ++failed_solves_;
+      continue;
+    }
+    // 用请求时的模型推出各步的预测状态, 供控制线程修正漂移
+    plan.states[0] = request.state;
+    for (int k = 0; k < horizon_; ++k) {
+      const auto u = plan.controls.segment<kControlSize>(k * kControlSize);
+      if (request.time_varying) {
+        plan.states[k + 1] = request.stages.matrix_cd[k];
+        plan.states[k + 1].noalias() +=
+            request.stages.matrix_ad[k] * plan.states[k];
+        plan.states[k + 1].noalias() += request.stages.matrix_bd[k] * u;
+      } else {
+        plan.states[k + 1].noalias() = request.matrix_ad * plan.states[k];
+        plan.states[k + 1].noalias() += request.matrix_bd * u;
+      }
+    }
+    plan.stamp = request.stamp;
+    plan.valid = true;
+    plan.solve_time_us = ElapsedUs(start);
+    plans_->Publish();
+    ++plans_published_;
+  }
+}
+
+MpcCommandSource AsyncMpcController::ApplyLatestPlan(
+    const std::chrono::steady_clock::time_point &now,
+    ControlVector *control) {
+  Request &request = requests_->write_buffer();
+  request.stamp = now;
+  request.matrix_ad = matrix_ad_;
+  request.matrix_bd = matrix_bd_;
+  request.state = matrix_state_;
+  if (request.time_varying) {
+    // 尺寸相同, 拷贝不分配
+    request.stages.matrix_ad = stage_model_.matrix_ad;
+    request.stages.matrix_bd = stage_model_.matrix_bd;
+    request.stages.matrix_cd = stage_model_.matrix_cd;
+  }
+  requests_->Publish();
+  wake_.notify_one();
+
+  if (plans_->Update()) {
+    mpc_stats_ = plans_->read_buffer().stats;
+  }
+  const Plan &plan = plans_->read_buffer();
+  plan_age_ = -1;
+  if (plan.valid) {
+    // 计划起点之后的第k个控制周期
+    const int k = static_cast<int>(
+        std::chrono::duration<double>(now - plan.stamp).count() / ts_ + 0.5);
+    if (k < horizon_) {
+      plan_age_ = k;
+      *control = plan.controls.segment<kControlSize>(k * kControlSize);
+      control->noalias() -= plan.gain * (matrix_state_ - plan.states[k]);
+      *control = control->cwiseMax(lower_bound_).cwiseMin(upper_bound_);
+      return MpcCommandSource::kPlan;
+    }
+  }
+  // 还没有计划, 或最新的计划已经用完
+  if (ComputeLqrFallback(StateVector::Zero(), control)) {
+    return MpcCommandSource::kLqr;
+  }
+  *control = ControlVector::Zero();
+  return MpcCommandSource::kNone;
+}
+
+bool AsyncMpcController::ComputeControlCommand(
+    const VehicleState &localization,
+    const TrajectoryData &planning_published_trajectory, ControlCmd &cmd) {
+  const auto cycle_start = std::chrono::steady_clock::now();
+  if (!running_ || !UpdateModel(localization, planning_published_trajectory)) {
+    return false;
+  }
+  ControlVector control = ControlVector::Zero();
+  command_source_ = ApplyLatestPlan(cycle_start, &control);
+  // 控制线程不求解QP, 不会超时
+  deadline_monitor_.Record(ElapsedUs(cycle_start), mpc_time_budget_us_, false,
+                           command_source_);
+
+  cmd.steer_target = control(0, 0);
+  cmd.acc = control(1, 0);
+  return true;
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,265 @@
+#include "dense_qp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+// 约束被视为违反的阈值
+constexpr double kFeasibilityTolerance = 1e-9;
+// 判断新约束与活动集线性相关
+constexpr double kDependenceTolerance = 1e-12;
+}  // namespace
+
+constexpr double DenseQpSolver::kInfinity;
+
+void DenseQpSolver::Resize(const int num_variables, const int num_rows) {
+  num_variables_ = num_variables;
+  num_rows_ = num_rows;
+  const int n = num_variables;
+  llt_ = Eigen::LLT<Eigen::MatrixXd>(n);
+  J0_.resize(n, n);
+  J_.resize(n, n);
+  R_ = Eigen::MatrixXd::Zero(n, n);
+  d_.resize(n);
+  z_.resize(n);
+  r_.resize(n);
+  u_.resize(n);
+  active_.assign(n, -1);
+  is_active_.assign(2 * (n + num_rows), 0);
+  factorized_ = false;
+}
+
+bool DenseQpSolver::SetHessian(const Eigen::MatrixXd &H) {
+  llt_.compute(H);
+  factorized_ = llt_.info() == Eigen::Success;
+  if (factorized_) {
+    // J = L^-T: L^T J = I
+    J0_.setIdentity();
+    llt_.matrixU().solveInPlace(J0_);
+  }
+  return factorized_;
+}
+
+double DenseQpSolver::Bound(const int i) const {
+  const int n = num_variables_;
+  if (i < n) {
+    return (*lb_)(i);
+  } else if (i < 2 * n) {
+    return -(*ub_)(i - n);
+  } else if (i < 2 * n + num_rows_) {
+    return (*lb_a_)(i - 2 * n);
+  }
+  return -(*ub_a_)(i - 2 * n - num_rows_);
+}
+
+double DenseQpSolver::Slack(const int i, const Eigen::VectorXd &x) const {
+  const int n = num_variables_;
+  if (i < n) {
+    return x(i) - (*lb_)(i);
+  } else if (i < 2 * n) {
+    return (*ub_)(i - n) - x(i - n);
+  } else if (i < 2 * n + num_rows_) {
+    return C_->row(i - 2 * n).dot(x) - (*lb_a_)(i - 2 * n);
+  }
+  const int row = i - 2 * n - num_rows_;
+  return (*ub_a_)(row) - C_->row(row).dot(x);
+}
+
+void DenseQpSolver::TransformNormal(const int i) {
+  const int n = num_variables_;
+  // 变量上下界的法向量是单位向量, J^T e_j 即J的第j行
+  if (i < n) {
+    d_ = J_.row(i).transpose();
+  } else if (i < 2 * n) {
+    d_ = -J_.row(i - n).transpose();
+  } else if (i < 2 * n + num_rows_) {
+    d_.noalias() = J_.transpose() * C_->row(i - 2 * n).transpose();
+  } else {
+    d_.noalias() = -J_.transpose() * C_->row(i - 2 * n - num_rows_).transpose();
+  }
+}
+
+bool DenseQpSolver::AddConstraint(const int i) {
+  const int n = num_variables_;
+  const int q = num_active_;
+  // 从下往上用Givens旋转把d_的第q+1..n-1个分量消去, 同样的旋转作用于J的列
+  for (int j = n - 1; j > q; --j) {
+    const double a = d_(j - 1);
+    const double b = d_(j);
+    if (b == 0.0) {
+      continue;
+    }
+    const double h = std::hypot(a, b);
+    const double c = a / h;
+    const double s = b / h;
+    d_(j - 1) = h;
+    d_(j) = 0.0;
+    for (int k = 0; k < n; ++k) {
+      const double left = J_(k, j - 1);
+      const double right = J_(k, j);
+      J_(k, j - 1) = c * left + s * right;
+      J_(k, j) = -s * left + c * right;
+    }
+  }
+  if (std::fabs(d_(q)) <= kDependenceTolerance) {
+    return false;
+  }
+  R_.col(q).head(q + 1) = d_.head(q + 1);
+  active_[q] = i;
+  is_active_[i] = 1;
+  ++num_active_;
+  return true;
+}
+
+void DenseQpSolver::DropConstraint(const int k) {
+  const int n = num_variables_;
+  is_active_[active_[k]] = 0;
+  for (int j = k; j < num_active_ - 1; ++j) {
+    active_[j] = active_[j + 1];
+    u_(j) = u_(j + 1);
+    R_.col(j).head(j + 2) = R_.col(j + 1).head(j + 2);
+  }
+  --num_active_;
+  // 删除一列后R在第k列之后为上Hessenberg形, 逐列消去次对角元
+  for (int j = k; j < num_active_; ++j) {
+    const double a = R_(j, j);
+    const double b = R_(j + 1, j);
+    if (b == 0.0) {
+      continue;
+    }
+    const double h = std::hypot(a, b);
+    const double c = a / h;
+    const double s = b / h;
+    R_(j, j) = h;
+    R_(j + 1, j) = 0.0;
+    for (int col = j + 1; col < num_active_; ++col) {
+      const double top = R_(j, col);
+      const double bottom = R_(j + 1, col);
+      R_(j, col) = c * top + s * bottom;
+      R_(j + 1, col) = -s * top + c * bottom;
+    }
+    for (int row = 0; row < n; ++row) {
+      const double left = J_(row, j);
+      const double right = J_(row, j + 1);
+      J_(row, j) = c * left + s * right;
+      J_(row, j + 1) = -s * left + c * right;
+    }
+  }
+}
+
+int DenseQpSolver::Solve(const Eigen::VectorXd &g, const Eigen::VectorXd &lb,
+                         const Eigen::VectorXd &ub, const Eigen::MatrixXd &C,
+                         const Eigen::VectorXd &lb_a,
+                         const Eigen::VectorXd &ub_a, const int max_iterations,
+                         const double time_limit_us, Eigen::VectorXd *x) {
+  const auto start = std::chrono::steady_clock::now();
+  iterations_ = 0;
+  num_active_ = 0;
+  if (!factorized_) {
+    return kNotConvex;
+  }
+  lb_ = &lb;
+  ub_ = &ub;
+  C_ = &C;
+  lb_a_ = &lb_a;
+  ub_a_ = &ub_a;
+  const int n = num_variables_;
+  const int num_constraints = 2 * (n + num_rows_);
+  std::fill(is_active_.begin(), is_active_.end(), 0);
+  J_ = J0_;
+
+  // 无约束最优解 x = -H^-1 g = -J J^T g
+  d_.noalias() = J_.transpose() * g;
+  x->noalias() = -J_ * d_;
+
+  const double inf = std::numeric_limits<double>::infinity();
+  while (true) {
+    // step 1: 选出违反最多的约束
+    int p = -1;
+    double slack = -kFeasibilityTolerance;
+    for (int i = 0; i < num_constraints; ++i) {
+      if (is_active_[i] || std::fabs(Bound(i)) >= kInfinity) {
+        continue;
+      }
+      const double s = Slack(i, *x);
+      if (s < slack) {
+        slack = s;
+        p = i;
+      }
+    }
+    if (p < 0) {
+      return kSolved;
+    }
+
+    // step 2: 沿原始方向z和对偶方向r前进, 直到p满足(加入活动集)或
+    // 某个活动约束的乘子降为零(移出活动集)
+    double u_plus = 0.0;
+    while (true) {
+      if (++iterations_ > max_iterations) {
+        return kMaxIterations;
+      }
+      if (time_limit_us > 0.0 &&
+          std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - start)
+                  .count() > time_limit_us) {
+        return kTimeLimit;
+      }
+      const int q = num_active_;
+      TransformNormal(p);
+      z_.noalias() = J_.rightCols(n - q) * d_.tail(n - q);
+      auto r = r_.head(q);
+      r = d_.head(q);
+      R_.topLeftCorner(q, q).triangularView<Eigen::Upper>().solveInPlace(r);
+
+      double t1 = inf;
+      int drop = -1;
+      for (int k = 0; k < q; ++k) {
+        if (r(k) > 0.0 && u_(k) / r(k) < t1) {
+          t1 = u_(k) / r(k);
+          drop = k;
+        }
+      }
+      // z^T n_p = |J2^T n_p|^2
+      const double zn = d_.tail(n - q).squaredNorm();
+      const double t2 = zn > kDependenceTolerance ? -slack / zn : inf;
+      if (t1 == inf && t2 == inf) {
+        return kInfeasible;
+      }
+      if (t2 == inf) {
+        // n_p与活动约束线性相关: 只走对偶步, 移出一个约束
+        u_.head(q) -= t1 * r;
+        u_plus += t1;
+        DropConstraint(drop);
+        continue;
+      }
+      const double t = std::min(t1, t2);
+      *x += t * z_;
+      u_.head(q) -= t * r;
+      u_plus += t;
+      if (t2 <= t1) {
+        if (!AddConstraint(p)) {
+          return kInfeasible;
+        }
+        u_(num_active_ - 1) = u_plus;
+        break;
+      }
+      DropConstraint(drop);
+      slack = Slack(p, *x);
+    }
+  }
+}
+
+size_t DenseQpSolver::MemoryBytes() const {
+  return (llt_.matrixLLT().size() + J0_.size() + J_.size() + R_.size() +
+          d_.size() + z_.size() + r_.size() + u_.size()) *
+             sizeof(double) +
+         active_.capacity() * sizeof(int) + is_active_.capacity();
+}
+
+}  // namespace control
+}  // namespace shenlan
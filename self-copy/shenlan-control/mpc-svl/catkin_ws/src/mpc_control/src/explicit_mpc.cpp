@@ -0,0 +1,610 @@
+#include "explicit_mpc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <set>
+
+#include "dense_qp.h"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// 判断控制量在上下限上
+constexpr double kActiveTolerance = 1e-8;
+// 点在区域内的容差, 半空间已归一化, 单位同状态量
+constexpr double kRegionTolerance = 1e-5;
+// 法向量小于此值的半空间视为常数
+constexpr double kZeroNormTolerance = 1e-12;
+// 读文件时单个数组的长度上限, 防止损坏的文件申请过大的内存
+constexpr std::uint64_t kMaxArraySize = std::uint64_t(1) << 28;
+
+constexpr std::uint32_t kFileMagic = 0x43504d45;  // "EMPC"
+constexpr std::uint32_t kFileVersion = 2;
+
+template <typename T>
+void WriteValue(const T &value, std::ostream *out) {
+  out->write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool ReadValue(std::istream *in, T *value) {
+  return static_cast<bool>(
+      in->read(reinterpret_cast<char *>(value), sizeof(T)));
+}
+
+template <typename T>
+void WriteVector(const std::vector<T> &values, std::ostream *out) {
+  WriteValue(static_cast<std::uint64_t>(values.size()), out);
+  out->write(reinterpret_cast<const char *>(values.data()),
+             values.size() * sizeof(T));
+}
+
+template <typename T>
+bool ReadVector(std::istream *in, std::vector<T> *values) {
+  std::uint64_t size = 0;
+  if (!ReadValue(in, &size) || size > kMaxArraySize) {
+    return false;
+  }
+  values->resize(size);
+  return static_cast<bool>(in->read(reinterpret_cast<char *>(values->data()),
+                                    size * sizeof(T)));
+}
+
+template <typename T>
+std::size_t VectorBytes(const std::vector<T> &values) {
+  return values.size() * sizeof(T);
+}
+
+}  // namespace
+
+bool ExplicitMpcLaw::Build(const ExplicitMpcProblem &problem,
+                           const ExplicitMpcBuildOptions &options) {
+  const int n = problem.matrix_a.rows();
+  const int m = problem.matrix_b.cols();
+  const int N = problem.horizon;
+  if (n == 0 || m == 0 || N <= 0 || problem.matrix_a.cols() != n ||
+      problem.matrix_b.rows() != n || problem.matrix_q.rows() != n ||
+      problem.matrix_q.cols() != n || problem.matrix_r.rows() != m ||
+      problem.matrix_r.cols() != m || problem.u_lower.size() != m ||
+      problem.u_upper.size() != m || problem.x_lower.size() != n ||
+      problem.x_upper.size() != n ||
+      (problem.x_lower.array() > problem.x_upper.array()).any()) {
+    return false;
+  }
+  const int num_variables = N * m;
+
+  // 压缩: X = Phi x_0 + Gamma U, Gamma的(k, j)块为A^(k-j) B
+  Eigen::MatrixXd phi(N * n, n);
+  Eigen::MatrixXd gamma = Eigen::MatrixXd::Zero(N * n, num_variables);
+  Eigen::MatrixXd power = problem.matrix_a;
+  Eigen::MatrixXd impulse = problem.matrix_b;
+  for (int k = 0; k < N; ++k) {
+    phi.middleRows(k * n, n) = power;
+    for (int j = 0; j + k < N; ++j) {
+      gamma.block((j + k) * n, j * m, n, m) = impulse;
+    }
+    power = problem.matrix_a * power;
+    impulse = problem.matrix_a * impulse;
+  }
+  Eigen::MatrixXd q_gamma(N * n, num_variables);
+  for (int k = 0; k < N; ++k) {
+    q_gamma.middleRows(k * n, n).noalias() =
+        problem.matrix_q * gamma.middleRows(k * n, n);
+  }
+  // 0.5 U^T H U + (F x_0)^T U
+  Eigen::MatrixXd H = gamma.transpose() * q_gamma;
+  for (int k = 0; k < N; ++k) {
+    H.block(k * m, k * m, m, m) += problem.matrix_r;
+  }
+  const Eigen::MatrixXd F = q_gamma.transpose() * phi;
+  Eigen::VectorXd lb(num_variables);
+  Eigen::VectorXd ub(num_variables);
+  for (int k = 0; k < N; ++k) {
+    lb.segment(k * m, m) = problem.u_lower;
+    ub.segment(k * m, m) = problem.u_upper;
+  }
+
+  DenseQpSolver qp;
+  qp.Resize(num_variables, 0);
+  if (!qp.SetHessian(H)) {
+    return false;
+  }
+
+  state_dim_ = n;
+  control_dim_ = m;
+  depth_ = 0;
+  lower_.assign(problem.x_lower.data(), problem.x_lower.data() + n);
+  upper_.assign(problem.x_upper.data(), problem.x_upper.data() + n);
+  row_offset_.assign(1, 0);
+  rows_.clear();
+  laws_.clear();
+  nodes_.clear();
+  leaf_regions_.clear();
+
+  std::mt19937 rng(options.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  const Eigen::MatrixXd no_rows(0, num_variables);
+  const Eigen::VectorXd no_bounds(0);
+  Eigen::VectorXd x(n);
+  Eigen::VectorXd g(num_variables);
+  Eigen::VectorXd solution(num_variables);
+  // 0: 自由, 1: 在下限, 2: 在上限
+  std::vector<char> active(num_variables);
+  std::set<std::vector<char>> visited;
+  std::vector<int> free_index;
+  Eigen::MatrixXd row_a;
+  Eigen::VectorXd row_b;
+  std::size_t last_region = 0;
+
+  for (int sample = 0; sample < options.samples; ++sample) {
+    for (int j = 0; j < n; ++j) {
+      x(j) = problem.x_lower(j) +
+             unit(rng) * (problem.x_upper(j) - problem.x_lower(j));
+    }
+    // 已有区域覆盖的点不用求解; 相邻样本常落在同一区域, 先查上一个
+    const std::size_t regions = num_regions();
+    bool covered = regions > 0 && Contains(last_region, x.data());
+    for (std::size_t r = 0; r < regions && !covered; ++r) {
+      if (Contains(r, x.data())) {
+        covered = true;
+        last_region = r;
+      }
+    }
+    if (covered) {
+      continue;
+    }
+
+    g.noalias() = F * x;
+    if (qp.Solve(g, lb, ub, no_rows, no_bounds, no_bounds, 10 * num_variables,
+                 0.0, &solution) != DenseQpSolver::kSolved) {
+      continue;
+    }
+    free_index.clear();
+    for (int i = 0; i < num_variables; ++i) {
+      const double scale = 1.0 + std::max(std::fabs(lb(i)), std::fabs(ub(i)));
+      if (solution(i) - lb(i) <= kActiveTolerance * scale) {
+        active[i] = 1;
+      } else if (ub(i) - solution(i) <= kActiveTolerance * scale) {
+        active[i] = 2;
+      } else {
+        active[i] = 0;
+        free_index.push_back(i);
+      }
+    }
+    if (!visited.insert(active).second) {
+      continue;
+    }
+
+    // 活动集固定时: U_F = -H_FF^-1 (F_F x_0 + H_FA U_A), U = K x_0 + k
+    Eigen::MatrixXd gain = Eigen::MatrixXd::Zero(num_variables, n);
+    Eigen::VectorXd offset = Eigen::VectorXd::Zero(num_variables);
+    for (int i = 0; i < num_variables; ++i) {
+      if (active[i] != 0) {
+        offset(i) = active[i] == 1 ? lb(i) : ub(i);
+      }
+    }
+    const int num_free = free_index.size();
+    if (num_free > 0) {
+      Eigen::MatrixXd h_free(num_free, num_free);
+      Eigen::MatrixXd f_free(num_free, n);
+      Eigen::VectorXd c_free(num_free);
+      for (int a = 0; a < num_free; ++a) {
+        for (int b = 0; b < num_free; ++b) {
+          h_free(a, b) = H(free_index[a], free_index[b]);
+        }
+        f_free.row(a) = F.row(free_index[a]);
+        // 活动分量的贡献, 自由分量的offset此时为0
+        c_free(a) = H.row(free_index[a]).dot(offset);
+      }
+      const Eigen::LLT<Eigen::MatrixXd> llt(h_free);
+      const Eigen::MatrixXd gain_free = -llt.solve(f_free);
+      const Eigen::VectorXd offset_free = -llt.solve(c_free);
+      for (int a = 0; a < num_free; ++a) {
+        gain.row(free_index[a]) = gain_free.row(a);
+        offset(free_index[a]) = offset_free(a);
+      }
+    }
+    // 梯度H U + F x_0, 即活动约束的乘子
+    const Eigen::MatrixXd gradient_gain = H * gain + F;
+    const Eigen::VectorXd gradient_offset = H * offset;
+
+    // 区域: 自由分量在上下限之内, 下限上的梯度 >= 0, 上限上的梯度 <= 0
+    row_a.resize(2 * num_variables, n);
+    row_b.resize(2 * num_variables);
+    int num_rows = 0;
+    bool empty = false;
+    const auto add_row = [&](const Eigen::VectorXd &a, const double b) {
+      const double norm = a.norm();
+      if (norm < kZeroNormTolerance) {
+        empty = empty || b < -kRegionTolerance;
+        return;
+      }
+      // 箱内a^T x的最大值不超过b时, 这一行不起作用
+      double reach = 0.0;
+      for (int j = 0; j < n; ++j) {
+        reach += a(j) > 0.0 ? a(j) * problem.x_upper(j)
+                            : a(j) * problem.x_lower(j);
+      }
+      if (reach <= b) {
+        return;
+      }
+      row_a.row(num_rows) = a.transpose() / norm;
+      row_b(num_rows) = b / norm;
+      ++num_rows;
+    };
+    for (int i = 0; i < num_variables; ++i) {
+      if (active[i] == 0) {
+        add_row(gain.row(i).transpose(), ub(i) - offset(i));
+        add_row(-gain.row(i).transpose(), offset(i) - lb(i));
+      } else if (active[i] == 1) {
+        add_row(-gradient_gain.row(i).transpose(), gradient_offset(i));
+      } else {
+        add_row(gradient_gain.row(i).transpose(), -gradient_offset(i));
+      }
+    }
+    // 退化的活动集(弱活动约束)给出的区域可能不含样本本身, 不保存
+    if (empty || (num_rows > 0 &&
+                     ((row_a.topRows(num_rows) * x - row_b.head(num_rows))
+                          .maxCoeff() > kRegionTolerance))) {
+      continue;
+    }
+
+    for (int r = 0; r < num_rows; ++r) {
+      for (int j = 0; j < n; ++j) {
+        rows_.push_back(static_cast<float>(row_a(r, j)));
+      }
+      rows_.push_back(static_cast<float>(row_b(r)));
+    }
+    row_offset_.push_back(row_offset_.back() + num_rows);
+    // 只保存第一步的控制律
+    for (int c = 0; c < m; ++c) {
+      for (int j = 0; j < n; ++j) {
+        laws_.push_back(static_cast<float>(gain(c, j)));
+      }
+      laws_.push_back(static_cast<float>(offset(c)));
+    }
+  }
+
+  std::vector<std::uint32_t> regions(num_regions());
+  for (std::size_t r = 0; r < regions.size(); ++r) {
+    regions[r] = r;
+  }
+  BuildTree(regions, problem.x_lower, problem.x_upper, 0, options);
+  return true;
+}
+
+bool ExplicitMpcLaw::Contains(const std::size_t r, const double *state) const {
+  const std::size_t stride = state_dim_ + 1;
+  const float *row = rows_.data() + row_offset_[r] * stride;
+  const float *end = rows_.data() + row_offset_[r + 1] * stride;
+  for (; row != end; row += stride) {
+    double value = -row[state_dim_];
+    for (std::size_t j = 0; j < state_dim_; ++j) {
+      value += row[j] * state[j];
+    }
+    if (value > kRegionTolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ExplicitMpcLaw::Intersects(const std::size_t r,
+                                const Eigen::VectorXd &lower,
+                                const Eigen::VectorXd &upper) const {
+  const int n = state_dim_;
+  const std::size_t stride = state_dim_ + 1;
+  const int num_rows = row_offset_[r + 1] - row_offset_[r];
+  Eigen::MatrixXd C(num_rows, n);
+  Eigen::VectorXd ub_a(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    const float *row = rows_.data() + (row_offset_[r] + i) * stride;
+    // 单独一行在格子内取不到b以下时, 不必求解
+    double reach = 0.0;
+    for (int j = 0; j < n; ++j) {
+      C(i, j) = row[j];
+      reach += row[j] > 0.0f ? row[j] * lower(j) : row[j] * upper(j);
+    }
+    ub_a(i) = row[n] + kRegionTolerance;
+    if (reach > ub_a(i)) {
+      return false;
+    }
+  }
+  if (num_rows <= 1) {
+    return true;
+  }
+  // 格子与区域的交集非空: 到格子中心最近的点的QP可行
+  DenseQpSolver qp;
+  qp.Resize(n, num_rows);
+  qp.SetHessian(Eigen::MatrixXd::Identity(n, n));
+  const Eigen::VectorXd g = -0.5 * (lower + upper);
+  const Eigen::VectorXd lb_a =
+      Eigen::VectorXd::Constant(num_rows, -DenseQpSolver::kInfinity);
+  Eigen::VectorXd x(n);
+  return qp.Solve(g, lower, upper, C, lb_a, ub_a, 10 * (n + num_rows), 0.0,
+                  &x) != DenseQpSolver::kInfeasible;
+}
+
+// 沿相对最宽的坐标在中点二分, 直到格子里的区域不超过leaf_size
+void ExplicitMpcLaw::BuildTree(const std::vector<std::uint32_t> &regions,
+                               const Eigen::VectorXd &lower,
+                               const Eigen::VectorXd &upper,
+                               const std::size_t depth,
+                               const ExplicitMpcBuildOptions &options) {
+  depth_ = std::max<std::uint32_t>(depth_, depth);
+  const std::size_t index = nodes_.size();
+  nodes_.push_back(Node{-1, 0.0f, 0, 0});
+
+  std::vector<std::uint32_t> left;
+  std::vector<std::uint32_t> right;
+  Eigen::VectorXd left_upper = upper;
+  Eigen::VectorXd right_lower = lower;
+  int axis = -1;
+  float value = 0.0f;
+  if (regions.size() > static_cast<std::size_t>(options.leaf_size) &&
+      depth < static_cast<std::size_t>(options.max_depth)) {
+    double widest = -1.0;
+    for (std::size_t j = 0; j < state_dim_; ++j) {
+      const double width = (upper(j) - lower(j)) / (upper_[j] - lower_[j]);
+      if (width > widest) {
+        widest = width;
+        axis = j;
+      }
+    }
+    value = static_cast<float>(0.5 * (lower(axis) + upper(axis)));
+    left_upper(axis) = value;
+    right_lower(axis) = value;
+    for (const std::uint32_t r : regions) {
+      if (Intersects(r, lower, left_upper)) {
+        left.push_back(r);
+      }
+      if (Intersects(r, right_lower, upper)) {
+        right.push_back(r);
+      }
+    }
+    // 两侧都没有减少(多个区域交于格子里的一点)时, 再分也没有用
+    if (left.size() == regions.size() && right.size() == regions.size()) {
+      axis = -1;
+    }
+  }
+
+  if (axis < 0) {
+    nodes_[index].first = leaf_regions_.size();
+    nodes_[index].second = regions.size();
+    leaf_regions_.insert(leaf_regions_.end(), regions.begin(), regions.end());
+    return;
+  }
+  nodes_[index].axis = axis;
+  nodes_[index].value = value;
+  BuildTree(left, lower, left_upper, depth + 1, options);
+  nodes_[index].second = nodes_.size();
+  BuildTree(right, right_lower, upper, depth + 1, options);
+}
+
+bool ExplicitMpcLaw::Evaluate(const double *state, double *control) const {
+  if (nodes_.empty()) {
+    return false;
+  }
+  for (std::size_t j = 0; j < state_dim_; ++j) {
+    if (!(state[j] >= lower_[j] && state[j] <= upper_[j])) {
+      return false;
+    }
+  }
+  std::size_t index = 0;
+  while (nodes_[index].axis >= 0) {
+    const Node &node = nodes_[index];
+    index = state[node.axis] <= node.value ? index + 1 : node.second;
+  }
+  const Node &leaf = nodes_[index];
+  const std::size_t stride = state_dim_ + 1;
+  for (std::size_t i = leaf.first; i < leaf.first + leaf.second; ++i) {
+    const std::uint32_t r = leaf_regions_[i];
+    if (!Contains(r, state)) {
+      continue;
+    }
+    const float *law = laws_.data() + r * control_dim_ * stride;
+    for (std::size_t c = 0; c < control_dim_; ++c, law += stride) {
+      double u = law[state_dim_];
+      for (std::size_t j = 0; j < state_dim_; ++j) {
+        u += law[j] * state[j];
+      }
+      control[c] = u;
+    }
+    return true;
+  }
+  return false;
+}
+
+std::size_t ExplicitMpcLaw::MemoryBytes() const {
+  return VectorBytes(lower_) + VectorBytes(upper_) +
+         VectorBytes(row_offset_) + VectorBytes(rows_) + VectorBytes(laws_) +
+         VectorBytes(nodes_) + VectorBytes(leaf_regions_);
+}
+
+void ExplicitMpcLaw::Write(std::ostream *out) const {
+  WriteValue(state_dim_, out);
+  WriteValue(control_dim_, out);
+  WriteValue(depth_, out);
+  WriteVector(lower_, out);
+  WriteVector(upper_, out);
+  WriteVector(row_offset_, out);
+  WriteVector(rows_, out);
+  WriteVector(laws_, out);
+  WriteVector(nodes_, out);
+  WriteVector(leaf_regions_, out);
+}
+
+bool ExplicitMpcLaw::Read(std::istream *in) {
+  if (!ReadValue(in, &state_dim_) || !ReadValue(in, &control_dim_) ||
+      !ReadValue(in, &depth_) || !ReadVector(in, &lower_) ||
+      !ReadVector(in, &upper_) || !ReadVector(in, &row_offset_) ||
+      !ReadVector(in, &rows_) || !ReadVector(in, &laws_) ||
+      !ReadVector(in, &nodes_) || !ReadVector(in, &leaf_regions_)) {
+    return false;
+  }
+  // Evaluate不检查下标, 这里检查一遍
+  const std::size_t stride = state_dim_ + 1;
+  const std::size_t regions = num_regions();
+  if (state_dim_ == 0 || control_dim_ == 0 || lower_.size() != state_dim_ ||
+      upper_.size() != state_dim_ || row_offset_.empty() ||
+      row_offset_.front() != 0 ||
+      !std::is_sorted(row_offset_.begin(), row_offset_.end()) ||
+      rows_.size() != std::size_t(row_offset_.back()) * stride ||
+      laws_.size() != regions * control_dim_ * stride || nodes_.empty()) {
+    return false;
+  }
+  for (const std::uint32_t r : leaf_regions_) {
+    if (r >= regions) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < nodes_.size(); ++i) {
+    const Node &node = nodes_[i];
+    if (node.axis >= 0
+            ? (std::size_t(node.axis) >= state_dim_ || i + 1 >= nodes_.size() ||
+               node.second <= i + 1 || node.second >= nodes_.size())
+            : std::size_t(node.first) + node.second > leaf_regions_.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+double ExplicitMpc::GridSpeed(const ExplicitMpcConfig &config, const int i) {
+  if (config.num_speeds <= 1) {
+    return config.min_speed;
+  }
+  const double ratio = static_cast<double>(i) / (config.num_speeds - 1);
+  return 1.0 / (1.0 / config.min_speed +
+                ratio * (1.0 / config.max_speed - 1.0 / config.min_speed));
+}
+
+bool ExplicitMpc::Build(const ExplicitMpcConfig &config,
+                        const std::vector<ExplicitMpcProblem> &lateral,
+                        const ExplicitMpcProblem &longitudinal,
+                        const std::vector<double> &model_key) {
+  if (config.min_speed <= 0.0 || config.max_speed <= config.min_speed ||
+      config.num_speeds < 2 ||
+      lateral.size() != static_cast<std::size_t>(config.num_speeds)) {
+    return false;
+  }
+  horizon_ = config.horizon;
+  model_key_ = model_key;
+  inverse_min_speed_ = 1.0 / config.min_speed;
+  inverse_speed_step_ = (1.0 / config.min_speed - 1.0 / config.max_speed) /
+                        (config.num_speeds - 1);
+  lateral_.assign(lateral.size(), ExplicitMpcLaw());
+  ExplicitMpcBuildOptions options = config.options;
+  for (std::size_t i = 0; i < lateral.size(); ++i) {
+    options.seed = config.options.seed + i;
+    if (lateral[i].matrix_a.rows() != 4 || lateral[i].matrix_b.cols() != 1 ||
+        !lateral_[i].Build(lateral[i], options)) {
+      return false;
+    }
+  }
+  return longitudinal.matrix_a.rows() == 1 &&
+         longitudinal.matrix_b.cols() == 1 &&
+         longitudinal_.Build(longitudinal, config.options);
+}
+
+bool ExplicitMpc::Evaluate(const StateVector &state, const double v,
+                           ControlVector *control) const {
+  if (lateral_.size() < 2 || !(v > 0.0)) {
+    return false;
+  }
+  // 在两个相邻的网格速度之间按1/v线性插值
+  const double last = lateral_.size() - 1.0;
+  const double position = (inverse_min_speed_ - 1.0 / v) / inverse_speed_step_;
+  // 网格两端按舍入误差放宽
+  if (!(position >= -1e-9 && position <= last + 1e-9)) {
+    return false;
+  }
+  const double clamped = std::min(std::max(position, 0.0), last);
+  const std::size_t index = std::min(static_cast<std::size_t>(clamped),
+                                     lateral_.size() - 1);
+  const double ratio = clamped - index;
+  double steer = 0.0;
+  if (!lateral_[index].Evaluate(state.data(), &steer)) {
+    return false;
+  }
+  if (ratio > 0.0) {
+    double next_steer = 0.0;
+    if (!lateral_[index + 1].Evaluate(state.data(), &next_steer)) {
+      return false;
+    }
+    steer += ratio * (next_steer - steer);
+  }
+  double acceleration = 0.0;
+  if (!longitudinal_.Evaluate(state.data() + 5, &acceleration)) {
+    return false;
+  }
+  (*control) << steer, acceleration;
+  return true;
+}
+
+std::size_t ExplicitMpc::MemoryBytes() const {
+  std::size_t bytes = longitudinal_.MemoryBytes();
+  for (const ExplicitMpcLaw &law : lateral_) {
+    bytes += law.MemoryBytes();
+  }
+  return bytes;
+}
+
+bool ExplicitMpc::Save(const std::string &path) const {
+  std::ofstream out(path, std::ios::binary);
+  WriteValue(kFileMagic, &out);
+  WriteValue(kFileVersion, &out);
+  WriteValue(static_cast<std::int32_t>(horizon_), &out);
+  WriteValue(inverse_min_speed_, &out);
+  WriteValue(inverse_speed_step_, &out);
+  WriteVector(model_key_, &out);
+  WriteValue(static_cast<std::uint32_t>(lateral_.size()), &out);
+  for (const ExplicitMpcLaw &law : lateral_) {
+    law.Write(&out);
+  }
+  longitudinal_.Write(&out);
+  return static_cast<bool>(out);
+}
+
+bool ExplicitMpc::Load(const std::string &path,
+                       const std::vector<double> &model_key) {
+  std::ifstream in(path, std::ios::binary);
+  std::uint32_t magic = 0;
+  std::uint32_t version = 0;
+  std::int32_t horizon = 0;
+  std::vector<double> key;
+  std::uint32_t count = 0;
+  // 模型参数、权重、约束或预测步长变化后旧表作废
+  if (!ReadValue(&in, &magic) || magic != kFileMagic ||
+      !ReadValue(&in, &version) || version != kFileVersion ||
+      !ReadValue(&in, &horizon) || !ReadValue(&in, &inverse_min_speed_) ||
+      !ReadValue(&in, &inverse_speed_step_) || !ReadVector(&in, &key) ||
+      key != model_key || !ReadValue(&in, &count) || count < 2 ||
+      count > kMaxArraySize || !(inverse_min_speed_ > 0.0) ||
+      !(inverse_speed_step_ > 0.0)) {
+    lateral_.clear();
+    return false;
+  }
+  horizon_ = horizon;
+  model_key_.swap(key);
+  lateral_.assign(count, ExplicitMpcLaw());
+  for (ExplicitMpcLaw &law : lateral_) {
+    if (!law.Read(&in) || law.state_dim() != 4 || law.control_dim() != 1) {
+      lateral_.clear();
+      return false;
+    }
+  }
+  if (!longitudinal_.Read(&in) || longitudinal_.state_dim() != 1 ||
+      longitudinal_.control_dim() != 1) {
+    lateral_.clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,259 @@
+/**
+ * Offline generator of the explicit MPC table of MPCController. Builds the
+ * table with MPCController::BuildExplicitMpc from the model, weights and
+ * limits of Init, writes it to the output file and reads it back.
+ *
+ * Then builds it again for a few horizons, speed grids and leaf sizes and
+ * reports, per configuration: regions (lateral laws of all grid speeds and
+ * the speed error law), tree nodes and depth, table bytes, build time, the
+ * lookup time (mean and 99th percentile of ExplicitMpc::Evaluate, each
+ * timed on its own, so the percentile includes the clock), the share of
+ * random states of the box the table covers, and the largest difference
+ * of the front wheel angle and the acceleration from the exact QP solution
+ * (the condensed active-set formulation of the controller) where it does,
+ * at the grid speeds and at random speeds between them. For comparison,
+ * the mean update and solve time of the OSQP formulation on the same
+ * states and its workspace bytes.
+ *
+ * usage: explicit_mpc_tool [output] [horizon]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "explicit_mpc.h"
+#include "mpc_controller.h"
+
+using shenlan::control::ExplicitMpc;
+using shenlan::control::ExplicitMpcConfig;
+using shenlan::control::MPCController;
+using shenlan::control::MpcCommandSource;
+using shenlan::control::MpcFormulation;
+using shenlan::control::MpcOsqpStats;
+
+namespace {
+
+// 每个配置评估的随机状态数
+constexpr int kSamples = 5000;
+
+// 控制器的QP, 在给定误差状态和车速下求解一次
+class ReferenceController : public MPCController {
+ public:
+  ReferenceController(const MpcFormulation formulation, const int horizon) {
+    Init();
+    SetMpcFormulation(formulation);
+    SetHorizon(horizon);
+  }
+
+  bool Solve(const StateVector &state, const double v, ControlVector *control,
+             MpcOsqpStats *stats) {
+    StateMatrix matrix_ad;
+    DiscretizeAtSpeed(std::max(v, minimum_speed_protection_), &matrix_ad);
+    std::vector<double> control_cmd(kControlSize, 0.0);
+    if (SolveQp(matrix_ad, matrix_bd_, nullptr, state, StateVector::Zero(),
+                0.0, &control_cmd, stats) != MpcCommandSource::kSolution) {
+      return false;
+    }
+    (*control) << control_cmd[0], control_cmd[1];
+    return true;
+  }
+
+  std::size_t OsqpMemoryBytes() const {
+    return mpc_osqp_ != nullptr ? mpc_osqp_->MemoryBytes() : 0;
+  }
+};
+
+struct ToolReport {
+  std::size_t regions = 0;
+  std::size_t nodes = 0;
+  std::size_t depth = 0;
+  std::size_t bytes = 0;
+  double build_time_s = 0.0;
+  double lookup_mean_ns = 0.0;
+  double lookup_p99_ns = 0.0;
+  double coverage = 0.0;
+  // 网格速度上 / 网格之间的最大误差: 前轮转角[rad], 加速度[m/s^2]
+  double grid_steer_error = 0.0;
+  double between_steer_error = 0.0;
+  double acceleration_error = 0.0;
+  double osqp_time_us = 0.0;
+  std::size_t osqp_bytes = 0;
+};
+
+bool Evaluate(const ExplicitMpcConfig &config, ExplicitMpc *explicit_mpc,
+              ToolReport *report) {
+  ReferenceController builder(MpcFormulation::kCondensed, config.horizon);
+  const auto start = std::chrono::steady_clock::now();
+  if (!builder.BuildExplicitMpc(config, explicit_mpc)) {
+    return false;
+  }
+  report->build_time_s = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  for (const auto &law : explicit_mpc->lateral_laws()) {
+    report->regions += law.num_regions();
+    report->nodes += law.num_nodes();
+    report->depth = std::max(report->depth, law.depth());
+  }
+  const auto &longitudinal = explicit_mpc->longitudinal_law();
+  report->regions += longitudinal.num_regions();
+  report->nodes += longitudinal.num_nodes();
+  report->depth = std::max(report->depth, longitudinal.depth());
+  report->bytes = explicit_mpc->MemoryBytes();
+
+  ReferenceController exact(MpcFormulation::kCondensed, config.horizon);
+  ReferenceController osqp(MpcFormulation::kSparse, config.horizon);
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  const double box[MPCController::kStateSize] = {
+      config.max_lateral_error, config.max_lateral_error_rate,
+      config.max_heading_error, config.max_heading_error_rate, 0.0,
+      config.max_speed_error};
+  const int grid = explicit_mpc->lateral_laws().size();
+  // 偶数样本取网格速度, 奇数样本取网格之间的速度
+  std::vector<ExplicitMpc::StateVector,
+              Eigen::aligned_allocator<ExplicitMpc::StateVector>>
+      states(kSamples);
+  std::vector<double> speeds(kSamples);
+  for (int k = 0; k < kSamples; ++k) {
+    for (int j = 0; j < MPCController::kStateSize; ++j) {
+      states[k](j) = (2.0 * unit(generator) - 1.0) * box[j];
+    }
+    speeds[k] =
+        k % 2 == 0
+            ? ExplicitMpc::GridSpeed(
+                  config, std::min<int>(unit(generator) * grid, grid - 1))
+            : config.min_speed +
+                  unit(generator) * (config.max_speed - config.min_speed);
+  }
+
+  // 平均查表时间: 连续调用, 不含计时本身
+  ExplicitMpc::ControlVector control;
+  int covered = 0;
+  const auto batch_start = std::chrono::steady_clock::now();
+  for (int k = 0; k < kSamples; ++k) {
+    covered += explicit_mpc->Evaluate(states[k], speeds[k], &control);
+  }
+  report->lookup_mean_ns = std::chrono::duration<double, std::nano>(
+                               std::chrono::steady_clock::now() - batch_start)
+                               .count() /
+                           kSamples;
+  report->coverage = static_cast<double>(covered) / kSamples;
+
+  std::vector<double> lookup_ns;
+  lookup_ns.reserve(kSamples);
+  double osqp_time_us = 0.0;
+  int osqp_solves = 0;
+  for (int k = 0; k < kSamples; ++k) {
+    const auto lookup_start = std::chrono::steady_clock::now();
+    const bool found = explicit_mpc->Evaluate(states[k], speeds[k], &control);
+    lookup_ns.push_back(std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - lookup_start)
+                            .count());
+
+    MPCController::ControlVector reference;
+    MpcOsqpStats stats;
+    if (osqp.Solve(states[k], speeds[k], &reference, &stats)) {
+      osqp_time_us += stats.update_time_us + stats.solve_time_us;
+      ++osqp_solves;
+    }
+    if (!found || !exact.Solve(states[k], speeds[k], &reference, &stats)) {
+      continue;
+    }
+    const double steer_error = std::fabs(control(0) - reference(0));
+    double &steer_max =
+        k % 2 == 0 ? report->grid_steer_error : report->between_steer_error;
+    steer_max = std::max(steer_max, steer_error);
+    report->acceleration_error = std::max(
+        report->acceleration_error, std::fabs(control(1) - reference(1)));
+  }
+  report->osqp_time_us = osqp_solves > 0 ? osqp_time_us / osqp_solves : 0.0;
+  report->osqp_bytes = osqp.OsqpMemoryBytes();
+  std::sort(lookup_ns.begin(), lookup_ns.end());
+  report->lookup_p99_ns = lookup_ns[lookup_ns.size() * 99 / 100];
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::string output = argc > 1 ? argv[1] : "explicit_mpc.bin";
+  ExplicitMpcConfig config;
+  config.horizon = argc > 2 ? std::atoi(argv[2]) : MPCController::kHorizon;
+
+  ExplicitMpc explicit_mpc;
+  ToolReport report;
+  if (!Evaluate(config, &explicit_mpc, &report)) {
+    std::cerr << "the controller model does not decouple into the lateral "
+                 "and the speed error problem"
+              << std::endl;
+    return 1;
+  }
+  ExplicitMpc loaded;
+  if (!explicit_mpc.Save(output) ||
+      !loaded.Load(output, explicit_mpc.model_key()) ||
+      loaded.MemoryBytes() != explicit_mpc.MemoryBytes()) {
+    std::cerr << "could not write and read back " << output << std::endl;
+    return 1;
+  }
+  std::cout << "wrote " << output << ": horizon " << loaded.horizon() << ", "
+            << loaded.lateral_laws().size() << " speeds from "
+            << config.min_speed << " to " << config.max_speed << " m/s, "
+            << report.regions << " regions, " << loaded.MemoryBytes()
+            << " bytes" << std::endl
+            << std::endl;
+
+  struct Variant {
+    int horizon;
+    int num_speeds;
+    int leaf_size;
+  };
+  const std::vector<Variant> variants = {
+      {config.horizon, config.num_speeds, 4},
+      {config.horizon, config.num_speeds, 8},
+      {config.horizon, config.num_speeds, 16},
+      {config.horizon, 8, 8},
+      {config.horizon, 30, 8},
+      {5, config.num_speeds, 8},
+      {20, config.num_speeds, 8}};
+  std::cout << std::setw(4) << "N" << std::setw(7) << "speeds" << std::setw(6)
+            << "leaf" << std::setw(9) << "regions" << std::setw(8) << "nodes"
+            << std::setw(7) << "depth" << std::setw(10) << "bytes"
+            << std::setw(9) << "build s" << std::setw(9) << "mean ns"
+            << std::setw(9) << "p99 ns" << std::setw(8) << "cover"
+            << std::setw(11) << "du grid" << std::setw(11) << "du betw"
+            << std::setw(11) << "da" << std::setw(10) << "osqp us"
+            << std::setw(11) << "osqp B" << std::endl;
+  for (const Variant &variant : variants) {
+    ExplicitMpcConfig variant_config = config;
+    variant_config.horizon = variant.horizon;
+    variant_config.num_speeds = variant.num_speeds;
+    variant_config.options.leaf_size = variant.leaf_size;
+    ExplicitMpc table;
+    ToolReport row;
+    if (!Evaluate(variant_config, &table, &row)) {
+      return 1;
+    }
+    std::cout << std::setw(4) << variant.horizon << std::setw(7)
+              << variant.num_speeds << std::setw(6) << variant.leaf_size
+              << std::setw(9) << row.regions << std::setw(8) << row.nodes
+              << std::setw(7) << row.depth << std::setw(10) << row.bytes
+              << std::fixed << std::setprecision(2) << std::setw(9)
+              << row.build_time_s << std::setprecision(0) << std::setw(9)
+              << row.lookup_mean_ns << std::setw(9) << row.lookup_p99_ns
+              << std::setprecision(3) << std::setw(8) << row.coverage
+              << std::scientific << std::setprecision(2) << std::setw(11)
+              << row.grid_steer_error << std::setw(11)
+              << row.between_steer_error << std::setw(11)
+              << row.acceleration_error << std::fixed << std::setprecision(1)
+              << std::setw(10) << row.osqp_time_us << std::setw(11)
+              << row.osqp_bytes << std::defaultfloat << std::endl;
+  }
+  return 0;
+}
@@ -1,3 +1,5 @@
+#include "async_mpc_controller.h"
+#include "compiled_roadmap.h"
 #include "mpc_controller.h"
 
 using namespace std;
@@ -50,57 +52,100 @@ void odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
 }
 
 int main(int argc, char** argv) {
-  // Read the reference_line txt
-  std::ifstream infile;
-  infile.open(
-      "src/mpc_control/data/reference_line.txt");  //将文件流对象与文件连接起来
-  assert(infile.is_open());  //若失败,则输出错误消息,并终止程序运行
-
-  std::vector<std::pair<double, double>> xy_points;
-  std::string s;
-  std::string x;
-  std::string y;
-  while (getline(infile, s)) {
-    std::stringstream word(s);
-    word >> x;
-    word >> y;
-    double pt_x = std::atof(x.c_str());
-    double pt_y = std::atof(y.c_str());
-    xy_points.push_back(std::make_pair(pt_x, pt_y));
-  }
-  infile.close();
-
-  // Construct the reference_line path profile
-  std::vector<double> headings;
-  std::vector<double> accumulated_s;
-  std::vector<double> kappas;
-  std::vector<double> dkappas;
-  std::unique_ptr<shenlan::control::ReferenceLine> reference_line =
-      std::make_unique<shenlan::control::ReferenceLine>(xy_points);
-  reference_line->ComputePathProfile(&headings, &accumulated_s, &kappas,
-                                     &dkappas);
-
-  /* for (size_t i = 0; i < headings.size(); i++) {
-    std::cout << "pt " << i << " heading: " << headings[i]
-              << " acc_s: " << accumulated_s[i] << " kappa: " << kappas[i]
-              << " dkappas: " << dkappas[i] << std::endl;
-  } */
-
-  // Construct the planning trajectory
+  ros::init(argc, argv, "control_pub");
+  // LTV和实时迭代按弧长采样参考线, 只有它们需要快照中的等弧长参考线
+  bool mpc_time_varying = false;
+  ros::NodeHandle("~").getParam("mpc_time_varying",
+                                mpc_time_varying);  // 沿参考线的逐步模型(LTV)
+  bool mpc_nonlinear = false;
+  ros::NodeHandle("~").getParam("mpc_nonlinear",
+                                mpc_nonlinear);  // 非线性自行车模型, 实时迭代
+  const bool station_line = mpc_time_varying || mpc_nonlinear;
+
+  // 数据目录中有roadmap_compiler生成且未过期的路网时直接映射, 不再解析文本
+  const std::string roadmap_text = "src/mpc_control/data/reference_line.txt";
+  const std::string roadmap_compiled =
+      "src/mpc_control/data/reference_line.roadmap";
   TrajectoryData planning_published_trajectory;
-  for (size_t i = 0; i < headings.size(); i++) {
-    TrajectoryPoint trajectory_pt;
-    trajectory_pt.x = xy_points[i].first;
-    trajectory_pt.y = xy_points[i].second;
-    trajectory_pt.v = 5.0;
-    trajectory_pt.a = 0.0;
-    trajectory_pt.heading = headings[i];
-    trajectory_pt.kappa = kappas[i];
-
-    planning_published_trajectory.trajectory_points.push_back(trajectory_pt);
+  shenlan::control::CompiledRoadmap compiled_roadmap;
+  if (compiled_roadmap.Open(roadmap_compiled) &&
+      !compiled_roadmap.Stale(roadmap_text)) {
+    // 点直接读入快照, s与dkappa取文件中的列
+    planning_published_trajectory.snapshot =
+        compiled_roadmap.Snapshot(5.0, station_line);
+    std::cout << "compiled roadmap: " << roadmap_compiled << ", "
+              << compiled_roadmap.size() << " points" << std::endl;
+  } else {
+    if (compiled_roadmap.is_open()) {
+      std::cout << roadmap_text << " changed since " << roadmap_compiled
+                << " was compiled, reading the text" << std::endl;
+    } else if (shenlan::control::CompiledRoadmap::IsCompiled(
+                   roadmap_compiled)) {
+      std::cout << compiled_roadmap.error() << ", reading the text"
+                << std::endl;
+    }
+    compiled_roadmap.Close();
+    // Read the reference_line txt
+    std::ifstream infile;
+    infile.open(roadmap_text);  //将文件流对象与文件连接起来
+    assert(infile.is_open());  //若失败,则输出错误消息,并终止程序运行
+
+    std::vector<std::pair<double, double>> xy_points;
+    std::string s;
+    std::string x;
+    std::string y;
+    while (getline(infile, s)) {
+      std::stringstream word(s);
+      word >> x;
+      word >> y;
+      double pt_x = std::atof(x.c_str());
+      double pt_y = std::atof(y.c_str());
+      xy_points.push_back(std::make_pair(pt_x, pt_y));
+    }
+    infile.close();
+
+    // Construct the reference_line path profile
+    std::vector<double> headings;
+    std::vector<double> accumulated_s;
+    std::vector<double> kappas;
+    std::vector<double> dkappas;
+    std::unique_ptr<shenlan::control::ReferenceLine> reference_line =
+        std::make_unique<shenlan::control::ReferenceLine>(xy_points);
+    reference_line->ComputePathProfile(&headings, &accumulated_s, &kappas,
+                                       &dkappas);
+
+    /* for (size_t i = 0; i < headings.size(); i++) {
+      std::cout << "pt " << i << " heading: " << headings[i]
+                << " acc_s: " << accumulated_s[i] << " kappa: " << kappas[i]
+                << " dkappas: " << dkappas[i] << std::endl;
+    } */
+
+    // Construct the planning trajectory
+    for (size_t i = 0; i < headings.size(); i++) {
+      TrajectoryPoint trajectory_pt;
+      trajectory_pt.x = xy_points[i].first;
+      trajectory_pt.y = xy_points[i].second;
+      trajectory_pt.v = 5.0;
+      trajectory_pt.a = 0.0;
+      trajectory_pt.heading = headings[i];
+      trajectory_pt.kappa = kappas[i];
+
+      planning_published_trajectory.trajectory_points.push_back(trajectory_pt);
+    }
+
+    // 构建不可变的轨迹快照(含空间索引), 控制器共享引用, 不再逐周期拷贝;
+    // 轨迹点移入快照
+    planning_published_trajectory.snapshot =
+        shenlan::control::TrajectorySnapshot::Create(
+            std::move(planning_published_trajectory.trajectory_points), true,
+            station_line);
   }
+  const auto &index_stats =
+      planning_published_trajectory.snapshot->spatial_index()->stats();
+  std::cout << "spatial index: " << index_stats.num_points << " points, build "
+            << index_stats.build_time_ms << " ms, "
+            << index_stats.bytes_per_point << " bytes/point" << std::endl;
 
-  ros::init(argc, argv, "control_pub");
   ros::NodeHandle nh;
   ROS_INFO("init !");
   ros::Subscriber sub = nh.subscribe("/odom", 10, odomCallback);
@@ -115,16 +160,127 @@ int main(int argc, char** argv) {
 
   // Lqr control part
   ControlCmd cmd;
-  std::unique_ptr<shenlan::control::MPCController> mpc_controller =
-      std::make_unique<shenlan::control::MPCController>();
+  bool mpc_async = false;
+  ros::NodeHandle("~").getParam("mpc_async",
+                                mpc_async);  // QP在工作线程求解
+  shenlan::control::AsyncMpcController *async_mpc_controller = nullptr;
+  std::unique_ptr<shenlan::control::MPCController> mpc_controller;
+  if (mpc_async) {
+    async_mpc_controller = new shenlan::control::AsyncMpcController();
+    mpc_controller.reset(async_mpc_controller);
+  } else {
+    mpc_controller = std::make_unique<shenlan::control::MPCController>();
+  }
   mpc_controller->Init();
+  int mpc_horizon = shenlan::control::MPCController::kHorizon;
+  ros::NodeHandle("~").getParam("mpc_horizon",
+                                mpc_horizon);  // 预测步长
+  mpc_controller->SetHorizon(mpc_horizon);
+  std::string mpc_formulation = "sparse";
+  ros::NodeHandle("~").getParam("mpc_formulation",
+                                mpc_formulation);  // QP形式: sparse/condensed/riccati
+  if (mpc_formulation == "condensed") {
+    mpc_controller->SetMpcFormulation(
+        shenlan::control::MpcFormulation::kCondensed);
+  } else if (mpc_formulation == "riccati") {
+    mpc_controller->SetMpcFormulation(
+        shenlan::control::MpcFormulation::kRiccati);
+  }
+  double mpc_time_budget_us = 5000.0;
+  ros::NodeHandle("~").getParam("mpc_time_budget_us",
+                                mpc_time_budget_us);  // 每周期时间预算, 0不限时
+  mpc_controller->SetTimeBudget(mpc_time_budget_us);
+  mpc_controller->SetTimeVarying(mpc_time_varying);
+  if (mpc_nonlinear && async_mpc_controller == nullptr) {
+    mpc_controller->SetNonlinear(true);
+  } else if (mpc_nonlinear) {
+    ROS_INFO("mpc_nonlinear ignored: the async worker solves the linear model");
+  }
+  std::vector<int> mpc_move_blocking;
+  ros::NodeHandle("~").getParam("mpc_move_blocking",
+                                mpc_move_blocking);  // 控制量保持不变的分块长度
+  mpc_controller->SetMoveBlocking(mpc_move_blocking);
+  bool mpc_adaptive_horizon = false;
+  ros::NodeHandle("~").getParam("mpc_adaptive_horizon",
+                                mpc_adaptive_horizon);  // 预测步长随车速和负载变化
+  if (mpc_adaptive_horizon && async_mpc_controller == nullptr) {
+    shenlan::control::MpcHorizonConfig horizon_config;
+    horizon_config.min_horizon = mpc_horizon;
+    ros::NodeHandle("~").getParam("mpc_max_horizon",
+                                  horizon_config.max_horizon);
+    ros::NodeHandle("~").getParam("mpc_horizon_steps_per_speed",
+                                  horizon_config.steps_per_speed);
+    mpc_controller->SetAdaptiveHorizon(horizon_config);
+  } else if (mpc_adaptive_horizon) {
+    ROS_INFO("mpc_adaptive_horizon ignored: the async horizon is fixed");
+  }
+  std::string mpc_explicit_table;
+  ros::NodeHandle("~").getParam("mpc_explicit_table",
+                                mpc_explicit_table);  // 显式MPC的查表文件, 由explicit_mpc_tool生成
+  if (!mpc_explicit_table.empty() && async_mpc_controller == nullptr) {
+    auto explicit_mpc = std::make_shared<shenlan::control::ExplicitMpc>();
+    // 表须由当前的模型、权重、约束和预测步长生成
+    if (explicit_mpc->Load(
+            mpc_explicit_table,
+            mpc_controller->ExplicitMpcModelKey(mpc_controller->horizon()))) {
+      ROS_INFO("mpc explicit table: %zu speeds, horizon %d, %zu bytes",
+               explicit_mpc->lateral_laws().size(), explicit_mpc->horizon(),
+               explicit_mpc->MemoryBytes());
+      mpc_controller->SetExplicitMpc(explicit_mpc);
+    } else {
+      ROS_WARN("mpc_explicit_table %s could not be loaded or was built for "
+               "another model, weights, limits or horizon",
+               mpc_explicit_table.c_str());
+    }
+  } else if (!mpc_explicit_table.empty()) {
+    ROS_INFO("mpc_explicit_table ignored: the async worker solves the QP");
+  }
+  if (async_mpc_controller != nullptr) {
+    // 形式、步长和权重都设好之后再启动工作线程
+    async_mpc_controller->Start();
+  }
   lgsvl_msgs::VehicleControlData control_cmd;
   lgsvl_msgs::VehicleControlData control_cmd_pub; 
 
   ros::Rate loop_rate(100);
+  ros::Time last_deadline_log = ros::Time::now();
   while (ros::ok()) {
     mpc_controller->ComputeControlCommand(vehicle_state_,
                                         planning_published_trajectory, cmd);
+    const shenlan::control::MpcOsqpStats &mpc_stats =
+        mpc_controller->mpc_stats();
+    ROS_INFO_THROTTLE(1.0,
+                      "mpc osqp: setup %.1f us, update %.1f us, solve %.1f us, "
+                      "%d iterations (warm %d), status %d",
+                      mpc_stats.setup_time_us, mpc_stats.update_time_us,
+                      mpc_stats.solve_time_us, mpc_stats.iterations,
+                      mpc_stats.warm_started, mpc_stats.status);
+    if ((ros::Time::now() - last_deadline_log).toSec() >= 1.0) {
+      // 分位数每秒统计一次
+      last_deadline_log = ros::Time::now();
+      const shenlan::control::MpcDeadlineSummary &deadline =
+          mpc_controller->deadline_monitor().Summarize();
+      ROS_INFO("mpc cycle: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f "
+               "us; %zu cycles, %zu deadline misses, %zu overruns, "
+               "%zu explicit, fallbacks %zu iterate / %zu lqr / %zu zero",
+               deadline.p50_us, deadline.p90_us, deadline.p99_us,
+               deadline.max_us, deadline.cycles, deadline.deadline_misses,
+               deadline.overruns, deadline.explicit_commands,
+               deadline.iterate_fallbacks, deadline.lqr_fallbacks,
+               deadline.failures);
+      if (mpc_adaptive_horizon && async_mpc_controller == nullptr) {
+        ROS_INFO("mpc horizon: %d steps, load cap %d, %zu changes",
+                 mpc_controller->horizon(),
+                 mpc_controller->horizon_scheduler().load_cap(),
+                 mpc_controller->horizon_scheduler().changes());
+      }
+      if (async_mpc_controller != nullptr) {
+        ROS_INFO("mpc async: %zu plans, %zu failed solves, plan age %d",
+                 async_mpc_controller->plans(),
+                 async_mpc_controller->failed_solves(),
+                 async_mpc_controller->plan_age());
+      }
+    }
     control_cmd.header.stamp = ros::Time::now();
     //cout << "cmd.acc" << cmd.acc << endl;
     //cout << "vehicle_state_.acceleration: " << vehicle_state_.acceleration << endl;
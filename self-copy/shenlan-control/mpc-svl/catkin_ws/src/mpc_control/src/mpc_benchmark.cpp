@@ -0,0 +1,1387 @@
+/**
+ * Per-cycle cost of the MPC solve over a simulated closed-loop drive (100
+ * Hz, speed ramping up to 15 m/s, cruising, braking to a stop; the error
+ * state starts off the path and is propagated with the discrete model, the
+ * first control and an oscillating disturbance). Runs the whole cycle (A
+ * update, discretization, QP update and OSQP solve) several ways: a new
+ * MpcOsqp set up and torn down every cycle, and one long-lived MpcOsqp
+ * updated in place started cold, from the shifted previous solution and
+ * from the previous solution as it is, on the compile-time 6x2 model the
+ * controller uses, plus the shifted long-lived solver on runtime-sized
+ * MatrixXd. Reports setup, update and solve time separately,
+ * total time percentiles, ADMM iterations per cycle, heap allocations per
+ * cycle, failed solves and the largest difference of the first control
+ * against the per-cycle setup. With a file argument the per-cycle
+ * iteration counts of the long-lived 6x2 solver are written there as CSV
+ * (cycle, speed, cold, shifted, previous).
+ * A second table sets the QP up for horizons 10, 50 and 200 and compares
+ * the direct CSC assembly of MpcOsqp with the former dense builder (block
+ * matrix, identity temporaries, scan for nonzeros): assembly time, peak
+ * heap of the assembly and the osqp_setup time that follows it.
+ * A third table runs the first 20 s of the drive with the sparse OSQP
+ * formulation, the condensed one (states eliminated, dense active-set QP)
+ * and the Riccati interior-point solver for horizons 5 to 100 and reports
+ * which is fastest per cycle.
+ * A fourth table runs the same drive at horizon 100 with per-solve time
+ * limits: deadline misses, commands taken from the stopped solver's last
+ * iterate or from the LQR gain of the same linearization, cycle time
+ * percentiles and the steering difference to the unlimited solve.
+ * A fifth table runs the first 5 s of the drive in real time at 100 Hz with
+ * the Riccati solver on the worker thread of AsyncMpcController, for long
+ * horizons: control-thread cycle time, commands from a plan or from the
+ * LQR fallback, mean plan age, plans per second and the steering difference
+ * to the synchronous unlimited solve.
+ * A sixth table drives the bundled reference lines (data/reference_line.txt
+ * and data/cube_town_reference_line.txt, read relative to catkin_ws like
+ * main.cpp) at 5 m/s in error coordinates, the plant driven by the
+ * curvature under the vehicle, with one model at the current speed for the
+ * whole horizon (LTI) and with the stage-wise model along the reference
+ * (LTV): per-cycle time of the model update and solve, lateral and heading
+ * error.
+ * A seventh table holds the input over blocks of stages (move blocking) in
+ * the sparse and condensed formulations: QP size, cycle time and the
+ * steering difference to the unblocked solve of the same horizon.
+ * An eighth table chooses the horizon every cycle from the speed and the
+ * QP time against a budget (MpcHorizonScheduler) over the whole drive:
+ * mean, smallest and largest horizon, horizon changes, cycle time, deadline
+ * misses and LQR fallbacks.
+ * A ninth table drives a kinematic bicycle in world coordinates along the
+ * bundled reference lines at 1 and 3 m/s, from standstill 2 m and 1.5 rad
+ * off the line, through the whole ComputeControlCommand with a 10 ms
+ * budget, once with the linear error model (LTV, sparse) and once with the
+ * nonlinear bicycle by real-time iteration (MpcRti): cycle time, overruns,
+ * LQR fallbacks, lateral and heading error, excess of the solver's control
+ * over its limits and the error of the RTI prediction against the
+ * nonlinear model.
+ *
+ * usage: mpc_benchmark [iterations.csv]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Eigen/LU"
+#include "async_mpc_controller.h"
+#include "reference_line.h"
+#include "trajectory_snapshot.h"
+#include "mpc_condensed.h"
+#include "mpc_controller.h"
+#include "mpc_riccati.h"
+#include "riccati_solver.h"
+
+using shenlan::control::AsyncMpcController;
+using shenlan::control::MPCController;
+using shenlan::control::MpcCondensed;
+using shenlan::control::MpcOsqp;
+using shenlan::control::MpcOsqpStats;
+using shenlan::control::MpcRiccati;
+using shenlan::control::TrajectorySnapshotPtr;
+using shenlan::control::TrajectorySoA;
+using shenlan::control::WarmStartMode;
+
+#ifdef __GLIBC__
+#include <malloc.h>
+// 统计堆分配次数和占用字节数: 在本工具内接管malloc/calloc/realloc/free,
+// 包括Eigen和OSQP的分配
+static std::size_t heap_allocations = 0;
+static std::size_t heap_bytes = 0;
+static std::size_t heap_peak_bytes = 0;
+extern "C" void *__libc_malloc(std::size_t size);
+extern "C" void *__libc_calloc(std::size_t count, std::size_t size);
+extern "C" void *__libc_realloc(void *ptr, std::size_t size);
+extern "C" void __libc_free(void *ptr);
+static void *CountAllocation(void *ptr) {
+  ++heap_allocations;
+  if (ptr != nullptr) {
+    heap_bytes += malloc_usable_size(ptr);
+    heap_peak_bytes = std::max(heap_peak_bytes, heap_bytes);
+  }
+  return ptr;
+}
+extern "C" void *malloc(std::size_t size) {
+  return CountAllocation(__libc_malloc(size));
+}
+extern "C" void *calloc(std::size_t count, std::size_t size) {
+  return CountAllocation(__libc_calloc(count, size));
+}
+extern "C" void *realloc(void *ptr, std::size_t size) {
+  if (ptr != nullptr) {
+    heap_bytes -= malloc_usable_size(ptr);
+  }
+  return CountAllocation(__libc_realloc(ptr, size));
+}
+extern "C" void free(void *ptr) {
+  if (ptr != nullptr) {
+    heap_bytes -= malloc_usable_size(ptr);
+  }
+  __libc_free(ptr);
+}
+#else
+static const std::size_t heap_allocations = 0;
+static const std::size_t heap_bytes = 0;
+static std::size_t heap_peak_bytes = 0;
+#endif
+
+namespace {
+
+std::vector<double> SpeedProfile() {
+  std::vector<double> speeds;
+  const double dt = 0.01;
+  for (double t = 0.0; t < 60.0; t += dt) {
+    double v = 0.0;
+    if (t < 20.0) {
+      v = 15.0 * t / 20.0;
+    } else if (t < 50.0) {
+      v = 15.0 + 0.5 * std::sin(t);
+    } else {
+      v = 15.0 * (60.0 - t) / 10.0;
+    }
+    speeds.push_back(v);
+  }
+  return speeds;
+}
+
+struct CycleReport {
+  double setup_us = 0.0;
+  double update_us = 0.0;
+  double solve_us = 0.0;
+  double mean_us = 0.0;
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double allocations = 0.0;
+  double mean_iterations = 0.0;
+  int p50_iterations = 0;
+  int p99_iterations = 0;
+  int max_iterations = 0;
+  double max_us = 0.0;
+  std::size_t failures = 0;
+  // solves stopped at the time limit, and where their command came from
+  std::size_t deadline_misses = 0;
+  std::size_t iterate_fallbacks = 0;
+  std::size_t lqr_fallbacks = 0;
+  // ADMM iterations of every cycle
+  std::vector<int> iterations;
+  // first control of every cycle
+  std::vector<double> steer;
+  std::vector<double> acc;
+};
+
+struct AsyncReport {
+  // ApplyLatestPlan on the control thread [us]
+  double mean_us = 0.0;
+  double p99_us = 0.0;
+  double max_us = 0.0;
+  std::size_t plan_cycles = 0;
+  std::size_t lqr_cycles = 0;
+  std::size_t zero_cycles = 0;
+  double mean_plan_age = 0.0;
+  double plans_per_second = 0.0;
+  std::size_t failed_solves = 0;
+  std::vector<double> steer;
+  // command of the cycle came from a plan
+  std::vector<bool> from_plan;
+};
+
+struct TrackReport {
+  std::size_t cycles = 0;
+  // stage model, QP update and solve [us]
+  double mean_us = 0.0;
+  double p99_us = 0.0;
+  double rms_lateral_error = 0.0;
+  double max_lateral_error = 0.0;
+  double rms_heading_error = 0.0;
+  std::size_t failures = 0;
+};
+
+struct ClosedLoopReport {
+  std::size_t cycles = 0;
+  // ComputeControlCommand [us]
+  double mean_us = 0.0;
+  double p99_us = 0.0;
+  double max_us = 0.0;
+  // cycles over the time budget
+  std::size_t overruns = 0;
+  std::size_t lqr_fallbacks = 0;
+  double rms_lateral_error = 0.0;
+  double max_lateral_error = 0.0;
+  double max_heading_error = 0.0;
+  // largest excess of the solver's first control over the control limits,
+  // before the controller clamps it
+  double max_bound_violation = 0.0;
+  // largest difference between the states the RTI solution predicts and the
+  // nonlinear model under its controls
+  double max_prediction_error = 0.0;
+  // the track was driven to its end
+  bool finished = false;
+};
+
+struct AdaptiveReport {
+  std::size_t cycles = 0;
+  double mean_horizon = 0.0;
+  int min_horizon = 0;
+  int max_horizon = 0;
+  // cycles on which the horizon changed and the QP was set up again
+  std::size_t changes = 0;
+  // whole cycle: horizon, discretization, QP, fallback [us]
+  double mean_us = 0.0;
+  double p99_us = 0.0;
+  double max_us = 0.0;
+  std::size_t deadline_misses = 0;
+  std::size_t lqr_fallbacks = 0;
+};
+
+struct AssemblyReport {
+  std::size_t nonzeros = 0;
+  double dense_us = 0.0;
+  std::size_t dense_peak_bytes = 0;
+  double csc_us = 0.0;
+  std::size_t csc_bytes = 0;
+  double osqp_setup_us = 0.0;
+};
+
+// 改动前的组装方式: 稠密约束矩阵和单位阵临时量, 逐元素扫描非零元,
+// 再经逐列的(行, 值)表转成CSC. 只作对比基准
+template <int N, int M>
+std::size_t DenseAssembly(const Eigen::Matrix<double, N, N> &matrix_a,
+                          const Eigen::Matrix<double, N, M> &matrix_b,
+                          const Eigen::Matrix<double, N, N> &matrix_q,
+                          const Eigen::Matrix<double, M, M> &matrix_r,
+                          const std::size_t horizon) {
+  static constexpr double kEpsilon = 1e-6;
+  const std::size_t n = matrix_b.rows();
+  const std::size_t m = matrix_b.cols();
+  const std::size_t num_param = n * (horizon + 1) + m * horizon;
+  const std::size_t rows = n * (horizon + 1) + num_param;
+
+  std::vector<std::vector<std::pair<c_int, c_float>>> kernel_columns(
+      num_param);
+  for (std::size_t i = 0; i <= horizon; ++i) {
+    for (std::size_t j = 0; j < n; ++j) {
+      kernel_columns[i * n + j].emplace_back(i * n + j, matrix_q(j, j));
+    }
+  }
+  for (std::size_t i = 0; i < horizon; ++i) {
+    for (std::size_t j = 0; j < m; ++j) {
+      kernel_columns[n * (horizon + 1) + i * m + j].emplace_back(
+          n * (horizon + 1) + i * m + j, matrix_r(j, j));
+    }
+  }
+  std::vector<c_float> P_data;
+  std::vector<c_int> P_indices;
+  std::vector<c_int> P_indptr;
+  for (const auto &column : kernel_columns) {
+    P_indptr.push_back(P_data.size());
+    for (const auto &row_data_pair : column) {
+      P_data.push_back(row_data_pair.second);
+      P_indices.push_back(row_data_pair.first);
+    }
+  }
+  P_indptr.push_back(P_data.size());
+
+  Eigen::MatrixXd matrix_constraint = Eigen::MatrixXd::Zero(rows, num_param);
+  const Eigen::MatrixXd state_identity_mat =
+      Eigen::MatrixXd::Identity(n * (horizon + 1), n * (horizon + 1));
+  matrix_constraint.block(0, 0, n * (horizon + 1), n * (horizon + 1)) =
+      -1 * state_identity_mat;
+  for (std::size_t i = 0; i < horizon; ++i) {
+    matrix_constraint.block((i + 1) * n, i * n, n, n) = matrix_a;
+    matrix_constraint.block((i + 1) * n, n * (horizon + 1) + i * m, n, m) =
+        matrix_b;
+  }
+  const Eigen::MatrixXd all_identity_mat =
+      Eigen::MatrixXd::Identity(num_param, num_param);
+  matrix_constraint.block(n * (horizon + 1), 0, num_param, num_param) =
+      all_identity_mat;
+  const auto is_dynamics_entry = [&](const std::size_t row,
+                                     const std::size_t col) {
+    if (row < n || row >= n * (horizon + 1)) {
+      return false;
+    }
+    const std::size_t stage = row / n - 1;
+    const std::size_t control_col = n * (horizon + 1) + stage * m;
+    return (col >= stage * n && col < stage * n + n) ||
+           (col >= control_col && col < control_col + m);
+  };
+  std::vector<std::vector<std::pair<c_int, c_float>>> columns(num_param + 1);
+  for (std::size_t i = 0; i < num_param; ++i) {
+    for (std::size_t j = 0; j < rows; ++j) {
+      if (std::fabs(matrix_constraint(j, i)) > kEpsilon ||
+          is_dynamics_entry(j, i)) {
+        columns[i].emplace_back(j, matrix_constraint(j, i));
+      }
+    }
+  }
+  std::vector<c_float> A_data;
+  std::vector<c_int> A_indices;
+  std::vector<c_int> A_indptr;
+  for (std::size_t i = 0; i < num_param; ++i) {
+    A_indptr.push_back(A_data.size());
+    for (const auto &row_data_pair : columns[i]) {
+      A_data.push_back(row_data_pair.second);
+      A_indices.push_back(row_data_pair.first);
+    }
+  }
+  A_indptr.push_back(A_data.size());
+  return A_data.size();
+}
+
+template <int N, int M>
+void ConfigureWarmStart(MpcOsqp<N, M> *solver, const WarmStartMode mode,
+                        const std::vector<int> &move_blocking) {
+  solver->SetWarmStart(mode);
+  solver->SetMoveBlocking(move_blocking);
+}
+
+// 有效集法从无约束最优解出发, 不需要热启动
+template <int N, int M>
+void ConfigureWarmStart(MpcCondensed<N, M> *solver, const WarmStartMode,
+                        const std::vector<int> &move_blocking) {
+  solver->SetMoveBlocking(move_blocking);
+}
+
+// 内点法从零输入轨迹出发, 不需要热启动; 分块不在Riccati递推中实现
+template <class Solver>
+void ConfigureWarmStart(Solver *, const WarmStartMode,
+                        const std::vector<int> &) {}
+
+class MpcBenchmark : public MPCController {
+ public:
+  MpcBenchmark() { Init(); }
+
+  // 每个周期: 更新A, Tustin离散化, 更新QP并求解;
+  // persistent为false时每个周期重新构造求解器(setup + solve + cleanup).
+  // Solver为MpcOsqp、MpcCondensed或MpcRiccati. time_limit_us大于0时限时求解,
+  // 未解出则与控制器一样取最后迭代值或LQR. move_blocking见MpcOsqp::SetMoveBlocking
+  template <class Solver>
+  CycleReport RunCycles(
+      const std::vector<double> &speeds, const bool persistent,
+      const WarmStartMode warm_start, const int horizon,
+      const double time_limit_us = 0.0,
+      const std::vector<int> &move_blocking = std::vector<int>()) const {
+    typename Solver::StateMatrix a = matrix_a_;
+    const typename Solver::StateMatrix a_coeff = matrix_a_coeff_;
+    const typename Solver::ControlMatrix bd = matrix_bd_;
+    const typename Solver::StateMatrix q = matrix_q_;
+    const typename Solver::ControlWeightMatrix r = matrix_r_;
+    const int n = static_cast<int>(a.rows());
+    const int m = static_cast<int>(r.rows());
+    const typename Solver::StateMatrix I = Solver::StateMatrix::Identity(n, n);
+    typename Solver::StateMatrix ad(n, n);
+    // 初始偏离路径0.5m, 之后由离散模型、第一个控制量和扰动推进
+    typename Solver::StateVector state(n);
+    state << 0.5, 0.0, 0.05, 0.0, 0.3, 0.5;
+    typename Solver::StateVector disturbance = Solver::StateVector::Zero(n);
+    typename Solver::ControlVector control(m);
+    const typename Solver::StateVector reference = Solver::StateVector::Zero(n);
+    typename Solver::ControlVector lower_bound(m);
+    typename Solver::ControlVector upper_bound(m);
+    lower_bound << -M_PI / 6, max_deceleration_;
+    upper_bound << M_PI / 6, max_acceleration_;
+    const double max = std::numeric_limits<double>::max();
+    typename Solver::StateVector lower_state_bound(n);
+    typename Solver::StateVector upper_state_bound(n);
+    lower_state_bound << -max, -max, -M_PI, -max, -max, -max;
+    upper_state_bound << max, max, M_PI, max, max, max;
+
+    CycleReport report;
+    std::vector<double> times;
+    times.reserve(speeds.size());
+    std::vector<double> control_cmd(m, 0.0);
+    report.steer.reserve(speeds.size());
+    report.acc.reserve(speeds.size());
+    report.iterations.reserve(speeds.size());
+    std::unique_ptr<Solver> solver;
+    // 第一个周期的setup不计入每周期分配次数
+    std::size_t allocations = 0;
+    std::size_t setups = 0;
+    std::size_t updates = 0;
+    for (std::size_t k = 0; k < speeds.size(); ++k) {
+      const double t = 0.01 * k;
+      const std::size_t allocations_before = heap_allocations;
+      const auto start = std::chrono::steady_clock::now();
+      const double v = std::max(speeds[k], minimum_speed_protection_);
+      a(1, 1) = a_coeff(1, 1) / v;
+      a(1, 3) = a_coeff(1, 3) / v;
+      a(3, 1) = a_coeff(3, 1) / v;
+      a(3, 3) = a_coeff(3, 3) / v;
+      ad.noalias() = (I - ts_ * 0.5 * a).inverse() * (I + ts_ * 0.5 * a);
+      if (solver == nullptr || !persistent) {
+        solver.reset(new Solver(ad, bd, q, r, state, lower_bound, upper_bound,
+                                lower_state_bound, upper_state_bound,
+                                reference, mpc_max_iteration_, horizon,
+                                mpc_eps_));
+        ConfigureWarmStart(solver.get(), warm_start, move_blocking);
+      } else {
+        solver->Update(ad, bd, state, reference);
+      }
+      solver->SetTimeLimit(time_limit_us);
+      if (!solver->Solve(&control_cmd)) {
+        ++report.failures;
+        if (time_limit_us > 0.0) {
+          Fallback(*solver, ad, state, lower_bound, upper_bound, &control_cmd,
+                   &report);
+        }
+      }
+      const MpcOsqpStats &stats = solver->stats();
+      if (stats.deadline_reached) {
+        ++report.deadline_misses;
+      }
+      if (stats.workspace_reused) {
+        report.update_us += stats.update_time_us;
+        ++updates;
+      } else {
+        report.setup_us += stats.setup_time_us;
+        ++setups;
+      }
+      report.solve_us += stats.solve_time_us;
+      report.iterations.push_back(stats.iterations);
+      if (!persistent) {
+        solver.reset();
+      }
+      times.push_back(std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+      if (k > 0) {
+        allocations += heap_allocations - allocations_before;
+      }
+      control << control_cmd[0], control_cmd[1];
+      disturbance(1) = 0.5 * std::sin(0.5 * t);
+      disturbance(3) = 0.3 * std::sin(0.3 * t);
+      disturbance(5) = 0.2 * std::sin(0.1 * t);
+      state = ad * state + bd * control + ts_ * disturbance;
+      report.steer.push_back(control_cmd[0]);
+      report.acc.push_back(control_cmd[1]);
+    }
+
+    // setup和update取各自发生的周期的平均值
+    report.setup_us /= std::max<std::size_t>(setups, 1);
+    report.update_us /= std::max<std::size_t>(updates, 1);
+    report.solve_us /= speeds.size();
+    report.allocations =
+        static_cast<double>(allocations) / (speeds.size() - 1);
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    for (const double t : times) {
+      report.mean_us += t;
+    }
+    report.mean_us /= times.size();
+    report.p50_us = sorted[sorted.size() / 2];
+    report.p99_us = sorted[sorted.size() * 99 / 100];
+    report.max_us = sorted.back();
+    std::vector<int> sorted_iterations = report.iterations;
+    std::sort(sorted_iterations.begin(), sorted_iterations.end());
+    for (const int iterations : report.iterations) {
+      report.mean_iterations += iterations;
+    }
+    report.mean_iterations /= report.iterations.size();
+    report.p50_iterations = sorted_iterations[sorted_iterations.size() / 2];
+    report.p99_iterations =
+        sorted_iterations[sorted_iterations.size() * 99 / 100];
+    report.max_iterations = sorted_iterations.back();
+    return report;
+  }
+
+  // 与MPCController相同的兜底: 约束违反足够小的最后迭代值, 否则LQR
+  template <class Solver>
+  void Fallback(const Solver &solver, const typename Solver::StateMatrix &ad,
+                const typename Solver::StateVector &state,
+                const typename Solver::ControlVector &lower_bound,
+                const typename Solver::ControlVector &upper_bound,
+                std::vector<double> *control_cmd, CycleReport *report) const {
+    const int m = static_cast<int>(lower_bound.size());
+    if (solver.stats().primal_residual <= mpc_iterate_tolerance_ &&
+        solver.LastIterate(control_cmd)) {
+      ++report->iterate_fallbacks;
+    } else {
+      shenlan::control::RiccatiOptions options;
+      options.method = shenlan::control::RiccatiMethod::kDoubling;
+      options.tolerance = 1e-6;
+      options.max_iterations = 50;
+      StateMatrix p;
+      GainMatrix k;
+      shenlan::control::SolveDiscreteRiccati<kStateSize, kControlSize>(
+          ad, matrix_bd_, matrix_q_, matrix_r_, options, nullptr, &p, &k);
+      const StateVector x = state;
+      const ControlVector u = -k * x;
+      for (int i = 0; i < m; ++i) {
+        control_cmd->at(i) = u(i);
+      }
+      ++report->lqr_fallbacks;
+    }
+    for (int i = 0; i < m; ++i) {
+      control_cmd->at(i) =
+          std::max(lower_bound(i), std::min(upper_bound(i), control_cmd->at(i)));
+    }
+  }
+
+  // 车速10m/s的6x2模型, 在给定预测步长下建立QP
+  AssemblyReport RunAssembly(const int horizon, const int repeats) const {
+    typedef MpcOsqp<kStateSize, kControlSize> Osqp;
+    StateMatrix a = matrix_a_;
+    const double v = 10.0;
+    a(1, 1) = matrix_a_coeff_(1, 1) / v;
+    a(1, 3) = matrix_a_coeff_(1, 3) / v;
+    a(3, 1) = matrix_a_coeff_(3, 1) / v;
+    a(3, 3) = matrix_a_coeff_(3, 3) / v;
+    const StateMatrix I = StateMatrix::Identity();
+    const StateMatrix ad =
+        (I - ts_ * 0.5 * a).inverse() * (I + ts_ * 0.5 * a);
+    ControlVector lower_bound;
+    ControlVector upper_bound;
+    lower_bound << -M_PI / 6, max_deceleration_;
+    upper_bound << M_PI / 6, max_acceleration_;
+    const double max = std::numeric_limits<double>::max();
+    StateVector lower_state_bound;
+    StateVector upper_state_bound;
+    lower_state_bound << -max, -max, -M_PI, -max, -max, -max;
+    upper_state_bound << max, max, M_PI, max, max, max;
+    StateVector state;
+    state << 0.3, 0.1, 0.05, 0.01, 0.2, 0.5;
+
+    AssemblyReport report;
+    std::vector<double> control_cmd(kControlSize, 0.0);
+    for (int k = 0; k < repeats; ++k) {
+      const std::size_t bytes_before = heap_bytes;
+      heap_peak_bytes = heap_bytes;
+      const auto start = std::chrono::steady_clock::now();
+      report.nonzeros =
+          DenseAssembly(ad, matrix_bd_, matrix_q_, matrix_r_, horizon);
+      report.dense_us += std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+      report.dense_peak_bytes = heap_peak_bytes - bytes_before;
+
+      Osqp solver(ad, matrix_bd_, matrix_q_, matrix_r_, state, lower_bound,
+                  upper_bound, lower_state_bound, upper_state_bound,
+                  StateVector::Zero(), mpc_max_iteration_, horizon, mpc_eps_);
+      solver.Solve(&control_cmd);
+      const MpcOsqpStats &stats = solver.stats();
+      report.csc_us += stats.assembly_time_us;
+      report.osqp_setup_us += stats.setup_time_us - stats.assembly_time_us;
+      report.csc_bytes = solver.MemoryBytes();
+    }
+    report.dense_us /= repeats;
+    report.csc_us /= repeats;
+    report.osqp_setup_us /= repeats;
+    return report;
+  }
+};
+
+class AsyncMpcBenchmark : public AsyncMpcController {
+ public:
+  AsyncMpcBenchmark() { Init(); }
+
+  // 与RunCycles相同的闭环, 按100Hz实时运行; 控制线程只交出状态并取计划
+  AsyncReport RunAsync(const std::vector<double> &speeds, const int horizon) {
+    SetMpcFormulation(shenlan::control::MpcFormulation::kRiccati);
+    SetHorizon(horizon);
+    Start();
+    const StateMatrix I = StateMatrix::Identity();
+    StateMatrix a = matrix_a_;
+    StateVector state;
+    state << 0.5, 0.0, 0.05, 0.0, 0.3, 0.5;
+    StateVector disturbance = StateVector::Zero();
+    ControlVector control = ControlVector::Zero();
+
+    AsyncReport report;
+    std::vector<double> times;
+    times.reserve(speeds.size());
+    report.steer.reserve(speeds.size());
+    report.from_plan.reserve(speeds.size());
+    std::size_t plan_age_sum = 0;
+    const auto period = std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(std::chrono::duration<double>(ts_));
+    const auto run_start = std::chrono::steady_clock::now();
+    auto next_cycle = run_start;
+    for (std::size_t k = 0; k < speeds.size(); ++k) {
+      const double t = 0.01 * k;
+      const auto start = std::chrono::steady_clock::now();
+      const double v = std::max(speeds[k], minimum_speed_protection_);
+      a(1, 1) = matrix_a_coeff_(1, 1) / v;
+      a(1, 3) = matrix_a_coeff_(1, 3) / v;
+      a(3, 1) = matrix_a_coeff_(3, 1) / v;
+      a(3, 3) = matrix_a_coeff_(3, 3) / v;
+      matrix_ad_.noalias() =
+          (I - ts_ * 0.5 * a).inverse() * (I + ts_ * 0.5 * a);
+      matrix_state_ = state;
+      const shenlan::control::MpcCommandSource source =
+          ApplyLatestPlan(start, &control);
+      times.push_back(std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+      if (source == shenlan::control::MpcCommandSource::kPlan) {
+        ++report.plan_cycles;
+        plan_age_sum += plan_age();
+      } else if (source == shenlan::control::MpcCommandSource::kLqr) {
+        ++report.lqr_cycles;
+      } else {
+        ++report.zero_cycles;
+      }
+      disturbance(1) = 0.5 * std::sin(0.5 * t);
+      disturbance(3) = 0.3 * std::sin(0.3 * t);
+      disturbance(5) = 0.2 * std::sin(0.1 * t);
+      state = matrix_ad_ * state + matrix_bd_ * control + ts_ * disturbance;
+      report.steer.push_back(control(0));
+      report.from_plan.push_back(source ==
+                                 shenlan::control::MpcCommandSource::kPlan);
+      next_cycle += period;
+      std::this_thread::sleep_until(next_cycle);
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - run_start)
+                               .count();
+    Stop();
+
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    for (const double time : times) {
+      report.mean_us += time;
+    }
+    report.mean_us /= times.size();
+    report.p99_us = sorted[sorted.size() * 99 / 100];
+    report.max_us = sorted.back();
+    report.mean_plan_age =
+        static_cast<double>(plan_age_sum) /
+        std::max<std::size_t>(report.plan_cycles, 1);
+    report.plans_per_second = plans() / seconds;
+    report.failed_solves = failed_solves();
+    return report;
+  }
+};
+
+// 读取参考线, 去掉重复点, 曲率和朝向由ReferenceLine计算
+TrajectorySnapshotPtr LoadTrack(const std::string &path, const double speed) {
+  std::ifstream file(path);
+  std::vector<std::pair<double, double>> xy_points;
+  double x = 0.0;
+  double y = 0.0;
+  while (file >> x >> y) {
+    if (xy_points.empty() || std::hypot(x - xy_points.back().first,
+                                        y - xy_points.back().second) > 1e-6) {
+      xy_points.emplace_back(x, y);
+    }
+  }
+  std::vector<double> headings;
+  std::vector<double> accumulated_s;
+  std::vector<double> kappas;
+  std::vector<double> dkappas;
+  shenlan::control::ReferenceLine reference_line(xy_points);
+  if (!reference_line.ComputePathProfile(&headings, &accumulated_s, &kappas,
+                                         &dkappas)) {
+    return nullptr;
+  }
+  std::vector<TrajectoryPoint> points(xy_points.size());
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    points[i].x = xy_points[i].first;
+    points[i].y = xy_points[i].second;
+    points[i].heading = headings[i];
+    points[i].kappa = kappas[i];
+    points[i].v = speed;
+    points[i].a = 0.0;
+  }
+  return shenlan::control::TrajectorySnapshot::Create(std::move(points),
+                                                      false, true);
+}
+
+class TrackBenchmark : public MPCController {
+ public:
+  TrackBenchmark() { Init(); }
+
+  // 误差坐标下沿参考线行驶: 被控对象取车辆所在处的曲率, 控制器用当前
+  // 车速的单一模型(LTI)或沿参考线的逐步模型(LTV)
+  TrackReport RunTrack(const TrajectorySnapshotPtr &track,
+                       const bool time_varying, const int horizon) {
+    SetMpcFormulation(shenlan::control::MpcFormulation::kRiccati);
+    SetHorizon(horizon);
+    SetTimeVarying(time_varying);
+    SetTimeBudget(0.0);
+    trajectory_ = track;
+    trajectory_matcher_.Reset();
+    const TrajectorySoA &soa = track->soa();
+    const std::vector<double> &accumulated_s = soa.accumulated_s();
+    const double v = soa.v().front();
+    DiscretizeAtSpeed(v, &matrix_ad_);
+    const StateVector reference = StateVector::Zero();
+    StateVector state;
+    state << 0.3, 0.0, 0.05, 0.0, 0.0, 0.0;
+
+    TrackReport report;
+    std::vector<double> times;
+    std::vector<double> control_cmd(kControlSize, 0.0);
+    MpcOsqpStats stats;
+    std::size_t index = 0;
+    double s = 0.0;
+    while (s < accumulated_s.back()) {
+      while (index + 2 < accumulated_s.size() &&
+             accumulated_s[index + 1] <= s) {
+        ++index;
+      }
+      const double ratio = (s - accumulated_s[index]) /
+                           (accumulated_s[index + 1] - accumulated_s[index]);
+      double kappa =
+          soa.kappa()[index] +
+          ratio * (soa.kappa()[index + 1] - soa.kappa()[index]);
+      if (!std::isfinite(kappa)) {
+        kappa = 0.0;
+      }
+      // 匹配点提示与控制器中一样来自TrajectoryMatcher
+      trajectory_matcher_.Match(
+          soa, soa.x()[index] + ratio * (soa.x()[index + 1] - soa.x()[index]),
+          soa.y()[index] + ratio * (soa.y()[index + 1] - soa.y()[index]));
+
+      const auto start = std::chrono::steady_clock::now();
+      if (time_varying) {
+        UpdateStageModel(s, v);
+      }
+      const shenlan::control::MpcCommandSource source =
+          SolveQp(matrix_ad_, matrix_bd_, time_varying ? &stage_model_ : nullptr,
+                  state, reference, 0.0, &control_cmd, &stats);
+      times.push_back(std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+      ControlVector control = ControlVector::Zero();
+      if (source == shenlan::control::MpcCommandSource::kNone) {
+        ++report.failures;
+      } else {
+        control << control_cmd[0], control_cmd[1];
+      }
+
+      // 被控对象: 与控制器相同的误差动力学, 加上车辆所在处曲率的作用
+      StateVector curvature = StateVector::Zero();
+      curvature(1) = (matrix_a_coeff_(1, 3) / v - v) * v * kappa * ts_;
+      curvature(3) = matrix_a_coeff_(3, 3) / v * v * kappa * ts_;
+      state = matrix_ad_ * state + matrix_bd_ * control + curvature;
+      report.rms_lateral_error += state(0) * state(0);
+      report.rms_heading_error += state(2) * state(2);
+      report.max_lateral_error =
+          std::max(report.max_lateral_error, std::abs(state(0)));
+      s += v * ts_;
+    }
+    report.cycles = times.size();
+    report.rms_lateral_error =
+        std::sqrt(report.rms_lateral_error / report.cycles);
+    report.rms_heading_error =
+        std::sqrt(report.rms_heading_error / report.cycles);
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    for (const double time : times) {
+      report.mean_us += time;
+    }
+    report.mean_us /= times.size();
+    report.p99_us = sorted[sorted.size() * 99 / 100];
+    return report;
+  }
+};
+
+class ClosedLoopBenchmark : public MPCController {
+ public:
+  ClosedLoopBenchmark() { Init(); }
+
+  // 世界坐标下的运动学自行车作为被控对象, 从静止、偏离参考线出发,
+  // 整个周期经ComputeControlCommand; 线性模型用沿参考线的LTV稀疏QP,
+  // 非线性模型用实时迭代
+  ClosedLoopReport RunClosedLoop(const TrajectorySnapshotPtr &track,
+                                 const bool nonlinear, const int horizon,
+                                 const double lateral_offset,
+                                 const double heading_offset,
+                                 const double budget_us) {
+    SetHorizon(horizon);
+    SetTimeVarying(!nonlinear);
+    SetNonlinear(nonlinear);
+    SetTimeBudget(budget_us);
+    TrajectoryData trajectory;
+    trajectory.snapshot = track;
+    const TrajectorySoA &soa = track->soa();
+    const double length = soa.accumulated_s().back();
+    VehicleState vehicle = VehicleState();
+    const double heading = soa.heading().front();
+    vehicle.x = soa.x().front() - lateral_offset * std::sin(heading);
+    vehicle.y = soa.y().front() + lateral_offset * std::cos(heading);
+    vehicle.heading = heading + heading_offset;
+    vehicle.velocity = 0.0;
+
+    ClosedLoopReport report;
+    std::vector<double> times;
+    const std::size_t max_cycles =
+        static_cast<std::size_t>((length / soa.v().front() + 20.0) / ts_);
+    times.reserve(max_cycles);
+    ControlCmd cmd;
+    for (std::size_t k = 0; k < max_cycles; ++k) {
+      const auto start = std::chrono::steady_clock::now();
+      const bool ok = ComputeControlCommand(vehicle, trajectory, cmd);
+      const double time = std::chrono::duration<double, std::micro>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+      if (!ok) {
+        break;
+      }
+      times.push_back(time);
+      if (budget_us > 0.0 && time > budget_us) {
+        ++report.overruns;
+      }
+      if (command_source() == shenlan::control::MpcCommandSource::kLqr) {
+        ++report.lqr_fallbacks;
+      } else if (command_source() !=
+                 shenlan::control::MpcCommandSource::kNone) {
+        for (int i = 0; i < kControlSize; ++i) {
+          report.max_bound_violation = std::max(
+              report.max_bound_violation,
+              std::max(control_cmd_[i] - upper_bound_(i),
+                       lower_bound_(i) - control_cmd_[i]));
+        }
+      }
+      if (nonlinear && mpc_rti() != nullptr) {
+        report.max_prediction_error = std::max(
+            report.max_prediction_error, mpc_rti()->PredictionError());
+      }
+      report.rms_lateral_error += matrix_state_(0) * matrix_state_(0);
+      report.max_lateral_error =
+          std::max(report.max_lateral_error, std::abs(matrix_state_(0)));
+      report.max_heading_error =
+          std::max(report.max_heading_error, std::abs(matrix_state_(2)));
+      if (matched_s_ >= length - 1.0) {
+        report.finished = true;
+        break;
+      }
+
+      // 被控对象: 运动学自行车, 每个周期10个欧拉子步
+      const double steer = cmd.steer_target;
+      const double acc = cmd.acc;
+      for (int i = 0; i < 10; ++i) {
+        const double dt = 0.1 * ts_;
+        vehicle.x += dt * vehicle.velocity * std::cos(vehicle.heading);
+        vehicle.y += dt * vehicle.velocity * std::sin(vehicle.heading);
+        vehicle.heading += dt * vehicle.velocity * std::tan(steer) / wheelbase_;
+        vehicle.velocity = std::max(vehicle.velocity + dt * acc, 0.0);
+      }
+      vehicle.angular_velocity = vehicle.velocity * std::tan(steer) / wheelbase_;
+      vehicle.acceleration = acc;
+    }
+    report.cycles = times.size();
+    report.rms_lateral_error =
+        std::sqrt(report.rms_lateral_error / std::max<std::size_t>(
+                                                 report.cycles, 1));
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    for (const double time : times) {
+      report.mean_us += time;
+    }
+    report.mean_us /= std::max<std::size_t>(times.size(), 1);
+    report.p99_us = sorted.empty() ? 0.0 : sorted[sorted.size() * 99 / 100];
+    report.max_us = sorted.empty() ? 0.0 : sorted.back();
+    return report;
+  }
+};
+
+class AdaptiveHorizonBenchmark : public MPCController {
+ public:
+  AdaptiveHorizonBenchmark() { Init(); }
+
+  // 与RunCycles相同的闭环, 每个周期先由调度器按车速和上一周期的求解时间
+  // 选预测步长; 求解时限即周期预算, 超时与控制器一样用迭代值或LQR
+  AdaptiveReport RunAdaptive(const std::vector<double> &speeds,
+                             const shenlan::control::MpcFormulation formulation,
+                             const double budget_us,
+                             const std::vector<int> &move_blocking) {
+    SetMpcFormulation(formulation);
+    SetMoveBlocking(move_blocking);
+    SetTimeBudget(budget_us);
+    SetAdaptiveHorizon(shenlan::control::MpcHorizonConfig());
+    StateVector state;
+    state << 0.5, 0.0, 0.05, 0.0, 0.3, 0.5;
+    StateVector disturbance = StateVector::Zero();
+    const StateVector reference = StateVector::Zero();
+
+    AdaptiveReport report;
+    report.min_horizon = std::numeric_limits<int>::max();
+    std::vector<double> times;
+    times.reserve(speeds.size());
+    for (std::size_t k = 0; k < speeds.size(); ++k) {
+      const double t = 0.01 * k;
+      const auto start = std::chrono::steady_clock::now();
+      const double v = std::max(speeds[k], minimum_speed_protection_);
+      UpdateHorizon(speeds[k]);
+      DiscretizeAtSpeed(v, &matrix_ad_);
+      matrix_state_ = state;
+      ControlVector control = ControlVector::Zero();
+      const shenlan::control::MpcCommandSource source =
+          SolveQp(matrix_ad_, matrix_bd_, nullptr, state, reference,
+                  budget_us, &control_cmd_, &mpc_stats_);
+      if (source != shenlan::control::MpcCommandSource::kNone) {
+        control << control_cmd_[0], control_cmd_[1];
+        control = control.cwiseMax(lower_bound_).cwiseMin(upper_bound_);
+      } else if (ComputeLqrFallback(reference, &control)) {
+        ++report.lqr_fallbacks;
+      }
+      times.push_back(std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+      if (mpc_stats_.deadline_reached) {
+        ++report.deadline_misses;
+      }
+      report.mean_horizon += horizon_;
+      report.min_horizon = std::min(report.min_horizon, horizon_);
+      report.max_horizon = std::max(report.max_horizon, horizon_);
+      disturbance(1) = 0.5 * std::sin(0.5 * t);
+      disturbance(3) = 0.3 * std::sin(0.3 * t);
+      disturbance(5) = 0.2 * std::sin(0.1 * t);
+      state = matrix_ad_ * state + matrix_bd_ * control + ts_ * disturbance;
+    }
+    report.cycles = times.size();
+    report.mean_horizon /= report.cycles;
+    report.changes = horizon_scheduler_.changes();
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+    for (const double time : times) {
+      report.mean_us += time;
+    }
+    report.mean_us /= times.size();
+    report.p99_us = sorted[sorted.size() * 99 / 100];
+    report.max_us = sorted.back();
+    return report;
+  }
+};
+
+std::string BlockingName(const std::vector<int> &move_blocking) {
+  if (move_blocking.empty()) {
+    return "none";
+  }
+  std::string name;
+  for (const int length : move_blocking) {
+    name += (name.empty() ? "" : ",") + std::to_string(length);
+  }
+  return name;
+}
+
+double MaxDifference(const std::vector<double> &a,
+                     const std::vector<double> &b) {
+  double difference = 0.0;
+  for (std::size_t i = 0; i < a.size() && i < b.size(); ++i) {
+    difference = std::max(difference, std::fabs(a[i] - b[i]));
+  }
+  return difference;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::vector<double> speeds = SpeedProfile();
+  const MpcBenchmark benchmark;
+  const int n = MPCController::kStateSize;
+  const int m = MPCController::kControlSize;
+  const int horizon = MPCController::kHorizon;
+  typedef MpcOsqp<n, m> Osqp;
+  typedef MpcOsqp<Eigen::Dynamic, Eigen::Dynamic> OsqpDynamic;
+  const CycleReport reports[] = {
+      benchmark.RunCycles<Osqp>(speeds, false, WarmStartMode::kCold, horizon),
+      benchmark.RunCycles<Osqp>(speeds, true, WarmStartMode::kCold, horizon),
+      benchmark.RunCycles<Osqp>(speeds, true, WarmStartMode::kShifted,
+                                horizon),
+      benchmark.RunCycles<Osqp>(speeds, true, WarmStartMode::kPrevious,
+                                horizon),
+      benchmark.RunCycles<OsqpDynamic>(speeds, true, WarmStartMode::kShifted,
+                                       horizon)};
+  const int num_reports = sizeof(reports) / sizeof(reports[0]);
+  const char *names[] = {"setup/cycle", "persistent", "persistent",
+                         "persistent", "persistent"};
+  const char *starts[] = {"cold", "cold", "shifted", "previous", "shifted"};
+  const char *matrices[] = {"6x2", "6x2", "6x2", "6x2", "dynamic"};
+
+  std::cout << speeds.size() << " cycles, horizon "
+            << MPCController::kHorizon
+            << "; setup and update averaged over the cycles running them"
+            << std::endl;
+  std::cout << std::setw(12) << "workspace" << std::setw(9) << "start"
+            << std::setw(9) << "matrices" << std::setw(10) << "setup us" << std::setw(11) << "update us"
+            << std::setw(10) << "solve us" << std::setw(10) << "mean us"
+            << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+            << std::setw(9) << "mean it" << std::setw(8) << "p50 it"
+            << std::setw(8) << "p99 it" << std::setw(8) << "max it"
+            << std::setw(9) << "allocs" << std::setw(8) << "failed"
+            << std::setw(12) << "|steer-ref|" << std::setw(12) << "|acc-ref|"
+            << std::endl;
+  const CycleReport &reference = reports[0];
+  for (int k = 0; k < num_reports; ++k) {
+    const CycleReport &report = reports[k];
+    std::cout << std::setw(12) << names[k] << std::setw(9) << starts[k]
+              << std::setw(9) << matrices[k]
+              << std::setw(10) << std::fixed << std::setprecision(1)
+              << report.setup_us << std::setw(11) << report.update_us
+              << std::setw(10) << report.solve_us << std::setw(10)
+              << report.mean_us << std::setw(10) << report.p50_us
+              << std::setw(10) << report.p99_us << std::setw(9)
+              << report.mean_iterations << std::setw(8)
+              << report.p50_iterations << std::setw(8)
+              << report.p99_iterations << std::setw(8)
+              << report.max_iterations << std::setw(9) << report.allocations
+              << std::setw(8) << report.failures
+              << std::setw(12) << std::scientific << std::setprecision(2)
+              << MaxDifference(report.steer, reference.steer) << std::setw(12)
+              << MaxDifference(report.acc, reference.acc) << std::endl;
+  }
+
+  if (argc > 1) {
+    std::ofstream file(argv[1]);
+    file << "cycle,speed,cold,shifted,previous" << std::endl;
+    for (std::size_t k = 0; k < speeds.size(); ++k) {
+      file << k << "," << speeds[k] << "," << reports[1].iterations[k] << ","
+           << reports[2].iterations[k] << "," << reports[3].iterations[k]
+           << std::endl;
+    }
+  }
+
+  // 稀疏(OSQP, 移位热启动)、消去状态的稠密有效集法和Riccati内点法,
+  // 各预测步长下的每周期耗时
+  const std::vector<double> formulation_speeds(speeds.begin(),
+                                               speeds.begin() + 2000);
+  std::cout << std::endl
+            << "sparse (OSQP, shifted warm start) vs condensed (dense active "
+               "set) vs Riccati interior point, "
+            << formulation_speeds.size() << " cycles" << std::endl;
+  std::cout << std::setw(8) << "horizon" << std::setw(11) << "sparse us"
+            << std::setw(11) << "p99 us" << std::setw(9) << "mean it"
+            << std::setw(11) << "cond us" << std::setw(11) << "p99 us"
+            << std::setw(9) << "mean it" << std::setw(11) << "ricc us"
+            << std::setw(11) << "p99 us" << std::setw(9) << "mean it"
+            << std::setw(8) << "failed" << std::setw(12) << "|steer-sp|"
+            << std::setw(11) << "fastest" << std::endl;
+  for (const int formulation_horizon : {5, 10, 20, 50, 100}) {
+    const CycleReport sparse = benchmark.RunCycles<Osqp>(
+        formulation_speeds, true, WarmStartMode::kShifted,
+        formulation_horizon);
+    const CycleReport condensed = benchmark.RunCycles<MpcCondensed<n, m>>(
+        formulation_speeds, true, WarmStartMode::kCold, formulation_horizon);
+    const CycleReport riccati = benchmark.RunCycles<MpcRiccati<n, m>>(
+        formulation_speeds, true, WarmStartMode::kCold, formulation_horizon);
+    const char *fastest = "sparse";
+    double fastest_us = sparse.mean_us;
+    if (condensed.mean_us < fastest_us) {
+      fastest = "condensed";
+      fastest_us = condensed.mean_us;
+    }
+    if (riccati.mean_us < fastest_us) {
+      fastest = "riccati";
+    }
+    std::cout << std::setw(8) << formulation_horizon << std::setw(11)
+              << std::fixed << std::setprecision(1) << sparse.mean_us
+              << std::setw(11) << sparse.p99_us << std::setw(9)
+              << sparse.mean_iterations << std::setw(11) << condensed.mean_us
+              << std::setw(11) << condensed.p99_us << std::setw(9)
+              << condensed.mean_iterations << std::setw(11)
+              << riccati.mean_us << std::setw(11) << riccati.p99_us
+              << std::setw(9) << riccati.mean_iterations << std::setw(8)
+              << sparse.failures + condensed.failures + riccati.failures
+              << std::setw(12) << std::scientific << std::setprecision(2)
+              << std::max(MaxDifference(condensed.steer, sparse.steer),
+                          MaxDifference(riccati.steer, sparse.steer))
+              << std::setw(11) << fastest << std::endl;
+  }
+
+  // 预测步长100, 限时求解: 超时次数、兜底来源、周期耗时
+  const int deadline_horizon = 100;
+  const CycleReport unlimited = benchmark.RunCycles<MpcRiccati<n, m>>(
+      formulation_speeds, true, WarmStartMode::kCold, deadline_horizon);
+  std::cout << std::endl
+            << "time-limited solves, horizon " << deadline_horizon << ", "
+            << formulation_speeds.size()
+            << " cycles; steer difference against the unlimited Riccati solve"
+            << std::endl;
+  std::cout << std::setw(10) << "solver" << std::setw(10) << "limit us"
+            << std::setw(10) << "mean us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "max us" << std::setw(8) << "missed"
+            << std::setw(9) << "iterate" << std::setw(6) << "lqr"
+            << std::setw(12) << "|steer-ref|" << std::endl;
+  for (const double limit_us : {0.0, 1000.0, 250.0, 100.0}) {
+    const CycleReport reports_by_solver[] = {
+        benchmark.RunCycles<Osqp>(formulation_speeds, true,
+                                  WarmStartMode::kShifted, deadline_horizon,
+                                  limit_us),
+        benchmark.RunCycles<MpcRiccati<n, m>>(formulation_speeds, true,
+                                              WarmStartMode::kCold,
+                                              deadline_horizon, limit_us)};
+    const char *solver_names[] = {"sparse", "riccati"};
+    for (int k = 0; k < 2; ++k) {
+      const CycleReport &report = reports_by_solver[k];
+      std::cout << std::setw(10) << solver_names[k] << std::setw(10)
+                << std::fixed << std::setprecision(1) << limit_us
+                << std::setw(10) << report.mean_us << std::setw(10)
+                << report.p99_us << std::setw(10) << report.max_us
+                << std::setw(8) << report.deadline_misses << std::setw(9)
+                << report.iterate_fallbacks << std::setw(6)
+                << report.lqr_fallbacks << std::setw(12) << std::scientific
+                << std::setprecision(2)
+                << MaxDifference(report.steer, unlimited.steer) << std::endl;
+    }
+  }
+
+  // 工作线程求解, 控制线程按100Hz取最新计划并用LQR修正漂移
+  const std::vector<double> async_speeds(speeds.begin(),
+                                         speeds.begin() + 500);
+  std::cout << std::endl
+            << "asynchronous Riccati solve on a worker thread, "
+            << async_speeds.size()
+            << " cycles in real time at 100 Hz; steer difference against the "
+               "synchronous unlimited solve over the cycles run from a plan"
+            << std::endl;
+  std::cout << std::setw(8) << "horizon" << std::setw(10) << "sync us"
+            << std::setw(10) << "ctrl us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "max us" << std::setw(7) << "plan"
+            << std::setw(6) << "lqr" << std::setw(6) << "zero"
+            << std::setw(9) << "mean age" << std::setw(10) << "plans/s"
+            << std::setw(8) << "failed" << std::setw(12) << "|steer-ref|"
+            << std::endl;
+  for (const int async_horizon : {50, 100, 200}) {
+    const CycleReport sync = benchmark.RunCycles<MpcRiccati<n, m>>(
+        async_speeds, true, WarmStartMode::kCold, async_horizon);
+    AsyncMpcBenchmark async_benchmark;
+    const AsyncReport report =
+        async_benchmark.RunAsync(async_speeds, async_horizon);
+    double steer_difference = 0.0;
+    for (std::size_t k = 0; k < report.steer.size(); ++k) {
+      if (report.from_plan[k]) {
+        steer_difference = std::max(
+            steer_difference, std::abs(report.steer[k] - sync.steer[k]));
+      }
+    }
+    std::cout << std::setw(8) << async_horizon << std::setw(10) << std::fixed
+              << std::setprecision(1) << sync.mean_us << std::setw(10)
+              << report.mean_us << std::setw(10) << report.p99_us
+              << std::setw(10) << report.max_us << std::setw(7)
+              << report.plan_cycles << std::setw(6) << report.lqr_cycles
+              << std::setw(6) << report.zero_cycles << std::setw(9)
+              << report.mean_plan_age << std::setw(10)
+              << report.plans_per_second << std::setw(8)
+              << report.failed_solves << std::setw(12) << std::scientific
+              << std::setprecision(2)
+              << steer_difference << std::endl;
+  }
+
+  // 分块: 控制量在块内不变, QP中控制变量的个数等于块数;
+  // 稀疏形式的变量仍以状态为主, 稠密形式的变量只剩各块的控制量
+  std::cout << std::endl
+            << "move blocking, sparse (OSQP, shifted warm start) and "
+               "condensed, "
+            << formulation_speeds.size()
+            << " cycles; steer difference against the unblocked solve of the "
+               "same horizon and formulation"
+            << std::endl;
+  std::cout << std::setw(10) << "solver" << std::setw(8) << "horizon"
+            << std::setw(14) << "blocks" << std::setw(7) << "moves"
+            << std::setw(7) << "vars" << std::setw(10) << "mean us"
+            << std::setw(10) << "p99 us" << std::setw(9) << "mean it"
+            << std::setw(8) << "failed" << std::setw(12) << "|steer-ref|"
+            << std::endl;
+  const std::vector<std::vector<int>> blockings = {
+      {}, {2}, {1, 1, 2, 4, 8}};
+  const std::pair<bool, int> blocking_cases[] = {
+      {false, 10}, {false, 30}, {false, 60},
+      {true, 30},  {true, 60},  {true, 100}};
+  for (const std::pair<bool, int> &blocking_case : blocking_cases) {
+    const bool condensed = blocking_case.first;
+    const int blocking_horizon = blocking_case.second;
+    CycleReport unblocked;
+    for (const std::vector<int> &move_blocking : blockings) {
+      const CycleReport report =
+          condensed ? benchmark.RunCycles<MpcCondensed<n, m>>(
+                          formulation_speeds, true, WarmStartMode::kCold,
+                          blocking_horizon, 0.0, move_blocking)
+                    : benchmark.RunCycles<Osqp>(
+                          formulation_speeds, true, WarmStartMode::kShifted,
+                          blocking_horizon, 0.0, move_blocking);
+      if (move_blocking.empty()) {
+        unblocked = report;
+      }
+      Osqp sizing(Osqp::StateMatrix::Identity(), Osqp::ControlMatrix::Zero(),
+                  Osqp::StateMatrix::Identity(),
+                  Osqp::ControlWeightMatrix::Identity(),
+                  Osqp::StateVector::Zero(), Osqp::ControlVector::Zero(),
+                  Osqp::ControlVector::Zero(), Osqp::StateVector::Zero(),
+                  Osqp::StateVector::Zero(), Osqp::StateVector::Zero(), 1,
+                  blocking_horizon, 1.0);
+      sizing.SetMoveBlocking(move_blocking);
+      const std::size_t moves = sizing.num_blocks();
+      const std::size_t vars =
+          condensed ? m * moves : n * (blocking_horizon + 1) + m * moves;
+      std::cout << std::setw(10) << (condensed ? "condensed" : "sparse")
+                << std::setw(8) << blocking_horizon << std::setw(14)
+                << BlockingName(move_blocking) << std::setw(7) << moves
+                << std::setw(7) << vars << std::setw(10) << std::fixed
+                << std::setprecision(1) << report.mean_us << std::setw(10)
+                << report.p99_us << std::setw(9) << report.mean_iterations
+                << std::setw(8) << report.failures << std::setw(12)
+                << std::scientific << std::setprecision(2)
+                << MaxDifference(report.steer, unblocked.steer) << std::endl;
+    }
+  }
+
+  // 预测步长随车速(0 -> 15m/s)和求解负载变化, 整段60s
+  std::cout << std::endl
+            << "adaptive horizon over the whole drive, " << speeds.size()
+            << " cycles: 10 steps + 4 per m/s in steps of 10, at most 100, "
+               "capped by the QP time against the budget"
+            << std::endl;
+  std::cout << std::setw(10) << "solver" << std::setw(14) << "blocks"
+            << std::setw(11) << "budget us" << std::setw(10) << "mean N"
+            << std::setw(7) << "min N" << std::setw(7) << "max N"
+            << std::setw(9) << "changes" << std::setw(10) << "mean us"
+            << std::setw(10) << "p99 us" << std::setw(10) << "max us"
+            << std::setw(8) << "missed" << std::setw(6) << "lqr"
+            << std::endl;
+  struct AdaptiveCase {
+    const char *name;
+    shenlan::control::MpcFormulation formulation;
+    std::vector<int> move_blocking;
+    double budget_us;
+  };
+  const AdaptiveCase adaptive_cases[] = {
+      {"sparse", shenlan::control::MpcFormulation::kSparse, {}, 0.0},
+      {"sparse", shenlan::control::MpcFormulation::kSparse, {}, 500.0},
+      {"sparse", shenlan::control::MpcFormulation::kSparse, {1, 1, 2, 4, 8},
+       500.0},
+      {"condensed", shenlan::control::MpcFormulation::kCondensed,
+       {1, 1, 2, 4, 8}, 0.0},
+      {"condensed", shenlan::control::MpcFormulation::kCondensed,
+       {1, 1, 2, 4, 8}, 500.0},
+      {"riccati", shenlan::control::MpcFormulation::kRiccati, {}, 0.0},
+      {"riccati", shenlan::control::MpcFormulation::kRiccati, {}, 100.0}};
+  for (const AdaptiveCase &adaptive_case : adaptive_cases) {
+    AdaptiveHorizonBenchmark adaptive_benchmark;
+    const AdaptiveReport report = adaptive_benchmark.RunAdaptive(
+        speeds, adaptive_case.formulation, adaptive_case.budget_us,
+        adaptive_case.move_blocking);
+    std::cout << std::setw(10) << adaptive_case.name << std::setw(14)
+              << BlockingName(adaptive_case.move_blocking) << std::setw(11)
+              << std::fixed << std::setprecision(1) << adaptive_case.budget_us
+              << std::setw(10) << report.mean_horizon << std::setw(7)
+              << report.min_horizon << std::setw(7) << report.max_horizon
+              << std::setw(9) << report.changes << std::setw(10)
+              << report.mean_us << std::setw(10) << report.p99_us
+              << std::setw(10) << report.max_us << std::setw(8)
+              << report.deadline_misses << std::setw(6)
+              << report.lqr_fallbacks << std::endl;
+  }
+
+  // 参考线上的时变模型与单一模型, Riccati内点法
+  const char *track_files[] = {"src/mpc_control/data/reference_line.txt",
+                               "src/mpc_control/data/cube_town_reference_line.txt"};
+  std::cout << std::endl
+            << "LTI vs LTV model along the bundled reference lines at 5 m/s, "
+               "Riccati interior point; time covers the stage model and the "
+               "solve"
+            << std::endl;
+  std::cout << std::setw(30) << "track" << std::setw(8) << "horizon"
+            << std::setw(6) << "model" << std::setw(8) << "cycles"
+            << std::setw(10) << "mean us" << std::setw(10) << "p99 us"
+            << std::setw(11) << "rms lat m" << std::setw(11) << "max lat m"
+            << std::setw(13) << "rms head rad" << std::setw(8) << "failed"
+            << std::endl;
+  for (const char *track_file : track_files) {
+    const TrajectorySnapshotPtr track = LoadTrack(track_file, 5.0);
+    if (track == nullptr || track->size() < 2) {
+      std::cout << std::setw(30) << track_file << "  not found, run from "
+                << "catkin_ws" << std::endl;
+      continue;
+    }
+    const std::string name = std::string(track_file).substr(
+        std::string(track_file).find_last_of('/') + 1);
+    for (const int track_horizon : {10, 30, 60, 100}) {
+      for (const bool time_varying : {false, true}) {
+        TrackBenchmark track_benchmark;
+        const TrackReport report =
+            track_benchmark.RunTrack(track, time_varying, track_horizon);
+        std::cout << std::setw(30) << name << std::setw(8) << track_horizon
+                  << std::setw(6) << (time_varying ? "ltv" : "lti")
+                  << std::setw(8) << report.cycles << std::setw(10)
+                  << std::fixed << std::setprecision(1) << report.mean_us
+                  << std::setw(10) << report.p99_us << std::setw(11)
+                  << std::setprecision(4) << report.rms_lateral_error
+                  << std::setw(11) << report.max_lateral_error
+                  << std::setw(13) << report.rms_heading_error
+                  << std::setw(8) << report.failures << std::endl;
+      }
+    }
+  }
+
+  // 非线性模型(实时迭代)与线性误差模型, 从静止、偏离参考线2m、朝向偏差
+  // 1.5rad出发, 10ms预算
+  std::cout << std::endl
+            << "closed loop on a kinematic bicycle from standstill, 2 m and "
+               "1.5 rad off the reference line, 10 ms budget: linear error "
+               "model (LTV, sparse) vs nonlinear bicycle (RTI); time is the "
+               "whole ComputeControlCommand"
+            << std::endl;
+  std::cout << std::setw(30) << "track" << std::setw(6) << "v m/s"
+            << std::setw(8) << "horizon" << std::setw(8) << "model"
+            << std::setw(8) << "cycles" << std::setw(10) << "mean us"
+            << std::setw(10) << "p99 us" << std::setw(10) << "max us"
+            << std::setw(8) << "overrun" << std::setw(6) << "lqr"
+            << std::setw(11) << "rms lat m" << std::setw(11) << "max lat m"
+            << std::setw(11) << "max head" << std::setw(11) << "|u|-limit"
+            << std::setw(11) << "pred err" << std::setw(5) << "end"
+            << std::endl;
+  for (const char *track_file : track_files) {
+    const std::string name = std::string(track_file).substr(
+        std::string(track_file).find_last_of('/') + 1);
+    for (const double track_speed : {1.0, 3.0}) {
+      const TrajectorySnapshotPtr track = LoadTrack(track_file, track_speed);
+      if (track == nullptr || track->size() < 2) {
+        continue;
+      }
+      for (const int loop_horizon : {50, 100}) {
+        for (const bool nonlinear : {false, true}) {
+          ClosedLoopBenchmark closed_loop;
+          const ClosedLoopReport report = closed_loop.RunClosedLoop(
+              track, nonlinear, loop_horizon, 2.0, 1.5, 10000.0);
+          std::cout << std::setw(30) << name << std::setw(6) << std::fixed
+                    << std::setprecision(1) << track_speed << std::setw(8)
+                    << loop_horizon << std::setw(8)
+                    << (nonlinear ? "rti" : "ltv") << std::setw(8)
+                    << report.cycles << std::setw(10) << report.mean_us
+                    << std::setw(10) << report.p99_us << std::setw(10)
+                    << report.max_us << std::setw(8) << report.overruns
+                    << std::setw(6) << report.lqr_fallbacks << std::setw(11)
+                    << std::setprecision(4) << report.rms_lateral_error
+                    << std::setw(11) << report.max_lateral_error
+                    << std::setw(11) << report.max_heading_error
+                    << std::setw(11) << std::scientific
+                    << std::setprecision(1) << report.max_bound_violation
+                    << std::setw(11) << report.max_prediction_error
+                    << std::setw(5) << (report.finished ? "yes" : "no")
+                    << std::endl;
+        }
+      }
+    }
+  }
+
+  std::cout << std::endl
+            << "QP assembly, dense builder vs direct CSC; memory is the peak "
+               "heap of the dense assembly and the arrays MpcOsqp keeps"
+            << std::endl;
+  std::cout << std::setw(8) << "horizon" << std::setw(10) << "nnz(A)"
+            << std::setw(12) << "dense us" << std::setw(12) << "dense KB"
+            << std::setw(10) << "csc us" << std::setw(10) << "csc KB"
+            << std::setw(10) << "speedup" << std::setw(12) << "osqp us"
+            << std::endl;
+  for (const int horizon : {10, 50, 200}) {
+    const AssemblyReport report =
+        benchmark.RunAssembly(horizon, horizon < 200 ? 20 : 3);
+    std::cout << std::setw(8) << horizon << std::setw(10) << report.nonzeros
+              << std::setw(12) << std::fixed << std::setprecision(1)
+              << report.dense_us << std::setw(12)
+              << report.dense_peak_bytes / 1024.0 << std::setw(10)
+              << report.csc_us << std::setw(10) << report.csc_bytes / 1024.0
+              << std::setw(10) << report.dense_us / report.csc_us
+              << std::setw(12) << report.osqp_setup_us << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include "mpc_condensed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace shenlan {
+namespace control {
+
+template <int kStates, int kControls>
+MpcCondensed<kStates, kControls>::MpcCondensed(
+    const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+    const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,
+    const StateVector &matrix_initial_x, const ControlVector &matrix_u_lower,
+    const ControlVector &matrix_u_upper, const StateVector &matrix_x_lower,
+    const StateVector &matrix_x_upper, const StateVector &matrix_x_ref,
+    const int max_iter, const int horizon, const double eps_abs)
+    : matrix_a_(matrix_a),
+      matrix_b_(matrix_b),
+      matrix_q_(matrix_q),
+      q_diagonal_(matrix_q.diagonal()),
+      r_diagonal_(matrix_r.diagonal()),
+      q_x_ref_(matrix_q * matrix_x_ref),
+      matrix_initial_x_(matrix_initial_x),
+      matrix_u_lower_(matrix_u_lower),
+      matrix_u_upper_(matrix_u_upper),
+      matrix_x_lower_(matrix_x_lower),
+      matrix_x_upper_(matrix_x_upper),
+      matrix_x_ref_(matrix_x_ref),
+      max_iteration_(max_iter),
+      horizon_(horizon) {
+  state_dim_ = matrix_b.rows();
+  control_dim_ = matrix_b.cols();
+  AssignBlocks(std::vector<int>());
+  // 只为有限的状态约束建立不等式行
+  for (size_t j = 0; j < state_dim_; ++j) {
+    if (std::fabs(matrix_x_lower(j)) < DenseQpSolver::kInfinity ||
+        std::fabs(matrix_x_upper(j)) < DenseQpSolver::kInfinity) {
+      bounded_states_.push_back(j);
+    }
+  }
+}
+
+// 与MpcOsqp::SetMoveBlocking相同: 最后一个长度重复到覆盖预测步长, 末块截断
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::AssignBlocks(
+    const std::vector<int> &block_lengths) {
+  block_start_.assign(1, 0);
+  block_of_stage_.resize(horizon_);
+  size_t stage = 0;
+  size_t i = 0;
+  while (stage < horizon_) {
+    int length = block_lengths.empty()
+                     ? 1
+                     : block_lengths[std::min(i, block_lengths.size() - 1)];
+    length = std::max(length, 1);
+    const size_t end = std::min(stage + length, horizon_);
+    for (; stage < end; ++stage) {
+      block_of_stage_[stage] = block_start_.size() - 1;
+    }
+    block_start_.push_back(end);
+    ++i;
+  }
+  num_blocks_ = block_start_.size() - 1;
+}
+
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::SetMoveBlocking(
+    const std::vector<int> &block_lengths) {
+  const std::vector<size_t> previous = block_start_;
+  AssignBlocks(block_lengths);
+  if (block_start_ != previous) {
+    // 变量数变了, 下次求解重新分配
+    initialized_ = false;
+  }
+}
+
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::SumBlockColumns(
+    const Eigen::MatrixXd &stage_matrix, Eigen::MatrixXd *blocked) const {
+  const size_t m = control_dim_;
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    auto columns = blocked->middleCols(b * m, m);
+    columns = stage_matrix.middleCols(block_start_[b] * m, m);
+    for (size_t k = block_start_[b] + 1; k < block_start_[b + 1]; ++k) {
+      columns += stage_matrix.middleCols(k * m, m);
+    }
+  }
+}
+
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::Update(
+    const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+    const StateVector &matrix_initial_x, const StateVector &matrix_x_ref) {
+  dynamics_changed_ = dynamics_changed_ || matrix_a != matrix_a_ ||
+                      matrix_b != matrix_b_;
+  if (matrix_x_ref != matrix_x_ref_) {
+    matrix_x_ref_ = matrix_x_ref;
+    q_x_ref_.noalias() = matrix_q_ * matrix_x_ref_;
+  }
+  matrix_a_ = matrix_a;
+  matrix_b_ = matrix_b;
+  matrix_initial_x_ = matrix_initial_x;
+}
+
+// H_ij = sum_(k > max(i, j)) (A^(k-1-i) B)^T Q (A^(k-1-j) B) + R δ_ij,
+// 按 H_ij = H_(i+1)(j+1) + (A^(N-1-i) B)^T Q (A^(N-1-j) B) 从右下角递推
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::Condense() {
+  const size_t m = control_dim_;
+  const size_t N = horizon_;
+  impulse_[0] = matrix_b_;
+  for (size_t i = 1; i < N; ++i) {
+    impulse_[i].noalias() = matrix_a_ * impulse_[i - 1];
+  }
+
+  for (size_t i = N; i-- > 0;) {
+    for (size_t j = 0; j <= i; ++j) {
+      auto block = hessian_.template block<kControls, kControls>(i * m, j * m,
+                                                                 m, m);
+      block.noalias() = impulse_[N - 1 - i].transpose() *
+                        q_diagonal_.asDiagonal() * impulse_[N - 1 - j];
+      if (i + 1 < N) {
+        block += hessian_.template block<kControls, kControls>(
+            (i + 1) * m, (j + 1) * m, m, m);
+      }
+    }
+  }
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      hessian_.template block<kControls, kControls>(j * m, i * m, m, m) =
+          hessian_.template block<kControls, kControls>(i * m, j * m, m, m)
+              .transpose();
+    }
+    hessian_.template block<kControls, kControls>(i * m, i * m, m, m)
+        .diagonal() += r_diagonal_;
+  }
+
+  // 第k步(k = 1..N)的状态约束行: x_k = A^k x_0 + sum_(j<k) A^(k-1-j) B u_j
+  const size_t num_bounded = bounded_states_.size();
+  for (size_t k = 1; k <= N; ++k) {
+    for (size_t t = 0; t < num_bounded; ++t) {
+      const size_t row = (k - 1) * num_bounded + t;
+      for (size_t j = 0; j < k; ++j) {
+        constraint_.row(row).segment(j * m, m) =
+            impulse_[k - 1 - j].row(bounded_states_[t]);
+      }
+    }
+  }
+  if (!blocked()) {
+    qp_.SetHessian(hessian_);
+    return;
+  }
+  // 分块: u = T v, H_v = T^T H T, 状态约束行 C T; T的每列把一块的各步相加
+  SumBlockColumns(hessian_, &blocked_columns_);
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    auto rows = blocked_hessian_.middleRows(b * m, m);
+    rows = blocked_columns_.middleRows(block_start_[b] * m, m);
+    for (size_t k = block_start_[b] + 1; k < block_start_[b + 1]; ++k) {
+      rows += blocked_columns_.middleRows(k * m, m);
+    }
+  }
+  SumBlockColumns(constraint_, &blocked_constraint_);
+  qp_.SetHessian(blocked_hessian_);
+}
+
+// g_i = B^T λ_(i+1), λ_k = Q A^k x_0 - Q x_ref + A^T λ_(k+1), λ_(N+1) = 0
+template <int kStates, int kControls>
+void MpcCondensed<kStates, kControls>::CalculateGradient() {
+  const size_t m = control_dim_;
+  const size_t N = horizon_;
+  free_response_[0] = matrix_initial_x_;
+  for (size_t k = 1; k <= N; ++k) {
+    free_response_[k].noalias() = matrix_a_ * free_response_[k - 1];
+  }
+  costate_[N] = q_diagonal_.cwiseProduct(free_response_[N]) - q_x_ref_;
+  for (size_t k = N - 1; k >= 1; --k) {
+    costate_[k] = q_diagonal_.cwiseProduct(free_response_[k]) - q_x_ref_;
+    costate_[k].noalias() += matrix_a_.transpose() * costate_[k + 1];
+  }
+  for (size_t i = 0; i < N; ++i) {
+    gradient_.template segment<kControls>(i * m, m).noalias() =
+        matrix_b_.transpose() * costate_[i + 1];
+  }
+
+  // 状态约束减去零输入响应
+  const size_t num_bounded = bounded_states_.size();
+  for (size_t k = 1; k <= N; ++k) {
+    for (size_t t = 0; t < num_bounded; ++t) {
+      const int j = bounded_states_[t];
+      const size_t row = (k - 1) * num_bounded + t;
+      constraint_lower_(row) =
+          std::fabs(matrix_x_lower_(j)) < DenseQpSolver::kInfinity
+              ? matrix_x_lower_(j) - free_response_[k](j)
+              : -DenseQpSolver::kInfinity;
+      constraint_upper_(row) =
+          std::fabs(matrix_x_upper_(j)) < DenseQpSolver::kInfinity
+              ? matrix_x_upper_(j) - free_response_[k](j)
+              : DenseQpSolver::kInfinity;
+    }
+  }
+
+  if (blocked()) {
+    for (size_t b = 0; b < num_blocks_; ++b) {
+      auto segment = blocked_gradient_.segment(b * m, m);
+      segment = gradient_.segment(block_start_[b] * m, m);
+      for (size_t k = block_start_[b] + 1; k < block_start_[b + 1]; ++k) {
+        segment += gradient_.segment(k * m, m);
+      }
+    }
+  }
+}
+
+template <int kStates, int kControls>
+bool MpcCondensed<kStates, kControls>::Solve(std::vector<double> *control_cmd) {
+  const auto start = std::chrono::steady_clock::now();
+  if (!initialized_) {
+    // 只在第一次求解和分块变化时分配
+    const size_t num_controls = control_dim_ * horizon_;
+    const size_t num_moves = control_dim_ * num_blocks_;
+    const size_t num_rows = bounded_states_.size() * horizon_;
+    impulse_.assign(horizon_, ControlMatrix::Zero(state_dim_, control_dim_));
+    free_response_.assign(horizon_ + 1, StateVector::Zero(state_dim_));
+    costate_.assign(horizon_ + 1, StateVector::Zero(state_dim_));
+    hessian_ = Eigen::MatrixXd::Zero(num_controls, num_controls);
+    gradient_ = Eigen::VectorXd::Zero(num_controls);
+    constraint_ = Eigen::MatrixXd::Zero(num_rows, num_controls);
+    constraint_lower_ = Eigen::VectorXd::Zero(num_rows);
+    constraint_upper_ = Eigen::VectorXd::Zero(num_rows);
+    if (blocked()) {
+      blocked_hessian_ = Eigen::MatrixXd::Zero(num_moves, num_moves);
+      blocked_columns_ = Eigen::MatrixXd::Zero(num_controls, num_moves);
+      blocked_gradient_ = Eigen::VectorXd::Zero(num_moves);
+      blocked_constraint_ = Eigen::MatrixXd::Zero(num_rows, num_moves);
+    } else {
+      blocked_hessian_.resize(0, 0);
+      blocked_columns_.resize(0, 0);
+      blocked_gradient_.resize(0);
+      blocked_constraint_.resize(0, 0);
+    }
+    lower_bound_.resize(num_moves);
+    upper_bound_.resize(num_moves);
+    for (size_t i = 0; i < num_blocks_; ++i) {
+      lower_bound_.template segment<kControls>(i * control_dim_,
+                                               control_dim_) = matrix_u_lower_;
+      upper_bound_.template segment<kControls>(i * control_dim_,
+                                               control_dim_) = matrix_u_upper_;
+    }
+    solution_ = Eigen::VectorXd::Zero(num_moves);
+    qp_.Resize(num_moves, num_rows);
+    Condense();
+    CalculateGradient();
+    initialized_ = true;
+    dynamics_changed_ = false;
+    stats_.setup_time_us = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    stats_.assembly_time_us = stats_.setup_time_us;
+    stats_.update_time_us = 0.0;
+    stats_.workspace_reused = false;
+  } else {
+    if (dynamics_changed_) {
+      Condense();
+      dynamics_changed_ = false;
+    }
+    CalculateGradient();
+    stats_.setup_time_us = 0.0;
+    stats_.assembly_time_us = 0.0;
+    stats_.update_time_us = std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    stats_.workspace_reused = true;
+  }
+
+  const auto solve_start = std::chrono::steady_clock::now();
+  const int status = qp_.Solve(
+      blocked() ? blocked_gradient_ : gradient_, lower_bound_, upper_bound_,
+      blocked() ? blocked_constraint_ : constraint_, constraint_lower_,
+      constraint_upper_, max_iteration_, time_limit_us_, &solution_);
+  stats_.solve_time_us = std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - solve_start)
+                             .count();
+  stats_.iterations = qp_.iterations();
+  stats_.status = status;
+  stats_.warm_started = false;
+  stats_.deadline_reached = status == DenseQpSolver::kTimeLimit;
+  stats_.primal_residual = status == DenseQpSolver::kSolved
+                               ? 0.0
+                               : std::numeric_limits<double>::infinity();
+  if (status != DenseQpSolver::kSolved) {
+    return false;
+  }
+  for (size_t i = 0; i < control_dim_; ++i) {
+    control_cmd->at(i) = solution_(i);
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+bool MpcCondensed<kStates, kControls>::ControlSequence(
+    Eigen::VectorXd *controls) const {
+  if (stats_.status != DenseQpSolver::kSolved) {
+    return false;
+  }
+  // 尺寸不变时不重新分配
+  controls->resize(control_dim_ * horizon_);
+  for (size_t k = 0; k < horizon_; ++k) {
+    controls->segment(k * control_dim_, control_dim_) =
+        solution_.segment(block_of_stage_[k] * control_dim_, control_dim_);
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+size_t MpcCondensed<kStates, kControls>::MemoryBytes() const {
+  return (impulse_.capacity() * state_dim_ * control_dim_ +
+          (free_response_.capacity() + costate_.capacity()) * state_dim_ +
+          hessian_.size() + gradient_.size() + lower_bound_.size() +
+          upper_bound_.size() + constraint_.size() + constraint_lower_.size() +
+          constraint_upper_.size() + blocked_hessian_.size() +
+          blocked_columns_.size() + blocked_gradient_.size() +
+          blocked_constraint_.size() + solution_.size()) *
+             sizeof(double) +
+         (block_start_.capacity() + block_of_stage_.capacity()) *
+             sizeof(size_t) +
+         qp_.MemoryBytes();
+}
+
+template class MpcCondensed<6, 2>;
+template class MpcCondensed<Eigen::Dynamic, Eigen::Dynamic>;
+
+}  // namespace control
+}  // namespace shenlan
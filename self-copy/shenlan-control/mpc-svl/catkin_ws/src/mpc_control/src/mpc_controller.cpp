@@ -1,7 +1,10 @@
 #include "mpc_controller.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iomanip>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -13,6 +16,38 @@ using namespace std;
 namespace shenlan {
 namespace control {
 
+namespace {
+
+// 给LQR兜底预留的时间, 6x2模型的doubling求解约5~20us
+constexpr double kLqrReserveUs = 100.0;
+
+double ElapsedUs(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// 在时限内求解; 未解出时, 约束违反足够小的最后迭代值也可以使用
+template <class QpSolver>
+MpcCommandSource SolveWithinLimit(QpSolver *solver, const double time_limit_us,
+                                  const double iterate_tolerance,
+                                  std::vector<double> *control_cmd,
+                                  MpcOsqpStats *stats) {
+  solver->SetTimeLimit(time_limit_us);
+  const bool solved = solver->Solve(control_cmd);
+  *stats = solver->stats();
+  if (solved) {
+    return MpcCommandSource::kSolution;
+  }
+  if (stats->primal_residual <= iterate_tolerance &&
+      solver->LastIterate(control_cmd)) {
+    return MpcCommandSource::kIterate;
+  }
+  return MpcCommandSource::kNone;
+}
+
+}  // namespace
+
 MPCController::MPCController() {}
 
 MPCController::~MPCController() {}
@@ -47,15 +82,75 @@ void MPCController::LoadControlConf() {
 
   mpc_eps_ = 0.01;
   mpc_max_iteration_ = 1500;
+  mpc_warm_start_ = WarmStartMode::kShifted;
+  mpc_formulation_ = MpcFormulation::kSparse;
+  // 100Hz控制周期的一半
+  mpc_time_budget_us_ = 5000.0;
+  mpc_iterate_tolerance_ = 0.05;
   return;
 }
 
+void MPCController::SetMpcFormulation(const MpcFormulation formulation) {
+  mpc_formulation_ = formulation;
+  mpc_osqp_.reset();
+  mpc_condensed_.reset();
+  mpc_riccati_.reset();
+}
+
+void MPCController::SetHorizon(const int horizon) {
+  if (horizon == horizon_) {
+    return;
+  }
+  horizon_ = horizon;
+  mpc_osqp_.reset();
+  mpc_condensed_.reset();
+  mpc_riccati_.reset();
+  mpc_rti_.reset();
+}
+
+void MPCController::SetNonlinear(const bool nonlinear) {
+  mpc_nonlinear_ = nonlinear;
+  mpc_rti_.reset();
+}
+
+void MPCController::SetMoveBlocking(const std::vector<int> &block_lengths) {
+  mpc_move_blocking_ = block_lengths;
+  if (mpc_osqp_ != nullptr) {
+    // 分块不变时不重建工作空间
+    mpc_osqp_->SetMoveBlocking(mpc_move_blocking_);
+  }
+  if (mpc_condensed_ != nullptr) {
+    mpc_condensed_->SetMoveBlocking(mpc_move_blocking_);
+  }
+}
+
+void MPCController::SetAdaptiveHorizon(const MpcHorizonConfig &config) {
+  mpc_adaptive_horizon_ = true;
+  horizon_scheduler_.Configure(config);
+  SetHorizon(horizon_scheduler_.horizon());
+}
+
+// 预测步长随车速增加, 求解时间接近周期预算时缩短
+void MPCController::UpdateHorizon(const double speed) {
+  if (!mpc_adaptive_horizon_) {
+    return;
+  }
+  // 重建求解器的周期只有setup时间, 不计入负载
+  const double qp_time_us =
+      mpc_stats_.workspace_reused
+          ? mpc_stats_.update_time_us + mpc_stats_.solve_time_us
+          : 0.0;
+  SetHorizon(horizon_scheduler_.Update(speed, qp_time_us,
+                                       mpc_time_budget_us_,
+                                       mpc_stats_.deadline_reached));
+}
+
 void MPCController::Init() {
   LoadControlConf();
 
   // Matrix init operations.
-  matrix_a_ = Matrix::Zero(basic_state_size_, basic_state_size_);
-  matrix_ad_ = Matrix::Zero(basic_state_size_, basic_state_size_);
+  matrix_a_ = StateMatrix::Zero();
+  matrix_ad_ = StateMatrix::Zero();
   matrix_a_(0, 1) = 1.0;
   matrix_a_(1, 2) = (cf_ + cr_) / mass_;
   matrix_a_(2, 3) = 1.0;
@@ -63,15 +158,15 @@ void MPCController::Init() {
   matrix_a_(4, 5) = 1;
   matrix_a_(5, 5) = 0.0;
 
-  matrix_a_coeff_ = Matrix::Zero(basic_state_size_, basic_state_size_);
+  matrix_a_coeff_ = StateMatrix::Zero();
   matrix_a_coeff_(1, 1) = -(cf_ + cr_) / mass_;
   matrix_a_coeff_(1, 3) = (lr_ * cr_ - lf_ * cf_) / mass_;
   matrix_a_coeff_(2, 3) = 1.0;
   matrix_a_coeff_(3, 1) = (lr_ * cr_ - lf_ * cf_) / iz_;
   matrix_a_coeff_(3, 3) = -1.0 * (lf_ * lf_ * cf_ + lr_ * lr_ * cr_) / iz_;
 
-  matrix_b_ = Matrix::Zero(basic_state_size_, controls_);
-  matrix_bd_ = Matrix::Zero(basic_state_size_, controls_);
+  matrix_b_ = ControlMatrix::Zero();
+  matrix_bd_ = ControlMatrix::Zero();
   matrix_b_(1, 0) = cf_ / mass_;
   matrix_b_(3, 0) = lf_ * cf_ / iz_;
   matrix_b_(4, 1) = 0.0;
@@ -79,13 +174,13 @@ void MPCController::Init() {
   //matrix_b_(5, 1) = 1.0;
   matrix_bd_ = matrix_b_ * ts_;
 
-  matrix_state_ = Matrix::Zero(basic_state_size_, 1);
+  matrix_state_ = StateVector::Zero();
 
-  matrix_r_ = Matrix::Identity(controls_, controls_);
+  matrix_r_ = ControlWeightMatrix::Identity();
   matrix_r_(0, 0) = 3.25;
   matrix_r_(1, 1) = 1.0;
 
-  matrix_q_ = Matrix::Zero(basic_state_size_, basic_state_size_);
+  matrix_q_ = StateMatrix::Zero();
   matrix_q_(0, 0) = 3.0;   // 横向误差
   matrix_q_(1, 1) = 0.0;   // 横向误差速率
   matrix_q_(2, 2) = 15.0;  // 朝向误差
@@ -93,14 +188,27 @@ void MPCController::Init() {
   matrix_q_(4, 4) = 0.0;  // 纵向位置误差
   matrix_q_(5, 5) = 10;  // 纵向速度误差
 
-  return;
-}
+  // 控制量上下限: 前轮转角, 加速度
+  lower_bound_ << -M_PI / 6, max_deceleration_;
+  upper_bound_ << M_PI / 6, max_acceleration_;
+  // 状态量上下限, 只限制朝向误差
+  // lateral_error, lateral_error_rate, heading_error, heading_error_rate
+  // station_error, station_error_rate
+  const double max = std::numeric_limits<double>::max();
+  lower_state_bound_ << -1.0 * max, -1.0 * max, -1.0 * M_PI, -1.0 * max,
+      -1.0 * max, -1.0 * max;
+  upper_state_bound_ << max, max, M_PI, max, max, max;
+
+  control_cmd_.assign(controls_, 0.0);
+  command_source_ = MpcCommandSource::kSolution;
+  deadline_monitor_.Reset();
+  lqr_k_ = GainMatrix::Zero();
+  mpc_osqp_.reset();
+  mpc_condensed_.reset();
+  mpc_riccati_.reset();
+  mpc_rti_.reset();
 
-double PointDistanceSquare(const TrajectoryPoint &point, const double x,
-                           const double y) {
-  const double dx = point.x - x;
-  const double dy = point.y - y;
-  return dx * dx + dy * dy;
+  return;
 }
 
 double NormalizeAngle(const double angle) {
@@ -115,12 +223,26 @@ double MPCController::Wheel2SteerPct(const double wheel_angle) {
   return wheel_angle / wheel_single_direction_max_degree_ * 100;
 }
 
-// 计算控制命令
-bool MPCController::ComputeControlCommand(
+// 轨迹快照、误差状态和离散模型, 每个周期求解前更新
+bool MPCController::UpdateModel(
     const VehicleState &localization,
-    const TrajectoryData &planning_published_trajectory, ControlCmd &cmd) {
-  //轨迹
-  trajectory_points_ = planning_published_trajectory.trajectory_points;
+    const TrajectoryData &planning_published_trajectory) {
+  //轨迹: 只持有快照的引用, 版本号变化时才切换并重置匹配状态
+  const TrajectorySnapshotPtr &snapshot = planning_published_trajectory.snapshot;
+  if (snapshot == nullptr || snapshot->empty()) {
+    std::cout << "trajectory snapshot is empty" << std::endl;
+    return false;
+  }
+  if ((mpc_time_varying_ || mpc_nonlinear_) &&
+      snapshot->station_line().empty()) {
+    // 逐步模型按弧长采样参考线, 快照需带等弧长参考线
+    std::cout << "trajectory snapshot has no station line" << std::endl;
+    return false;
+  }
+  if (trajectory_ == nullptr || trajectory_->version() != snapshot->version()) {
+    trajectory_ = snapshot;
+    trajectory_matcher_.Reset();
+  }
 
   // Update state // 同时计算纵向,横向误差，更新状态空间向量
   UpdateState(localization);
@@ -128,44 +250,352 @@ bool MPCController::ComputeControlCommand(
   // 更新状态矩阵A
   UpdateMatrix(localization);
 
-  Matrix control_matrix = Matrix::Zero(controls_, 1);
+  if (mpc_time_varying_) {
+    // 沿参考线逐步线性化
+    UpdateStageModel(matched_s_, std::max(localization.velocity,
+                                          minimum_speed_protection_));
+  }
+  return true;
+}
 
-  Matrix reference_state = Matrix::Zero(basic_state_size_, 1);
-  // reference_state(5, 0) = 5;
+void MPCController::DiscretizeAtSpeed(const double v,
+                                      StateMatrix *matrix_ad) const {
+  StateMatrix matrix_a = matrix_a_;
+  matrix_a(1, 1) = matrix_a_coeff_(1, 1) / v;
+  matrix_a(1, 3) = matrix_a_coeff_(1, 3) / v;
+  matrix_a(3, 1) = matrix_a_coeff_(3, 1) / v;
+  matrix_a(3, 3) = matrix_a_coeff_(3, 3) / v;
+  const StateMatrix matrix_i = StateMatrix::Identity();
+  matrix_ad->noalias() = (matrix_i - ts_ * 0.5 * matrix_a).inverse() *
+                         (matrix_i + ts_ * 0.5 * matrix_a);
+}
 
+// 从弧长s开始, 第一步以车速v、之后以参考速度前进, 各步所在处的曲率和参考速度
+void MPCController::SampleReference(const double s, const double v,
+                                    const int count,
+                                    std::vector<double> *kappa,
+                                    std::vector<double> *speed) const {
+  // 尺寸不变时不重新分配
+  kappa->resize(count);
+  speed->resize(count);
+  // 等弧长采样的参考线, 每一步O(1)查找, 轨迹末端之后保持最后一个点
+  const ArcLengthReferenceLine &station_line = trajectory_->station_line();
+  double stage_s = s;
+  for (int k = 0; k < count; ++k) {
+    const StationPoint point = station_line.at(stage_s);
+    double stage_kappa = point.kappa;
+    const double reference_v = point.v;
+    if (!std::isfinite(stage_kappa)) {
+      // 重复点处差分得不到曲率
+      stage_kappa = 0.0;
+    }
+    (*kappa)[k] = stage_kappa;
+    (*speed)[k] = reference_v;
+    stage_s +=
+        (k == 0 ? v : std::max(reference_v, minimum_speed_protection_)) * ts_;
+  }
+}
 
-  // 控制变量的下限
-  Matrix lower_bound(controls_, 1);
-  lower_bound << -M_PI/6, max_deceleration_;
+// 第k步的模型取车辆以参考速度行驶k步后到达的参考点: A_k随该点车速变化,
+// c_k为参考曲率引起的期望横摆角速度 v * kappa 对横向误差的作用
+// (与A同样的系数, 见Apollo lateral MPC的matrix_c_)
+void MPCController::UpdateStageModel(const double s, const double v) {
+  if (stage_model_.matrix_ad.size() != static_cast<size_t>(horizon_)) {
+    // 只在预测步长变化时分配
+    stage_model_.matrix_ad.assign(horizon_, StateMatrix::Zero());
+    stage_model_.matrix_bd.assign(horizon_, ControlMatrix::Zero());
+    stage_model_.matrix_cd.assign(horizon_, StateVector::Zero());
+  }
+  SampleReference(s, v, horizon_, &stage_kappa_, &stage_speed_);
+  double previous_v = -1.0;
+  for (int k = 0; k < horizon_; ++k) {
+    const double kappa = stage_kappa_[k];
+    const double stage_v =
+        k > 0 ? std::max(stage_speed_[k], minimum_speed_protection_) : v;
+
+    // 第0步即当前车速的matrix_ad_; 参考速度分段恒定, 相同车速的阶段不再求逆
+    if (k == 0) {
+      stage_model_.matrix_ad[k] = matrix_ad_;
+    } else if (stage_v == previous_v) {
+      stage_model_.matrix_ad[k] = stage_model_.matrix_ad[k - 1];
+    } else {
+      DiscretizeAtSpeed(stage_v, &stage_model_.matrix_ad[k]);
+    }
+    previous_v = stage_v;
+    stage_model_.matrix_bd[k] = matrix_bd_;
+    const double heading_rate = stage_v * kappa;
+    StateVector &matrix_cd = stage_model_.matrix_cd[k];
+    matrix_cd.setZero();
+    matrix_cd(1, 0) =
+        (matrix_a_coeff_(1, 3) / stage_v - stage_v) * heading_rate * ts_;
+    matrix_cd(3, 0) = matrix_a_coeff_(3, 3) / stage_v * heading_rate * ts_;
+  }
+}
 
-  // 控制变量的上限
-  Matrix upper_bound(controls_, 1);
-  upper_bound << M_PI/6, max_acceleration_;
+// 非线性自行车模型的实时迭代: 沿参考线取各步的曲率和参考速度, 一次SQP步
+MpcCommandSource MPCController::SolveRti(const double v,
+                                         const double time_limit_us,
+                                         std::vector<double> *control_cmd,
+                                         MpcOsqpStats *stats) {
+  SampleReference(matched_s_, std::max(v, minimum_speed_protection_),
+                  horizon_ + 1, &stage_kappa_, &stage_speed_);
+  if (mpc_rti_ == nullptr) {
+    // 权重和约束取线性模型中对应的横向误差、朝向误差、速度误差
+    const double max = std::numeric_limits<double>::max();
+    MpcRti::StateMatrix matrix_q = MpcRti::StateMatrix::Zero();
+    matrix_q(0, 0) = matrix_q_(0, 0);
+    matrix_q(1, 1) = matrix_q_(2, 2);
+    matrix_q(2, 2) = matrix_q_(5, 5);
+    MpcRti::StateVector lower_state_bound;
+    MpcRti::StateVector upper_state_bound;
+    lower_state_bound << lower_state_bound_(0), lower_state_bound_(2), -max;
+    upper_state_bound << upper_state_bound_(0), upper_state_bound_(2), max;
+    mpc_rti_.reset(new MpcRti(wheelbase_, ts_, matrix_q, matrix_r_,
+                              lower_bound_, upper_bound_, lower_state_bound,
+                              upper_state_bound, mpc_max_iteration_, horizon_,
+                              mpc_eps_));
+  }
+  MpcRti::StateVector state;
+  state << matrix_state_(0), matrix_state_(2), v - stage_speed_[0];
+  mpc_rti_->Update(state, stage_kappa_, stage_speed_);
+  return SolveWithinLimit(mpc_rti_.get(), time_limit_us,
+                          mpc_iterate_tolerance_, control_cmd, stats);
+}
 
-  // 状态变量的上下限
+// 横向(横向误差、朝向误差及其速率, 前轮转角)与速度误差(加速度)两个子问题;
+// 纵向位置误差不计权重, 也不影响速度误差, 不进入显式解
+bool MPCController::BuildExplicitMpc(const ExplicitMpcConfig &config,
+                                     ExplicitMpc *explicit_mpc) const {
+  if (matrix_q_(4, 4) != 0.0 || matrix_bd_(5, 0) != 0.0 ||
+      matrix_bd_.block<4, 1>(0, 1).any() || !matrix_r_.isDiagonal() ||
+      !matrix_q_.isDiagonal()) {
+    return false;
+  }
+  // 表内只有朝向误差的约束, 且不能起作用
   const double max = std::numeric_limits<double>::max();
-  Matrix lower_state_bound(basic_state_size_, 1);
-  Matrix upper_state_bound(basic_state_size_, 1);
+  for (int j = 0; j < kStateSize; ++j) {
+    const double limit = j == 2 ? config.max_heading_error : max;
+    if (lower_state_bound_(j) > -limit || upper_state_bound_(j) < limit) {
+      return false;
+    }
+  }
+  Eigen::VectorXd lateral_box(4);
+  lateral_box << config.max_lateral_error, config.max_lateral_error_rate,
+      config.max_heading_error, config.max_heading_error_rate;
+  std::vector<ExplicitMpcProblem> lateral;
+  for (int i = 0; i < config.num_speeds; ++i) {
+    StateMatrix matrix_ad;
+    DiscretizeAtSpeed(
+        std::max(ExplicitMpc::GridSpeed(config, i), minimum_speed_protection_),
+        &matrix_ad);
+    if (matrix_ad.block<4, 2>(0, 4).any() ||
+        matrix_ad.block<2, 4>(4, 0).any() || matrix_ad(5, 4) != 0.0) {
+      return false;
+    }
+    ExplicitMpcProblem problem;
+    problem.matrix_a = matrix_ad.topLeftCorner<4, 4>();
+    problem.matrix_b = matrix_bd_.block<4, 1>(0, 0);
+    problem.matrix_q = matrix_q_.topLeftCorner<4, 4>();
+    problem.matrix_r = matrix_r_.topLeftCorner<1, 1>();
+    problem.u_lower = lower_bound_.head<1>();
+    problem.u_upper = upper_bound_.head<1>();
+    problem.x_lower = -lateral_box;
+    problem.x_upper = lateral_box;
+    problem.horizon = config.horizon;
+    lateral.push_back(problem);
+  }
+  // 速度误差的模型与车速无关: e_v' = -a
+  ExplicitMpcProblem longitudinal;
+  longitudinal.matrix_a = Eigen::MatrixXd::Constant(1, 1, 1.0);
+  longitudinal.matrix_b = matrix_bd_.block<1, 1>(5, 1);
+  longitudinal.matrix_q = matrix_q_.block<1, 1>(5, 5);
+  longitudinal.matrix_r = matrix_r_.block<1, 1>(1, 1);
+  longitudinal.u_lower = lower_bound_.tail<1>();
+  longitudinal.u_upper = upper_bound_.tail<1>();
+  longitudinal.x_lower = Eigen::VectorXd::Constant(1, -config.max_speed_error);
+  longitudinal.x_upper = Eigen::VectorXd::Constant(1, config.max_speed_error);
+  longitudinal.horizon = config.horizon;
+  return explicit_mpc->Build(config, lateral, longitudinal,
+                             ExplicitMpcModelKey(config.horizon));
+}
 
-  // lateral_error, lateral_error_rate, heading_error, heading_error_rate
-  // station_error, station_error_rate
-  lower_state_bound << -1.0 * max, -1.0 * max, -1.0 * M_PI, -1.0 * max,
-      -1.0 * max, -1.0 * max;
-  upper_state_bound << max, max, M_PI, max, max, max;
+std::vector<double> MPCController::ExplicitMpcModelKey(
+    const int horizon) const {
+  std::vector<double> key = {static_cast<double>(horizon),
+                             ts_,
+                             cf_,
+                             cr_,
+                             mass_,
+                             lf_,
+                             lr_,
+                             iz_,
+                             minimum_speed_protection_};
+  key.insert(key.end(), matrix_q_.data(), matrix_q_.data() + matrix_q_.size());
+  key.insert(key.end(), matrix_r_.data(), matrix_r_.data() + matrix_r_.size());
+  key.insert(key.end(), lower_bound_.data(),
+             lower_bound_.data() + lower_bound_.size());
+  key.insert(key.end(), upper_bound_.data(),
+             upper_bound_.data() + upper_bound_.size());
+  key.insert(key.end(), lower_state_bound_.data(),
+             lower_state_bound_.data() + lower_state_bound_.size());
+  key.insert(key.end(), upper_state_bound_.data(),
+             upper_state_bound_.data() + upper_state_bound_.size());
+  return key;
+}
+
+bool MPCController::EvaluateExplicitMpc(const double v,
+                                        std::vector<double> *control_cmd) {
+  // 显式解只对应单一线性模型、逐步输入和同一预测步长
+  if (explicit_mpc_ == nullptr || mpc_nonlinear_ || mpc_time_varying_ ||
+      !mpc_move_blocking_.empty() || explicit_mpc_->horizon() != horizon_) {
+    return false;
+  }
+  ExplicitMpc::ControlVector control;
+  if (!explicit_mpc_->Evaluate(matrix_state_,
+                               std::max(v, minimum_speed_protection_),
+                               &control)) {
+    return false;
+  }
+  control_cmd->at(0) = control(0);
+  control_cmd->at(1) = control(1);
+  return true;
+}
 
-  std::vector<double> control_cmd(controls_, 0);   
+// 建立或更新所选形式的QP求解器, 在时限内求解
+MpcCommandSource MPCController::SolveQp(const StateMatrix &matrix_ad,
+                                        const ControlMatrix &matrix_bd,
+                                        const StageModel *stages,
+                                        const StateVector &initial_state,
+                                        const StateVector &reference_state,
+                                        const double time_limit_us,
+                                        std::vector<double> *control_cmd,
+                                        MpcOsqpStats *stats) {
+  if (mpc_formulation_ == MpcFormulation::kCondensed) {
+    // 消去状态的稠密QP, 只在A、B变化时重新压缩
+    if (mpc_condensed_ == nullptr) {
+      mpc_condensed_.reset(new CondensedSolver(
+          matrix_ad, matrix_bd, matrix_q_, matrix_r_, initial_state,
+          lower_bound_, upper_bound_, lower_state_bound_, upper_state_bound_,
+          reference_state, mpc_max_iteration_, horizon_, mpc_eps_));
+      mpc_condensed_->SetMoveBlocking(mpc_move_blocking_);
+    } else {
+      mpc_condensed_->Update(matrix_ad, matrix_bd, initial_state,
+                             reference_state);
+    }
+    return SolveWithinLimit(mpc_condensed_.get(), time_limit_us,
+                            mpc_iterate_tolerance_, control_cmd, stats);
+  }
+  if (mpc_formulation_ == MpcFormulation::kRiccati) {
+    // 内点法, 每次牛顿步沿预测步长做Riccati递推
+    if (mpc_riccati_ == nullptr) {
+      mpc_riccati_.reset(new RiccatiSolver(
+          matrix_ad, matrix_bd, matrix_q_, matrix_r_, initial_state,
+          lower_bound_, upper_bound_, lower_state_bound_, upper_state_bound_,
+          reference_state, mpc_max_iteration_, horizon_, mpc_eps_));
+    } else if (stages == nullptr) {
+      mpc_riccati_->Update(matrix_ad, matrix_bd, initial_state,
+                           reference_state);
+    }
+    if (stages != nullptr) {
+      mpc_riccati_->UpdateStages(stages->matrix_ad, stages->matrix_bd,
+                                 stages->matrix_cd, initial_state,
+                                 reference_state);
+    }
+    return SolveWithinLimit(mpc_riccati_.get(), time_limit_us,
+                            mpc_iterate_tolerance_, control_cmd, stats);
+  }
+  if (mpc_osqp_ == nullptr) {
+    // 第一个周期建立OSQP工作空间, 之后只原地更新A、初始状态和参考
+    mpc_osqp_.reset(new Solver(matrix_ad, matrix_bd, matrix_q_, matrix_r_,
+                               initial_state, lower_bound_, upper_bound_,
+                               lower_state_bound_, upper_state_bound_,
+                               reference_state, mpc_max_iteration_, horizon_,
+                               mpc_eps_));
+    mpc_osqp_->SetWarmStart(mpc_warm_start_);
+    mpc_osqp_->SetMoveBlocking(mpc_move_blocking_);
+  } else if (stages == nullptr) {
+    mpc_osqp_->Update(matrix_ad, matrix_bd, initial_state, reference_state);
+  }
+  if (stages != nullptr) {
+    // 时变模型: 只改写与上一周期不同的A_k元素和c_k所在的约束上下限
+    mpc_osqp_->UpdateStages(stages->matrix_ad, stages->matrix_bd,
+                            stages->matrix_cd, initial_state,
+                            reference_state);
+  }
+  return SolveWithinLimit(mpc_osqp_.get(), time_limit_us,
+                          mpc_iterate_tolerance_, control_cmd, stats);
+}
 
-  MpcOsqp mpc_osqp(matrix_ad_, matrix_bd_, matrix_q_, matrix_r_,
-                   matrix_state_, lower_bound, upper_bound, lower_state_bound,
-                   upper_state_bound, reference_state, mpc_max_iteration_,
-                   horizon_, mpc_eps_);
-  if (!mpc_osqp.Solve(&control_cmd)) {
-    //std::cout << "MPC OSQP solver failed" << std::endl;
+bool MPCController::QpControlSequence(Eigen::VectorXd *controls) const {
+  if (mpc_nonlinear_) {
+    return mpc_rti_ != nullptr && mpc_rti_->ControlSequence(controls);
+  }
+  if (mpc_formulation_ == MpcFormulation::kCondensed) {
+    return mpc_condensed_ != nullptr &&
+           mpc_condensed_->ControlSequence(controls);
+  }
+  if (mpc_formulation_ == MpcFormulation::kRiccati) {
+    return mpc_riccati_ != nullptr && mpc_riccati_->ControlSequence(controls);
+  }
+  return mpc_osqp_ != nullptr && mpc_osqp_->ControlSequence(controls);
+}
+
+// 计算控制命令
+bool MPCController::ComputeControlCommand(
+    const VehicleState &localization,
+    const TrajectoryData &planning_published_trajectory, ControlCmd &cmd) {
+  const auto cycle_start = std::chrono::steady_clock::now();
+  UpdateHorizon(localization.velocity);
+  if (!UpdateModel(localization, planning_published_trajectory)) {
+    return false;
+  }
+
+  ControlVector control_matrix = ControlVector::Zero();
+
+  StateVector reference_state = StateVector::Zero();
+  // reference_state(5, 0) = 5;
+
+  // 本周期余下的求解时间, 扣除LQR兜底的预留; 预算为0时不限时
+  double time_limit_us = 0.0;
+  bool out_of_time = false;
+  if (mpc_time_budget_us_ > 0.0) {
+    time_limit_us =
+        mpc_time_budget_us_ - kLqrReserveUs - ElapsedUs(cycle_start);
+    out_of_time = time_limit_us <= 0.0;
+  }
+
+  MpcCommandSource source = MpcCommandSource::kNone;
+  if (EvaluateExplicitMpc(localization.velocity, &control_cmd_)) {
+    // 查表得到控制量, 不调用求解器
+    mpc_stats_ = MpcOsqpStats();
+    source = MpcCommandSource::kExplicit;
+  } else if (out_of_time) {
+    // 没有时间求解QP, 直接用LQR
+    mpc_stats_ = MpcOsqpStats();
+    mpc_stats_.deadline_reached = true;
+    mpc_stats_.primal_residual = std::numeric_limits<double>::infinity();
+  } else if (mpc_nonlinear_) {
+    source = SolveRti(localization.velocity, time_limit_us, &control_cmd_,
+                      &mpc_stats_);
   } else {
-    //std::cout << "MPC OSQP problem solved! " << std::endl;
-    control_matrix(0, 0) = control_cmd.at(0);
-    control_matrix(1, 0) = control_cmd.at(1);
+    source = SolveQp(matrix_ad_, matrix_bd_,
+                     mpc_time_varying_ ? &stage_model_ : nullptr,
+                     matrix_state_, reference_state, time_limit_us,
+                     &control_cmd_, &mpc_stats_);
+  }
+
+  if (source != MpcCommandSource::kNone) {
+    // 迭代值可能略微超出控制量上下限
+    control_matrix(0, 0) = control_cmd_.at(0);
+    control_matrix(1, 0) = control_cmd_.at(1);
+    control_matrix =
+        control_matrix.cwiseMax(lower_bound_).cwiseMin(upper_bound_);
+  } else if (ComputeLqrFallback(reference_state, &control_matrix)) {
+    source = MpcCommandSource::kLqr;
   }
+  command_source_ = source;
+  deadline_monitor_.Record(ElapsedUs(cycle_start), mpc_time_budget_us_,
+                           mpc_stats_.deadline_reached, source);
 
   double steer_angle_feedback = control_matrix(0, 0);
   double acc_feedback = control_matrix(1, 0);
@@ -178,6 +608,34 @@ bool MPCController::ComputeControlCommand(
 }
 
 
+// 与MPC相同的线性化和权重下的无限时域LQR, doubling法从Q开始求解
+bool MPCController::ComputeLqrGain(const StateMatrix &matrix_ad,
+                                   const ControlMatrix &matrix_bd,
+                                   GainMatrix *gain,
+                                   RiccatiStats *stats) const {
+  RiccatiOptions options;
+  options.method = RiccatiMethod::kDoubling;
+  options.tolerance = 1e-6;
+  options.max_iterations = 50;
+  StateMatrix p;
+  SolveDiscreteRiccati<kStateSize, kControlSize>(
+      matrix_ad, matrix_bd, matrix_q_, matrix_r_, options, nullptr, &p, gain,
+      stats);
+  return gain->allFinite();
+}
+
+bool MPCController::ComputeLqrFallback(const StateVector &reference_state,
+                                       ControlVector *control) {
+  GainMatrix k;
+  if (!ComputeLqrGain(matrix_ad_, matrix_bd_, &k, &lqr_stats_)) {
+    return false;
+  }
+  lqr_k_ = k;
+  *control = -lqr_k_ * (matrix_state_ - reference_state);
+  *control = control->cwiseMax(lower_bound_).cwiseMin(upper_bound_);
+  return true;
+}
+
 void MPCController::UpdateState(const VehicleState &vehicle_state) {
   //std::shared_ptr<LateralControlError> lat_con_err = std::make_shared<LateralControlError>();
   // 智能指针
@@ -203,7 +661,7 @@ void MPCController::UpdateMatrix(const VehicleState &vehicle_state) {
   matrix_a_(1, 3) = matrix_a_coeff_(1, 3) / v;
   matrix_a_(3, 1) = matrix_a_coeff_(3, 1) / v;
   matrix_a_(3, 3) = matrix_a_coeff_(3, 3) / v;
-  Matrix matrix_i = Matrix::Identity(matrix_a_.cols(), matrix_a_.cols());
+  const StateMatrix matrix_i = StateMatrix::Identity();
   matrix_ad_ = (matrix_i - ts_ * 0.5 * matrix_a_).inverse() * // 将状态矩阵A离散化
                (matrix_i + ts_ * 0.5 * matrix_a_);
 }
@@ -215,7 +673,7 @@ void MPCController::ComputeErrors(const double x, const double y,
                                          const double linear_a,
                                          LateralControlErrorPtr& lat_con_err) {
   TrajectoryPoint target_point;
-  // 查询距离当前位置距离最近的tagret_point
+  // 查询当前位置在轨迹上的投影点作为target_point
   target_point = QueryNearestPointByPosition(x, y);
 
 
@@ -253,17 +711,11 @@ void MPCController::ComputeErrors(const double x, const double y,
 
 TrajectoryPoint MPCController::QueryNearestPointByPosition(const double x,
                                                            const double y) {
-  double d_min = PointDistanceSquare(trajectory_points_.front(), x, y);
-  size_t index_min = 0;
-
-  for (size_t i = 1; i < trajectory_points_.size(); ++i) {
-    double d_temp = PointDistanceSquare(trajectory_points_[i], x, y);
-    if (d_temp < d_min) {
-      d_min = d_temp;
-      index_min = i;
-    }
-  }
-  return trajectory_points_[index_min];
+  // 返回轨迹上的投影点(垂足), 各属性在线段上插值
+  const ProjectedPoint projection = trajectory_matcher_.Project(
+      trajectory_->soa(), x, y, trajectory_->spatial_index().get());
+  matched_s_ = projection.s;
+  return projection.point;
 }
 
 
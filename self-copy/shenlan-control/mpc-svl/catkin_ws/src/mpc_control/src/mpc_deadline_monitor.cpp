@@ -0,0 +1,66 @@
+#include "mpc_deadline_monitor.h"
+
+#include <algorithm>
+
+namespace shenlan {
+namespace control {
+
+constexpr std::size_t MpcDeadlineMonitor::kWindow;
+
+MpcDeadlineMonitor::MpcDeadlineMonitor()
+    : window_(kWindow, 0.0), sorted_(kWindow, 0.0) {}
+
+void MpcDeadlineMonitor::Reset() {
+  summary_ = MpcDeadlineSummary();
+  next_ = 0;
+  filled_ = 0;
+}
+
+void MpcDeadlineMonitor::Record(const double cycle_time_us,
+                                const double budget_us,
+                                const bool deadline_reached,
+                                const MpcCommandSource source) {
+  ++summary_.cycles;
+  if (deadline_reached) {
+    ++summary_.deadline_misses;
+  }
+  if (budget_us > 0.0 && cycle_time_us > budget_us) {
+    ++summary_.overruns;
+  }
+  if (source == MpcCommandSource::kIterate) {
+    ++summary_.iterate_fallbacks;
+  } else if (source == MpcCommandSource::kLqr) {
+    ++summary_.lqr_fallbacks;
+  } else if (source == MpcCommandSource::kExplicit) {
+    ++summary_.explicit_commands;
+  } else if (source == MpcCommandSource::kNone) {
+    ++summary_.failures;
+  }
+  summary_.max_us = std::max(summary_.max_us, cycle_time_us);
+  window_[next_] = cycle_time_us;
+  next_ = (next_ + 1) % kWindow;
+  filled_ = std::min(filled_ + 1, kWindow);
+}
+
+const MpcDeadlineSummary &MpcDeadlineMonitor::Summarize() {
+  if (filled_ == 0) {
+    return summary_;
+  }
+  // 在窗口的副本上逐个取分位数, 后一次nth_element只需处理前一次的右半部分
+  const auto begin = sorted_.begin();
+  const auto end = begin + filled_;
+  std::copy(window_.begin(), window_.begin() + filled_, begin);
+  const auto p50 = begin + filled_ / 2;
+  const auto p90 = begin + filled_ * 9 / 10;
+  const auto p99 = begin + filled_ * 99 / 100;
+  std::nth_element(begin, p50, end);
+  std::nth_element(p50, p90, end);
+  std::nth_element(p90, p99, end);
+  summary_.p50_us = *p50;
+  summary_.p90_us = *p90;
+  summary_.p99_us = *p99;
+  return summary_;
+}
+
+}  // namespace control
+}  // namespace shenlan
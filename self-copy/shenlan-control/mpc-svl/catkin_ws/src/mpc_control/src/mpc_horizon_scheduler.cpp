@@ -0,0 +1,73 @@
+#include "mpc_horizon_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace shenlan {
+namespace control {
+
+MpcHorizonScheduler::MpcHorizonScheduler() { Configure(MpcHorizonConfig()); }
+
+void MpcHorizonScheduler::Configure(const MpcHorizonConfig &config) {
+  config_ = config;
+  config_.min_horizon = std::max(config_.min_horizon, 1);
+  config_.max_horizon = std::max(config_.max_horizon, config_.min_horizon);
+  config_.step = std::max(config_.step, 1);
+  horizon_ = config_.min_horizon;
+  speed_horizon_ = config_.min_horizon;
+  load_cap_ = config_.max_horizon;
+  step_time_us_ = -1.0;
+  changes_ = 0;
+}
+
+int MpcHorizonScheduler::Clamp(const int horizon) const {
+  return std::min(std::max(horizon, config_.min_horizon), config_.max_horizon);
+}
+
+int MpcHorizonScheduler::Update(const double speed, const double qp_time_us,
+                                const double budget_us,
+                                const bool deadline_reached) {
+  const int step = config_.step;
+  // 车速: 向上取整到step的倍数; 降低要多让出半个step, 避免在边界来回切换
+  const double demand =
+      config_.min_horizon + config_.steps_per_speed * std::max(speed, 0.0);
+  const int rounded_up = Clamp(
+      static_cast<int>(std::ceil(demand / step - 1e-9)) * step);
+  const int rounded_down = Clamp(
+      static_cast<int>(std::ceil((demand + 0.5 * step) / step - 1e-9)) * step);
+  if (rounded_up > speed_horizon_) {
+    speed_horizon_ = rounded_up;
+  } else if (rounded_down < speed_horizon_) {
+    speed_horizon_ = rounded_down;
+  }
+
+  // 负载: 每步求解时间的平滑值乘预测步长, 与周期预算比较
+  if (qp_time_us > 0.0) {
+    const double sample = qp_time_us / horizon_;
+    step_time_us_ = step_time_us_ < 0.0
+                        ? sample
+                        : step_time_us_ +
+                              config_.smoothing * (sample - step_time_us_);
+  }
+  if (budget_us > 0.0 && step_time_us_ >= 0.0) {
+    if (deadline_reached ||
+        step_time_us_ * horizon_ > config_.shrink_load * budget_us) {
+      load_cap_ = Clamp(std::min(load_cap_, horizon_) - step);
+    } else if (step_time_us_ * (load_cap_ + step) <
+               config_.grow_load * budget_us) {
+      load_cap_ = Clamp(load_cap_ + step);
+    }
+  } else {
+    load_cap_ = config_.max_horizon;
+  }
+
+  const int horizon = std::min(speed_horizon_, load_cap_);
+  if (horizon != horizon_) {
+    horizon_ = horizon;
+    ++changes_;
+  }
+  return horizon_;
+}
+
+}  // namespace control
+}  // namespace shenlan
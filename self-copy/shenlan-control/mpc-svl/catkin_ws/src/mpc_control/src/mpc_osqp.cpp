@@ -1,20 +1,25 @@
 #include "mpc_osqp.h"
 
+#include <chrono>
+
 namespace shenlan {
 namespace control {
-MpcOsqp::MpcOsqp(const Eigen::MatrixXd &matrix_a,
-                 const Eigen::MatrixXd &matrix_b,
-                 const Eigen::MatrixXd &matrix_q,
-                 const Eigen::MatrixXd &matrix_r,
-                 const Eigen::MatrixXd &matrix_initial_x,
-                 const Eigen::MatrixXd &matrix_u_lower,
-                 const Eigen::MatrixXd &matrix_u_upper,
-                 const Eigen::MatrixXd &matrix_x_lower,
-                 const Eigen::MatrixXd &matrix_x_upper,
-                 const Eigen::MatrixXd &matrix_x_ref, const int max_iter,
-                 const int horizon, const double eps_abs)
-    : matrix_a_(matrix_a),  // 6 * 6
-      matrix_b_(matrix_b),  // 6 * 2
+template <int kStates, int kControls>
+MpcOsqp<kStates, kControls>::MpcOsqp(const StateMatrix &matrix_a,
+                                     const ControlMatrix &matrix_b,
+                                     const StateMatrix &matrix_q,
+                                     const ControlWeightMatrix &matrix_r,
+                                     const StateVector &matrix_initial_x,
+                                     const ControlVector &matrix_u_lower,
+                                     const ControlVector &matrix_u_upper,
+                                     const StateVector &matrix_x_lower,
+                                     const StateVector &matrix_x_upper,
+                                     const StateVector &matrix_x_ref,
+                                     const int max_iter, const int horizon,
+                                     const double eps_abs)
+    : stage_a_(horizon, matrix_a),  // 6 * 6
+      stage_b_(horizon, matrix_b),  // 6 * 2
+      stage_c_(horizon, StateVector::Zero(matrix_b.rows())),  // 6 * 1
       matrix_q_(matrix_q),  // 6 * 6
       matrix_r_(matrix_r),  // 2 * 2
       matrix_initial_x_(matrix_initial_x), // 6 * 1
@@ -28,143 +33,329 @@ MpcOsqp::MpcOsqp(const Eigen::MatrixXd &matrix_a,
       eps_abs_(eps_abs) {
   state_dim_ = matrix_b.rows();     // 6
   control_dim_ = matrix_b.cols();   // 2
-  num_param_ = state_dim_ * (horizon_ + 1) + control_dim_ * horizon_; // 6 * (10 + 1) + 2 * 10;
+  // 默认每步一个控制量: num_param_ = 6 * (10 + 1) + 2 * 10
+  AssignBlocks(std::vector<int>());
 }
 
-void MpcOsqp::CalculateKernel(std::vector<c_float> *P_data,
-                              std::vector<c_int> *P_indices,
-                              std::vector<c_int> *P_indptr) {
-  // col1:(row,val),...; col2:(row,val),....; ...
-  // P = diag(Q,Q,....Q, R, R,...R) Q*(horizon+1), R*horizon
-  std::vector<std::vector<std::pair<c_int, c_float>>> columns;
-  columns.resize(num_param_);
-  int value_index = 0;
-  // state and terminal state
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::AssignBlocks(
+    const std::vector<int> &block_lengths) {
+  block_start_.assign(1, 0);
+  block_of_stage_.resize(horizon_);
+  size_t stage = 0;
+  size_t i = 0;
+  while (stage < horizon_) {
+    // 最后一个长度重复到覆盖预测步长, 末块截断; 空表示每步一块
+    int length = block_lengths.empty()
+                     ? 1
+                     : block_lengths[std::min(i, block_lengths.size() - 1)];
+    length = std::max(length, 1);
+    const size_t end = std::min(stage + length, horizon_);
+    for (; stage < end; ++stage) {
+      block_of_stage_[stage] = block_start_.size() - 1;
+    }
+    block_start_.push_back(end);
+    ++i;
+  }
+  num_blocks_ = block_start_.size() - 1;
+  num_param_ = state_dim_ * (horizon_ + 1) + control_dim_ * num_blocks_;
+}
+
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::SetMoveBlocking(
+    const std::vector<int> &block_lengths) {
+  const std::vector<size_t> previous = block_start_;
+  AssignBlocks(block_lengths);
+  if (block_start_ == previous) {
+    return;
+  }
+  // 变量数和稀疏结构变了, 下次求解重新建立工作空间
+  if (workspace_ != nullptr) {
+    osqp_cleanup(workspace_);
+    workspace_ = nullptr;
+  }
+  A_indptr_.clear();
+}
+
+template <int kStates, int kControls>
+MpcOsqp<kStates, kControls>::~MpcOsqp() {
+  if (workspace_ != nullptr) {
+    osqp_cleanup(workspace_);
+  }
+}
+
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::Update(const StateMatrix &matrix_a,
+                                         const ControlMatrix &matrix_b,
+                                         const StateVector &matrix_initial_x,
+                                         const StateVector &matrix_x_ref) {
+  // 尺寸不变, 赋值不会重新分配内存; 变化的元素在UpdateWorkspace中比较
+  reference_changed_ = reference_changed_ || matrix_x_ref != matrix_x_ref_;
+  std::fill(stage_a_.begin(), stage_a_.end(), matrix_a);
+  std::fill(stage_b_.begin(), stage_b_.end(), matrix_b);
+  for (StateVector &c : stage_c_) {
+    c.setZero();
+  }
+  matrix_initial_x_ = matrix_initial_x;
+  matrix_x_ref_ = matrix_x_ref;
+}
+
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::UpdateStages(
+    const StateMatrixSequence &matrix_a, const ControlMatrixSequence &matrix_b,
+    const StateVectorSequence &matrix_c, const StateVector &matrix_initial_x,
+    const StateVector &matrix_x_ref) {
+  reference_changed_ = reference_changed_ || matrix_x_ref != matrix_x_ref_;
+  std::copy(matrix_a.begin(), matrix_a.begin() + horizon_, stage_a_.begin());
+  std::copy(matrix_b.begin(), matrix_b.begin() + horizon_, stage_b_.begin());
+  std::copy(matrix_c.begin(), matrix_c.begin() + horizon_, stage_c_.begin());
+  matrix_initial_x_ = matrix_initial_x;
+  matrix_x_ref_ = matrix_x_ref;
+}
+
+// P = diag(Q,Q,....Q, R, R,...R) Q*(horizon+1), R*horizon
+// 对角阵, 每列一个元素, 稀疏结构见CalculateSparsityPattern
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::SetWarmStart(const WarmStartMode mode) {
+  warm_start_ = mode;
+  if (workspace_ != nullptr) {
+    osqp_update_warm_start(workspace_, warm_start_ != WarmStartMode::kCold);
+  }
+}
+
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::SetTimeLimit(const double time_limit_us) {
+  // OSQP以秒计时, 0表示不限时
+  time_limit_ = std::max(time_limit_us, 0.0) * 1e-6;
+  if (workspace_ != nullptr) {
+    osqp_update_time_limit(workspace_, time_limit_);
+  }
+}
+
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::CalculateKernel() {
   //  csc矩阵村出发: 分别是data, 对应data[i]的行索引值， 对应data[i]以列为基准对应,出现的顺序
   // 详情请见,https://blog.csdn.net/qq_41959288/article/details/118519021
+  c_float *value = P_data_.data();
+  // state and terminal state
   for (size_t i = 0; i <= horizon_; ++i) {
     for (size_t j = 0; j < state_dim_; ++j) {
-      // (row, val)   
-      // 行索引, data值
-      columns[i * state_dim_ + j].emplace_back(i * state_dim_ + j,
-                                               matrix_q_(j, j));
-      ++value_index;
+      *value++ = matrix_q_(j, j);
     }
   }
-  // control
-  const size_t state_total_dim = state_dim_ * (horizon_ + 1);
-  for (size_t i = 0; i < horizon_; ++i) {
+  // control: 一块内控制量不变, 权重为块长乘R
+  for (size_t i = 0; i < num_blocks_; ++i) {
+    const double length = block_start_[i + 1] - block_start_[i];
     for (size_t j = 0; j < control_dim_; ++j) {
-      // (row, val)
-      // 行索引, data值
-      columns[i * control_dim_ + j + state_total_dim].emplace_back(
-          state_total_dim + i * control_dim_ + j, matrix_r_(j, j));
-      ++value_index;
+      *value++ = length * matrix_r_(j, j);
     }
   }
-
-  int ind_p = 0;
-  for (size_t i = 0; i < num_param_; ++i) {
-    // TODO(SHU) Check this
-    P_indptr->emplace_back(ind_p);
-    for (const auto &row_data_pair : columns[i]) {
-      P_data->emplace_back(row_data_pair.second);    // val
-      P_indices->emplace_back(row_data_pair.first);  // row
-      ++ind_p;
-    }
-  }
-  P_indptr->emplace_back(ind_p);  
 }
 
 // reference is always zero
-void MpcOsqp::CalculateGradient() {
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::CalculateGradient() {
   // populate the gradient vector
-  gradient_ = Eigen::VectorXd::Zero(
-      state_dim_ * (horizon_ + 1) + control_dim_ * horizon_, 1);
+  // 只在setup时分配, 之后原地改写
+  if (gradient_.size() != static_cast<Eigen::Index>(num_param_)) {
+    gradient_ = Eigen::VectorXd::Zero(num_param_);
+  }
   for (size_t i = 0; i < horizon_ + 1; i++) {     // 将J = (x_k - x_r)^T * Q * (x_k - x_r) 展开之后的一次型计算
-    gradient_.block(i * state_dim_, 0, state_dim_, 1) =
+    gradient_.template segment<kStates>(i * state_dim_, state_dim_) =
         -1.0 * matrix_q_ * matrix_x_ref_;
   }
 }
 
-// equality constraints x(k+1) = A*x(k)
-void MpcOsqp::CalculateEqualityConstraint(std::vector<c_float> *A_data,
-                                          std::vector<c_int> *A_indices,
-                                          std::vector<c_int> *A_indptr) {
-  static constexpr double kEpsilon = 1e-6;
-  // block matrix
-  Eigen::MatrixXd matrix_constraint = Eigen::MatrixXd::Zero(
-      state_dim_ * (horizon_ + 1) + state_dim_ * (horizon_ + 1) +
-          control_dim_ * horizon_,
-      state_dim_ * (horizon_ + 1) + control_dim_ * horizon_);
-  Eigen::MatrixXd state_identity_mat = Eigen::MatrixXd::Identity(
-      state_dim_ * (horizon_ + 1), state_dim_ * (horizon_ + 1));
-
-  matrix_constraint.block(0, 0, state_dim_ * (horizon_ + 1),
-                          state_dim_ * (horizon_ + 1)) =
-      -1 * state_identity_mat;
-
-  Eigen::MatrixXd control_identity_mat =
-      Eigen::MatrixXd::Identity(control_dim_, control_dim_);
-
-  for (size_t i = 0; i < horizon_; i++) {
-    matrix_constraint.block((i + 1) * state_dim_, i * state_dim_, state_dim_,
-                            state_dim_) = matrix_a_;
-  }
-
-  for (size_t i = 0; i < horizon_; i++) {
-    matrix_constraint.block((i + 1) * state_dim_,
-                            i * control_dim_ + (horizon_ + 1) * state_dim_,
-                            state_dim_, control_dim_) = matrix_b_;
-  }
-
-  Eigen::MatrixXd all_identity_mat =
-      Eigen::MatrixXd::Identity(num_param_, num_param_);
-
-  matrix_constraint.block(state_dim_ * (horizon_ + 1), 0, num_param_,
-                          num_param_) = all_identity_mat;
-  std::vector<std::vector<std::pair<c_int, c_float>>> columns;
-  columns.resize(num_param_ + 1);
-  int value_index = 0;
-  // state and terminal state
-  for (size_t i = 0; i < num_param_; ++i) {  // col
-    for (size_t j = 0; j < num_param_ + state_dim_ * (horizon_ + 1);
-         ++j)  // row
-      if (std::fabs(matrix_constraint(j, i)) > kEpsilon) {
-        // (row, val)
-        columns[i].emplace_back(j, matrix_constraint(j, i));
-        ++value_index;
+// CSC structure of P and A, built once from the block layout of the QP.
+// Columns of A:
+//   x_k (k < N): -1 at row k*n + j, A_k(:, j) at rows (k+1)*n.., 1 at the
+//                inequality row of x_k
+//   x_N:         -1 at row N*n + j, 1 at the inequality row
+//   u_b:         B_k(:, j) at rows (k+1)*n.. for every stage k of block b,
+//                1 at the inequality row
+// Rows within a column are ascending. The A and B block entries are kept
+// even when zero so the pattern does not depend on the speed, their
+// positions go to dynamics_index_ stage by stage, column-major within the
+// A_k and B_k blocks.
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::CalculateSparsityPattern() {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  const size_t state_total_dim = n * (horizon_ + 1);
+  const size_t block_size = n * n;
+  const size_t stage_size = block_size + n * m;
+
+  // P: 对角
+  P_data_.resize(num_param_);
+  P_indices_.resize(num_param_);
+  P_indptr_.resize(num_param_ + 1);
+  for (size_t i = 0; i < num_param_; ++i) {
+    P_indices_[i] = i;
+    P_indptr_[i] = i;
+  }
+  P_indptr_[num_param_] = num_param_;
+
+  // A: 等式约束 [-I + 下移一块的A_k | B_k], 不等式约束 I
+  const size_t nnz = 2 * state_total_dim + horizon_ * stage_size +
+                     m * num_blocks_;
+  A_data_.resize(nnz);
+  A_indices_.resize(nnz);
+  A_indptr_.resize(num_param_ + 1);
+  dynamics_index_.resize(horizon_ * stage_size);
+  dynamics_values_.resize(horizon_ * stage_size);
+  changed_index_.resize(horizon_ * stage_size);
+  changed_values_.resize(horizon_ * stage_size);
+  c_int position = 0;
+  size_t col = 0;
+  for (size_t k = 0; k <= horizon_; ++k) {
+    for (size_t j = 0; j < n; ++j, ++col) {
+      A_indptr_[col] = position;
+      A_indices_[position++] = k * n + j;
+      if (k < horizon_) {
+        for (size_t r = 0; r < n; ++r) {
+          dynamics_index_[k * stage_size + j * n + r] = position;
+          A_indices_[position++] = (k + 1) * n + r;
+        }
       }
+      A_indices_[position++] = state_total_dim + col;
+    }
   }
-  int ind_A = 0;
-  for (size_t i = 0; i < num_param_; ++i) {
-    A_indptr->emplace_back(ind_A);
-    for (const auto &row_data_pair : columns[i]) {
-      A_data->emplace_back(row_data_pair.second);    // value
-      A_indices->emplace_back(row_data_pair.first);  // row
-      ++ind_A;
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    for (size_t j = 0; j < m; ++j, ++col) {
+      A_indptr_[col] = position;
+      for (size_t k = block_start_[b]; k < block_start_[b + 1]; ++k) {
+        for (size_t r = 0; r < n; ++r) {
+          dynamics_index_[k * stage_size + block_size + j * n + r] = position;
+          A_indices_[position++] = (k + 1) * n + r;
+        }
+      }
+      A_indices_[position++] = state_total_dim + col;
+    }
+  }
+  A_indptr_[num_param_] = position;
+}
+
+// equality constraints x(k+1) = A_k*x(k) + B_k*u(k) + c_k, inequality rows
+// identity; c_k goes into the bounds
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::CalculateEqualityConstraint() {
+  // 与CalculateSparsityPattern相同的顺序逐列写入数值
+  c_float *value = A_data_.data();
+  for (size_t k = 0; k <= horizon_; ++k) {
+    for (size_t j = 0; j < state_dim_; ++j) {
+      *value++ = -1.0;
+      if (k < horizon_) {
+        for (size_t r = 0; r < state_dim_; ++r) {
+          *value++ = stage_a_[k](r, j);
+        }
+      }
+      *value++ = 1.0;
+    }
+  }
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    for (size_t j = 0; j < control_dim_; ++j) {
+      for (size_t k = block_start_[b]; k < block_start_[b + 1]; ++k) {
+        for (size_t r = 0; r < state_dim_; ++r) {
+          *value++ = stage_b_[k](r, j);
+        }
+      }
+      *value++ = 1.0;
     }
   }
-  A_indptr->emplace_back(ind_A);
+}
+
+// 只收集与工作空间中不同的元素: 车速不变时A不变, 只随车速变化的
+// 横向块需要改写, 时变模型下也只有车速或曲率变化的阶段
+template <int kStates, int kControls>
+c_int MpcOsqp<kStates, kControls>::CollectDynamicsChanges() {
+  const size_t block_size = state_dim_ * state_dim_;
+  const size_t b_size = state_dim_ * control_dim_;
+  const size_t stage_size = block_size + b_size;
+  c_int count = 0;
+  for (size_t k = 0; k < horizon_; ++k) {
+    const double *a = stage_a_[k].data();
+    const double *b = stage_b_[k].data();
+    const size_t first = k * stage_size;
+    for (size_t i = 0; i < stage_size; ++i) {
+      const double value = i < block_size ? a[i] : b[i - block_size];
+      if (value != dynamics_values_[first + i]) {
+        dynamics_values_[first + i] = value;
+        changed_index_[count] = dynamics_index_[first + i];
+        changed_values_[count] = value;
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+// 保存本次的解作为下一周期的起点. kShifted: x_k <- x_(k+1),
+// u_k <- u_(k+1), 末端重复; 对偶变量按约束行的同样布局前移.
+// 分块时第b块取其第一步之后一步所在块的值
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::StoreSolution() {
+  const c_float *x = workspace_->solution->x;
+  const c_float *y = workspace_->solution->y;
+  guess_valid_ = true;
+  if (warm_start_ == WarmStartMode::kPrevious) {
+    std::copy(x, x + primal_guess_.size(), primal_guess_.begin());
+    std::copy(y, y + dual_guess_.size(), dual_guess_.begin());
+    return;
+  }
+  const size_t state_total_dim = state_dim_ * (horizon_ + 1);
+  // 状态
+  std::copy(x + state_dim_, x + state_total_dim, primal_guess_.begin());
+  std::copy(x + state_total_dim - state_dim_, x + state_total_dim,
+            primal_guess_.begin() + state_total_dim - state_dim_);
+  // 控制
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    const size_t source =
+        block_of_stage_[std::min(block_start_[b] + 1, horizon_ - 1)];
+    const c_float *u = x + state_total_dim + source * control_dim_;
+    std::copy(u, u + control_dim_,
+              primal_guess_.begin() + state_total_dim + b * control_dim_);
+  }
+  // 等式约束的对偶: 第0块对应初始状态, 第k块对应第k-1步的动力学
+  std::copy(y + state_dim_, y + state_total_dim, dual_guess_.begin());
+  std::copy(y + state_total_dim - state_dim_, y + state_total_dim,
+            dual_guess_.begin() + state_total_dim - state_dim_);
+  // 不等式约束的对偶, 行与决策变量一一对应
+  const c_float *y_box = y + state_total_dim;
+  c_float *dual_box = dual_guess_.data() + state_total_dim;
+  std::copy(y_box + state_dim_, y_box + state_total_dim, dual_box);
+  std::copy(y_box + state_total_dim - state_dim_, y_box + state_total_dim,
+            dual_box + state_total_dim - state_dim_);
+  for (size_t b = 0; b < num_blocks_; ++b) {
+    const size_t source =
+        block_of_stage_[std::min(block_start_[b] + 1, horizon_ - 1)];
+    const c_float *u = y_box + state_total_dim + source * control_dim_;
+    std::copy(u, u + control_dim_,
+              dual_box + state_total_dim + b * control_dim_);
+  }
 }
 
 // 计算约束向量
-void MpcOsqp::CalculateConstraintVectors() {
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::CalculateConstraintVectors() {
   // evaluate the lower and the upper inequality vectors
   // 不等式约束
-  Eigen::VectorXd lowerInequality = Eigen::MatrixXd::Zero(    // 决策变量下界
-      state_dim_ * (horizon_ + 1) + control_dim_ * horizon_, 1);
-  Eigen::VectorXd upperInequality = Eigen::MatrixXd::Zero(    // 决策变量上界
-      state_dim_ * (horizon_ + 1) + control_dim_ * horizon_, 1);
-  for (size_t i = 0; i < horizon_; i++) {   // 控制变量上下界
-    lowerInequality.block(control_dim_ * i + state_dim_ * (horizon_ + 1), 0,
-                          control_dim_, 1) = matrix_u_lower_;
-    upperInequality.block(control_dim_ * i + state_dim_ * (horizon_ + 1), 0,
-                          control_dim_, 1) = matrix_u_upper_;
+  Eigen::VectorXd lowerInequality =
+      Eigen::MatrixXd::Zero(num_param_, 1);  // 决策变量下界
+  Eigen::VectorXd upperInequality =
+      Eigen::MatrixXd::Zero(num_param_, 1);  // 决策变量上界
+  for (size_t i = 0; i < num_blocks_; i++) {   // 控制变量上下界, 每块一个
+    lowerInequality.template segment<kControls>(
+        control_dim_ * i + state_dim_ * (horizon_ + 1), control_dim_) =
+        matrix_u_lower_;
+    upperInequality.template segment<kControls>(
+        control_dim_ * i + state_dim_ * (horizon_ + 1), control_dim_) =
+        matrix_u_upper_;
   }
   for (size_t i = 0; i < horizon_ + 1; i++) {   // 状态变量上下界
-    lowerInequality.block(state_dim_ * i, 0, state_dim_, 1) = matrix_x_lower_;
-    upperInequality.block(state_dim_ * i, 0, state_dim_, 1) = matrix_x_upper_;
+    lowerInequality.template segment<kStates>(state_dim_ * i, state_dim_) =
+        matrix_x_lower_;
+    upperInequality.template segment<kStates>(state_dim_ * i, state_dim_) =
+        matrix_x_upper_;
   }
 
   // evaluate the lower and the upper equality vectors
@@ -172,21 +363,30 @@ void MpcOsqp::CalculateConstraintVectors() {
   Eigen::VectorXd lowerEquality =   
       Eigen::MatrixXd::Zero(state_dim_ * (horizon_ + 1), 1);
   Eigen::VectorXd upperEquality;
-  lowerEquality.block(0, 0, state_dim_, 1) = -1 * matrix_initial_x_;  // 初始状态  
+  lowerEquality.template segment<kStates>(0, state_dim_) =
+      -1 * matrix_initial_x_;  // 初始状态  
+  for (size_t i = 0; i < horizon_; i++) {   // 动力学的仿射项: A_k x_k - x_(k+1) + B_k u_k = -c_k
+    lowerEquality.template segment<kStates>(state_dim_ * (i + 1), state_dim_) =
+        -1 * stage_c_[i];
+  }
   upperEquality = lowerEquality;
   lowerEquality = lowerEquality;
 
   // merge inequality and equality vectors
   // 合并等式约束和不等式约束
   lowerBound_ = Eigen::MatrixXd::Zero(
-      2 * state_dim_ * (horizon_ + 1) + control_dim_ * horizon_, 1);
+      state_dim_ * (horizon_ + 1) + num_param_, 1);
   lowerBound_ << lowerEquality, lowerInequality;
   upperBound_ = Eigen::MatrixXd::Zero(
-      2 * state_dim_ * (horizon_ + 1) + control_dim_ * horizon_, 1);
+      state_dim_ * (horizon_ + 1) + num_param_, 1);
   upperBound_ << upperEquality, upperInequality;
+  // 无界用OSQP_INFTY表示; osqp_update_bounds不会像setup那样截断
+  lowerBound_ = lowerBound_.cwiseMax(-OSQP_INFTY);
+  upperBound_ = upperBound_.cwiseMin(OSQP_INFTY);
 }
 
-OSQPSettings *MpcOsqp::Settings() {
+template <int kStates, int kControls>
+OSQPSettings *MpcOsqp<kStates, kControls>::Settings() {
   // default setting
   OSQPSettings *settings =
       reinterpret_cast<OSQPSettings *>(c_malloc(sizeof(OSQPSettings)));
@@ -194,92 +394,252 @@ OSQPSettings *MpcOsqp::Settings() {
     return nullptr;
   } else {
     osqp_set_default_settings(settings);
-    settings->polish = true;
+    settings->polish = polish_;
+    // 起点由Solve通过osqp_warm_start给出(上一周期的解或零);
+    // kCold时每个周期从零开始迭代
+    settings->warm_start = warm_start_ != WarmStartMode::kCold;
     settings->scaled_termination = true;
     settings->verbose = false;
     settings->max_iter = max_iteration_;    // 最大迭代次数
     settings->eps_abs = eps_abs_;   // 计算精度
+    settings->eps_rel = eps_rel_;
+    settings->time_limit = time_limit_;
     return settings;
   }
 }
 
-OSQPData *MpcOsqp::Data() {
+template <int kStates, int kControls>
+OSQPData *MpcOsqp<kStates, kControls>::Data() {
   OSQPData *data = reinterpret_cast<OSQPData *>(c_malloc(sizeof(OSQPData)));
-  size_t kernel_dim = state_dim_ * (horizon_ + 1) + control_dim_ * horizon_;  // 6 * (10 + 1) + 2 * 10
+  size_t kernel_dim = num_param_;  // 6 * (10 + 1) + 2 * 块数
   size_t num_affine_constraint =  // 约束的数量
-      2 * state_dim_ * (horizon_ + 1) + control_dim_ * horizon_; // 等式约束 + 不等式约束的数量   
+      state_dim_ * (horizon_ + 1) + num_param_; // 等式约束 + 不等式约束的数量   
   if (data == nullptr) {
     return nullptr;
   } else {
     data->n = kernel_dim;   // data->n 需要求解的变量的数量
     data->m = num_affine_constraint;  // 约束的数量 = 等式约束的数量 + 不等式约束的数量
-    std::vector<c_float> P_data;    // X^T*P*X + Q*X
-    std::vector<c_int> P_indices;
-    std::vector<c_int> P_indptr;
-    CalculateKernel(&P_data, &P_indices, &P_indptr);
-    data->P =
-        csc_matrix(kernel_dim, kernel_dim, P_data.size(), CopyData(P_data),
-                   CopyData(P_indices), CopyData(P_indptr));
+    // X^T*P*X + Q*X, CSC数组保存在成员中, osqp_setup会拷贝一份
+    // 稀疏结构只与维数和预测步长有关, 只建立一次
+    if (A_indptr_.size() != num_param_ + 1) {
+      CalculateSparsityPattern();
+    }
+    CalculateKernel();
+    data->P = csc_matrix(kernel_dim, kernel_dim, P_data_.size(),
+                         P_data_.data(), P_indices_.data(), P_indptr_.data());
     data->q = gradient_.data();
-    std::vector<c_float> A_data;
-    std::vector<c_int> A_indices;
-    std::vector<c_int> A_indptr;
-    CalculateEqualityConstraint(&A_data, &A_indices, &A_indptr);
+    CalculateEqualityConstraint();
+    for (size_t i = 0; i < dynamics_index_.size(); ++i) {
+      dynamics_values_[i] = A_data_[dynamics_index_[i]];
+    }
     data->A =
-        csc_matrix(state_dim_ * (horizon_ + 1) + state_dim_ * (horizon_ + 1) +
-                       control_dim_ * horizon_,
-                   kernel_dim, A_data.size(), CopyData(A_data),
-                   CopyData(A_indices), CopyData(A_indptr));
+        csc_matrix(num_affine_constraint, kernel_dim, A_data_.size(), A_data_.data(),
+                   A_indices_.data(), A_indptr_.data());
     data->l = lowerBound_.data();
     data->u = upperBound_.data();
     return data;
   }
 }
 
-void MpcOsqp::FreeData(OSQPData *data) {
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::FreeData(OSQPData *data) {
   c_free(data->A);
   c_free(data->P);
   c_free(data);
 }
 
-bool MpcOsqp::Solve(std::vector<double> *control_cmd) {
+// 组装QP并建立OSQP工作空间(含KKT分解), 只在第一次求解时执行
+template <int kStates, int kControls>
+bool MpcOsqp<kStates, kControls>::Setup() {
+  const auto start = std::chrono::steady_clock::now();
   CalculateGradient();
   CalculateConstraintVectors();
+  primal_guess_.assign(num_param_, 0.0);
+  dual_guess_.assign(lowerBound_.size(), 0.0);
+  guess_valid_ = false;
 
   OSQPData *data = Data();
-
   OSQPSettings *settings = Settings();
-  OSQPWorkspace *osqp_workspace = nullptr;
-  // osqp_setup(&osqp_workspace, data, settings);  // 和版本相关
-  osqp_workspace = osqp_setup(data, settings);
-  osqp_solve(osqp_workspace);
-
-  auto status = osqp_workspace->info->status_val;
-  // check status
-  if (status < 0 || (status != 1 && status != 2)) {
-    osqp_cleanup(osqp_workspace);
-    FreeData(data);
+  if (data == nullptr || settings == nullptr) {
+    if (data != nullptr) {
+      FreeData(data);
+    }
     c_free(settings);
     return false;
-  } else if (osqp_workspace->solution == nullptr) {
-    osqp_cleanup(osqp_workspace);
-    FreeData(data);
-    c_free(settings);
+  }
+  stats_.assembly_time_us = std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+  // osqp_setup(&workspace_, data, settings);  // 和版本相关
+  workspace_ = osqp_setup(data, settings);
+  FreeData(data);
+  c_free(settings);
+  reference_changed_ = false;
+  stats_.setup_time_us = std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  stats_.update_time_us = 0.0;
+  stats_.workspace_reused = false;
+  return workspace_ != nullptr;
+}
+
+// 只改写随车速和状态变化的部分, 稀疏结构和设置不变, 不分配内存
+template <int kStates, int kControls>
+void MpcOsqp<kStates, kControls>::UpdateWorkspace() {
+  const auto start = std::chrono::steady_clock::now();
+  const c_int changed = CollectDynamicsChanges();
+  if (changed > 0) {
+    // A变化时OSQP重新做KKT数值分解, 符号分解沿用
+    osqp_update_A(workspace_, changed_values_.data(), changed_index_.data(),
+                  changed);
+  }
+  if (reference_changed_) {
+    CalculateGradient();
+    osqp_update_lin_cost(workspace_, gradient_.data());
+    reference_changed_ = false;
+  }
+  // 初始状态约束: -x_0 = -x(0), 动力学约束的仿射项 -c_k
+  lowerBound_.template segment<kStates>(0, state_dim_) = -matrix_initial_x_;
+  upperBound_.template segment<kStates>(0, state_dim_) = -matrix_initial_x_;
+  for (size_t i = 0; i < horizon_; ++i) {
+    lowerBound_.template segment<kStates>(state_dim_ * (i + 1), state_dim_) =
+        -stage_c_[i];
+    upperBound_.template segment<kStates>(state_dim_ * (i + 1), state_dim_) =
+        -stage_c_[i];
+  }
+  osqp_update_bounds(workspace_, lowerBound_.data(), upperBound_.data());
+  stats_.setup_time_us = 0.0;
+  stats_.assembly_time_us = 0.0;
+  stats_.update_time_us = std::chrono::duration<double, std::micro>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+  stats_.workspace_reused = true;
+}
+
+template <int kStates, int kControls>
+bool MpcOsqp<kStates, kControls>::Solve(std::vector<double> *control_cmd) {
+  if (workspace_ == nullptr) {
+    if (!Setup()) {
+      return false;
+    }
+  } else {
+    UpdateWorkspace();
+  }
+
+  const bool warm_start = warm_start_ != WarmStartMode::kCold;
+  stats_.warm_started = warm_start && guess_valid_;
+  if (warm_start && stats_.workspace_reused) {
+    // 失败后guess为零, 避免从发散的迭代值继续
+    osqp_warm_start(workspace_, primal_guess_.data(), dual_guess_.data());
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  osqp_solve(workspace_);
+  stats_.solve_time_us = std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  stats_.iterations = static_cast<int>(workspace_->info->iter);
+
+  auto status = workspace_->info->status_val;
+  stats_.status = static_cast<int>(status);
+  stats_.deadline_reached = status == OSQP_TIME_LIMIT_REACHED;
+  stats_.primal_residual = workspace_->solution != nullptr
+                               ? workspace_->info->pri_res
+                               : std::numeric_limits<double>::infinity();
+  // check status
+  if (status < 0 || (status != 1 && status != 2) ||
+      workspace_->solution == nullptr) {
+    if (guess_valid_) {
+      std::fill(primal_guess_.begin(), primal_guess_.end(), 0.0);
+      std::fill(dual_guess_.begin(), dual_guess_.end(), 0.0);
+      guess_valid_ = false;
+    }
     return false;
   }
+  if (warm_start) {
+    StoreSolution();
+  }
 
   size_t first_control = state_dim_ * (horizon_ + 1);   // 总的决策变量是 state_dim_ * (horizon_ + 1) + control_dim_ * horizon_
                                                         // 包括[x_k, u_k],u_k的索引是state_dim_ * (horizon_ + 1)， 所以去第一个控制量
   for (size_t i = 0; i < control_dim_; ++i) {
-    control_cmd->at(i) = osqp_workspace->solution->x[i + first_control];
+    control_cmd->at(i) = workspace_->solution->x[i + first_control];
   }
+  return true;
+}
 
-  // Cleanup
-  osqp_cleanup(osqp_workspace);
-  FreeData(data);
-  c_free(settings);
+// 超时或达到迭代上限时OSQP仍保存最后的迭代值
+template <int kStates, int kControls>
+bool MpcOsqp<kStates, kControls>::LastIterate(
+    std::vector<double> *control_cmd) const {
+  if (workspace_ == nullptr || workspace_->solution == nullptr ||
+      (stats_.status != OSQP_TIME_LIMIT_REACHED &&
+       stats_.status != OSQP_MAX_ITER_REACHED)) {
+    return false;
+  }
+  const size_t first_control = state_dim_ * (horizon_ + 1);
+  for (size_t i = 0; i < control_dim_; ++i) {
+    control_cmd->at(i) = workspace_->solution->x[i + first_control];
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+bool MpcOsqp<kStates, kControls>::ControlSequence(
+    Eigen::VectorXd *controls) const {
+  if (workspace_ == nullptr || workspace_->solution == nullptr ||
+      (stats_.status != 1 && stats_.status != 2)) {
+    return false;
+  }
+  const size_t first_control = state_dim_ * (horizon_ + 1);
+  // 尺寸不变时不重新分配
+  controls->resize(control_dim_ * horizon_);
+  for (size_t k = 0; k < horizon_; ++k) {
+    controls->segment(k * control_dim_, control_dim_) =
+        Eigen::Map<const Eigen::VectorXd>(
+            workspace_->solution->x + first_control +
+                block_of_stage_[k] * control_dim_,
+            control_dim_);
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+bool MpcOsqp<kStates, kControls>::StateSequence(
+    StateVectorSequence *states) const {
+  if (workspace_ == nullptr || workspace_->solution == nullptr ||
+      (stats_.status != 1 && stats_.status != 2)) {
+    return false;
+  }
+  if (states->size() < horizon_ + 1) {
+    states->resize(horizon_ + 1, StateVector::Zero(state_dim_));
+  }
+  for (size_t k = 0; k <= horizon_; ++k) {
+    (*states)[k] = Eigen::Map<const Eigen::VectorXd>(
+        workspace_->solution->x + k * state_dim_, state_dim_);
+  }
   return true;
 }
 
+template <int kStates, int kControls>
+size_t MpcOsqp<kStates, kControls>::MemoryBytes() const {
+  return (P_data_.capacity() + A_data_.capacity() +
+          dynamics_values_.capacity() + changed_values_.capacity()) *
+             sizeof(c_float) +
+         (P_indices_.capacity() + P_indptr_.capacity() +
+          A_indices_.capacity() + A_indptr_.capacity() +
+          dynamics_index_.capacity() + changed_index_.capacity()) *
+             sizeof(c_int) +
+         (block_start_.capacity() + block_of_stage_.capacity()) *
+             sizeof(size_t) +
+         (gradient_.size() + lowerBound_.size() + upperBound_.size() +
+          primal_guess_.capacity() + dual_guess_.capacity()) *
+             sizeof(double);
+}
+
+template class MpcOsqp<6, 2>;
+template class MpcOsqp<3, 2>;
+template class MpcOsqp<Eigen::Dynamic, Eigen::Dynamic>;
+
 }  // namespace control
 }  // namespace shenlan
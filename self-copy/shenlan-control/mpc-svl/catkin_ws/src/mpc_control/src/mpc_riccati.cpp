@@ -0,0 +1,569 @@
+#include "mpc_riccati.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+// 超过该值的上下限视为无约束
+constexpr double kInfiniteBound = 1e20;
+// 每步最多走到边界的比例
+constexpr double kStepFraction = 0.99;
+}  // namespace
+
+template <int kStates, int kControls>
+constexpr int MpcRiccati<kStates, kControls>::kMaxIterations;
+
+template <int kStates, int kControls>
+MpcRiccati<kStates, kControls>::MpcRiccati(
+    const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+    const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,
+    const StateVector &matrix_initial_x, const ControlVector &matrix_u_lower,
+    const ControlVector &matrix_u_upper, const StateVector &matrix_x_lower,
+    const StateVector &matrix_x_upper, const StateVector &matrix_x_ref,
+    const int max_iter, const int horizon, const double eps_abs)
+    : matrix_q_(matrix_q),
+      matrix_initial_x_(matrix_initial_x),
+      matrix_x_ref_(matrix_x_ref),
+      max_iteration_(std::min(max_iter, kMaxIterations)),
+      horizon_(horizon),
+      eps_abs_(eps_abs) {
+  state_dim_ = matrix_b.rows();
+  control_dim_ = matrix_b.cols();
+  first_control_ = state_dim_ * (horizon_ + 1);
+  num_param_ = first_control_ + control_dim_ * horizon_;
+  stage_a_.assign(horizon_, matrix_a);
+  stage_b_.assign(horizon_, matrix_b);
+  stage_c_.assign(horizon_, StateVector::Zero(state_dim_));
+
+  // 代价的对角、上下限及其掩码, 只在构造时计算
+  hessian_diagonal_.resize(num_param_);
+  lower_bound_ = Eigen::VectorXd::Zero(num_param_);
+  upper_bound_ = Eigen::VectorXd::Zero(num_param_);
+  has_lower_ = Eigen::VectorXd::Zero(num_param_);
+  has_upper_ = Eigen::VectorXd::Zero(num_param_);
+  for (size_t k = 0; k <= horizon_; ++k) {
+    hessian_diagonal_.template segment<kStates>(k * state_dim_, state_dim_) =
+        matrix_q.diagonal();
+  }
+  for (size_t k = 0; k < horizon_; ++k) {
+    hessian_diagonal_.template segment<kControls>(
+        first_control_ + k * control_dim_, control_dim_) = matrix_r.diagonal();
+  }
+  // x_0由等式固定, 不加上下限
+  for (size_t i = state_dim_; i < num_param_; ++i) {
+    const bool is_state = i < first_control_;
+    const size_t j =
+        is_state ? i % state_dim_ : (i - first_control_) % control_dim_;
+    const double lower = is_state ? matrix_x_lower(j) : matrix_u_lower(j);
+    const double upper = is_state ? matrix_x_upper(j) : matrix_u_upper(j);
+    if (std::fabs(lower) < kInfiniteBound) {
+      lower_bound_(i) = lower;
+      has_lower_(i) = 1.0;
+      ++num_bounds_;
+    }
+    if (std::fabs(upper) < kInfiniteBound) {
+      upper_bound_(i) = upper;
+      has_upper_(i) = 1.0;
+      ++num_bounds_;
+    }
+  }
+}
+
+template <int kStates, int kControls>
+void MpcRiccati<kStates, kControls>::Update(
+    const StateMatrix &matrix_a, const ControlMatrix &matrix_b,
+    const StateVector &matrix_initial_x, const StateVector &matrix_x_ref) {
+  std::fill(stage_a_.begin(), stage_a_.end(), matrix_a);
+  std::fill(stage_b_.begin(), stage_b_.end(), matrix_b);
+  for (StateVector &c : stage_c_) {
+    c.setZero();
+  }
+  matrix_initial_x_ = matrix_initial_x;
+  matrix_x_ref_ = matrix_x_ref;
+}
+
+template <int kStates, int kControls>
+void MpcRiccati<kStates, kControls>::UpdateStages(
+    const StateMatrixSequence &matrix_a, const ControlMatrixSequence &matrix_b,
+    const StateVectorSequence &matrix_c, const StateVector &matrix_initial_x,
+    const StateVector &matrix_x_ref) {
+  // 只取前horizon_个阶段, 尺寸不变, 不分配内存
+  std::copy(matrix_a.begin(), matrix_a.begin() + horizon_, stage_a_.begin());
+  std::copy(matrix_b.begin(), matrix_b.begin() + horizon_, stage_b_.begin());
+  std::copy(matrix_c.begin(), matrix_c.begin() + horizon_, stage_c_.begin());
+  matrix_initial_x_ = matrix_initial_x;
+  matrix_x_ref_ = matrix_x_ref;
+}
+
+template <int kStates, int kControls>
+void MpcRiccati<kStates, kControls>::Allocate() {
+  const size_t num_dynamics = state_dim_ * horizon_;
+  gradient_ = Eigen::VectorXd::Zero(num_param_);
+  z_ = Eigen::VectorXd::Zero(num_param_);
+  slack_lower_ = Eigen::VectorXd::Zero(num_param_);
+  slack_upper_ = Eigen::VectorXd::Zero(num_param_);
+  dual_lower_ = Eigen::VectorXd::Zero(num_param_);
+  dual_upper_ = Eigen::VectorXd::Zero(num_param_);
+  dual_dynamics_ = Eigen::VectorXd::Zero(num_dynamics);
+  residual_dynamics_ = Eigen::VectorXd::Zero(num_dynamics);
+  residual_stationarity_ = Eigen::VectorXd::Zero(num_param_);
+  residual_lower_ = Eigen::VectorXd::Zero(num_param_);
+  residual_upper_ = Eigen::VectorXd::Zero(num_param_);
+  complementarity_lower_ = Eigen::VectorXd::Zero(num_param_);
+  complementarity_upper_ = Eigen::VectorXd::Zero(num_param_);
+  barrier_ = Eigen::VectorXd::Zero(num_param_);
+  newton_gradient_ = Eigen::VectorXd::Zero(num_param_);
+  step_z_ = Eigen::VectorXd::Zero(num_param_);
+  step_slack_lower_ = Eigen::VectorXd::Zero(num_param_);
+  step_slack_upper_ = Eigen::VectorXd::Zero(num_param_);
+  step_dual_lower_ = Eigen::VectorXd::Zero(num_param_);
+  step_dual_upper_ = Eigen::VectorXd::Zero(num_param_);
+  next_dual_dynamics_ = Eigen::VectorXd::Zero(num_dynamics);
+
+  cost_to_go_.assign(horizon_ + 1, StateMatrix::Zero(state_dim_, state_dim_));
+  cost_to_go_linear_.assign(horizon_ + 1, StateVector::Zero(state_dim_));
+  cross_.assign(horizon_, GainMatrix::Zero(control_dim_, state_dim_));
+  gain_.assign(horizon_, GainMatrix::Zero(control_dim_, state_dim_));
+  feedforward_.assign(horizon_, ControlVector::Zero(control_dim_));
+  control_factor_.assign(horizon_,
+                         Eigen::LLT<ControlWeightMatrix>(control_dim_));
+  // 动态尺寸时为中间量预留空间, 之后的求解不再分配
+  state_scratch_ = StateMatrix::Zero(state_dim_, state_dim_);
+  control_scratch_ = ControlMatrix::Zero(state_dim_, control_dim_);
+  weight_scratch_ = ControlWeightMatrix::Zero(control_dim_, control_dim_);
+  vector_scratch_ = StateVector::Zero(state_dim_);
+  control_vector_scratch_ = ControlVector::Zero(control_dim_);
+}
+
+// 零输入(截断到控制上下限)轨迹, 松弛取到下限/上限的距离且不小于1, 乘子取1
+template <int kStates, int kControls>
+void MpcRiccati<kStates, kControls>::InitializeIterate() {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  z_.template segment<kStates>(0, n) = matrix_initial_x_;
+  for (size_t k = 0; k < horizon_; ++k) {
+    auto u = z_.template segment<kControls>(first_control_ + k * m, m);
+    for (size_t j = 0; j < m; ++j) {
+      const size_t i = first_control_ + k * m + j;
+      double value = 0.0;
+      if (has_lower_(i) > 0.0) {
+        value = std::max(value, lower_bound_(i));
+      }
+      if (has_upper_(i) > 0.0) {
+        value = std::min(value, upper_bound_(i));
+      }
+      u(j) = value;
+    }
+    z_.template segment<kStates>((k + 1) * n, n).noalias() =
+        stage_a_[k] * z_.template segment<kStates>(k * n, n);
+    z_.template segment<kStates>((k + 1) * n, n).noalias() += stage_b_[k] * u;
+    z_.template segment<kStates>((k + 1) * n, n) += stage_c_[k];
+  }
+  slack_lower_ =
+      has_lower_.cwiseProduct((z_ - lower_bound_).cwiseMax(1.0)) +
+      (1.0 - has_lower_.array()).matrix();
+  slack_upper_ =
+      has_upper_.cwiseProduct((upper_bound_ - z_).cwiseMax(1.0)) +
+      (1.0 - has_upper_.array()).matrix();
+  dual_lower_ = has_lower_;
+  dual_upper_ = has_upper_;
+  dual_dynamics_.setZero();
+}
+
+template <int kStates, int kControls>
+bool MpcRiccati<kStates, kControls>::CenterStartingPoint() {
+  CalculateResiduals();
+  if (!FactorizeNewtonSystem()) {
+    return false;
+  }
+  complementarity_lower_ = slack_lower_.cwiseProduct(dual_lower_);
+  complementarity_upper_ = slack_upper_.cwiseProduct(dual_upper_);
+  SolveNewtonSystem();
+  // z和动力学乘子走整步, 松弛和乘子取绝对值且不小于1
+  z_ += step_z_;
+  dual_dynamics_ = next_dual_dynamics_;
+  slack_lower_ = (has_lower_.array() *
+                      (slack_lower_ + step_slack_lower_).array().abs().max(1.0) +
+                  1.0 - has_lower_.array())
+                     .matrix();
+  slack_upper_ = (has_upper_.array() *
+                      (slack_upper_ + step_slack_upper_).array().abs().max(1.0) +
+                  1.0 - has_upper_.array())
+                     .matrix();
+  dual_lower_ = (has_lower_.array() *
+                 (dual_lower_ + step_dual_lower_).array().abs().max(1.0))
+                    .matrix();
+  dual_upper_ = (has_upper_.array() *
+                 (dual_upper_ + step_dual_upper_).array().abs().max(1.0))
+                    .matrix();
+  return true;
+}
+
+// r_e = A_k x_k + B_k u_k + c_k - x_(k+1)
+// r_d = H z + g - lambda_l + lambda_u + C^T nu (x_0 不是变量, 置零)
+// r_l = z - lb - s_l, r_u = ub - z - s_u
+template <int kStates, int kControls>
+double MpcRiccati<kStates, kControls>::CalculateResiduals() {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  residual_stationarity_ = hessian_diagonal_.cwiseProduct(z_) + gradient_ -
+                           dual_lower_ + dual_upper_;
+  for (size_t k = 0; k < horizon_; ++k) {
+    const auto x = z_.template segment<kStates>(k * n, n);
+    const auto u = z_.template segment<kControls>(first_control_ + k * m, m);
+    const auto nu = dual_dynamics_.template segment<kStates>(k * n, n);
+    auto residual = residual_dynamics_.template segment<kStates>(k * n, n);
+    residual.noalias() = stage_a_[k] * x;
+    residual.noalias() += stage_b_[k] * u;
+    residual += stage_c_[k] - z_.template segment<kStates>((k + 1) * n, n);
+
+    residual_stationarity_.template segment<kStates>((k + 1) * n, n) -= nu;
+    residual_stationarity_.template segment<kStates>(k * n, n).noalias() +=
+        stage_a_[k].transpose() * nu;
+    residual_stationarity_
+        .template segment<kControls>(first_control_ + k * m, m)
+        .noalias() += stage_b_[k].transpose() * nu;
+  }
+  residual_stationarity_.template segment<kStates>(0, n).setZero();
+  residual_lower_ = has_lower_.cwiseProduct(z_ - lower_bound_ - slack_lower_);
+  residual_upper_ = has_upper_.cwiseProduct(upper_bound_ - z_ - slack_upper_);
+
+  // 残差相对于迭代值的量级: 不稳定模型的长预测步长下 H z 可达1e5,
+  // 绝对精度受舍入限制
+  const double primal_scale =
+      1.0 + z_.template lpNorm<Eigen::Infinity>();
+  const double dual_scale =
+      1.0 + std::max({hessian_diagonal_.cwiseProduct(z_)
+                          .template lpNorm<Eigen::Infinity>(),
+                      gradient_.template lpNorm<Eigen::Infinity>(),
+                      dual_lower_.template lpNorm<Eigen::Infinity>(),
+                      dual_upper_.template lpNorm<Eigen::Infinity>()});
+  double residual =
+      residual_stationarity_.template lpNorm<Eigen::Infinity>() / dual_scale;
+  if (horizon_ > 0) {
+    residual = std::max(
+        residual,
+        residual_dynamics_.template lpNorm<Eigen::Infinity>() / primal_scale);
+  }
+  residual = std::max(
+      residual, residual_lower_.template lpNorm<Eigen::Infinity>() /
+                    primal_scale);
+  return std::max(residual, residual_upper_.template lpNorm<Eigen::Infinity>() /
+                                primal_scale);
+}
+
+// 牛顿方程为LQ问题: 阶段权重 diag(H) + lambda / s, 动力学残差作为仿射项.
+// P_N = Q_N, R_k + B^T P B = L L^T, K_k = -(R_k + B^T P B)^-1 B^T P A,
+// P_k = Q_k + A^T P A + (B^T P A)^T K_k
+template <int kStates, int kControls>
+bool MpcRiccati<kStates, kControls>::FactorizeNewtonSystem() {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  const size_t N = horizon_;
+  barrier_ = (dual_lower_.array() / slack_lower_.array() +
+              dual_upper_.array() / slack_upper_.array())
+                 .matrix();
+
+  cost_to_go_[N].setZero();
+  cost_to_go_[N].diagonal() =
+      hessian_diagonal_.template segment<kStates>(N * n, n) +
+      barrier_.template segment<kStates>(N * n, n);
+  for (size_t k = N; k-- > 0;) {
+    const StateMatrix &next = cost_to_go_[k + 1];
+    control_scratch_.noalias() = next * stage_b_[k];
+    weight_scratch_.noalias() = stage_b_[k].transpose() * control_scratch_;
+    weight_scratch_.diagonal() +=
+        hessian_diagonal_.template segment<kControls>(first_control_ + k * m,
+                                                      m) +
+        barrier_.template segment<kControls>(first_control_ + k * m, m);
+    control_factor_[k].compute(weight_scratch_);
+    if (control_factor_[k].info() != Eigen::Success) {
+      return false;
+    }
+    // B^T P A = (P B)^T A
+    cross_[k].noalias() = control_scratch_.transpose() * stage_a_[k];
+    gain_[k] = cross_[k];
+    control_factor_[k].solveInPlace(gain_[k]);
+    gain_[k] = -gain_[k];
+    if (k == 0) {
+      break;
+    }
+    state_scratch_.noalias() = next * stage_a_[k];
+    cost_to_go_[k].noalias() = stage_a_[k].transpose() * state_scratch_;
+    cost_to_go_[k].noalias() += cross_[k].transpose() * gain_[k];
+    cost_to_go_[k].diagonal() +=
+        hessian_diagonal_.template segment<kStates>(k * n, n) +
+        barrier_.template segment<kStates>(k * n, n);
+  }
+  return true;
+}
+
+// 线性项 q = H z + g - lambda_l + lambda_u + (c_l + lambda_l r_l) / s_l
+//            - (c_u + lambda_u r_u) / s_u,
+// 反向递推 p_k 和前馈 k_k, 正向展开得到步长和新的动力学乘子 nu_k = P dx + p
+template <int kStates, int kControls>
+void MpcRiccati<kStates, kControls>::SolveNewtonSystem() {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  const size_t N = horizon_;
+  newton_gradient_ =
+      (hessian_diagonal_.array() * z_.array() + gradient_.array() -
+       dual_lower_.array() + dual_upper_.array() +
+       (complementarity_lower_.array() +
+        dual_lower_.array() * residual_lower_.array()) /
+           slack_lower_.array() -
+       (complementarity_upper_.array() +
+        dual_upper_.array() * residual_upper_.array()) /
+           slack_upper_.array())
+          .matrix();
+
+  cost_to_go_linear_[N] = newton_gradient_.template segment<kStates>(N * n, n);
+  for (size_t k = N; k-- > 0;) {
+    // v = P_(k+1) c_k + p_(k+1)
+    vector_scratch_ = cost_to_go_linear_[k + 1];
+    vector_scratch_.noalias() +=
+        cost_to_go_[k + 1] *
+        residual_dynamics_.template segment<kStates>(k * n, n);
+    control_vector_scratch_ = newton_gradient_.template segment<kControls>(
+        first_control_ + k * m, m);
+    control_vector_scratch_.noalias() +=
+        stage_b_[k].transpose() * vector_scratch_;
+    control_factor_[k].solveInPlace(control_vector_scratch_);
+    feedforward_[k] = -control_vector_scratch_;
+    if (k == 0) {
+      break;
+    }
+    cost_to_go_linear_[k] = newton_gradient_.template segment<kStates>(k * n, n);
+    cost_to_go_linear_[k].noalias() +=
+        stage_a_[k].transpose() * vector_scratch_;
+    cost_to_go_linear_[k].noalias() += cross_[k].transpose() * feedforward_[k];
+  }
+
+  step_z_.template segment<kStates>(0, n).setZero();
+  for (size_t k = 0; k < N; ++k) {
+    const auto dx = step_z_.template segment<kStates>(k * n, n);
+    auto du = step_z_.template segment<kControls>(first_control_ + k * m, m);
+    du = feedforward_[k];
+    du.noalias() += gain_[k] * dx;
+    auto dx_next = step_z_.template segment<kStates>((k + 1) * n, n);
+    dx_next = residual_dynamics_.template segment<kStates>(k * n, n);
+    dx_next.noalias() += stage_a_[k] * dx;
+    dx_next.noalias() += stage_b_[k] * du;
+    auto nu = next_dual_dynamics_.template segment<kStates>(k * n, n);
+    nu = cost_to_go_linear_[k + 1];
+    nu.noalias() += cost_to_go_[k + 1] * dx_next;
+  }
+
+  step_slack_lower_ = has_lower_.cwiseProduct(step_z_ + residual_lower_);
+  step_slack_upper_ = has_upper_.cwiseProduct(residual_upper_ - step_z_);
+  step_dual_lower_ = (-(complementarity_lower_.array() +
+                        dual_lower_.array() * step_slack_lower_.array()) /
+                      slack_lower_.array())
+                         .matrix();
+  step_dual_upper_ = (-(complementarity_upper_.array() +
+                        dual_upper_.array() * step_slack_upper_.array()) /
+                      slack_upper_.array())
+                         .matrix();
+}
+
+template <int kStates, int kControls>
+double MpcRiccati<kStates, kControls>::MaxStep() const {
+  double step = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < num_param_; ++i) {
+    if (step_slack_lower_(i) < 0.0) {
+      step = std::min(step, -slack_lower_(i) / step_slack_lower_(i));
+    }
+    if (step_dual_lower_(i) < 0.0) {
+      step = std::min(step, -dual_lower_(i) / step_dual_lower_(i));
+    }
+    if (step_slack_upper_(i) < 0.0) {
+      step = std::min(step, -slack_upper_(i) / step_slack_upper_(i));
+    }
+    if (step_dual_upper_(i) < 0.0) {
+      step = std::min(step, -dual_upper_(i) / step_dual_upper_(i));
+    }
+  }
+  return step;
+}
+
+template <int kStates, int kControls>
+bool MpcRiccati<kStates, kControls>::Solve(std::vector<double> *control_cmd) {
+  const auto start = std::chrono::steady_clock::now();
+  if (!initialized_) {
+    Allocate();
+    initialized_ = true;
+    stats_.workspace_reused = false;
+  } else {
+    stats_.workspace_reused = true;
+  }
+  // g = -Q x_ref, 与MpcOsqp相同
+  vector_scratch_.noalias() = -matrix_q_ * matrix_x_ref_;
+  for (size_t k = 0; k <= horizon_; ++k) {
+    gradient_.template segment<kStates>(k * state_dim_, state_dim_) =
+        vector_scratch_;
+  }
+  InitializeIterate();
+  const double prepare_time_us = std::chrono::duration<double, std::micro>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+  stats_.setup_time_us = stats_.workspace_reused ? 0.0 : prepare_time_us;
+  stats_.assembly_time_us = stats_.setup_time_us;
+  stats_.update_time_us = stats_.workspace_reused ? prepare_time_us : 0.0;
+  stats_.warm_started = false;
+
+  const auto solve_start = std::chrono::steady_clock::now();
+  int status = CenterStartingPoint() ? kMaxIterationsReached : kUnsolved;
+  int iteration = 0;
+  // 最长一次迭代的耗时, 预计下一次迭代会超时就停止
+  double iteration_time_us = 0.0;
+  auto iteration_start = solve_start;
+  for (; status == kMaxIterationsReached; ++iteration) {
+    const auto now = std::chrono::steady_clock::now();
+    iteration_time_us = std::max(
+        iteration_time_us,
+        std::chrono::duration<double, std::micro>(now - iteration_start)
+            .count());
+    iteration_start = now;
+    const double residual = CalculateResiduals();
+    const double mu =
+        num_bounds_ > 0 ? (slack_lower_.dot(dual_lower_) +
+                           slack_upper_.dot(dual_upper_)) /
+                              num_bounds_
+                        : 0.0;
+    if (residual <= eps_abs_ && mu <= eps_abs_) {
+      status = kSolved;
+      break;
+    }
+    if (iteration >= max_iteration_) {
+      break;
+    }
+    if (time_limit_us_ > 0.0 &&
+        std::chrono::duration<double, std::micro>(now - start).count() +
+                iteration_time_us >
+            time_limit_us_) {
+      status = kTimeLimitReached;
+      break;
+    }
+    if (!FactorizeNewtonSystem()) {
+      status = kUnsolved;
+      break;
+    }
+
+    // 预测步: 目标互补量为零
+    complementarity_lower_ = slack_lower_.cwiseProduct(dual_lower_);
+    complementarity_upper_ = slack_upper_.cwiseProduct(dual_upper_);
+    SolveNewtonSystem();
+    if (num_bounds_ > 0) {
+      // 校正步: 中心化参数 sigma = (mu_aff / mu)^3, 加二阶项
+      const double affine_step = std::min(1.0, MaxStep());
+      const double mu_affine =
+          (((slack_lower_ + affine_step * step_slack_lower_).array() *
+            (dual_lower_ + affine_step * step_dual_lower_).array())
+               .sum() +
+           ((slack_upper_ + affine_step * step_slack_upper_).array() *
+            (dual_upper_ + affine_step * step_dual_upper_).array())
+               .sum()) /
+          num_bounds_;
+      const double sigma = std::pow(mu_affine / mu, 3);
+      complementarity_lower_ =
+          (complementarity_lower_.array() +
+           step_slack_lower_.array() * step_dual_lower_.array() -
+           sigma * mu * has_lower_.array())
+              .matrix();
+      complementarity_upper_ =
+          (complementarity_upper_.array() +
+           step_slack_upper_.array() * step_dual_upper_.array() -
+           sigma * mu * has_upper_.array())
+              .matrix();
+      SolveNewtonSystem();
+    }
+
+    const double step = std::min(1.0, kStepFraction * MaxStep());
+    z_ += step * step_z_;
+    slack_lower_ += step * step_slack_lower_;
+    slack_upper_ += step * step_slack_upper_;
+    dual_lower_ += step * step_dual_lower_;
+    dual_upper_ += step * step_dual_upper_;
+    dual_dynamics_ += step * (next_dual_dynamics_ - dual_dynamics_);
+  }
+  stats_.solve_time_us = std::chrono::duration<double, std::micro>(
+                             std::chrono::steady_clock::now() - solve_start)
+                             .count();
+  stats_.iterations = iteration;
+  stats_.status = status;
+  stats_.deadline_reached = status == kTimeLimitReached;
+  // 残差在最后一次收敛判断时计算, 对应当前迭代值
+  stats_.primal_residual =
+      status == kUnsolved
+          ? std::numeric_limits<double>::infinity()
+          : std::max({residual_dynamics_.template lpNorm<Eigen::Infinity>(),
+                      residual_lower_.template lpNorm<Eigen::Infinity>(),
+                      residual_upper_.template lpNorm<Eigen::Infinity>()});
+  if (status != kSolved) {
+    return false;
+  }
+  for (size_t i = 0; i < control_dim_; ++i) {
+    control_cmd->at(i) = z_(first_control_ + i);
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+bool MpcRiccati<kStates, kControls>::LastIterate(
+    std::vector<double> *control_cmd) const {
+  if (stats_.status != kTimeLimitReached &&
+      stats_.status != kMaxIterationsReached) {
+    return false;
+  }
+  for (size_t i = 0; i < control_dim_; ++i) {
+    control_cmd->at(i) = z_(first_control_ + i);
+  }
+  return true;
+}
+
+template <int kStates, int kControls>
+bool MpcRiccati<kStates, kControls>::ControlSequence(
+    Eigen::VectorXd *controls) const {
+  if (stats_.status != kSolved) {
+    return false;
+  }
+  *controls = z_.tail(control_dim_ * horizon_);
+  return true;
+}
+
+template <int kStates, int kControls>
+size_t MpcRiccati<kStates, kControls>::MemoryBytes() const {
+  const size_t n = state_dim_;
+  const size_t m = control_dim_;
+  const size_t vectors =
+      hessian_diagonal_.size() + gradient_.size() + lower_bound_.size() +
+      upper_bound_.size() + has_lower_.size() + has_upper_.size() +
+      z_.size() + slack_lower_.size() + slack_upper_.size() +
+      dual_lower_.size() + dual_upper_.size() + dual_dynamics_.size() +
+      residual_dynamics_.size() + residual_stationarity_.size() +
+      residual_lower_.size() + residual_upper_.size() +
+      complementarity_lower_.size() + complementarity_upper_.size() +
+      barrier_.size() + newton_gradient_.size() + step_z_.size() +
+      step_slack_lower_.size() + step_slack_upper_.size() +
+      step_dual_lower_.size() + step_dual_upper_.size() +
+      next_dual_dynamics_.size();
+  const size_t model = stage_a_.capacity() * n * n +
+                       stage_b_.capacity() * n * m + stage_c_.capacity() * n;
+  const size_t factors = cost_to_go_.capacity() * n * n +
+                         cost_to_go_linear_.capacity() * n +
+                         (cross_.capacity() + gain_.capacity()) * m * n +
+                         feedforward_.capacity() * m +
+                         control_factor_.capacity() * m * m;
+  return (vectors + model + factors) * sizeof(double);
+}
+
+template class MpcRiccati<6, 2>;
+template class MpcRiccati<Eigen::Dynamic, Eigen::Dynamic>;
+
+}  // namespace control
+}  // namespace shenlan
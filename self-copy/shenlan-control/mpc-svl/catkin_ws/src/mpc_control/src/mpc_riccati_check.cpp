@@ -0,0 +1,233 @@
+/**
+ * Cross-check of the Riccati interior-point MPC solver against OSQP on
+ * randomized problems. Each problem draws the state and control counts
+ * (2..8, 1..3), the horizon (5..60), a mildly unstable or stable model
+ * A = I + dt * random, random B, a diagonal Q with some zero weights, a
+ * positive diagonal R, control limits, finite limits on about a third of
+ * the states, an initial state inside the limits and a reference, then
+ * solves it with MpcRiccati, MpcOsqp (tight tolerances, polished) and
+ * MpcCondensed (exact active set). The first control of the three is
+ * compared; a problem counts as a mismatch when the Riccati solution is
+ * further than the tolerance from OSQP while both report success. OSQP
+ * runs with absolute and relative tolerance 1e-7; with its default relative
+ * tolerance of 1e-3 the first control can be off by 1e-2 when the unstable
+ * models drive the states to large values. Every
+ * fifth problem uses the 6x2 fixed-size instantiation of the controller.
+ * Exits with 1 on any mismatch or when the Riccati solver fails on a
+ * problem OSQP or the active-set solver solves. Random state limits make
+ * part of the problems infeasible; those are counted and skipped.
+ *
+ * usage: mpc_riccati_check [problems] [seed]
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "mpc_condensed.h"
+#include "mpc_osqp.h"
+#include "mpc_riccati.h"
+
+using shenlan::control::MpcCondensed;
+using shenlan::control::MpcOsqp;
+using shenlan::control::MpcRiccati;
+
+namespace {
+
+// 首个控制量与OSQP之差的容许值(乘以max(1, |u0|))
+constexpr double kOsqpTolerance = 1e-4;
+// 与精确有效集解之差的容许值; 不稳定模型的长预测步长下压缩后的H条件数
+// 随A^N增长, 有效集解本身只有1e-5量级的精度
+constexpr double kCondensedTolerance = 1e-4;
+
+struct CheckResult {
+  bool riccati_solved = false;
+  bool osqp_solved = false;
+  bool condensed_solved = false;
+  double osqp_difference = 0.0;
+  double condensed_difference = 0.0;
+  double scale = 0.0;
+  int iterations = 0;
+  double solve_time_us = 0.0;
+};
+
+template <int N, int M>
+CheckResult CheckProblem(std::mt19937 *generator, const int n, const int m,
+                         const int horizon) {
+  typedef MpcOsqp<N, M> Osqp;
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  auto random = [&]() { return uniform(*generator); };
+
+  typename Osqp::StateMatrix a = Osqp::StateMatrix::Identity(n, n);
+  const double dt = 0.01 + 0.04 * unit(*generator);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      a(i, j) += dt * random();
+    }
+  }
+  typename Osqp::ControlMatrix b(n, m);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < m; ++j) {
+      b(i, j) = dt * random();
+    }
+  }
+  typename Osqp::StateMatrix q = Osqp::StateMatrix::Zero(n, n);
+  for (int i = 0; i < n; ++i) {
+    q(i, i) = unit(*generator) < 0.3 ? 0.0 : 10.0 * unit(*generator);
+  }
+  typename Osqp::ControlWeightMatrix r =
+      Osqp::ControlWeightMatrix::Zero(m, m);
+  for (int i = 0; i < m; ++i) {
+    r(i, i) = 0.1 + 5.0 * unit(*generator);
+  }
+
+  const double max = std::numeric_limits<double>::max();
+  typename Osqp::ControlVector u_lower(m);
+  typename Osqp::ControlVector u_upper(m);
+  for (int i = 0; i < m; ++i) {
+    u_lower(i) = -(0.2 + 2.0 * unit(*generator));
+    u_upper(i) = 0.2 + 2.0 * unit(*generator);
+  }
+  typename Osqp::StateVector x_lower(n);
+  typename Osqp::StateVector x_upper(n);
+  typename Osqp::StateVector x0(n);
+  typename Osqp::StateVector x_ref(n);
+  for (int i = 0; i < n; ++i) {
+    if (unit(*generator) < 0.3) {
+      x_lower(i) = -(0.5 + 3.0 * unit(*generator));
+      x_upper(i) = 0.5 + 3.0 * unit(*generator);
+      x0(i) = x_lower(i) + (x_upper(i) - x_lower(i)) * unit(*generator);
+    } else {
+      x_lower(i) = -max;
+      x_upper(i) = max;
+      x0(i) = 2.0 * random();
+    }
+    x_ref(i) = 0.5 * random();
+  }
+
+  CheckResult result;
+  std::vector<double> riccati_u(m, 0.0);
+  std::vector<double> osqp_u(m, 0.0);
+  std::vector<double> condensed_u(m, 0.0);
+  MpcRiccati<N, M> riccati(a, b, q, r, x0, u_lower, u_upper, x_lower,
+                           x_upper, x_ref, 100, horizon, 1e-9);
+  result.riccati_solved = riccati.Solve(&riccati_u);
+  result.iterations = riccati.stats().iterations;
+  result.solve_time_us = riccati.stats().solve_time_us;
+  Osqp osqp(a, b, q, r, x0, u_lower, u_upper, x_lower, x_upper, x_ref,
+            20000, horizon, 1e-7);
+  osqp.SetPolish(true);
+  osqp.SetRelativeTolerance(1e-7);
+  osqp.SetWarmStart(shenlan::control::WarmStartMode::kCold);
+  result.osqp_solved = osqp.Solve(&osqp_u);
+  MpcCondensed<N, M> condensed(a, b, q, r, x0, u_lower, u_upper, x_lower,
+                               x_upper, x_ref, 10000, horizon, 0.0);
+  result.condensed_solved = condensed.Solve(&condensed_u);
+
+  for (int i = 0; i < m; ++i) {
+    result.osqp_difference =
+        std::max(result.osqp_difference, std::fabs(riccati_u[i] - osqp_u[i]));
+    result.condensed_difference =
+        std::max(result.condensed_difference,
+                 std::fabs(riccati_u[i] - condensed_u[i]));
+    result.scale = std::max(result.scale, std::fabs(riccati_u[i]));
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const int num_problems = argc > 1 ? std::atoi(argv[1]) : 500;
+  const unsigned seed = argc > 2 ? std::atoi(argv[2]) : 1;
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> states(2, 8);
+  std::uniform_int_distribution<int> controls(1, 3);
+  std::uniform_int_distribution<int> horizons(5, 60);
+
+  int infeasible = 0;
+  int osqp_compared = 0;
+  int riccati_failed = 0;
+  int osqp_mismatches = 0;
+  int condensed_compared = 0;
+  int condensed_mismatches = 0;
+  double max_osqp_difference = 0.0;
+  double max_condensed_difference = 0.0;
+  double iterations = 0.0;
+  int max_iterations = 0;
+  double solve_time_us = 0.0;
+  int riccati_solved = 0;
+  for (int k = 0; k < num_problems; ++k) {
+    const int horizon = horizons(generator);
+    CheckResult result;
+    if (k % 5 == 0) {
+      result = CheckProblem<6, 2>(&generator, 6, 2, horizon);
+    } else {
+      const int n = states(generator);
+      const int m = controls(generator);
+      result = CheckProblem<Eigen::Dynamic, Eigen::Dynamic>(&generator, n, m,
+                                                            horizon);
+    }
+    if (result.riccati_solved) {
+      ++riccati_solved;
+      iterations += result.iterations;
+      max_iterations = std::max(max_iterations, result.iterations);
+      solve_time_us += result.solve_time_us;
+    }
+    if (!result.osqp_solved && !result.condensed_solved) {
+      ++infeasible;
+      continue;
+    }
+    if (!result.riccati_solved) {
+      ++riccati_failed;
+      continue;
+    }
+    if (result.osqp_solved) {
+      ++osqp_compared;
+      max_osqp_difference =
+          std::max(max_osqp_difference, result.osqp_difference);
+      if (result.osqp_difference >
+          kOsqpTolerance * std::max(1.0, result.scale)) {
+        ++osqp_mismatches;
+      }
+    }
+    if (result.condensed_solved) {
+      ++condensed_compared;
+      max_condensed_difference =
+          std::max(max_condensed_difference, result.condensed_difference);
+      if (result.condensed_difference >
+          kCondensedTolerance * std::max(1.0, result.scale)) {
+        ++condensed_mismatches;
+      }
+    }
+  }
+
+  std::cout << num_problems << " random problems, seed " << seed << std::endl
+            << "  solved by neither reference:    " << infeasible << std::endl
+            << "  Riccati failed on a solved one: " << riccati_failed
+            << std::endl
+            << "  Riccati iterations mean/max:    " << std::fixed
+            << std::setprecision(1)
+            << (riccati_solved > 0 ? iterations / riccati_solved : 0.0)
+            << " / " << max_iterations << std::endl
+            << "  Riccati solve time mean:        "
+            << (riccati_solved > 0 ? solve_time_us / riccati_solved : 0.0)
+            << " us" << std::endl
+            << std::scientific << std::setprecision(2)
+            << "  max |u0 - u0_osqp|:             " << max_osqp_difference
+            << " over " << osqp_compared << ", " << osqp_mismatches
+            << " above " << kOsqpTolerance << std::endl
+            << "  max |u0 - u0_condensed|:        "
+            << max_condensed_difference << " over " << condensed_compared
+            << ", " << condensed_mismatches << " above "
+            << kCondensedTolerance << std::endl;
+  const bool passed = riccati_failed == 0 && osqp_mismatches == 0 &&
+                      condensed_mismatches == 0;
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+#include "mpc_rti.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// 1 - kappa * e_y的下限: 车辆越过曲率中心时模型没有意义, 保持导数有界
+constexpr double kMinPathScale = 0.1;
+
+}  // namespace
+
+MpcRti::MpcRti(const double wheelbase, const double ts,
+               const StateMatrix &matrix_q, const ControlWeightMatrix &matrix_r,
+               const ControlVector &matrix_u_lower,
+               const ControlVector &matrix_u_upper,
+               const StateVector &matrix_x_lower,
+               const StateVector &matrix_x_upper, const int max_iter,
+               const int horizon, const double eps_abs)
+    : wheelbase_(wheelbase),
+      ts_(ts),
+      horizon_(horizon),
+      qp_(StateMatrix::Identity(), ControlMatrix::Zero(), matrix_q, matrix_r,
+          StateVector::Zero(), matrix_u_lower, matrix_u_upper, matrix_x_lower,
+          matrix_x_upper, StateVector::Zero(), max_iter, horizon, eps_abs),
+      matrix_initial_x_(StateVector::Zero()),
+      kappa_(horizon + 1, 0.0),
+      speed_(horizon + 1, 0.0),
+      states_(horizon + 1, StateVector::Zero()),
+      controls_(horizon, ControlVector::Zero()),
+      stage_a_(horizon, StateMatrix::Identity()),
+      stage_b_(horizon, ControlMatrix::Zero()),
+      stage_c_(horizon, StateVector::Zero()) {
+  // 每个周期的线性化点都来自上一周期的解, 移位热启动与之一致
+  qp_.SetWarmStart(WarmStartMode::kShifted);
+}
+
+void MpcRti::Update(const StateVector &matrix_initial_x,
+                    const std::vector<double> &kappa,
+                    const std::vector<double> &speed) {
+  matrix_initial_x_ = matrix_initial_x;
+  std::copy(kappa.begin(), kappa.begin() + horizon_ + 1, kappa_.begin());
+  std::copy(speed.begin(), speed.begin() + horizon_ + 1, speed_.begin());
+}
+
+MpcRti::StateVector MpcRti::Step(const StateVector &x, const ControlVector &u,
+                                 const double kappa, const double speed,
+                                 const double next_speed) const {
+  const double v = speed + x(2);
+  const double path_scale = std::max(1.0 - kappa * x(0), kMinPathScale);
+  const double s_dot = v * std::cos(x(1)) / path_scale;
+  StateVector next = x;
+  next(0) += ts_ * v * std::sin(x(1));
+  next(1) += ts_ * (v * std::tan(u(0)) / wheelbase_ - kappa * s_dot);
+  // 速度误差: 加速度, 减去参考速度在两步之间的变化
+  next(2) += ts_ * u(1) + speed - next_speed;
+  return next;
+}
+
+// x_(k+1) = f(x_k, u_k)在(x, u)处的一阶展开
+void MpcRti::Linearize(const size_t k, const StateVector &x,
+                       const ControlVector &u) {
+  const double kappa = kappa_[k];
+  const double v = speed_[k] + x(2);
+  const double cos_psi = std::cos(x(1));
+  const double sin_psi = std::sin(x(1));
+  const double tan_delta = std::tan(u(0));
+  const double cos_delta = std::cos(u(0));
+  const double raw_scale = 1.0 - kappa * x(0);
+  const double path_scale = std::max(raw_scale, kMinPathScale);
+  // s' = v cos(e_psi) / (1 - kappa e_y)对各状态的偏导; 下限处对e_y的导数为0
+  const double ds_dey = raw_scale > kMinPathScale
+                            ? v * cos_psi * kappa / (path_scale * path_scale)
+                            : 0.0;
+  const double ds_depsi = -v * sin_psi / path_scale;
+  const double ds_dev = cos_psi / path_scale;
+
+  StateMatrix &matrix_a = stage_a_[k];
+  matrix_a.setIdentity();
+  matrix_a(0, 1) += ts_ * v * cos_psi;
+  matrix_a(0, 2) += ts_ * sin_psi;
+  matrix_a(1, 0) += -ts_ * kappa * ds_dey;
+  matrix_a(1, 1) += -ts_ * kappa * ds_depsi;
+  matrix_a(1, 2) += ts_ * (tan_delta / wheelbase_ - kappa * ds_dev);
+
+  ControlMatrix &matrix_b = stage_b_[k];
+  matrix_b.setZero();
+  matrix_b(1, 0) = ts_ * v / (wheelbase_ * cos_delta * cos_delta);
+  matrix_b(2, 1) = ts_;
+
+  StateVector &matrix_c = stage_c_[k];
+  matrix_c = Step(x, u, kappa, speed_[k], speed_[k + 1]);
+  matrix_c.noalias() -= matrix_a * x;
+  matrix_c.noalias() -= matrix_b * u;
+}
+
+void MpcRti::Rollout() {
+  states_[0] = matrix_initial_x_;
+  for (size_t k = 0; k < horizon_; ++k) {
+    controls_[k].setZero();
+    states_[k + 1] = Step(states_[k], controls_[k], kappa_[k], speed_[k],
+                          speed_[k + 1]);
+  }
+}
+
+bool MpcRti::Solve(std::vector<double> *control_cmd) {
+  const auto start = std::chrono::steady_clock::now();
+  if (trajectory_valid_) {
+    // 上一周期的预测轨迹前移一步, 末步重复
+    for (size_t k = 0; k < horizon_; ++k) {
+      states_[k] = states_[k + 1];
+    }
+    for (size_t k = 0; k + 1 < horizon_; ++k) {
+      controls_[k] = controls_[k + 1];
+    }
+    // 第0步在测得的状态处线性化
+    states_[0] = matrix_initial_x_;
+  } else {
+    Rollout();
+  }
+  for (size_t k = 0; k < horizon_; ++k) {
+    Linearize(k, states_[k], controls_[k]);
+  }
+  qp_.UpdateStages(stage_a_, stage_b_, stage_c_, matrix_initial_x_,
+                   StateVector::Zero());
+  linearization_time_us_ = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+  const bool solved = qp_.Solve(control_cmd);
+  stats_ = qp_.stats();
+  stats_.update_time_us += linearization_time_us_;
+  // 解出时以QP的解作为下一周期的线性化轨迹, 否则下一周期从零输入重新展开
+  trajectory_valid_ = solved && qp_.StateSequence(&states_) &&
+                      qp_.ControlSequence(&control_sequence_);
+  if (trajectory_valid_) {
+    for (size_t k = 0; k < horizon_; ++k) {
+      controls_[k] = control_sequence_.segment<kControls>(k * kControls);
+    }
+  }
+  return solved;
+}
+
+double MpcRti::PredictionError() const {
+  if (!trajectory_valid_) {
+    return 0.0;
+  }
+  double error = 0.0;
+  StateVector x = states_[0];
+  for (size_t k = 0; k < horizon_; ++k) {
+    x = Step(x, controls_[k], kappa_[k], speed_[k], speed_[k + 1]);
+    error = std::max(error, (x - states_[k + 1]).cwiseAbs().maxCoeff());
+  }
+  return error;
+}
+
+size_t MpcRti::MemoryBytes() const {
+  return (kappa_.capacity() + speed_.capacity() + control_sequence_.size()) *
+             sizeof(double) +
+         states_.capacity() * sizeof(StateVector) +
+         controls_.capacity() * sizeof(ControlVector) +
+         stage_a_.capacity() * sizeof(StateMatrix) +
+         stage_b_.capacity() * sizeof(ControlMatrix) +
+         stage_c_.capacity() * sizeof(StateVector) + qp_.MemoryBytes();
+}
+
+}  // namespace control
+}  // namespace shenlan
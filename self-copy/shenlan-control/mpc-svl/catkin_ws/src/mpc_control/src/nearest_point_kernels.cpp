@@ -0,0 +1,246 @@
+#include "nearest_point_kernels.h"
+
+#include <cstdint>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHENLAN_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+template <typename T>
+std::size_t ArgMinScalar(const T *xs, const T *ys, const std::size_t begin,
+                         const std::size_t n, const T x, const T y,
+                         T *best_d2, std::size_t best_index) {
+  for (std::size_t i = begin; i < n; ++i) {
+    const T dx = xs[i] - x;
+    const T dy = ys[i] - y;
+    const T d2 = dx * dx + dy * dy;
+    if (d2 < *best_d2) {
+      *best_d2 = d2;
+      best_index = i;
+    }
+  }
+  return best_index;
+}
+
+// Reduce per-lane minima, lowest index wins a tie so the result matches the
+// scalar scan.
+template <typename T, typename I, int kLanes>
+std::size_t ReduceLanes(const T *lane_d2, const I *lane_index, T *best_d2) {
+  std::size_t best_index = 0;
+  *best_d2 = std::numeric_limits<T>::max();
+  for (int lane = 0; lane < kLanes; ++lane) {
+    const std::size_t index = static_cast<std::size_t>(lane_index[lane]);
+    if (lane_d2[lane] < *best_d2 ||
+        (lane_d2[lane] == *best_d2 && index < best_index)) {
+      *best_d2 = lane_d2[lane];
+      best_index = index;
+    }
+  }
+  return best_index;
+}
+
+#ifdef SHENLAN_X86_SIMD
+
+__attribute__((target("sse2"))) std::size_t ArgMinSse2(
+    const double *xs, const double *ys, const std::size_t n, const double x,
+    const double y, double *best_d2) {
+  const __m128d qx = _mm_set1_pd(x);
+  const __m128d qy = _mm_set1_pd(y);
+  __m128d min_d2 = _mm_set1_pd(std::numeric_limits<double>::max());
+  __m128d min_index = _mm_setzero_pd();
+  __m128d index = _mm_set_pd(1.0, 0.0);
+  const __m128d step = _mm_set1_pd(2.0);
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), qx);
+    const __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), qy);
+    const __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    const __m128d less = _mm_cmplt_pd(d2, min_d2);
+    min_d2 = _mm_or_pd(_mm_and_pd(less, d2), _mm_andnot_pd(less, min_d2));
+    min_index =
+        _mm_or_pd(_mm_and_pd(less, index), _mm_andnot_pd(less, min_index));
+    index = _mm_add_pd(index, step);
+  }
+  double lane_d2[2];
+  double lane_index[2];
+  _mm_storeu_pd(lane_d2, min_d2);
+  _mm_storeu_pd(lane_index, min_index);
+  const std::size_t best_index =
+      ReduceLanes<double, double, 2>(lane_d2, lane_index, best_d2);
+  return ArgMinScalar(xs, ys, i, n, x, y, best_d2, best_index);
+}
+
+__attribute__((target("avx2"))) std::size_t ArgMinAvx2(
+    const double *xs, const double *ys, const std::size_t n, const double x,
+    const double y, double *best_d2) {
+  const __m256d qx = _mm256_set1_pd(x);
+  const __m256d qy = _mm256_set1_pd(y);
+  __m256d min_d2 = _mm256_set1_pd(std::numeric_limits<double>::max());
+  __m256d min_index = _mm256_setzero_pd();
+  __m256d index = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+  const __m256d step = _mm256_set1_pd(4.0);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), qx);
+    const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), qy);
+    const __m256d d2 =
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    const __m256d less = _mm256_cmp_pd(d2, min_d2, _CMP_LT_OQ);
+    min_d2 = _mm256_blendv_pd(min_d2, d2, less);
+    min_index = _mm256_blendv_pd(min_index, index, less);
+    index = _mm256_add_pd(index, step);
+  }
+  double lane_d2[4];
+  double lane_index[4];
+  _mm256_storeu_pd(lane_d2, min_d2);
+  _mm256_storeu_pd(lane_index, min_index);
+  const std::size_t best_index =
+      ReduceLanes<double, double, 4>(lane_d2, lane_index, best_d2);
+  return ArgMinScalar(xs, ys, i, n, x, y, best_d2, best_index);
+}
+
+__attribute__((target("sse2"))) std::size_t ArgMinSse2(
+    const float *xs, const float *ys, const std::size_t n, const float x,
+    const float y, float *best_d2) {
+  const __m128 qx = _mm_set1_ps(x);
+  const __m128 qy = _mm_set1_ps(y);
+  __m128 min_d2 = _mm_set1_ps(std::numeric_limits<float>::max());
+  __m128i min_index = _mm_setzero_si128();
+  __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i step = _mm_set1_epi32(4);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), qx);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), qy);
+    const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    const __m128 less = _mm_cmplt_ps(d2, min_d2);
+    const __m128i less_i = _mm_castps_si128(less);
+    min_d2 = _mm_or_ps(_mm_and_ps(less, d2), _mm_andnot_ps(less, min_d2));
+    min_index = _mm_or_si128(_mm_and_si128(less_i, index),
+                             _mm_andnot_si128(less_i, min_index));
+    index = _mm_add_epi32(index, step);
+  }
+  float lane_d2[4];
+  std::int32_t lane_index[4];
+  _mm_storeu_ps(lane_d2, min_d2);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lane_index), min_index);
+  const std::size_t best_index =
+      ReduceLanes<float, std::int32_t, 4>(lane_d2, lane_index, best_d2);
+  return ArgMinScalar(xs, ys, i, n, x, y, best_d2, best_index);
+}
+
+__attribute__((target("avx2"))) std::size_t ArgMinAvx2(
+    const float *xs, const float *ys, const std::size_t n, const float x,
+    const float y, float *best_d2) {
+  const __m256 qx = _mm256_set1_ps(x);
+  const __m256 qy = _mm256_set1_ps(y);
+  __m256 min_d2 = _mm256_set1_ps(std::numeric_limits<float>::max());
+  __m256i min_index = _mm256_setzero_si256();
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i step = _mm256_set1_epi32(8);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), qx);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), qy);
+    const __m256 d2 =
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const __m256 less = _mm256_cmp_ps(d2, min_d2, _CMP_LT_OQ);
+    min_d2 = _mm256_blendv_ps(min_d2, d2, less);
+    min_index =
+        _mm256_blendv_epi8(min_index, index, _mm256_castps_si256(less));
+    index = _mm256_add_epi32(index, step);
+  }
+  float lane_d2[8];
+  std::int32_t lane_index[8];
+  _mm256_storeu_ps(lane_d2, min_d2);
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lane_index), min_index);
+  const std::size_t best_index =
+      ReduceLanes<float, std::int32_t, 8>(lane_d2, lane_index, best_d2);
+  return ArgMinScalar(xs, ys, i, n, x, y, best_d2, best_index);
+}
+
+#endif  // SHENLAN_X86_SIMD
+
+SimdLevel SupportedLevel(const SimdLevel level) {
+  return level < DetectSimdLevel() ? level : DetectSimdLevel();
+}
+
+template <typename T>
+std::size_t Dispatch(const T *xs, const T *ys, const std::size_t n, const T x,
+                     const T y, T *d2_min, const SimdLevel level) {
+  T best_d2 = std::numeric_limits<T>::max();
+  std::size_t best_index = 0;
+  switch (SupportedLevel(level)) {
+#ifdef SHENLAN_X86_SIMD
+    case SimdLevel::kAvx2:
+      best_index = ArgMinAvx2(xs, ys, n, x, y, &best_d2);
+      break;
+    case SimdLevel::kSse2:
+      best_index = ArgMinSse2(xs, ys, n, x, y, &best_d2);
+      break;
+#endif
+    default:
+      best_index = ArgMinScalar(xs, ys, 0, n, x, y, &best_d2, 0);
+      break;
+  }
+  if (d2_min != nullptr) {
+    *d2_min = best_d2;
+  }
+  return best_index;
+}
+
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+#ifdef SHENLAN_X86_SIMD
+  static const SimdLevel level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdLevel::kAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return SimdLevel::kSse2;
+    }
+    return SimdLevel::kScalar;
+  }();
+  return level;
+#else
+  return SimdLevel::kScalar;
+#endif
+}
+
+std::size_t ArgMinDistanceSquare(const double *xs, const double *ys,
+                                 const std::size_t n, const double x,
+                                 const double y, double *d2_min) {
+  return Dispatch(xs, ys, n, x, y, d2_min, DetectSimdLevel());
+}
+
+std::size_t ArgMinDistanceSquare(const double *xs, const double *ys,
+                                 const std::size_t n, const double x,
+                                 const double y, double *d2_min,
+                                 const SimdLevel level) {
+  return Dispatch(xs, ys, n, x, y, d2_min, level);
+}
+
+std::size_t ArgMinDistanceSquare(const float *xs, const float *ys,
+                                 const std::size_t n, const float x,
+                                 const float y, float *d2_min) {
+  return Dispatch(xs, ys, n, x, y, d2_min, DetectSimdLevel());
+}
+
+std::size_t ArgMinDistanceSquare(const float *xs, const float *ys,
+                                 const std::size_t n, const float x,
+                                 const float y, float *d2_min,
+                                 const SimdLevel level) {
+  return Dispatch(xs, ys, n, x, y, d2_min, level);
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,365 @@
+#include "reference_line_smoother.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "osqp/osqp.h"
+#include "reference_line.h"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// 小于该距离的相邻点视为重复点 [m]
+constexpr double kRepeatedPoint = 1e-3;
+
+double ElapsedMs(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// 曲率(及累积弧长), 与消费方用的ReferenceLine::ComputePathProfile相同
+void Curvature(const ReferenceLineSmoother::Points &points,
+               std::vector<double> *accumulated_s,
+               std::vector<double> *kappas) {
+  const std::size_t size = points.size();
+  std::vector<double> headings(size);
+  std::vector<double> dkappas(size);
+  accumulated_s->resize(size);
+  kappas->resize(size);
+  ReferenceLine::ComputePathProfile(points.data(), size, headings.data(),
+                                    accumulated_s->data(), kappas->data(),
+                                    dkappas.data());
+}
+
+// 点m到弦(a, b)的距离
+double ChordDistance(const std::pair<double, double> &a,
+                     const std::pair<double, double> &b,
+                     const std::pair<double, double> &m) {
+  const double dx = b.first - a.first;
+  const double dy = b.second - a.second;
+  const double length = std::hypot(dx, dy);
+  const double mx = m.first - a.first;
+  const double my = m.second - a.second;
+  return length > 0.0 ? std::fabs(dx * my - dy * mx) / length
+                      : std::hypot(mx, my);
+}
+
+}  // namespace
+
+ReferenceLineSmoother::ReferenceLineSmoother(
+    const ReferenceLineSmootherConfig &config)
+    : config_(config) {}
+
+bool ReferenceLineSmoother::Smooth(const Points &raw, Points *output) {
+  output->clear();
+  stats_ = ReferenceLineSmootherStats();
+  stats_.raw_points = raw.size();
+
+  auto start = std::chrono::steady_clock::now();
+  Points anchors;
+  Resample(raw, config_.resample_spacing, &anchors);
+  stats_.resampled_points = anchors.size();
+  stats_.resample_time_ms = ElapsedMs(start);
+  if (anchors.size() < 3) {
+    return false;
+  }
+
+  Points smoothed;
+  if (!SolveQp(anchors, &smoothed)) {
+    return false;
+  }
+
+  start = std::chrono::steady_clock::now();
+  Decimate(smoothed, output);
+  stats_.decimate_time_ms = ElapsedMs(start);
+  stats_.output_points = output->size();
+  return true;
+}
+
+void ReferenceLineSmoother::Resample(const Points &raw, const double spacing,
+                                     Points *resampled) {
+  resampled->clear();
+  Points unique;
+  unique.reserve(raw.size());
+  std::vector<double> s;
+  s.reserve(raw.size());
+  for (const auto &point : raw) {
+    if (!unique.empty() &&
+        std::hypot(point.first - unique.back().first,
+                   point.second - unique.back().second) < kRepeatedPoint) {
+      continue;
+    }
+    s.push_back(unique.empty() ? 0.0
+                               : s.back() + std::hypot(
+                                                point.first -
+                                                    unique.back().first,
+                                                point.second -
+                                                    unique.back().second));
+    unique.push_back(point);
+  }
+  if (unique.size() < 2 || !(spacing > 0.0)) {
+    *resampled = unique;
+    return;
+  }
+
+  const double length = s.back();
+  const std::size_t size =
+      static_cast<std::size_t>(std::ceil(length / spacing)) + 1;
+  const double step = length / (size - 1);
+  resampled->resize(size);
+  std::size_t j = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    if (i + 1 == size) {
+      (*resampled)[i] = unique.back();
+      break;
+    }
+    const double station = i * step;
+    while (j + 2 < unique.size() && s[j + 1] <= station) {
+      ++j;
+    }
+    const double ratio = (station - s[j]) / (s[j + 1] - s[j]);
+    (*resampled)[i] = std::make_pair(
+        unique[j].first + ratio * (unique[j + 1].first - unique[j].first),
+        unique[j].second + ratio * (unique[j + 1].second - unique[j].second));
+  }
+}
+
+bool ReferenceLineSmoother::SolveQp(const Points &anchors, Points *smoothed) {
+  const auto setup_start = std::chrono::steady_clock::now();
+  const std::size_t num_points = anchors.size();
+  const std::size_t n = 2 * num_points;
+
+  // 单个坐标的代价矩阵M是五对角的, band[k][i] = M(i, i + k);
+  // 1/2 z'Pz中P = 2M, x和y各一块
+  std::vector<double> band[3];
+  for (auto &diagonal : band) {
+    diagonal.assign(num_points, 0.0);
+  }
+  const double second[3] = {1.0, -2.0, 1.0};
+  for (std::size_t r = 0; r + 2 < num_points; ++r) {
+    for (int a = 0; a < 3; ++a) {
+      for (int b = a; b < 3; ++b) {
+        band[b - a][r + a] += config_.weight_smooth * second[a] * second[b];
+      }
+    }
+  }
+  for (std::size_t r = 0; r + 1 < num_points; ++r) {
+    band[0][r] += config_.weight_length;
+    band[0][r + 1] += config_.weight_length;
+    band[1][r] -= config_.weight_length;
+  }
+  for (std::size_t i = 0; i < num_points; ++i) {
+    band[0][i] += config_.weight_deviation;
+  }
+
+  // P的上三角, 按列存储: 第j列是M(j - 2, j), M(j - 1, j), M(j, j)
+  std::vector<c_float> P_data;
+  std::vector<c_int> P_indices;
+  std::vector<c_int> P_indptr;
+  P_data.reserve(3 * n);
+  P_indices.reserve(3 * n);
+  P_indptr.reserve(n + 1);
+  P_indptr.push_back(0);
+  for (std::size_t block = 0; block < 2; ++block) {
+    const std::size_t offset = block * num_points;
+    for (std::size_t j = 0; j < num_points; ++j) {
+      for (std::size_t k = std::min<std::size_t>(j, 2); k > 0; --k) {
+        P_data.push_back(2.0 * band[k][j - k]);
+        P_indices.push_back(offset + j - k);
+      }
+      P_data.push_back(2.0 * band[0][j]);
+      P_indices.push_back(offset + j);
+      P_indptr.push_back(P_data.size());
+    }
+  }
+
+  // 约束矩阵为单位阵, 上下界是以原始点为中心的方框, 端点固定
+  std::vector<c_float> A_data(n, 1.0);
+  std::vector<c_int> A_indices(n);
+  std::vector<c_int> A_indptr(n + 1);
+  std::vector<c_float> q(n);
+  std::vector<c_float> lower(n);
+  std::vector<c_float> upper(n);
+  std::vector<c_float> primal(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    A_indices[i] = i;
+    A_indptr[i] = i;
+    const std::size_t point = i % num_points;
+    const double reference =
+        i < num_points ? anchors[point].first : anchors[point].second;
+    const double bound = point == 0 || point + 1 == num_points
+                             ? 0.0
+                             : config_.max_deviation;
+    q[i] = -2.0 * config_.weight_deviation * reference;
+    lower[i] = reference - bound;
+    upper[i] = reference + bound;
+    primal[i] = reference;
+  }
+  A_indptr[n] = n;
+
+  OSQPData *data = reinterpret_cast<OSQPData *>(c_malloc(sizeof(OSQPData)));
+  OSQPSettings *settings =
+      reinterpret_cast<OSQPSettings *>(c_malloc(sizeof(OSQPSettings)));
+  if (data == nullptr || settings == nullptr) {
+    c_free(data);
+    c_free(settings);
+    return false;
+  }
+  data->n = n;
+  data->m = n;
+  data->P = csc_matrix(n, n, P_data.size(), P_data.data(), P_indices.data(),
+                       P_indptr.data());
+  data->q = q.data();
+  data->A = csc_matrix(n, n, A_data.size(), A_data.data(), A_indices.data(),
+                       A_indptr.data());
+  data->l = lower.data();
+  data->u = upper.data();
+  osqp_set_default_settings(settings);
+  settings->polish = true;
+  settings->warm_start = true;
+  settings->verbose = false;
+  settings->max_iter = config_.max_iteration;
+  settings->eps_abs = config_.eps_abs;
+  settings->eps_rel = config_.eps_rel;
+
+  OSQPWorkspace *workspace = osqp_setup(data, settings);
+  c_free(data->A);
+  c_free(data->P);
+  c_free(data);
+  c_free(settings);
+  stats_.setup_time_ms = ElapsedMs(setup_start);
+  if (workspace == nullptr) {
+    return false;
+  }
+
+  // 从原始点出发, 约束为方框, 对偶变量从零开始
+  const std::vector<c_float> dual(n, 0.0);
+  osqp_warm_start(workspace, primal.data(), dual.data());
+  const auto solve_start = std::chrono::steady_clock::now();
+  osqp_solve(workspace);
+  stats_.solve_time_ms = ElapsedMs(solve_start);
+  stats_.iterations = static_cast<int>(workspace->info->iter);
+  stats_.status = static_cast<int>(workspace->info->status_val);
+  const bool solved =
+      (stats_.status == 1 || stats_.status == 2) &&
+      workspace->solution != nullptr;
+  if (solved) {
+    const c_float *x = workspace->solution->x;
+    smoothed->resize(num_points);
+    stats_.max_deviation = 0.0;
+    for (std::size_t i = 0; i < num_points; ++i) {
+      (*smoothed)[i] = std::make_pair(x[i], x[num_points + i]);
+      stats_.max_deviation = std::max(
+          stats_.max_deviation, std::hypot(x[i] - anchors[i].first,
+                                           x[num_points + i] -
+                                               anchors[i].second));
+    }
+  }
+  osqp_cleanup(workspace);
+  return solved;
+}
+
+void ReferenceLineSmoother::Decimate(const Points &dense, Points *decimated) {
+  decimated->clear();
+  const std::size_t size = dense.size();
+  if (size < 3) {
+    *decimated = dense;
+    return;
+  }
+  std::vector<double> s;
+  std::vector<double> kappa;
+  Curvature(dense, &s, &kappa);
+
+  // 贪心: 弦能替代被跳过的点且曲率在弦上近似线性时继续延长;
+  // 曲率的一半容差留给消费方差分带来的误差
+  std::vector<std::size_t> kept(1, 0);
+  std::size_t i = 0;
+  while (i + 1 < size) {
+    std::size_t reach = i + 1;
+    for (std::size_t j = i + 2;
+         j < size && s[j] - s[i] <= config_.max_spacing; ++j) {
+      bool fits = true;
+      for (std::size_t m = i + 1; m < j && fits; ++m) {
+        const double ratio = (s[m] - s[i]) / (s[j] - s[i]);
+        fits = ChordDistance(dense[i], dense[j], dense[m]) <=
+                   config_.chord_tolerance &&
+               std::fabs(kappa[m] - kappa[i] -
+                         ratio * (kappa[j] - kappa[i])) <=
+                   0.5 * config_.curvature_tolerance;
+      }
+      if (!fits) {
+        break;
+      }
+      reach = j;
+    }
+    kept.push_back(reach);
+    i = reach;
+  }
+
+  // 用消费方的差分检查, 超出容差的线段从中间再加一个点, 直到都满足;
+  // 相邻两点间无法再分时, 误差来自两侧点距不均, 改为细分两侧的线段
+  Points candidate;
+  std::vector<double> candidate_s;
+  std::vector<double> candidate_kappa;
+  std::vector<double> segment_error;
+  std::vector<char> split;
+  stats_.refinements = 0;
+  while (true) {
+    candidate.resize(kept.size());
+    for (std::size_t k = 0; k < kept.size(); ++k) {
+      candidate[k] = dense[kept[k]];
+    }
+    Curvature(candidate, &candidate_s, &candidate_kappa);
+    const std::size_t segments = kept.size() - 1;
+    segment_error.assign(segments, 0.0);
+    split.assign(segments, 0);
+    for (std::size_t k = 0; k < segments; ++k) {
+      const std::size_t a = kept[k];
+      const std::size_t b = kept[k + 1];
+      for (std::size_t m = a; m <= b; ++m) {
+        const double ratio = (s[m] - s[a]) / (s[b] - s[a]);
+        segment_error[k] = std::max(
+            segment_error[k],
+            std::fabs(kappa[m] - candidate_kappa[k] -
+                      ratio * (candidate_kappa[k + 1] - candidate_kappa[k])));
+      }
+      if (segment_error[k] <= config_.curvature_tolerance) {
+        continue;
+      }
+      if (b - a >= 2) {
+        split[k] = 1;
+      } else {
+        if (k > 0 && kept[k] - kept[k - 1] >= 2) {
+          split[k - 1] = 1;
+        }
+        if (k + 1 < segments && kept[k + 2] - kept[k + 1] >= 2) {
+          split[k + 1] = 1;
+        }
+      }
+    }
+    std::vector<std::size_t> refined;
+    refined.reserve(2 * kept.size());
+    for (std::size_t k = 0; k < segments; ++k) {
+      refined.push_back(kept[k]);
+      if (split[k]) {
+        refined.push_back((kept[k] + kept[k + 1]) / 2);
+      }
+    }
+    refined.push_back(kept.back());
+    if (refined.size() == kept.size()) {
+      stats_.max_curvature_error =
+          *std::max_element(segment_error.begin(), segment_error.end());
+      break;
+    }
+    kept.swap(refined);
+    ++stats_.refinements;
+  }
+  decimated->swap(candidate);
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,313 @@
+/**
+ * Offline smoothing stage for recorded reference lines. Smooths and
+ * decimates the input with ReferenceLineSmoother and writes the kept points
+ * in the same "x y" format the nodes read, so the result can be given to
+ * them in place of the raw dump.
+ *
+ * Then reports, for the bundled reference lines (read relative to
+ * catkin_ws like main.cpp) and for synthetic town-sized routes of 2, 10 and
+ * 50 km (straights and 15 to 60 m arcs, waypoints every 0.5 m with 1 cm
+ * noise and repeated points): points before and after, the time of each
+ * step (resample, QP setup, QP solve, decimation), OSQP iterations, the
+ * largest deviation from the raw line, the curvature left by the
+ * decimation, the jitter of the curvature ComputePathProfile gives (sum of
+ * |kappa_(i+1) - kappa_i| per metre) on the raw and on the output points,
+ * for the synthetic routes the largest curvature error against the true
+ * curvature, and the trajectory snapshot bytes (SoA and spatial index) and
+ * mean nearest-point projection time along the route for both.
+ *
+ * usage: reference_line_smoother_tool [input] [output]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "reference_line.h"
+#include "reference_line_smoother.h"
+#include "trajectory_matcher.h"
+#include "trajectory_snapshot.h"
+
+using shenlan::control::ReferenceLine;
+using shenlan::control::ReferenceLineSmoother;
+using shenlan::control::ReferenceLineSmootherStats;
+using shenlan::control::TrajectoryMatcher;
+using shenlan::control::TrajectorySnapshot;
+using shenlan::control::TrajectorySnapshotPtr;
+
+namespace {
+
+typedef ReferenceLineSmoother::Points Points;
+
+Points LoadRoute(const std::string &path) {
+  Points points;
+  std::ifstream infile(path);
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::stringstream word(line);
+    double x = 0.0;
+    double y = 0.0;
+    if (word >> x >> y) {
+      points.emplace_back(x, y);
+    }
+  }
+  return points;
+}
+
+bool SaveRoute(const std::string &path, const Points &points) {
+  std::ofstream outfile(path);
+  outfile << std::fixed << std::setprecision(4);
+  for (const auto &point : points) {
+    outfile << point.first << "  " << point.second << "\n";
+  }
+  return static_cast<bool>(outfile);
+}
+
+// 直线与圆弧交替的路线, 0.5 m一个路点, 带1 cm噪声, 每20个点重复一次;
+// kappa为各路点处的真实曲率
+Points SyntheticTown(const double length, std::vector<double> *kappa) {
+  std::mt19937 generator(11);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> noise(0.0, 0.01);
+  Points points;
+  kappa->clear();
+  double x = 0.0;
+  double y = 0.0;
+  double heading = 0.0;
+  double s = 0.0;
+  const double step = 0.5;
+  bool straight = true;
+  while (s < length) {
+    const double segment_kappa =
+        straight ? 0.0
+                 : (unit(generator) < 0.5 ? -1.0 : 1.0) /
+                       (15.0 + 45.0 * unit(generator));
+    const double segment_length =
+        straight ? 50.0 + 150.0 * unit(generator)
+                 : 0.5 * M_PI / std::fabs(segment_kappa);
+    for (double t = 0.0; t < segment_length && s < length; t += step) {
+      points.emplace_back(x + noise(generator), y + noise(generator));
+      kappa->push_back(segment_kappa);
+      if (points.size() % 20 == 0) {
+        points.push_back(points.back());
+        kappa->push_back(segment_kappa);
+      }
+      x += step * std::cos(heading + 0.5 * step * segment_kappa);
+      y += step * std::sin(heading + 0.5 * step * segment_kappa);
+      heading += step * segment_kappa;
+      s += step;
+    }
+    straight = !straight;
+  }
+  return points;
+}
+
+std::vector<TrajectoryPoint> Trajectory(const Points &points) {
+  std::vector<double> headings;
+  std::vector<double> accumulated_s;
+  std::vector<double> kappas;
+  std::vector<double> dkappas;
+  ReferenceLine(points).ComputePathProfile(&headings, &accumulated_s,
+                                           &kappas, &dkappas);
+  std::vector<TrajectoryPoint> trajectory(points.size());
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    trajectory[i].x = points[i].first;
+    trajectory[i].y = points[i].second;
+    trajectory[i].heading = headings[i];
+    trajectory[i].kappa = kappas[i];
+    trajectory[i].v = 5.0;
+    trajectory[i].a = 0.0;
+  }
+  return trajectory;
+}
+
+// 曲率抖动: 相邻点曲率差的绝对值之和除以长度; 重复点的非有限值跳过
+double CurvatureJitter(const std::vector<TrajectoryPoint> &trajectory,
+                       const double length) {
+  double sum = 0.0;
+  for (std::size_t i = 1; i < trajectory.size(); ++i) {
+    const double difference = trajectory[i].kappa - trajectory[i - 1].kappa;
+    if (std::isfinite(difference)) {
+      sum += std::fabs(difference);
+    }
+  }
+  return sum / length;
+}
+
+struct MatchReport {
+  std::size_t bytes = 0;
+  double project_ns = 0.0;
+};
+
+// 沿路线(偏离0.3 m)逐点投影, 与控制器一样由TrajectoryMatcher记住上次的位置
+MatchReport MeasureMatch(const std::vector<TrajectoryPoint> &trajectory,
+                         const Points &drive) {
+  MatchReport report;
+  const TrajectorySnapshotPtr snapshot = TrajectorySnapshot::Create(trajectory);
+  report.bytes = snapshot->soa().MemoryBytes() +
+                 snapshot->spatial_index()->stats().memory_bytes;
+  TrajectoryMatcher matcher;
+  double sum = 0.0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &point : drive) {
+    sum += matcher
+               .Project(snapshot->soa(), point.first + 0.3, point.second,
+                        snapshot->spatial_index().get())
+               .s;
+  }
+  report.project_ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - start)
+                          .count() /
+                      drive.size();
+  if (sum < 0.0) {
+    std::cout << std::endl;
+  }
+  return report;
+}
+
+// 输出点处与真实曲率的最大差, 真实曲率取最近的原始路点
+double TrueCurvatureError(const std::vector<TrajectoryPoint> &trajectory,
+                          const Points &raw,
+                          const std::vector<double> &true_kappa) {
+  double max_error = 0.0;
+  std::size_t cursor = 0;
+  for (const TrajectoryPoint &point : trajectory) {
+    const auto distance = [&](const std::size_t i) {
+      return std::hypot(raw[i].first - point.x, raw[i].second - point.y);
+    };
+    std::size_t best = cursor;
+    for (std::size_t i = cursor; i < raw.size() && i < cursor + 400; ++i) {
+      if (distance(i) < distance(best)) {
+        best = i;
+      }
+    }
+    cursor = best;
+    if (std::isfinite(point.kappa)) {
+      max_error =
+          std::max(max_error, std::fabs(point.kappa - true_kappa[best]));
+    }
+  }
+  return max_error;
+}
+
+void PrintHeader() {
+  std::cout << std::setw(10) << "route" << std::setw(8) << "km"
+            << std::setw(9) << "raw" << std::setw(9) << "dense"
+            << std::setw(8) << "out" << std::setw(9) << "resamp"
+            << std::setw(9) << "setup" << std::setw(9) << "solve"
+            << std::setw(9) << "decim" << std::setw(7) << "iter"
+            << std::setw(9) << "dev m" << std::setw(10) << "dkappa"
+            << std::setw(10) << "jit raw" << std::setw(10) << "jit out"
+            << std::setw(10) << "true raw" << std::setw(10) << "true out"
+            << std::setw(10) << "B raw" << std::setw(9) << "B out"
+            << std::setw(8) << "ns raw" << std::setw(8) << "ns out"
+            << std::endl;
+}
+
+bool Report(const std::string &name, const Points &raw,
+            const std::vector<double> &true_kappa) {
+  ReferenceLineSmoother smoother;
+  Points output;
+  if (!smoother.Smooth(raw, &output)) {
+    std::cerr << name << ": smoothing failed, OSQP status "
+              << smoother.stats().status << std::endl;
+    return false;
+  }
+  const ReferenceLineSmootherStats &stats = smoother.stats();
+  const std::vector<TrajectoryPoint> raw_trajectory = Trajectory(raw);
+  const std::vector<TrajectoryPoint> output_trajectory = Trajectory(output);
+  double length = 0.0;
+  for (std::size_t i = 1; i < output.size(); ++i) {
+    length += std::hypot(output[i].first - output[i - 1].first,
+                         output[i].second - output[i - 1].second);
+  }
+  const MatchReport raw_match = MeasureMatch(raw_trajectory, raw);
+  const MatchReport output_match = MeasureMatch(output_trajectory, raw);
+
+  std::cout << std::setw(10) << name << std::fixed << std::setprecision(2)
+            << std::setw(8) << length / 1e3 << std::setw(9) << raw.size()
+            << std::setw(9) << stats.resampled_points << std::setw(8)
+            << stats.output_points << std::setprecision(1) << std::setw(9)
+            << stats.resample_time_ms << std::setw(9) << stats.setup_time_ms
+            << std::setw(9) << stats.solve_time_ms << std::setw(9)
+            << stats.decimate_time_ms << std::setw(7) << stats.iterations
+            << std::setprecision(3) << std::setw(9) << stats.max_deviation
+            << std::scientific << std::setprecision(1) << std::setw(10)
+            << stats.max_curvature_error << std::setw(10)
+            << CurvatureJitter(raw_trajectory, length) << std::setw(10)
+            << CurvatureJitter(output_trajectory, length);
+  if (true_kappa.empty()) {
+    std::cout << std::setw(10) << "-" << std::setw(10) << "-";
+  } else {
+    std::cout << std::setw(10)
+              << TrueCurvatureError(raw_trajectory, raw, true_kappa)
+              << std::setw(10)
+              << TrueCurvatureError(output_trajectory, raw, true_kappa);
+  }
+  std::cout << std::fixed << std::setprecision(0) << std::setw(10)
+            << raw_match.bytes << std::setw(9) << output_match.bytes
+            << std::setw(8) << raw_match.project_ns << std::setw(8)
+            << output_match.project_ns << std::defaultfloat << std::endl;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const std::string input =
+      argc > 1 ? argv[1] : "src/mpc_control/data/cube_town_reference_line.txt";
+  const std::string output = argc > 2 ? argv[2] : "smoothed_reference_line.txt";
+
+  const Points raw = LoadRoute(input);
+  ReferenceLineSmoother smoother;
+  Points smoothed;
+  if (!smoother.Smooth(raw, &smoothed)) {
+    std::cerr << "could not smooth " << input << " (" << raw.size()
+              << " points, OSQP status " << smoother.stats().status << ")"
+              << std::endl;
+    return 1;
+  }
+  if (!SaveRoute(output, smoothed)) {
+    std::cerr << "could not write " << output << std::endl;
+    return 1;
+  }
+  const ReferenceLineSmootherStats &stats = smoother.stats();
+  std::cout << "wrote " << output << ": " << stats.raw_points << " -> "
+            << stats.output_points << " points, largest deviation "
+            << stats.max_deviation << " m, curvature error "
+            << stats.max_curvature_error << " 1/m after "
+            << stats.refinements << " refinements" << std::endl
+            << std::endl;
+
+  std::cout << "times in ms; dkappa: curvature error left by the "
+               "decimation; jit: sum |delta kappa| per m; true: largest "
+               "error against the true curvature; B: snapshot bytes; ns: "
+               "mean projection"
+            << std::endl;
+  PrintHeader();
+  const std::vector<double> no_truth;
+  for (const char *name : {"reference_line", "cube_town_reference_line"}) {
+    const Points route =
+        LoadRoute(std::string("src/mpc_control/data/") + name + ".txt");
+    if (route.size() >= 3 &&
+        !Report(std::string(name).substr(0, 10), route, no_truth)) {
+      return 1;
+    }
+  }
+  for (const double length : {2000.0, 10000.0, 50000.0}) {
+    std::vector<double> true_kappa;
+    const Points route = SyntheticTown(length, &true_kappa);
+    std::ostringstream name;
+    name << "town " << length / 1e3;
+    if (!Report(name.str(), route, true_kappa)) {
+      return 1;
+    }
+  }
+  return 0;
+}
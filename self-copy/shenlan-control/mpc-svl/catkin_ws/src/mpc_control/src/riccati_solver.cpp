@@ -0,0 +1,148 @@
+#include "riccati_solver.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "Eigen/LU"
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+template <int N, int M>
+int FixedPoint(const Eigen::Matrix<double, N, N> &A,
+               const Eigen::Matrix<double, N, M> &B,
+               const Eigen::Matrix<double, N, N> &Q,
+               const Eigen::Matrix<double, M, M> &R,
+               const RiccatiOptions &options, Eigen::Matrix<double, N, N> *P,
+               bool *converged) {
+  typedef Eigen::Matrix<double, N, N> MatrixNN;
+  typedef Eigen::Matrix<double, M, N> MatrixMN;
+  const MatrixNN A_trans = A.transpose();
+  const MatrixMN B_trans = B.transpose();
+  MatrixNN P_next(P->rows(), P->cols());
+  int iterations = 0;
+  *converged = false;
+  while (iterations < options.max_iterations) {
+    ++iterations;
+    const MatrixNN PA = (*P) * A;
+    const MatrixMN BtPA = B_trans * PA;
+    P_next = Q + A_trans * PA -
+             BtPA.transpose() * (R + B_trans * (*P) * B).inverse() * BtPA;
+    const double P_error = (P_next - *P).cwiseAbs().maxCoeff();
+    P->swap(P_next);
+    if (!std::isfinite(P_error)) {
+      break;
+    }
+    if (P_error <= options.tolerance) {
+      *converged = true;
+      break;
+    }
+  }
+  return iterations;
+}
+
+// A_{k+1} = A_k (I + G_k H_k)^-1 A_k
+// G_{k+1} = G_k + A_k (I + G_k H_k)^-1 G_k A_k'
+// H_{k+1} = H_k + A_k' H_k (I + G_k H_k)^-1 A_k
+// with A_0 = A, G_0 = B R^-1 B', H_0 = Q; H_k converges to P.
+template <int N, int M>
+int Doubling(const Eigen::Matrix<double, N, N> &A,
+             const Eigen::Matrix<double, N, M> &B,
+             const Eigen::Matrix<double, N, N> &Q,
+             const Eigen::Matrix<double, M, M> &R,
+             const RiccatiOptions &options, Eigen::Matrix<double, N, N> *P,
+             bool *converged) {
+  typedef Eigen::Matrix<double, N, N> MatrixNN;
+  const int n = static_cast<int>(A.rows());
+  const MatrixNN I = MatrixNN::Identity(n, n);
+  MatrixNN A_k = A;
+  MatrixNN G_k = B * R.inverse() * B.transpose();
+  MatrixNN H_k = Q;
+  int iterations = 0;
+  *converged = false;
+  while (iterations < options.max_iterations) {
+    ++iterations;
+    const Eigen::PartialPivLU<MatrixNN> W(I + G_k * H_k);
+    const MatrixNN W_inv_A = W.solve(A_k);
+    const MatrixNN W_inv_G = W.solve(G_k);
+    const MatrixNN H_next = H_k + A_k.transpose() * H_k * W_inv_A;
+    G_k += A_k * W_inv_G * A_k.transpose();
+    A_k = A_k * W_inv_A;
+    const double H_error = (H_next - H_k).cwiseAbs().maxCoeff();
+    H_k = H_next;
+    if (!std::isfinite(H_error)) {
+      break;
+    }
+    if (H_error <= options.tolerance) {
+      *converged = true;
+      break;
+    }
+  }
+  // 对称化, 消除舍入误差
+  *P = 0.5 * (H_k + H_k.transpose());
+  return iterations;
+}
+
+}  // namespace
+
+template <int N, int M>
+bool SolveDiscreteRiccati(const Eigen::Matrix<double, N, N> &A,
+                          const Eigen::Matrix<double, N, M> &B,
+                          const Eigen::Matrix<double, N, N> &Q,
+                          const Eigen::Matrix<double, M, M> &R,
+                          const RiccatiOptions &options,
+                          const Eigen::Matrix<double, N, N> *P_init,
+                          Eigen::Matrix<double, N, N> *P,
+                          Eigen::Matrix<double, M, N> *K,
+                          RiccatiStats *stats) {
+  const auto start = std::chrono::steady_clock::now();
+  const bool warm_start = options.method == RiccatiMethod::kFixedPoint &&
+                          P_init != nullptr && P_init->rows() == Q.rows() &&
+                          P_init->cols() == Q.cols() && P_init->allFinite();
+
+  bool converged = false;
+  int iterations = 0;
+  if (options.method == RiccatiMethod::kDoubling) {
+    iterations = Doubling(A, B, Q, R, options, P, &converged);
+  } else {
+    *P = warm_start ? *P_init : Q;
+    iterations = FixedPoint(A, B, Q, R, options, P, &converged);
+  }
+
+  const Eigen::Matrix<double, M, N> B_trans = B.transpose();
+  const Eigen::Matrix<double, M, N> BtPA = B_trans * (*P) * A;
+  const Eigen::Matrix<double, M, M> S_inv = (R + B_trans * (*P) * B).inverse();
+  *K = S_inv * BtPA;
+  const double residual =
+      (Q + A.transpose() * (*P) * A - BtPA.transpose() * S_inv * BtPA - *P)
+          .cwiseAbs()
+          .maxCoeff();
+  converged = converged && std::isfinite(residual);
+
+  if (stats != nullptr) {
+    stats->iterations = iterations;
+    stats->residual = residual;
+    stats->converged = converged;
+    stats->warm_started = warm_start;
+    stats->solve_time_us = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+  }
+  return converged;
+}
+
+template bool SolveDiscreteRiccati<6, 2>(
+    const Eigen::Matrix<double, 6, 6> &, const Eigen::Matrix<double, 6, 2> &,
+    const Eigen::Matrix<double, 6, 6> &, const Eigen::Matrix<double, 2, 2> &,
+    const RiccatiOptions &, const Eigen::Matrix<double, 6, 6> *,
+    Eigen::Matrix<double, 6, 6> *, Eigen::Matrix<double, 2, 6> *,
+    RiccatiStats *);
+template bool SolveDiscreteRiccati<Eigen::Dynamic, Eigen::Dynamic>(
+    const Eigen::MatrixXd &, const Eigen::MatrixXd &, const Eigen::MatrixXd &,
+    const Eigen::MatrixXd &, const RiccatiOptions &, const Eigen::MatrixXd *,
+    Eigen::MatrixXd *, Eigen::MatrixXd *, RiccatiStats *);
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,194 @@
+#include "trajectory_matcher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+double SquaredDistance(const TrajectoryPoint &point, const double x,
+                       const double y) {
+  const double dx = point.x - x;
+  const double dy = point.y - y;
+  return dx * dx + dy * dy;
+}
+
+double WrapAngle(const double angle) {
+  double a = std::fmod(angle + M_PI, 2.0 * M_PI);
+  if (a < 0.0) {
+    a += 2.0 * M_PI;
+  }
+  return a - M_PI;
+}
+
+// Project (x, y) onto segment [p0, p1], return the clamped ratio.
+double SegmentRatio(const TrajectoryPoint &p0, const TrajectoryPoint &p1,
+                    const double x, const double y) {
+  const double vx = p1.x - p0.x;
+  const double vy = p1.y - p0.y;
+  const double length_square = vx * vx + vy * vy;
+  if (length_square < 1e-12) {
+    return 0.0;
+  }
+  const double ratio = ((x - p0.x) * vx + (y - p0.y) * vy) / length_square;
+  return std::min(std::max(ratio, 0.0), 1.0);
+}
+
+TrajectoryPoint Interpolate(const TrajectoryPoint &p0,
+                            const TrajectoryPoint &p1, const double ratio) {
+  TrajectoryPoint point;
+  point.x = p0.x + ratio * (p1.x - p0.x);
+  point.y = p0.y + ratio * (p1.y - p0.y);
+  point.heading =
+      WrapAngle(p0.heading + ratio * WrapAngle(p1.heading - p0.heading));
+  point.kappa = p0.kappa + ratio * (p1.kappa - p0.kappa);
+  point.v = p0.v + ratio * (p1.v - p0.v);
+  point.a = p0.a + ratio * (p1.a - p0.a);
+  return point;
+}
+
+}  // namespace
+
+void TrajectoryMatcher::SetWindow(const double lookback_s,
+                                  const double lookahead_s) {
+  lookback_s_ = std::max(lookback_s, 0.0);
+  lookahead_s_ = std::max(lookahead_s, 0.0);
+}
+
+void TrajectoryMatcher::SetRelocalizationDistance(const double distance) {
+  relocalization_distance_ = distance;
+}
+
+void TrajectoryMatcher::Reset() {
+  has_hint_ = false;
+  last_index_ = 0;
+  last_match_was_global_ = false;
+}
+
+void TrajectoryMatcher::Rebase(const TrajectorySoA &trajectory,
+                               const std::size_t dropped) {
+  if (!has_hint_ || trajectory.empty() || last_index_ < dropped ||
+      last_index_ - dropped >= trajectory.size()) {
+    Reset();
+    return;
+  }
+  // 新窗口的形状即为提示所指的轨迹, 下一次查询不会因形状变化而重置
+  last_index_ -= dropped;
+  trajectory_size_ = trajectory.size();
+  front_x_ = trajectory.x().front();
+  front_y_ = trajectory.y().front();
+  back_x_ = trajectory.x().back();
+  back_y_ = trajectory.y().back();
+}
+
+std::size_t TrajectoryMatcher::Match(const TrajectorySoA &trajectory,
+                                     const double x, const double y,
+                                     const TrajectorySpatialIndex *index) {
+  if (trajectory.empty()) {
+    Reset();
+    trajectory_size_ = 0;
+    return 0;
+  }
+  const std::size_t n = trajectory.size();
+  if (!IsSameShape(n, trajectory.x().front(), trajectory.y().front(),
+                   trajectory.x().back(), trajectory.y().back())) {
+    Reset();
+    trajectory_size_ = n;
+    front_x_ = trajectory.x().front();
+    front_y_ = trajectory.y().front();
+    back_x_ = trajectory.x().back();
+    back_y_ = trajectory.y().back();
+  }
+
+  const std::vector<double> &accumulated_s = trajectory.accumulated_s();
+  double d2_min = 0.0;
+  if (has_hint_) {
+    // 只在上一次匹配点前后的一段弧长内搜索
+    const double s_last = accumulated_s[last_index_];
+    const std::size_t begin =
+        std::lower_bound(accumulated_s.begin(),
+                         accumulated_s.begin() + last_index_,
+                         s_last - lookback_s_) -
+        accumulated_s.begin();
+    const std::size_t end =
+        std::upper_bound(accumulated_s.begin() + last_index_,
+                         accumulated_s.end(), s_last + lookahead_s_) -
+        accumulated_s.begin();
+    const std::size_t match = trajectory.NearestIndex(begin, end, x, y, &d2_min);
+
+    // 匹配点落在窗口边界上说明窗口已经跟丢车辆, 需要全局搜索
+    const bool on_boundary =
+        (match == begin && begin > 0) || (match + 1 == end && end < n);
+    const bool relocalized =
+        d2_min > relocalization_distance_ * relocalization_distance_;
+    if (!on_boundary && !relocalized) {
+      last_index_ = match;
+      last_match_was_global_ = false;
+      return match;
+    }
+  }
+
+  if (index != nullptr && index->size() == n) {
+    last_index_ = index->Nearest(x, y);
+  } else {
+    last_index_ = trajectory.NearestIndex(0, n, x, y, &d2_min);
+  }
+  has_hint_ = true;
+  last_match_was_global_ = true;
+  ++global_search_count_;
+  return last_index_;
+}
+
+ProjectedPoint TrajectoryMatcher::Project(const TrajectorySoA &trajectory,
+                                          const double x, const double y,
+                                          const TrajectorySpatialIndex *index) {
+  ProjectedPoint projected;
+  const std::size_t match = Match(trajectory, x, y, index);
+  if (trajectory.size() < 2) {
+    if (!trajectory.empty()) {
+      projected.point = trajectory.point(0);
+    }
+    return projected;
+  }
+
+  // 最近点前后两段线段上的垂足, 取距离更近的一个
+  double d2_min = std::numeric_limits<double>::max();
+  const std::size_t first = match > 0 ? match - 1 : 0;
+  const std::size_t last = std::min(match + 1, trajectory.size() - 1);
+  TrajectoryPoint p0 = trajectory.point(first);
+  for (std::size_t i = first; i < last; ++i) {
+    const TrajectoryPoint p1 = trajectory.point(i + 1);
+    const double ratio = SegmentRatio(p0, p1, x, y);
+    const TrajectoryPoint foot = Interpolate(p0, p1, ratio);
+    const double d2 = SquaredDistance(foot, x, y);
+    if (d2 < d2_min) {
+      d2_min = d2;
+      projected.point = foot;
+      projected.index = i;
+      projected.ratio = ratio;
+    }
+    p0 = p1;
+  }
+  const std::vector<double> &accumulated_s = trajectory.accumulated_s();
+  projected.s = accumulated_s[projected.index] +
+                projected.ratio * (accumulated_s[projected.index + 1] -
+                                   accumulated_s[projected.index]);
+  return projected;
+}
+
+// Only a cheap guard: comparing every point would cost more than the
+// windowed search, so a replanned trajectory with the same size and endpoints
+// is left to the caller's Reset().
+bool TrajectoryMatcher::IsSameShape(const std::size_t size,
+                                    const double front_x, const double front_y,
+                                    const double back_x,
+                                    const double back_y) const {
+  return size == trajectory_size_ && size > 0 && front_x == front_x_ &&
+         front_y == front_y_ && back_x == back_x_ && back_y == back_y_;
+}
+
+}  // namespace control
+}  // namespace shenlan
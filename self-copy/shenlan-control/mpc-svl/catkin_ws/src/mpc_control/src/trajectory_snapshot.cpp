@@ -0,0 +1,116 @@
+#include "trajectory_snapshot.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace shenlan {
+namespace control {
+
+namespace {
+
+// 0 is reserved for "no snapshot"
+std::atomic<std::uint64_t> next_version{1};
+// 0 is reserved for "not streamed"
+std::atomic<std::uint64_t> next_route_id{1};
+
+}  // namespace
+
+std::shared_ptr<const TrajectorySnapshot> TrajectorySnapshot::Create(
+    std::vector<TrajectoryPoint> points, const bool build_spatial_index,
+    const bool build_station_line, const TrajectoryWindow &window) {
+  std::shared_ptr<TrajectorySnapshot> snapshot(new TrajectorySnapshot());
+  snapshot->version_ = next_version.fetch_add(1, std::memory_order_relaxed);
+  snapshot->window_ = window;
+  snapshot->points_ = std::move(points);
+  snapshot->soa_.Assign(snapshot->points_);
+  if (build_spatial_index) {
+    snapshot->spatial_index_ = TrajectorySpatialIndex::Build(snapshot->points_);
+  }
+  if (build_station_line) {
+    snapshot->BuildStationLine(nullptr);
+  }
+  return snapshot;
+}
+
+std::shared_ptr<const TrajectorySnapshot> TrajectorySnapshot::Create(
+    std::vector<TrajectoryPoint> points,
+    std::shared_ptr<const TrajectorySpatialIndex> spatial_index,
+    const bool build_station_line, const TrajectoryWindow &window) {
+  return Create(std::move(points), nullptr, nullptr, std::move(spatial_index),
+                build_station_line, window);
+}
+
+std::shared_ptr<const TrajectorySnapshot> TrajectorySnapshot::Create(
+    std::vector<TrajectoryPoint> points, const double *accumulated_s,
+    const double *dkappa,
+    std::shared_ptr<const TrajectorySpatialIndex> spatial_index,
+    const bool build_station_line, const TrajectoryWindow &window) {
+  std::shared_ptr<TrajectorySnapshot> snapshot(new TrajectorySnapshot());
+  snapshot->version_ = next_version.fetch_add(1, std::memory_order_relaxed);
+  snapshot->window_ = window;
+  snapshot->points_ = std::move(points);
+  snapshot->soa_.Assign(snapshot->points_, accumulated_s);
+  snapshot->spatial_index_ = std::move(spatial_index);
+  if (build_station_line) {
+    snapshot->BuildStationLine(dkappa);
+  }
+  return snapshot;
+}
+
+void TrajectorySnapshot::BuildStationLine(const double *dkappa) {
+  const std::size_t size = soa_.size();
+  if (size < 2) {
+    return;
+  }
+  const std::vector<double> &s = soa_.accumulated_s();
+  const std::vector<double> &kappa = soa_.kappa();
+  std::vector<StationPoint> knots(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    knots[i].s = s[i];
+    knots[i].x = soa_.x()[i];
+    knots[i].y = soa_.y()[i];
+    knots[i].heading = soa_.heading()[i];
+    knots[i].kappa = kappa[i];
+    knots[i].v = soa_.v()[i];
+    if (dkappa != nullptr) {
+      knots[i].dkappa = dkappa[i];
+      continue;
+    }
+    // 与ReferenceLine相同的差分, 端点单侧
+    const std::size_t next = std::min(i + 1, size - 1);
+    const std::size_t previous = i > 0 ? i - 1 : 0;
+    const double length = s[next] - s[previous];
+    knots[i].dkappa =
+        length > 0.0 ? (kappa[next] - kappa[previous]) / length : 0.0;
+  }
+  // 采样点与节点错开时会削平节点处的折角, 取半个平均点距使差别足够小
+  station_line_.Build(knots, 0.5 * (s.back() - s.front()) / (size - 1));
+}
+
+std::uint64_t TrajectorySnapshot::NewRouteId() {
+  return next_route_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TrajectorySnapshot::FollowsWindow(const TrajectorySnapshot &earlier,
+                                       std::size_t *dropped) const {
+  if (window_.route_id == 0 || window_.route_id != earlier.window_.route_id ||
+      window_.first_index < earlier.window_.first_index) {
+    return false;
+  }
+  *dropped = window_.first_index - earlier.window_.first_index;
+  return true;
+}
+
+void TrajectoryChannel::Publish(TrajectorySnapshotPtr snapshot) {
+  const std::uint64_t version = snapshot != nullptr ? snapshot->version() : 0;
+  std::atomic_store_explicit(&snapshot_, std::move(snapshot),
+                             std::memory_order_release);
+  version_.store(version, std::memory_order_release);
+}
+
+TrajectorySnapshotPtr TrajectoryChannel::Latest() const {
+  return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+}
+
+}  // namespace control
+}  // namespace shenlan
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Reference attributes at arc length s.
+ */
+struct StationPoint {
+  double s = 0.0;
+  double x = 0.0;
+  double y = 0.0;
+  double heading = 0.0;
+  double kappa = 0.0;
+  double dkappa = 0.0;
+  double v = 0.0;
+};
+
+/**
+ * @brief Reference line indexed by arc length instead of position.
+ *
+ * The knots (e.g. the output of ReferenceLine::ComputePathProfile) are
+ * resampled to a uniform spacing, so the segment holding a station s is
+ * found by one multiplication and at(s) / range(s0, s1) take constant time,
+ * whatever the knot spacing was. Attributes are interpolated linearly
+ * between samples, heading across the +-pi seam. Built without resampling,
+ * the knots are kept as they are and looked up by binary search, unless
+ * they are uniform already.
+ */
+class ArcLengthReferenceLine {
+ public:
+  // samples [begin, end)
+  struct Range {
+    const StationPoint *begin = nullptr;
+    const StationPoint *end = nullptr;
+    std::size_t size() const { return end - begin; }
+    bool empty() const { return begin == end; }
+  };
+
+  ArcLengthReferenceLine() = default;
+
+  /**
+   * @param knots reference points with non-decreasing s
+   * @param spacing resampling step [m], lowered so that the samples end on
+   * the last knot; <= 0 keeps the knots
+   * @return false for fewer than two knots, decreasing s or zero length;
+   * the line is then empty
+   */
+  bool Build(const std::vector<StationPoint> &knots, const double spacing);
+
+  /**
+   * @brief from the columns of ReferenceLine::ComputePathProfile, all of
+   * xy_points.size() values, with reference speed v
+   */
+  bool Build(const std::vector<std::pair<double, double>> &xy_points,
+             const std::vector<double> &headings,
+             const std::vector<double> &accumulated_s,
+             const std::vector<double> &kappas,
+             const std::vector<double> &dkappas, const double v,
+             const double spacing);
+
+  /**
+   * @brief attributes at station s, interpolated; s outside the line is
+   * clamped to its ends. All zero but s on an empty line
+   */
+  StationPoint at(const double s) const;
+
+  /**
+   * @brief the samples with s0 <= s <= s1, empty if there are none
+   */
+  Range range(const double s0, const double s1) const;
+
+  std::size_t size() const { return samples_.size(); }
+  bool empty() const { return samples_.empty(); }
+  // constant-time lookup; false for kept non-uniform knots
+  bool uniform() const { return uniform_; }
+  // sample spacing of a uniform line [m]
+  double spacing() const { return spacing_; }
+  double front_s() const { return samples_.front().s; }
+  double back_s() const { return samples_.back().s; }
+  const std::vector<StationPoint> &samples() const { return samples_; }
+
+  std::size_t MemoryBytes() const;
+
+ private:
+  // index i of the segment [i, i + 1] holding s, s clamped to the line
+  std::size_t Segment(const double s) const;
+  // samples_ checked and stored, set up the lookup
+  bool Finish();
+
+  std::vector<StationPoint> samples_;
+  bool uniform_ = false;
+  double spacing_ = 0.0;
+  double inverse_spacing_ = 0.0;
+};
+
+}  // namespace control
+}  // namespace shenlan
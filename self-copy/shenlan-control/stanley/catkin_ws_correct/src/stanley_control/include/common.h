@@ -1,5 +1,7 @@
+#pragma once
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <iomanip>
 
@@ -51,8 +53,16 @@ struct TrajectoryPoint {
   double a;
 };
 
+namespace shenlan {
+namespace control {
+class TrajectorySnapshot;
+}  // namespace control
+}  // namespace shenlan
+
 struct TrajectoryData {
   std::vector<TrajectoryPoint> trajectory_points;
+  // 不可变的轨迹快照(含SoA与空间索引), 控制器按版本号共享, 不再逐周期拷贝
+  std::shared_ptr<const shenlan::control::TrajectorySnapshot> snapshot;
 };
 
 struct LateralControlError {
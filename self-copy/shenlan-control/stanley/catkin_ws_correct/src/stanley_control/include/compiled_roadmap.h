@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "trajectory_snapshot.h"
+#include "trajectory_spatial_index.h"
+
+namespace shenlan {
+namespace control {
+
+/**
+ * @brief Reference line compiled into a binary file and mapped read-only.
+ *
+ * The text roadmaps are parsed line by line and their path profile is
+ * recomputed on every start. Compile() does both once, offline, and writes
+ * a versioned file: a fixed header followed by the x, y, heading, s, kappa
+ * and dkappa columns (one contiguous double array each, as in
+ * TrajectorySoA) and optionally the tree order and split dimensions of a
+ * TrajectorySpatialIndex built over the points. Open() maps the file with
+ * mmap and points the columns into the mapping after checking the header,
+ * so loading does no parsing and touches only the pages that are read.
+ *
+ * The header records size and modification time of the text file it was
+ * compiled from, so a loader can tell a stale file with Stale().
+ */
+class CompiledRoadmap {
+ public:
+  static constexpr std::uint32_t kVersion = 1;
+
+  CompiledRoadmap() = default;
+  ~CompiledRoadmap();
+  CompiledRoadmap(const CompiledRoadmap &) = delete;
+  CompiledRoadmap &operator=(const CompiledRoadmap &) = delete;
+
+  /**
+   * @brief read the "x y" text roadmap at text_path, compute its path
+   * profile and write the compiled file to compiled_path (through a
+   * temporary file, so a running reader never sees a partial one)
+   * @param with_spatial_index also store a prebuilt spatial index
+   * @param error reason of a failure, may be null
+   * @return false if the text has fewer than two points or a file could
+   * not be read or written
+   */
+  static bool Compile(const std::string &text_path,
+                      const std::string &compiled_path,
+                      const bool with_spatial_index, std::string *error);
+
+  /**
+   * @brief whether the file at path starts with the compiled-roadmap magic
+   */
+  static bool IsCompiled(const std::string &path);
+
+  /**
+   * @brief map the file at path; a roadmap open before is closed first
+   * @return false if it cannot be mapped or its header does not match this
+   * version and byte order; error() then tells why
+   */
+  bool Open(const std::string &path);
+  void Close();
+
+  /**
+   * @brief whether text_path differs in size or modification time from the
+   * text the open roadmap was compiled from; false if it cannot be read
+   */
+  bool Stale(const std::string &text_path) const;
+
+  bool is_open() const { return data_ != nullptr; }
+  std::size_t size() const { return size_; }
+  std::size_t file_bytes() const { return file_bytes_; }
+  const std::string &error() const { return error_; }
+
+  // columns of size() values each, valid while the roadmap is open
+  const double *x() const { return x_; }
+  const double *y() const { return y_; }
+  const double *heading() const { return heading_; }
+  const double *accumulated_s() const { return s_; }
+  const double *kappa() const { return kappa_; }
+  const double *dkappa() const { return dkappa_; }
+
+  bool has_spatial_index() const { return tree_indices_ != nullptr; }
+
+  /**
+   * @brief the trajectory points, all with speed v and zero acceleration
+   */
+  void Points(const double v, std::vector<TrajectoryPoint> *points) const;
+
+  /**
+   * @brief the stored spatial index, null if there is none
+   */
+  std::shared_ptr<const TrajectorySpatialIndex> SpatialIndex() const;
+
+  /**
+   * @brief a trajectory snapshot of the roadmap: the points are read once
+   * into the vector the snapshot keeps, s and dkappa are taken from their
+   * columns and the stored spatial index is used (built if there is none)
+   * @param v speed of all points
+   * @param build_station_line see TrajectorySnapshot::Create
+   */
+  TrajectorySnapshotPtr Snapshot(const double v,
+                                 const bool build_station_line) const;
+
+ private:
+  // fails Open() with the given reason
+  bool Fail(const std::string &reason);
+
+  const unsigned char *data_ = nullptr;
+  std::size_t file_bytes_ = 0;
+  std::size_t size_ = 0;
+  std::int64_t source_bytes_ = -1;
+  std::int64_t source_mtime_ns_ = 0;
+  const double *x_ = nullptr;
+  const double *y_ = nullptr;
+  const double *heading_ = nullptr;
+  const double *s_ = nullptr;
+  const double *kappa_ = nullptr;
+  const double *dkappa_ = nullptr;
+  const std::uint32_t *tree_indices_ = nullptr;
+  const std::uint8_t *tree_split_dims_ = nullptr;
+  std::string error_;
+};
+
+}  // namespace control
+}  // namespace shenlan
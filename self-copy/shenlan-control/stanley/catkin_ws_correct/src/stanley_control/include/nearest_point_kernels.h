@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+namespace shenlan {
+namespace control {
+
+enum class SimdLevel { kScalar = 0, kSse2 = 1, kAvx2 = 2 };
+
+/**
+ * @brief highest instruction set the running cpu supports, detected once
+ */
+SimdLevel DetectSimdLevel();
+
+/**
+ * @brief index of the point nearest to (x, y) among n points stored as
+ * separate x and y arrays
+ *
+ * Ties resolve to the lowest index, as in a plain linear scan. The kernel is
+ * picked at runtime from DetectSimdLevel() unless a level is given; a level
+ * the cpu does not support falls back to the best supported one.
+ * @param xs x coordinates
+ * @param ys y coordinates
+ * @param n number of points, must be positive
+ * @param x query position x
+ * @param y query position y
+ * @param d2_min squared distance to the nearest point, may be null
+ * @return index of the nearest point in [0, n)
+ */
+std::size_t ArgMinDistanceSquare(const double *xs, const double *ys,
+                                 const std::size_t n, const double x,
+                                 const double y, double *d2_min = nullptr);
+std::size_t ArgMinDistanceSquare(const double *xs, const double *ys,
+                                 const std::size_t n, const double x,
+                                 const double y, double *d2_min,
+                                 const SimdLevel level);
+
+/**
+ * @brief float32 variant of ArgMinDistanceSquare, meant for coordinates
+ * stored relative to a local origin
+ */
+std::size_t ArgMinDistanceSquare(const float *xs, const float *ys,
+                                 const std::size_t n, const float x,
+                                 const float y, float *d2_min = nullptr);
+std::size_t ArgMinDistanceSquare(const float *xs, const float *ys,
+                                 const std::size_t n, const float x,
+                                 const float y, float *d2_min,
+                                 const SimdLevel level);
+
+}  // namespace control
+}  // namespace shenlan
@@ -1,6 +1,9 @@
+#pragma once
 #include <vector>
 #include <iostream>
 #include <math.h>
+#include <cstddef>
+#include <utility>
 
 namespace shenlan
 {
@@ -9,13 +12,31 @@ namespace control
 class ReferenceLine
 {
 public:
-    ReferenceLine(const std::vector<std::pair<double, double>>& xy_points);
+    // the points are moved in; pass an rvalue to avoid the copy
+    ReferenceLine(std::vector<std::pair<double, double>> xy_points);
     ~ReferenceLine() = default;
 
+    /**
+     * @brief heading, accumulated s, kappa and dkappa of every point; the
+     * vectors are resized, so they do not reallocate once large enough
+     * @return false for fewer than two points, the vectors are then cleared
+     */
     bool ComputePathProfile(
     std::vector<double>* headings, std::vector<double>* accumulated_s,
     std::vector<double>* kappas, std::vector<double>* dkappas);
 
+    /**
+     * @brief the same profile of size points read in place, written into
+     * caller-provided columns of size values each, without allocating. One
+     * pass: s runs two points ahead, the first derivatives one point ahead,
+     * dkappa one point behind, so no intermediate column is stored
+     * @return false for fewer than two points
+     */
+    static bool ComputePathProfile(
+    const std::pair<double, double>* xy_points, const std::size_t size,
+    double* headings, double* accumulated_s, double* kappas,
+    double* dkappas);
+
 private:
     std::vector<std::pair<double, double>> xy_points_;
 };
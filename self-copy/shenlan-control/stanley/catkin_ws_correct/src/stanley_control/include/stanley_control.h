@@ -8,6 +8,8 @@
 
 #include "Eigen/Core"
 #include "common.h"
+#include "trajectory_matcher.h"
+#include "trajectory_snapshot.h"
 
 
 namespace shenlan {
@@ -29,7 +31,10 @@ class StanleyController {
   TrajectoryPoint QueryNearestPointByPosition(const double x, const double y);
 
  protected:
-  std::vector<TrajectoryPoint> trajectory_points_;
+  // trajectory being tracked, shared with the publisher, never copied
+  TrajectorySnapshotPtr trajectory_;
+  // windowed match-point search, remembers the last matched index
+  TrajectoryMatcher trajectory_matcher_;
   double k_y_ = 0.0;
   double u_min_ = 0.0;
   double u_max_ = 100.0;
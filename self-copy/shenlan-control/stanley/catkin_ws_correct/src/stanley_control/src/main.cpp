@@ -1,4 +1,5 @@
 #include "stanley_control.h"
+#include "compiled_roadmap.h"
 #include "pid_controller.h"
 
 // Input
@@ -64,62 +65,99 @@ void odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
 }
 
 int main(int argc, char** argv) {
-  // Read the reference_line txt
-  std::ifstream infile;
-  infile.open(
-      "src/stanley_control/data/referenceline_2d_mod.txt");  //将文件流对象与文件连接起来
-  assert(infile.is_open());  //若失败,则输出错误消息,并终止程序运行
-
-  std::vector<std::pair<double, double>> xy_points;
-  std::string s;
-  std::string x;
-  std::string y;
-
-  while (getline(infile, s)) {
-    std::stringstream word(s);
-    word >> x;
-    word >> y;
-    double pt_x = std::atof(x.c_str());
-    double pt_y = std::atof(y.c_str());
-    xy_points.push_back(std::make_pair(pt_x, pt_y));
-  }
-  infile.close();
-
-  // Construct the reference_line path profile
-  std::vector<double> headings;
-  std::vector<double> accumulated_s;
-  std::vector<double> kappas;
-  std::vector<double> dkappas;
-  std::unique_ptr<shenlan::control::ReferenceLine> reference_line =
-      std::make_unique<shenlan::control::ReferenceLine>(xy_points);
-  reference_line->ComputePathProfile(&headings, &accumulated_s, &kappas,
-                                     &dkappas);
-
-  for (size_t i = 0; i < headings.size(); i++) {
-    std::cout << "pt " <<  setw(3) << i 
-              << " heading: " << setw(10) << headings[i]
-              << " acc_s: " << setw(7) << accumulated_s[i] 
-              << " kappa: " << setw(12) << kappas[i]
-              << " dkappas: " << setw(8) << dkappas[i] << std::endl;
-  }
-  std::cout << "-------------------------------------" << std::endl;
-  std::cout << std::endl;
-
-  // Construct the planning trajectory
+  // 数据目录中有roadmap_compiler生成且未过期的路网时直接映射, 不再解析文本
+  const std::string roadmap_text =
+      "src/stanley_control/data/referenceline_2d_mod.txt";
+  const std::string roadmap_compiled =
+      "src/stanley_control/data/referenceline_2d_mod.roadmap";
   TrajectoryData planning_published_trajectory;
-  for (size_t i = 0; i < headings.size(); i++) {
-    TrajectoryPoint trajectory_pt;
-    trajectory_pt.x = xy_points[i].first;
-    trajectory_pt.y = xy_points[i].second;
-    trajectory_pt.v = 2.0;
-    trajectory_pt.a = 0.0;
-    trajectory_pt.heading = headings[i];
-    trajectory_pt.kappa = kappas[i];
-
-    planning_published_trajectory.trajectory_points.push_back(trajectory_pt);
-  }
+  shenlan::control::CompiledRoadmap compiled_roadmap;
+  if (compiled_roadmap.Open(roadmap_compiled) &&
+      !compiled_roadmap.Stale(roadmap_text)) {
+    // 点直接读入快照, s与dkappa取文件中的列
+    planning_published_trajectory.snapshot =
+        compiled_roadmap.Snapshot(2.0, false);
+    std::cout << "compiled roadmap: " << roadmap_compiled << ", "
+              << compiled_roadmap.size() << " points" << std::endl;
+  } else {
+    if (compiled_roadmap.is_open()) {
+      std::cout << roadmap_text << " changed since " << roadmap_compiled
+                << " was compiled, reading the text" << std::endl;
+    } else if (shenlan::control::CompiledRoadmap::IsCompiled(
+                   roadmap_compiled)) {
+      std::cout << compiled_roadmap.error() << ", reading the text"
+                << std::endl;
+    }
+    compiled_roadmap.Close();
+    // Read the reference_line txt
+    std::ifstream infile;
+    infile.open(roadmap_text);  //将文件流对象与文件连接起来
+    assert(infile.is_open());  //若失败,则输出错误消息,并终止程序运行
+
+    std::vector<std::pair<double, double>> xy_points;
+    std::string s;
+    std::string x;
+    std::string y;
+
+    while (getline(infile, s)) {
+      std::stringstream word(s);
+      word >> x;
+      word >> y;
+      double pt_x = std::atof(x.c_str());
+      double pt_y = std::atof(y.c_str());
+      xy_points.push_back(std::make_pair(pt_x, pt_y));
+    }
+    infile.close();
+
+    // Construct the reference_line path profile
+    std::vector<double> headings;
+    std::vector<double> accumulated_s;
+    std::vector<double> kappas;
+    std::vector<double> dkappas;
+    std::unique_ptr<shenlan::control::ReferenceLine> reference_line =
+        std::make_unique<shenlan::control::ReferenceLine>(xy_points);
+    reference_line->ComputePathProfile(&headings, &accumulated_s, &kappas,
+                                       &dkappas);
+
+    /* for (size_t i = 0; i < headings.size(); i++) {
+      std::cout << "pt " <<  setw(3) << i 
+                << " heading: " << setw(10) << headings[i]
+                << " acc_s: " << setw(7) << accumulated_s[i] 
+                << " kappa: " << setw(12) << kappas[i]
+                << " dkappas: " << setw(8) << dkappas[i] << std::endl;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << std::endl; */
+
+    // Construct the planning trajectory
+    for (size_t i = 0; i < headings.size(); i++) {
+      TrajectoryPoint trajectory_pt;
+      trajectory_pt.x = xy_points[i].first;
+      trajectory_pt.y = xy_points[i].second;
+      trajectory_pt.v = 2.0;
+      trajectory_pt.a = 0.0;
+      trajectory_pt.heading = headings[i];
+      trajectory_pt.kappa = kappas[i];
+
+      planning_published_trajectory.trajectory_points.push_back(trajectory_pt);
+    }
 
-  TrajectoryPoint goal_point = planning_published_trajectory.trajectory_points.back();
+    // 构建不可变的轨迹快照(含空间索引), 控制器共享引用, 不再逐周期拷贝;
+    // 轨迹点移入快照
+    planning_published_trajectory.snapshot =
+        shenlan::control::TrajectorySnapshot::Create(
+            std::move(planning_published_trajectory.trajectory_points));
+  }
+  const auto &index_stats =
+      planning_published_trajectory.snapshot->spatial_index()->stats();
+  std::cout << "spatial index: " << index_stats.num_points << " points, build "
+            << index_stats.build_time_ms << " ms, "
+            << index_stats.bytes_per_point << " bytes/point" << std::endl;
+
+  // 轨迹点已移入快照, 之后从快照读取
+  const std::vector<TrajectoryPoint> &trajectory_points =
+      planning_published_trajectory.snapshot->points();
+  TrajectoryPoint goal_point = trajectory_points.back();
   
   // Initialize ros node
   ros::init(argc, argv, "control_pub");
@@ -137,9 +175,9 @@ int main(int argc, char** argv) {
   reference_path.header.stamp = ros::Time::now();
   reference_path.header.frame_id = "map";
   
-  for (size_t i = 0; i < headings.size(); i++) {
+  for (size_t i = 0; i < trajectory_points.size(); i++) {
     geometry_msgs::PoseStamped refpath_pose;
-    TrajectoryPoint trajectory_pt = planning_published_trajectory.trajectory_points[i];
+    const TrajectoryPoint &trajectory_pt = trajectory_points[i];
     refpath_pose.pose.position.x = trajectory_pt.x;
     refpath_pose.pose.position.y = trajectory_pt.y;
     refpath_pose.pose.position.z = 0.0;
@@ -34,8 +34,16 @@ void StanleyController::ComputeControlCmd(
     const VehicleState &vehicle_state,
     const TrajectoryData &planning_published_trajectory, ControlCmd &cmd) {
     
-    // 把planning_published_trajectory copy进StanleyController里的trajectory_points_
-    trajectory_points_ = planning_published_trajectory.trajectory_points;
+    // 只持有planning_published_trajectory快照的引用, 版本号变化时才切换并重置匹配状态
+    const TrajectorySnapshotPtr &snapshot = planning_published_trajectory.snapshot;
+    if (snapshot == nullptr || snapshot->empty()) {
+        std::cout << "trajectory snapshot is empty" << std::endl;
+        return;
+    }
+    if (trajectory_ == nullptr || trajectory_->version() != snapshot->version()) {
+        trajectory_ = snapshot;
+        trajectory_matcher_.Reset();
+    }
 
     // 获取车辆状态x, y, heading, vx
     double vehicle_x = vehicle_state.x;
@@ -68,7 +76,7 @@ void StanleyController::ComputeControlCmd(
 void StanleyController::ComputeLateralErrors(const double vehicle_x, const double vehicle_y,
                                              const double vehicle_theta, double &e_y,
                                              double &e_theta) {
-    // 找到trajectory上离当前位置最近的点
+    // 找到当前位置在trajectory上的投影点
     TrajectoryPoint target_point = QueryNearestPointByPosition(vehicle_x, vehicle_y);
     
     double dx = target_point.x - vehicle_x;
@@ -90,21 +98,14 @@ void StanleyController::ComputeLateralErrors(const double vehicle_x, const doubl
 
 TrajectoryPoint StanleyController::QueryNearestPointByPosition(const double x,
                                                                const double y) {
-  double d_min = PointDistanceSquare(trajectory_points_.front(), x, y);
-  size_t index_min = 0;
-
-  for (size_t i = 1; i < trajectory_points_.size(); ++i) {
-    double d_temp = PointDistanceSquare(trajectory_points_[i], x, y);
-    if (d_temp < d_min) {
-      d_min = d_temp;
-      index_min = i;
-    }
-  }
-  // cout << " index_min: " << index_min << endl;
-  //cout << "tarjectory.heading: " << trajectory_points_[index_min].heading << endl;
-  theta_ref_ = trajectory_points_[index_min].heading;
-
-  return trajectory_points_[index_min];
+  // 轨迹上的投影点(垂足), heading等属性在线段上插值
+  const ProjectedPoint match_point = trajectory_matcher_.Project(
+      trajectory_->soa(), x, y, trajectory_->spatial_index().get());
+  // cout << " s: " << match_point.s << endl;
+  //cout << "tarjectory.heading: " << match_point.point.heading << endl;
+  theta_ref_ = match_point.point.heading;
+
+  return match_point.point;
 }
 
 }  // namespace control
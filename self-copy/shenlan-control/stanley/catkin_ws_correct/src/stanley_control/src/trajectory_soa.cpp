@@ -0,0 +1,107 @@
+#include "trajectory_soa.h"
+
+#include <cmath>
+
+#include "nearest_point_kernels.h"
+
+namespace shenlan {
+namespace control {
+
+TrajectorySoA::TrajectorySoA(const std::vector<TrajectoryPoint> &points,
+                             const bool local_float_xy) {
+  Assign(points, local_float_xy);
+}
+
+void TrajectorySoA::Assign(const std::vector<TrajectoryPoint> &points,
+                           const bool local_float_xy) {
+  Assign(points, nullptr, local_float_xy);
+}
+
+void TrajectorySoA::Assign(const std::vector<TrajectoryPoint> &points,
+                           const double *accumulated_s,
+                           const bool local_float_xy) {
+  const std::size_t n = points.size();
+  x_.resize(n);
+  y_.resize(n);
+  heading_.resize(n);
+  kappa_.resize(n);
+  v_.resize(n);
+  a_.resize(n);
+  s_.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const TrajectoryPoint &point = points[i];
+    x_[i] = point.x;
+    y_[i] = point.y;
+    heading_[i] = point.heading;
+    kappa_[i] = point.kappa;
+    v_[i] = point.v;
+    a_[i] = point.a;
+  }
+  if (accumulated_s != nullptr) {
+    s_.assign(accumulated_s, accumulated_s + n);
+  } else {
+    if (n > 0) {
+      s_[0] = 0.0;
+    }
+    for (std::size_t i = 1; i < n; ++i) {
+      const double dx = x_[i] - x_[i - 1];
+      const double dy = y_[i] - y_[i - 1];
+      s_[i] = s_[i - 1] + std::sqrt(dx * dx + dy * dy);
+    }
+  }
+
+  local_x_.clear();
+  local_y_.clear();
+  origin_x_ = n > 0 ? x_[0] : 0.0;
+  origin_y_ = n > 0 ? y_[0] : 0.0;
+  if (local_float_xy) {
+    local_x_.resize(n);
+    local_y_.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      local_x_[i] = static_cast<float>(x_[i] - origin_x_);
+      local_y_[i] = static_cast<float>(y_[i] - origin_y_);
+    }
+  }
+}
+
+TrajectoryPoint TrajectorySoA::point(const std::size_t i) const {
+  TrajectoryPoint point;
+  point.x = x_[i];
+  point.y = y_[i];
+  point.heading = heading_[i];
+  point.kappa = kappa_[i];
+  point.v = v_[i];
+  point.a = a_[i];
+  return point;
+}
+
+std::size_t TrajectorySoA::NearestIndex(const std::size_t begin,
+                                        const std::size_t end, const double x,
+                                        const double y, double *d2_min) const {
+  std::size_t index = begin;
+  if (has_local_float_xy()) {
+    index += ArgMinDistanceSquare(
+        local_x_.data() + begin, local_y_.data() + begin, end - begin,
+        static_cast<float>(x - origin_x_), static_cast<float>(y - origin_y_));
+    if (d2_min != nullptr) {
+      const double dx = x_[index] - x;
+      const double dy = y_[index] - y;
+      *d2_min = dx * dx + dy * dy;
+    }
+  } else {
+    index += ArgMinDistanceSquare(x_.data() + begin, y_.data() + begin,
+                                  end - begin, x, y, d2_min);
+  }
+  return index;
+}
+
+std::size_t TrajectorySoA::MemoryBytes() const {
+  return (x_.capacity() + y_.capacity() + heading_.capacity() +
+          kappa_.capacity() + v_.capacity() + a_.capacity() +
+          s_.capacity()) *
+             sizeof(double) +
+         (local_x_.capacity() + local_y_.capacity()) * sizeof(float);
+}
+
+}  // namespace control
+}  // namespace shenlan